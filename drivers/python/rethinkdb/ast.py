@@ -693,11 +693,11 @@ class Table(RqlQuery):
     def get_all(self, *keys, **kwargs):
         return GetAll(self, *keys, **kwargs)
 
-    def index_create(self, name, fundef=None):
+    def index_create(self, name, fundef=None, covering=()):
         if fundef:
-            return IndexCreate(self, name, func_wrap(fundef))
+            return IndexCreate(self, name, func_wrap(fundef), covering=covering)
         else:
-            return IndexCreate(self, name)
+            return IndexCreate(self, name, covering=covering)
 
     def index_drop(self, name):
         return IndexDrop(self, name)
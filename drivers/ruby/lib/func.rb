@@ -21,7 +21,7 @@ module RethinkDB
       :insert => 1,
       :delete => -1,
       :reduce => -1, :between => -1, :grouped_map_reduce => -1,
-      :table => -1, :table_create => -1,
+      :table => -1, :table_create => -1, :index_create => -1,
       :get_all => -1, :eq_join => -1,
       :javascript => -1, :filter => {:with_block => 0, :without => 1},
       :slice => -1,
@@ -82,8 +82,10 @@ public:
     }
 
     void destroy_account(void *account) {
+        // All this does is hop threads and delete the account.
         coro_t::spawn_sometime(std::bind(&linux_disk_manager_t::delayed_destroy, this,
-                                         account));
+                                         account),
+                               SMALL_CORO_STACK);
     }
 
     void submit_action_to_stack_stats(action_t *a) {
@@ -11,6 +11,7 @@
 #include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 #include "utils.hpp"
 #include <boost/bind.hpp>
@@ -272,7 +273,13 @@ linux_tcp_conn_t::write_handler_t::write_handler_t(linux_tcp_conn_t *_parent) :
 
 void linux_tcp_conn_t::write_handler_t::coro_pool_callback(write_queue_op_t *operation, UNUSED signal_t *interruptor) {
     if (operation->buffer != NULL) {
-        parent->perform_write(operation->buffer, operation->size);
+        if (operation->prefix != NULL) {
+            parent->perform_write(operation->prefix->buffer, operation->prefix->size,
+                                  operation->buffer, operation->size);
+            parent->release_write_buffer(operation->prefix);
+        } else {
+            parent->perform_write(NULL, 0, operation->buffer, operation->size);
+        }
         if (operation->dealloc != NULL) {
             parent->release_write_buffer(operation->dealloc);
             parent->write_queue_limiter.unlock(operation->size);
@@ -297,6 +304,7 @@ void linux_tcp_conn_t::internal_flush_write_buffer() {
     op->buffer = current_write_buffer->buffer;
     op->size = current_write_buffer->size;
     op->dealloc = current_write_buffer.release();
+    op->prefix = NULL;
     op->cond = NULL;
     op->keepalive = auto_drainer_t::lock_t(drainer.get());
     current_write_buffer.init(get_write_buffer());
@@ -310,7 +318,7 @@ void linux_tcp_conn_t::internal_flush_write_buffer() {
     write_queue.push(op);
 }
 
-void linux_tcp_conn_t::perform_write(const void *buf, size_t size) {
+void linux_tcp_conn_t::perform_write(const void *prefix, size_t prefix_size, const void *buf, size_t size) {
     assert_thread();
 
     if (write_closed.is_pulsed()) {
@@ -320,8 +328,16 @@ void linux_tcp_conn_t::perform_write(const void *buf, size_t size) {
         return;
     }
 
-    while (size > 0) {
-        ssize_t res = ::write(sock.get(), buf, size);
+    struct iovec iov[2];
+    iov[0].iov_base = const_cast<void *>(prefix);
+    iov[0].iov_len = prefix_size;
+    iov[1].iov_base = const_cast<void *>(buf);
+    iov[1].iov_len = size;
+    struct iovec *first = prefix_size > 0 ? &iov[0] : &iov[1];
+    size_t remaining = prefix_size + size;
+
+    while (remaining > 0) {
+        ssize_t res = ::writev(sock.get(), first, &iov[2] - first);
 
         if (res == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
             /* Wait for a notification from the event queue, or for an order to
@@ -359,10 +375,20 @@ void linux_tcp_conn_t::perform_write(const void *buf, size_t size) {
             break;
 
         } else {
-            rassert(res <= static_cast<ssize_t>(size));
-            buf = reinterpret_cast<const void *>(reinterpret_cast<const char *>(buf) + res);
-            size -= res;
+            rassert(res <= static_cast<ssize_t>(remaining));
+            remaining -= res;
             if (write_perfmon) write_perfmon->record(res);
+
+            /* Skip past whatever got written */
+            size_t written = res;
+            while (written > 0 && written >= first->iov_len) {
+                written -= first->iov_len;
+                ++first;
+            }
+            if (written > 0) {
+                first->iov_base = reinterpret_cast<char *>(first->iov_base) + written;
+                first->iov_len -= written;
+            }
         }
     }
 }
@@ -373,8 +399,15 @@ void linux_tcp_conn_t::write(const void *buf, size_t size, signal_t *closer) THR
     write_queue_op_t op;
     cond_t to_signal_when_done;
 
-    /* Flush out any data that's been buffered, so that things don't get out of order */
-    if (current_write_buffer->size > 0) internal_flush_write_buffer();
+    /* Any data that's been buffered has to go out first, so that things don't
+    get out of order.  Rather than flushing it separately, we send it along
+    with `buf` in the same `writev()`. */
+    if (current_write_buffer->size > 0) {
+        op.prefix = current_write_buffer.release();
+        current_write_buffer.init(get_write_buffer());
+    } else {
+        op.prefix = NULL;
+    }
 
     /* Don't bother acquiring the write semaphore because we're going to block
     until the write is done anyway */
@@ -442,6 +475,7 @@ void linux_tcp_conn_t::flush_buffer(signal_t *closer) THROWS_ONLY(tcp_conn_write
     cond_t to_signal_when_done;
     op.buffer = NULL;
     op.dealloc = NULL;
+    op.prefix = NULL;
     op.cond = &to_signal_when_done;
     write_queue.push(&op);
     to_signal_when_done.wait();
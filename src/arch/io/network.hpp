@@ -241,6 +241,9 @@ private:
 
     struct write_queue_op_t : public intrusive_list_node_t<write_queue_op_t> {
         write_buffer_t *dealloc;
+        // Buffered data that has to go out ahead of `buffer`.  It is sent in
+        // the same `writev()` and then released.
+        write_buffer_t *prefix;
         const void *buffer;
         size_t size;
         cond_t *cond;
@@ -298,8 +301,9 @@ private:
     scoped_ptr_t<write_buffer_t> current_write_buffer;
 
     /* Used to actually perform a write. If the write end of the connection is open, then writes
-    `size` bytes from `buffer` to the socket. */
-    void perform_write(const void *buffer, size_t size);
+    `prefix_size` bytes from `prefix` followed by `size` bytes from `buffer` to the socket,
+    with as few `writev()` calls as it takes. */
+    void perform_write(const void *prefix, size_t prefix_size, const void *buffer, size_t size);
 
     scoped_ptr_t<auto_drainer_t> drainer;
 };
@@ -4,6 +4,8 @@
 #include <sys/mman.h>
 #include <unistd.h>
 
+#include <vector>
+
 #ifndef NDEBUG
 #include <cxxabi.h>   // For __cxa_current_exception_type (see below)
 #endif
@@ -33,12 +35,17 @@ bool context_ref_t::is_nil() {
 
 artificial_stack_t::artificial_stack_t(void (*initial_fun)(void), size_t _stack_size)
     : stack_size(_stack_size) {
-    /* Allocate the stack */
-    stack = malloc_aligned(stack_size, getpagesize());
+    /* Allocate the stack. We map it directly rather than going through the
+    allocator so that pages are only committed when the coroutine first touches
+    them, and so that `release_unused_memory()` can hand them back. */
+    stack = mmap(NULL, stack_size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANON, -1, 0);
+    guarantee_err(stack != MAP_FAILED, "could not allocate coroutine stack");
 
     /* Protect the end of the stack so that we crash when we get a stack
     overflow instead of corrupting memory. */
-    mprotect(stack, getpagesize(), PROT_NONE);
+    int res = mprotect(stack, getpagesize(), PROT_NONE);
+    guarantee_err(res == 0, "could not protect coroutine stack guard page");
 
     /* Register our stack with Valgrind so that it understands what's going on
     and doesn't create spurious errors */
@@ -124,11 +131,51 @@ artificial_stack_t::~artificial_stack_t() {
 #endif
 #endif
 
-    /* Undo protections changes */
-    mprotect(stack, getpagesize(), PROT_READ | PROT_WRITE);
+    /* Release the stack we allocated, guard page included */
+    int res = munmap(stack, stack_size);
+    guarantee_err(res == 0, "could not unmap coroutine stack");
+}
+
+void artificial_stack_t::release_unused_memory() {
+    /* The context must be parked on this stack; everything below it is dead,
+    so the pages there can be dropped. */
+    rassert(!context.is_nil());
+    release_memory_below(context.pointer);
+}
+
+void artificial_stack_t::release_memory_below(void *addr) {
+    /* The kernel hands back zeroed pages if the stack grows into them again.
+    We keep one page of slack below `addr` for the frames of this function and
+    of `madvise()`, in case `addr` is a local variable of our caller. */
+    rassert(address_in_stack(addr));
+    uintptr_t low = uintptr_t(stack) + getpagesize();
+    uintptr_t high = floor_aligned(uintptr_t(addr) - getpagesize(), getpagesize());
+    if (high > low) {
+        int res = madvise(reinterpret_cast<void *>(low), high - low, MADV_DONTNEED);
+        guarantee_err(res == 0, "could not release coroutine stack memory");
+    }
+}
 
-    /* Release the stack we allocated */
-    free(stack);
+size_t artificial_stack_t::get_committed_size() {
+    /* Stack pages are only committed when they're first touched, and
+    `release_memory_below()` uncommits them again, so the lowest resident page
+    marks the deepest the stack has grown since then. */
+    size_t page_size = getpagesize();
+    size_t num_pages = stack_size / page_size;
+    std::vector<unsigned char> resident(num_pages);
+#ifdef __MACH__
+    int res = mincore(stack, stack_size, reinterpret_cast<char *>(resident.data()));
+#else
+    int res = mincore(stack, stack_size, resident.data());
+#endif
+    guarantee_err(res == 0, "could not examine coroutine stack");
+    /* Skip the guard page, which is never committed. */
+    for (size_t i = 1; i < num_pages; ++i) {
+        if (resident[i] & 1) {
+            return (num_pages - i) * page_size;
+        }
+    }
+    return 0;
 }
 
 bool artificial_stack_t::address_in_stack(void *addr) {
@@ -52,6 +52,21 @@ public:
     /* Returns `true` if the given address is in the stack's protection page. */
     bool address_is_stack_overflow(void *);
 
+    /* Returns the pages that lie below the stack's saved context to the
+    operating system. Only call this while the context is switched out. */
+    void release_unused_memory();
+
+    /* Returns the pages that lie more than a page below `addr`, which must be
+    on this stack, to the operating system. Whatever is stored there is lost.
+    It's safe to pass the address of a local variable of the caller. */
+    void release_memory_below(void *addr);
+
+    /* Returns how many bytes of the stack the OS has committed memory for,
+    measured from the base down to the deepest committed page. Since pages are
+    committed on first use, this is the stack's high-water mark since it was
+    created or last released. */
+    size_t get_committed_size();
+
     /* Returns the base of the stack */
     void* get_stack_base() { return static_cast<char*>(stack) + stack_size; }
 
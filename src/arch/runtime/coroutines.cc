@@ -4,6 +4,9 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <algorithm>
+#include <map>
+
 #ifndef NDEBUG
 #include <stack>   /* the data structure, not the run-time concept */
 #endif
@@ -20,10 +23,11 @@
 #include "perfmon/perfmon.hpp"
 #include "utils.hpp"
 
-static perfmon_counter_t pm_active_coroutines, pm_allocated_coroutines;
+static perfmon_counter_t pm_active_coroutines, pm_allocated_coroutines, pm_released_coroutine_stacks;
 static perfmon_multi_membership_t pm_coroutines_membership(&get_global_perfmon_collection(),
     &pm_active_coroutines, "active_coroutines",
     &pm_allocated_coroutines, "allocated_coroutines",
+    &pm_released_coroutine_stacks, "released_coroutine_stacks",
     NULLPTR);
 
 size_t coro_stack_size = COROUTINE_STACK_SIZE; //Default, setable by command-line parameter
@@ -44,8 +48,19 @@ struct coro_globals_t {
     /* The previous context. */
     coro_t *prev_coro;
 
-    /* A list of coro_t objects that are not in use. */
-    intrusive_list_t<coro_t> free_coros;
+    /* Lists of coro_t objects that are not in use, one per stack class. The
+    most recently used ones are at the tail, and are handed out first. */
+    intrusive_list_t<coro_t> free_coros[NUM_CORO_STACK_CLASSES];
+
+    /* Idle coro_t objects beyond `COROUTINE_FREE_LIST_HIGH_WATER` are moved
+    here after their stacks' memory is returned to the OS. They are only
+    handed out when the corresponding `free_coros` list is empty. */
+    intrusive_list_t<coro_t> released_coros[NUM_CORO_STACK_CLASSES];
+
+    /* The most stack, in bytes, that any sampled coroutine from each spawn
+    site has used (see `COROUTINE_STACK_PROFILE_INTERVAL`). Keyed by
+    `coro_t::spawn_site`, which is a string constant per spawn site. */
+    std::map<const char *, size_t> stack_high_water_marks;
 
 #ifndef NDEBUG
 
@@ -84,9 +99,16 @@ struct coro_globals_t {
         rassert(!current_coro);
 
         /* Destroy remaining coroutines */
-        while (coro_t *s = free_coros.head()) {
-            free_coros.remove(s);
-            delete s;
+        for (int i = 0; i < NUM_CORO_STACK_CLASSES; ++i) {
+            while (coro_t *s = free_coros[i].head()) {
+                free_coros[i].remove(s);
+                delete s;
+            }
+            while (coro_t *s = released_coros[i].head()) {
+                released_coros[i].remove(s);
+                --pm_released_coroutine_stacks;
+                delete s;
+            }
         }
     }
 
@@ -110,19 +132,40 @@ void coro_runtime_t::get_coroutine_counts(std::map<std::string, size_t> *dest) {
     dest->clear();
     dest->insert(cglobals->total_coroutine_counts.begin(), cglobals->total_coroutine_counts.end());
 }
+
 #endif
 
+void coro_runtime_t::get_stack_high_water_marks(std::map<std::string, size_t> *dest) {
+    dest->clear();
+    for (std::map<const char *, size_t>::iterator it = cglobals->stack_high_water_marks.begin();
+         it != cglobals->stack_high_water_marks.end(); ++it) {
+        size_t *mark = &(*dest)[it->first];
+        *mark = std::max(*mark, it->second);
+    }
+}
+
 /* coro_t */
 
 #ifndef NDEBUG
 static __thread int64_t coro_selfname_counter = 0;
 #endif
 
-coro_t::coro_t() :
-    stack(&coro_t::run, coro_stack_size),
+static size_t stack_size_for_class(coro_stack_class_t stack_class) {
+    switch (stack_class) {
+    case DEFAULT_CORO_STACK: return coro_stack_size;
+    case SMALL_CORO_STACK: return COROUTINE_SMALL_STACK_SIZE;
+    default: unreachable();
+    }
+}
+
+coro_t::coro_t(coro_stack_class_t _stack_class) :
+    stack_class(_stack_class),
+    stack(&coro_t::run, stack_size_for_class(_stack_class)),
     current_thread_(linux_thread_pool_t::thread_id),
     notified_(false),
-    waiting_(false)
+    waiting_(false),
+    spawn_site(NULL),
+    profile_stack(false)
 #ifndef NDEBUG
     , selfname_number(get_thread_id() + MAX_THREADS * ++coro_selfname_counter)
 #endif
@@ -138,7 +181,21 @@ coro_t::coro_t() :
 }
 
 void coro_t::return_coro_to_free_list(coro_t *coro) {
-    cglobals->free_coros.push_back(coro);
+    intrusive_list_t<coro_t> *free_coros = &cglobals->free_coros[coro->stack_class];
+    free_coros->push_back(coro);
+
+    /* After a burst of coroutines, most of them sit idle with stacks the OS
+    has committed memory for. Keep the most recently used ones warm and give
+    the memory of the rest back. The head of the list is never `coro` itself,
+    so its context has already been switched out. */
+    if (free_coros->size() > COROUTINE_FREE_LIST_HIGH_WATER) {
+        coro_t *cold = free_coros->head();
+        rassert(cold != coro);
+        free_coros->remove(cold);
+        cold->stack.release_unused_memory();
+        cglobals->released_coros[coro->stack_class].push_back(cold);
+        ++pm_released_coroutine_stacks;
+    }
 }
 
 coro_t::~coro_t() {
@@ -154,10 +211,8 @@ coro_t::~coro_t() {
 void coro_t::run() {
     coro_t *coro = cglobals->current_coro;
 
-#ifndef NDEBUG
     char dummy;  /* Make sure we're on the right stack. */
     rassert(coro->stack.address_in_stack(&dummy));
-#endif
 
     while (true) {
         rassert(coro == cglobals->current_coro);
@@ -172,6 +227,15 @@ void coro_t::run() {
         cglobals->total_coroutine_counts[coro->coroutine_type.c_str()]++;
         cglobals->active_coroutines.insert(coro);
 #endif
+
+        /* For a coroutine whose stack gets measured (see `get_and_init_coro`),
+        the pages below this frame are dropped first, so whatever is committed
+        afterwards was touched by this coroutine. */
+        const bool profile_stack = coro->profile_stack;
+        if (profile_stack) {
+            coro->stack.release_memory_below(&dummy);
+        }
+
         coro->action_wrapper.run();
 #ifndef NDEBUG
         // Pet the watchdog to reset it before execution moves
@@ -180,6 +244,11 @@ void coro_t::run() {
         cglobals->active_coroutines.erase(coro);
 #endif
 
+        if (profile_stack) {
+            size_t *high_water_mark = &cglobals->stack_high_water_marks[coro->spawn_site];
+            *high_water_mark = std::max(*high_water_mark, coro->stack.get_committed_size());
+        }
+
         rassert(coro->current_thread_ == get_thread_id());
 
         // Destroy the Callable object which was either allocated within the coro_t or on the heap
@@ -348,15 +417,21 @@ bool coroutines_have_been_initialized() {
     return cglobals != NULL;
 }
 
-coro_t * coro_t::get_coro() {
+coro_t * coro_t::get_coro(coro_stack_class_t stack_class) {
     rassert(coroutines_have_been_initialized());
     coro_t *coro;
 
-    if (cglobals->free_coros.size() == 0) {
-        coro = new coro_t();
+    intrusive_list_t<coro_t> *free_coros = &cglobals->free_coros[stack_class];
+    intrusive_list_t<coro_t> *released_coros = &cglobals->released_coros[stack_class];
+    if (free_coros->size() != 0) {
+        coro = free_coros->tail();
+        free_coros->remove(coro);
+    } else if (released_coros->size() != 0) {
+        coro = released_coros->tail();
+        released_coros->remove(coro);
+        --pm_released_coroutine_stacks;
     } else {
-        coro = cglobals->free_coros.tail();
-        cglobals->free_coros.remove(coro);
+        coro = new coro_t(stack_class);
     }
 
     rassert(!coro->intrusive_list_node_t<coro_t>::in_a_list());
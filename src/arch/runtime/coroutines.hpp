@@ -9,6 +9,7 @@
 #include "arch/runtime/callable_action.hpp"
 #include "arch/runtime/context_switching.hpp"
 #include "arch/runtime/runtime_utils.hpp"
+#include "config/args.hpp"
 #include "utils.hpp"
 
 const size_t MAX_COROUTINE_STACK_SIZE = 8*1024*1024;
@@ -16,6 +17,19 @@ const size_t MAX_COROUTINE_STACK_SIZE = 8*1024*1024;
 int get_thread_id();
 struct coro_globals_t;
 
+/* Coroutines normally get a stack of the configured coroutine stack size
+(`COROUTINE_STACK_SIZE` unless overridden on the command line). Spawn sites
+that are known to run shallow code can ask for a `SMALL_CORO_STACK`, which is
+`COROUTINE_SMALL_STACK_SIZE` bytes, so that many more of them fit in memory.
+The stack profiler (see `coro_runtime_t::get_stack_high_water_marks()`) records
+how deep each spawn site's stacks get; check it before moving a spawn site to
+small stacks. */
+enum coro_stack_class_t {
+    DEFAULT_CORO_STACK = 0,
+    SMALL_CORO_STACK = 1
+};
+const int NUM_CORO_STACK_CLASSES = 2;
+
 /* A coro_t represents a fiber of execution within a thread. Create one with spawn_*(). Within a
 coroutine, call wait() to return control to the scheduler; the coroutine will be resumed when
 another fiber calls notify_*() on it.
@@ -28,21 +42,24 @@ public:
     friend bool is_coroutine_stack_overflow(void *);
 
     template<class Callable>
-    static void spawn_now_dangerously(const Callable &action) {
-        get_and_init_coro(action)->notify_now_deprecated();
+    static void spawn_now_dangerously(const Callable &action,
+                                      coro_stack_class_t stack_class = DEFAULT_CORO_STACK) {
+        get_and_init_coro(action, stack_class)->notify_now_deprecated();
     }
 
     template<class Callable>
-    static void spawn_sometime(const Callable &action) {
-        get_and_init_coro(action)->notify_sometime();
+    static void spawn_sometime(const Callable &action,
+                               coro_stack_class_t stack_class = DEFAULT_CORO_STACK) {
+        get_and_init_coro(action, stack_class)->notify_sometime();
     }
 
     // TODO: spawn_later_ordered is usually what naive people want,
     // but it's such a long and onerous name.  It should have the
     // shortest name.
     template<class Callable>
-    static void spawn_later_ordered(const Callable &action) {
-        get_and_init_coro(action)->notify_later_ordered();
+    static void spawn_later_ordered(const Callable &action,
+                                    coro_stack_class_t stack_class = DEFAULT_CORO_STACK) {
+        get_and_init_coro(action, stack_class)->notify_later_ordered();
     }
 
     // Use coro_t::spawn_*(boost::bind(...)) for spawning with parameters.
@@ -118,20 +135,27 @@ private:
 
     // Contructor sets up the stack, get_and_init_coro will load a function to be run
     //  at which point the coroutine can be notified
-    coro_t();
+    explicit coro_t(coro_stack_class_t stack_class);
 
     // If this function footprint ever changes, you may need to update the parse_coroutine_info function
     template<class Callable>
-    static coro_t * get_and_init_coro(const Callable &action) {
-        coro_t *coro = get_coro();
+    static coro_t * get_and_init_coro(const Callable &action, coro_stack_class_t stack_class) {
+        coro_t *coro = get_coro(stack_class);
 #ifndef NDEBUG
         coro->parse_coroutine_type(__PRETTY_FUNCTION__);
 #endif
+        /* Every `COROUTINE_STACK_PROFILE_INTERVAL`th coroutine spawned with
+        this type on this thread, starting with the first, gets its stack
+        measured. The counter is per instantiation, so deciding costs no
+        lookup. */
+        static __thread size_t spawn_count = 0;
+        coro->spawn_site = __PRETTY_FUNCTION__;
+        coro->profile_stack = spawn_count++ % COROUTINE_STACK_PROFILE_INTERVAL == 0;
         coro->action_wrapper.reset(action);
         return coro;
     }
 
-    static coro_t * get_coro();
+    static coro_t * get_coro(coro_stack_class_t stack_class);
 
     static void return_coro_to_free_list(coro_t *coro);
 
@@ -142,6 +166,7 @@ private:
 
     virtual void on_thread_switch();
 
+    const coro_stack_class_t stack_class;
     artificial_stack_t stack;
 
     int current_thread_;
@@ -152,6 +177,12 @@ private:
 
     callable_action_wrapper_t action_wrapper;
 
+    /* The `__PRETTY_FUNCTION__` of the `get_and_init_coro()` that spawned the
+    current action, which names its type, and whether to measure how much stack
+    the action uses. */
+    const char *spawn_site;
+    bool profile_stack;
+
 #ifndef NDEBUG
     int64_t selfname_number;
     std::string coroutine_type;
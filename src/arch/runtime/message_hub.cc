@@ -15,7 +15,8 @@
 #endif
 
 linux_message_hub_t::linux_message_hub_t(linux_event_queue_t *queue, linux_thread_pool_t *thread_pool, int current_thread)
-    : queue_(queue), thread_pool_(thread_pool), current_thread_(current_thread) {
+    : queue_(queue), thread_pool_(thread_pool), incoming_head_(NULL),
+      current_thread_(current_thread) {
 
     // We have to do this through dynamically, otherwise we might
     // allocate far too many file descriptors since this is what the
@@ -37,7 +38,7 @@ linux_message_hub_t::~linux_message_hub_t() {
         guarantee(queues_[i].msg_local_list.empty());
     }
 
-    guarantee(incoming_messages_.empty());
+    guarantee(incoming_head_ == NULL);
 
     delete[] notify_;
 }
@@ -81,14 +82,44 @@ void linux_message_hub_t::store_message_sometime(unsigned int nthread, linux_thr
 }
 
 
-void linux_message_hub_t::insert_external_message(linux_thread_message_t *msg) {
-    {
-        spinlock_acq_t acq(&incoming_messages_lock_);
-        incoming_messages_.push_back(msg);
+linux_thread_message_t *linux_message_hub_t::draining_marker() {
+    /* Never dereferenced; it only has to differ from every real message. */
+    static char marker;
+    return reinterpret_cast<linux_thread_message_t *>(&marker);
+}
+
+bool linux_message_hub_t::push_incoming(linux_message_hub_t *hub, msg_list_t *msgs) {
+    rassert(!msgs->empty());
+
+    /* Link the batch newest first, so that it comes out of the stack in the
+    order it was stored in. */
+    linux_thread_message_t *oldest = msgs->head();
+    linux_thread_message_t *newest = NULL;
+    while (linux_thread_message_t *m = msgs->head()) {
+        msgs->remove(m);
+        m->incoming_next_ = newest;
+        newest = m;
     }
 
+    linux_thread_message_t *old_head;
+    do {
+        old_head = hub->incoming_head_;
+        oldest->incoming_next_ = old_head;
+    } while (!__sync_bool_compare_and_swap(&hub->incoming_head_, old_head, newest));
+
+    /* If the stack wasn't empty, either an earlier sender already woke the
+    receiver or the receiver is delivering messages and will find ours. */
+    return old_head == NULL;
+}
+
+void linux_message_hub_t::insert_external_message(linux_thread_message_t *msg) {
+    msg_list_t msgs;
+    msgs.push_back(msg);
+
     // Wakey wakey eggs and bakey
-    notify_[current_thread_].event.wakey_wakey();
+    if (push_incoming(this, &msgs)) {
+        notify_[current_thread_].event.wakey_wakey();
+    }
 }
 
 void linux_message_hub_t::notify_t::on_event(int events) {
@@ -101,33 +132,54 @@ void linux_message_hub_t::notify_t::on_event(int events) {
     // don't pester us and use 100% cpu
     event.consume_wakey_wakeys();
 
-    msg_list_t msg_list;
-
-    // Pull the messages
-    {
-        spinlock_acq_t acq(&parent->incoming_messages_lock_);
-        msg_list.append_and_clear(&parent->incoming_messages_);
-    }
-
 #ifndef NDEBUG
     start_watchdog(); // Initialize watchdog before handling messages
 #endif
 
-    while (linux_thread_message_t *m = msg_list.head()) {
-        msg_list.remove(m);
-#ifndef NDEBUG
-        if (m->reloop_count_ > 0) {
-            --m->reloop_count_;
-            parent->do_store_message(parent->current_thread_, m);
-            continue;
+    for (int pass = 0; ; ++pass) {
+        // Pull the messages, leaving the marker behind so that senders know
+        // we're awake
+        linux_thread_message_t *chain
+            = __sync_lock_test_and_set(&parent->incoming_head_, draining_marker());
+
+        msg_list_t msg_list;
+        while (chain != NULL && chain != draining_marker()) {
+            linux_thread_message_t *next = chain->incoming_next_;
+            chain->incoming_next_ = NULL;
+            msg_list.push_front(chain);
+            chain = next;
         }
+
+        while (linux_thread_message_t *m = msg_list.head()) {
+            msg_list.remove(m);
+#ifndef NDEBUG
+            if (m->reloop_count_ > 0) {
+                --m->reloop_count_;
+                parent->do_store_message(parent->current_thread_, m);
+                continue;
+            }
 #endif
 
-        m->on_thread_switch();
+            m->on_thread_switch();
 
 #ifndef NDEBUG
-        pet_watchdog(); // Verify that each message completes in the acceptable time range
+            pet_watchdog(); // Verify that each message completes in the acceptable time range
 #endif
+        }
+
+        if (__sync_bool_compare_and_swap(&parent->incoming_head_, draining_marker(), NULL)) {
+            // Nothing arrived while we were busy; the next sender wakes us.
+            break;
+        }
+
+        // More messages arrived while we were delivering these, and their
+        // senders didn't wake us. Deliver them right away, but only a few times
+        // in a row so that the rest of the event loop gets a turn; after that,
+        // wake ourselves up to come back for them.
+        if (pass + 1 >= MESSAGE_HUB_MAX_DRAIN_PASSES) {
+            event.wakey_wakey();
+            break;
+        }
     }
 }
 
@@ -140,20 +192,11 @@ void linux_message_hub_t::push_messages() {
         thread_queue_t *queue = &queues_[i];
         if (!queue->msg_local_list.empty()) {
             // Transfer messages to the other core
-
-            bool do_wake_up;
-            {
-                spinlock_acq_t acq(&thread_pool_->threads[i]->message_hub.incoming_messages_lock_);
-
-                //We only need to do a wake up if the global
-                do_wake_up = thread_pool_->threads[i]->message_hub.incoming_messages_.empty();
-
-                thread_pool_->threads[i]->message_hub.incoming_messages_.append_and_clear(&queue->msg_local_list);
-            }
+            linux_message_hub_t *hub = &thread_pool_->threads[i]->message_hub;
 
             // Wakey wakey, perhaps eggs and bakey
-            if (do_wake_up) {
-                thread_pool_->threads[i]->message_hub.notify_[current_thread_].event.wakey_wakey();
+            if (push_incoming(hub, &queue->msg_local_list)) {
+                hub->notify_[current_thread_].event.wakey_wakey();
             }
         }
     }
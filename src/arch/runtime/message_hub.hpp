@@ -8,7 +8,6 @@
 #include "arch/runtime/event_queue.hpp"
 #include "arch/runtime/runtime_utils.hpp"
 #include "arch/runtime/system_event.hpp"
-#include "arch/spinlock.hpp"
 #include "config/args.hpp"
 #include "containers/intrusive_list.hpp"
 #include "utils.hpp"
@@ -71,8 +70,19 @@ private:
         msg_list_t msg_local_list;
     } queues_[MAX_THREADS];
 
-    msg_list_t incoming_messages_;
-    spinlock_t incoming_messages_lock_;
+    /* Messages from other threads for this thread. This is a lock-free stack
+    linked through `linux_thread_message_t::incoming_next_`, newest first:
+    senders push whole batches onto it with a compare-and-swap and we take
+    everything at once with an atomic exchange. While we are delivering
+    messages it holds `draining_marker()` (or a chain that ends in it), which
+    tells senders that we'll see their messages without being woken up. */
+    linux_thread_message_t *incoming_head_;
+
+    static linux_thread_message_t *draining_marker();
+
+    /* Pushes all of `msgs` onto `hub`'s incoming stack. Returns true if the
+    receiving thread must be woken up. */
+    static bool push_incoming(linux_message_hub_t *hub, msg_list_t *msgs);
 
     /* We keep one notify_t for each other message hub that we interact with. When it has
     messages for us, it signals the appropriate notify_t from our set of notify_ts. We get
@@ -7,6 +7,8 @@
 #include <unistd.h>
 #include <sys/time.h>
 
+#include <algorithm>
+
 #include "arch/barrier.hpp"
 #include "arch/io/timer_provider.hpp"
 #include "arch/runtime/event_queue.hpp"
@@ -242,18 +244,19 @@ void linux_thread_pool_t::run_thread_pool(linux_thread_message_t *initial_messag
     }
     linux_thread_pool_t::thread_pool = NULL;
 
-#ifndef NDEBUG
     // Save each thread's coroutine counters before shutting down
+#ifndef NDEBUG
     std::vector<std::map<std::string, size_t> > coroutine_counts(n_threads);
 #endif
+    std::vector<std::map<std::string, size_t> > stack_high_water_marks(n_threads);
 
     // Shut down child threads
     for (int i = 0; i < n_threads; i++) {
         // Cause child thread to break out of its loop
 #ifndef NDEBUG
-        threads[i]->initiate_shut_down(&coroutine_counts[i]);
+        threads[i]->initiate_shut_down(&coroutine_counts[i], &stack_high_water_marks[i]);
 #else
-        threads[i]->initiate_shut_down();
+        threads[i]->initiate_shut_down(&stack_high_water_marks[i]);
 #endif
     }
 
@@ -286,6 +289,23 @@ void linux_thread_pool_t::run_thread_pool(linux_thread_message_t *initial_messag
         }
     }
 #endif  // NDEBUG
+
+    {
+        // Combine stack high-water marks from each thread, and log the maxima
+        std::map<std::string, size_t> max_stack_high_water_marks;
+        for (int i = 0; i < n_threads; ++i) {
+            for (std::map<std::string, size_t>::iterator j = stack_high_water_marks[i].begin();
+                 j != stack_high_water_marks[i].end(); ++j) {
+                size_t *mark = &max_stack_high_water_marks[j->first];
+                *mark = std::max(*mark, j->second);
+            }
+        }
+
+        for (std::map<std::string, size_t>::iterator i = max_stack_high_water_marks.begin();
+             i != max_stack_high_water_marks.end(); ++i) {
+            logINF("sampled coroutines with type %s used at most %zu bytes of stack", i->first.c_str(), i->second);
+        }
+    }
 }
 
 // Note: Maybe we should use a signalfd instead of a signal handler, and then
@@ -359,6 +379,7 @@ linux_thread_t::linux_thread_t(linux_thread_pool_t *parent_pool, int thread_id)
 #ifndef NDEBUG
       , coroutine_counts_at_shutdown(NULL)
 #endif
+      , stack_high_water_marks_at_shutdown(NULL)
 {
     // Initialize the mutex which synchronizes access to the do_shutdown variable
     int res = pthread_mutex_init(&do_shutdown_mutex, NULL);
@@ -376,6 +397,8 @@ linux_thread_t::~linux_thread_t() {
     coroutine_counts_at_shutdown->clear();
     coro_runtime.get_coroutine_counts(coroutine_counts_at_shutdown);
 #endif
+    rassert(stack_high_water_marks_at_shutdown != NULL);
+    coro_runtime.get_stack_high_water_marks(stack_high_water_marks_at_shutdown);
 
     int res = pthread_mutex_destroy(&do_shutdown_mutex);
     guarantee_xerr(res == 0, res, "could not destroy do_shutdown_mutex");
@@ -404,15 +427,17 @@ bool linux_thread_t::should_shut_down() {
 }
 
 #ifndef NDEBUG
-void linux_thread_t::initiate_shut_down(std::map<std::string, size_t> *coroutine_counts) {
+void linux_thread_t::initiate_shut_down(std::map<std::string, size_t> *coroutine_counts,
+                                        std::map<std::string, size_t> *stack_high_water_marks) {
 #else
-void linux_thread_t::initiate_shut_down() {
+void linux_thread_t::initiate_shut_down(std::map<std::string, size_t> *stack_high_water_marks) {
 #endif
     int res = pthread_mutex_lock(&do_shutdown_mutex);
     guarantee_xerr(res == 0, res, "could not lock do_shutdown_mutex");
 #ifndef NDEBUG
     coroutine_counts_at_shutdown = coroutine_counts;
 #endif
+    stack_high_water_marks_at_shutdown = stack_high_water_marks;
     do_shutdown = true;
     shutdown_notify_event.wakey_wakey();
     res = pthread_mutex_unlock(&do_shutdown_mutex);
@@ -14,6 +14,7 @@
 #include "arch/runtime/coroutines.hpp"
 #include "arch/io/blocker_pool.hpp"
 #include "arch/io/timer_provider.hpp"
+#include "arch/spinlock.hpp"
 #include "arch/timer.hpp"
 
 class linux_thread_t;
@@ -29,6 +30,9 @@ struct coro_runtime_t {
 #ifndef NDEBUG
     void get_coroutine_counts(std::map<std::string, size_t> *dest);
 #endif
+    // The most stack that sampled coroutines from each spawn site have used on
+    // this thread, keyed by the spawn site's coroutine type.
+    void get_stack_high_water_marks(std::map<std::string, size_t> *dest);
 };
 
 
@@ -159,9 +163,10 @@ public:
     void pump();   // Called by the event queue
     bool should_shut_down();   // Called by the event queue
 #ifndef NDEBUG
-    void initiate_shut_down(std::map<std::string, size_t> *coroutine_counts); // Can be called from any thread
+    void initiate_shut_down(std::map<std::string, size_t> *coroutine_counts,
+                            std::map<std::string, size_t> *stack_high_water_marks); // Can be called from any thread
 #else
-    void initiate_shut_down(); // Can be called from any thread
+    void initiate_shut_down(std::map<std::string, size_t> *stack_high_water_marks); // Can be called from any thread
 #endif
     void on_event(int events);
 
@@ -173,6 +178,7 @@ private:
 #ifndef NDEBUG
     std::map<std::string, size_t> *coroutine_counts_at_shutdown;
 #endif
+    std::map<std::string, size_t> *stack_high_water_marks_at_shutdown;
 };
 
 #endif /* ARCH_RUNTIME_THREAD_POOL_HPP_ */
@@ -3,13 +3,13 @@
 #include "arch/runtime/thread_pool.hpp"
 #include "utils.hpp"
 
-class timer_token_t : public intrusive_priority_queue_node_t<timer_token_t> {
+class timer_token_t : public intrusive_list_node_t<timer_token_t> {
     friend class timer_handler_t;
 
 private:
-    timer_token_t() : interval_nanos(-1), next_time_in_nanos(-1), callback(NULL) { }
-
-    friend bool left_is_higher_priority(const timer_token_t *left, const timer_token_t *right);
+    timer_token_t()
+        : interval_nanos(-1), next_time_in_nanos(-1), callback(NULL),
+          bucket(NULL), level(-1), slot(-1) { }
 
     // The time between rings, if a repeating timer, otherwise zero.
     int64_t interval_nanos;
@@ -20,80 +20,264 @@ private:
     // The callback we call upon each 'ring'.
     timer_callback_t *callback;
 
+    // The list the token is in: a wheel slot, a list of tokens about to be fired, or NULL.
+    intrusive_list_t<timer_token_t> *bucket;
+
+    // The wheel slot the token is in, or -1 if it is not in one.
+    int level;
+    int slot;
+
     DISABLE_COPYING(timer_token_t);
 };
 
-bool left_is_higher_priority(const timer_token_t *left, const timer_token_t *right) {
-    return left->next_time_in_nanos < right->next_time_in_nanos;
-}
-
 timer_handler_t::timer_handler_t(linux_event_queue_t *queue)
     : timer_provider(queue),
-      expected_oneshot_time_in_nanos(0) {
+      expected_oneshot_time_in_nanos(0),
+      oneshot_scheduled(false),
+      current_tick(get_ticks() / MILLION),
+      num_tokens(0),
+      firing_token(NULL),
+      firing_token_canceled(false) {
+    for (int level = 0; level < wheel_levels; ++level) {
+        occupied[level] = 0;
+    }
     // Right now, we have no tokens.  So we don't ask the timer provider to do anything for us.
 }
 
 timer_handler_t::~timer_handler_t() {
-    guarantee(token_queue.empty());
+    guarantee(num_tokens == 0);
 }
 
-void timer_handler_t::on_oneshot() {
-    // If the timer_provider tends to return its callback a touch early, we don't want to make a
-    // bunch of calls to it, returning a tad early over and over again, leading up to a ticks
-    // threshold.  So we bump the real time up to the threshold when processing the priority queue.
-    int64_t real_ticks = get_ticks();
-    int64_t ticks = std::max(real_ticks, expected_oneshot_time_in_nanos);
+int64_t timer_handler_t::insert_token(timer_token_t *token) {
+    // A token never goes into a slot the wheel has already passed.
+    const int64_t tick = std::max<int64_t>(token->next_time_in_nanos / MILLION, current_tick + 1);
+    const int64_t delta = tick - current_tick;
+
+    int level = 0;
+    while (level < wheel_levels - 1 && delta >= (int64_t(1) << (wheel_bits * (level + 1)))) {
+        ++level;
+    }
+
+    // Tokens too far out for the wheel wait in the last slot of the top level, and are placed
+    // again when that slot is cascaded.
+    const int64_t wheel_span = int64_t(1) << (wheel_bits * wheel_levels);
+    const int64_t placed_tick = delta < wheel_span ? tick : current_tick + wheel_span - 1;
+
+    const int shift = wheel_bits * level;
+    const int slot = (placed_tick >> shift) & (wheel_slots - 1);
+
+    token->bucket = &slots[level][slot];
+    token->level = level;
+    token->slot = slot;
+    slots[level][slot].push_back(token);
+    occupied[level] |= uint64_t(1) << slot;
+    ++num_tokens;
+
+    if (level == 0) {
+        return std::max<int64_t>(token->next_time_in_nanos, placed_tick * MILLION);
+    } else {
+        return ((placed_tick >> shift) << shift) * MILLION;
+    }
+}
+
+void timer_handler_t::remove_token(timer_token_t *token) {
+    rassert(token->bucket != NULL);
+    token->bucket->remove(token);
+    if (token->level != -1) {
+        if (token->bucket->empty()) {
+            occupied[token->level] &= ~(uint64_t(1) << token->slot);
+        }
+        --num_tokens;
+    }
+    token->bucket = NULL;
+    token->level = -1;
+    token->slot = -1;
+}
+
+int64_t timer_handler_t::next_slot_tick(int level) const {
+    const uint64_t bits = occupied[level];
+    if (bits == 0) {
+        return -1;
+    }
+
+    // Slots are visited in order starting right after the current one, so rotate the bitmap to
+    // put that slot at bit zero.
+    const int shift = wheel_bits * level;
+    const int64_t base = current_tick >> shift;
+    const int rotation = ((base & (wheel_slots - 1)) + 1) & (wheel_slots - 1);
+    const uint64_t rotated = (bits >> rotation) | (bits << ((wheel_slots - rotation) & (wheel_slots - 1)));
+    const int64_t steps = __builtin_ctzll(rotated) + 1;
+    return (base + steps) << shift;
+}
+
+void timer_handler_t::advance_to(const int64_t now_tick, const int64_t real_ticks) {
+    while (num_tokens != 0) {
+        int64_t level_ticks[wheel_levels];
+        int64_t tick = -1;
+        for (int level = 0; level < wheel_levels; ++level) {
+            level_ticks[level] = next_slot_tick(level);
+            if (level_ticks[level] != -1 && (tick == -1 || level_ticks[level] < tick)) {
+                tick = level_ticks[level];
+            }
+        }
+        if (tick > now_tick) {
+            break;
+        }
+
+        current_tick = tick;
+
+        intrusive_list_t<timer_token_t> expiring;
+        if (level_ticks[0] == tick) {
+            intrusive_list_t<timer_token_t> *slot = &slots[0][tick & (wheel_slots - 1)];
+            while (timer_token_t *token = slot->head()) {
+                remove_token(token);
+                token->bucket = &expiring;
+                expiring.push_back(token);
+            }
+        }
 
-    while (!token_queue.empty() && token_queue.peek()->next_time_in_nanos <= ticks) {
-        timer_token_t *token = token_queue.pop();
+        // Cascade the higher levels' slots that are due.  Each token is placed again relative to
+        // the new position, which puts it in a lower level (or fires it now, if it is due).
+        for (int level = wheel_levels - 1; level > 0; --level) {
+            if (level_ticks[level] != tick) {
+                continue;
+            }
+            const int shift = wheel_bits * level;
+            intrusive_list_t<timer_token_t> *slot = &slots[level][(tick >> shift) & (wheel_slots - 1)];
+            while (timer_token_t *token = slot->head()) {
+                remove_token(token);
+                if (token->next_time_in_nanos / MILLION <= tick) {
+                    token->bucket = &expiring;
+                    expiring.push_back(token);
+                } else {
+                    insert_token(token);
+                }
+            }
+        }
+
+        fire_tokens(&expiring, real_ticks);
+    }
+
+    current_tick = std::max(current_tick, now_tick);
+}
 
-        // Put the repeating timer back on the queue before the callback can be called (so that it
+void timer_handler_t::fire_tokens(intrusive_list_t<timer_token_t> *expiring, const int64_t real_ticks) {
+    while (timer_token_t *token = expiring->head()) {
+        remove_token(token);
+
+        // Put the repeating timer back on the wheel before the callback can be called (so that it
         // may be canceled).
         if (token->interval_nanos != 0) {
             token->next_time_in_nanos = real_ticks + token->interval_nanos;
-            token_queue.push(token);
+            insert_token(token);
         }
 
+        firing_token = token;
+        firing_token_canceled = false;
         token->callback->on_timer();
+        firing_token = NULL;
 
-        // Delete nonrepeating timer tokens.
-        if (token->interval_nanos == 0) {
+        // Delete nonrepeating timer tokens, and tokens canceled by their own callback.
+        if (token->interval_nanos == 0 || firing_token_canceled) {
             delete token;
         }
     }
+}
 
-    // We've processed young tokens.  Now schedule a new one-shot (if necessary).
-    if (!token_queue.empty()) {
-        timer_provider.schedule_oneshot(token_queue.peek()->next_time_in_nanos, this);
+void timer_handler_t::reschedule_oneshot() {
+    if (num_tokens == 0) {
+        if (oneshot_scheduled) {
+            timer_provider.unschedule_oneshot();
+            oneshot_scheduled = false;
+        }
+        return;
+    }
+
+    int64_t tick = -1;
+    for (int level = 0; level < wheel_levels; ++level) {
+        const int64_t level_tick = next_slot_tick(level);
+        if (level_tick != -1 && (tick == -1 || level_tick < tick)) {
+            tick = level_tick;
+        }
+    }
+
+    int64_t time_in_nanos = tick * MILLION;
+    if (next_slot_tick(0) == tick) {
+        // We're going to fire this slot, so wake up for its earliest token rather than at the
+        // start of the millisecond.
+        int64_t earliest = INT64_MAX;
+        intrusive_list_t<timer_token_t> *slot = &slots[0][tick & (wheel_slots - 1)];
+        for (timer_token_t *token = slot->head(); token != NULL; token = slot->next(token)) {
+            earliest = std::min(earliest, token->next_time_in_nanos);
+        }
+        time_in_nanos = std::max(time_in_nanos, earliest);
+    }
+
+    if (!oneshot_scheduled || time_in_nanos != expected_oneshot_time_in_nanos) {
+        timer_provider.schedule_oneshot(time_in_nanos, this);
+        expected_oneshot_time_in_nanos = time_in_nanos;
+        oneshot_scheduled = true;
     }
 }
 
+void timer_handler_t::on_oneshot() {
+    oneshot_scheduled = false;
+
+    // If the timer_provider tends to return its callback a touch early, we don't want to make a
+    // bunch of calls to it, returning a tad early over and over again, leading up to a ticks
+    // threshold.  So we bump the real time up to the threshold when advancing the wheel.
+    int64_t real_ticks = get_ticks();
+    int64_t ticks = std::max(real_ticks, expected_oneshot_time_in_nanos);
+
+    advance_to(ticks / MILLION, real_ticks);
+
+    // We've processed young tokens.  Now schedule a new one-shot (if necessary).
+    reschedule_oneshot();
+}
+
 timer_token_t *timer_handler_t::add_timer_internal(const int64_t ms, timer_callback_t *callback, const bool once) {
     const int64_t nanos = ms * MILLION;
     rassert(nanos > 0);
 
-    const int64_t next_time_in_nanos = get_ticks() + nanos;
+    const int64_t ticks = get_ticks();
+
+    // An empty wheel can jump straight to the present, instead of stepping through the slots it
+    // missed while idle.
+    if (num_tokens == 0) {
+        current_tick = std::max<int64_t>(current_tick, ticks / MILLION);
+    }
 
     timer_token_t *const token = new timer_token_t;
     token->interval_nanos = once ? 0 : nanos;
-    token->next_time_in_nanos = next_time_in_nanos;
+    token->next_time_in_nanos = ticks + nanos;
     token->callback = callback;
 
-    const timer_token_t *top_entry = token_queue.peek();
-    token_queue.push(token);
+    const int64_t wakeup_time_in_nanos = insert_token(token);
 
-    if (top_entry == NULL || next_time_in_nanos < top_entry->next_time_in_nanos) {
-        timer_provider.schedule_oneshot(next_time_in_nanos, this);
+    if (!oneshot_scheduled || wakeup_time_in_nanos < expected_oneshot_time_in_nanos) {
+        timer_provider.schedule_oneshot(wakeup_time_in_nanos, this);
+        expected_oneshot_time_in_nanos = wakeup_time_in_nanos;
+        oneshot_scheduled = true;
     }
 
     return token;
 }
 
 void timer_handler_t::cancel_timer(timer_token_t *token) {
-    token_queue.remove(token);
+    if (token->bucket != NULL) {
+        remove_token(token);
+    }
+
+    // A token canceled by its own callback is deleted once the callback returns.
+    if (token == firing_token) {
+        firing_token_canceled = true;
+    } else {
+        delete token;
+    }
 
-    if (token_queue.empty()) {
+    if (num_tokens == 0 && oneshot_scheduled) {
         timer_provider.unschedule_oneshot();
+        oneshot_scheduled = false;
     }
 }
 
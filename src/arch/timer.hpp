@@ -2,7 +2,7 @@
 #ifndef ARCH_TIMER_HPP_
 #define ARCH_TIMER_HPP_
 
-#include "containers/intrusive_priority_queue.hpp"
+#include "containers/intrusive_list.hpp"
 #include "arch/io/timer_provider.hpp"
 
 class timer_token_t;
@@ -14,7 +14,13 @@ struct timer_callback_t {
 
 /* This timer class uses the underlying OS timer provider to get one-shot timing events. It then
  * manages a list of application timers based on that lower level interface. Everyone who needs a
- * timer should use this class (through the thread pool). */
+ * timer should use this class (through the thread pool).
+ *
+ * Timers are kept in a hierarchical timing wheel with millisecond ticks: level 0 has one slot per
+ * millisecond for the next 64 milliseconds, level 1 one slot per 64 milliseconds for the next 4096
+ * milliseconds, and so on.  Adding and canceling a timer are constant time, and timers in a
+ * higher level are cascaded down a level when the wheel reaches their slot.  Timers that fall in
+ * the same millisecond are fired together. */
 class timer_handler_t : private timer_provider_callback_t {
 public:
     explicit timer_handler_t(linux_event_queue_t *queue);
@@ -24,17 +30,49 @@ public:
     void cancel_timer(timer_token_t *timer);
 
 private:
+    static const int wheel_bits = 6;
+    static const int wheel_slots = 1 << wheel_bits;
+    static const int wheel_levels = 5;
+
     void on_oneshot();
 
+    // Puts the token in its wheel slot, and returns when the oneshot must go off for that slot.
+    int64_t insert_token(timer_token_t *token);
+    void remove_token(timer_token_t *token);
+
+    // Returns the tick of the next slot in `level` that has to be fired or cascaded, or -1 if the
+    // level is empty.
+    int64_t next_slot_tick(int level) const;
+
+    // Fires or cascades every slot up to and including `now_tick`.
+    void advance_to(int64_t now_tick, int64_t real_ticks);
+    void fire_tokens(intrusive_list_t<timer_token_t> *expiring, int64_t real_ticks);
+
+    // Points the timer provider at the next slot, or unschedules it when there are no tokens.
+    void reschedule_oneshot();
+
     // The timer provider, a platform-dependent typedef for interfacing with the OS.
     timer_provider_t timer_provider;
 
     // The expected time of the next on_oneshot call.  If the oneshot arrived earlier than this
     // time, we pretend that it had arrived on time.
     int64_t expected_oneshot_time_in_nanos;
+    bool oneshot_scheduled;
+
+    // The wheel's current position, in milliseconds.  Every slot up to and including this tick
+    // has been fired.
+    int64_t current_tick;
+
+    intrusive_list_t<timer_token_t> slots[wheel_levels][wheel_slots];
+
+    // Bit `i` of `occupied[level]` is set when `slots[level][i]` is nonempty.
+    uint64_t occupied[wheel_levels];
+
+    size_t num_tokens;
 
-    // A priority queue of timer tokens, ordered by the soonest.
-    intrusive_priority_queue_t<timer_token_t> token_queue;
+    // The token whose callback is running, so that it may be canceled from the callback.
+    timer_token_t *firing_token;
+    bool firing_token_canceled;
 
     DISABLE_COPYING(timer_handler_t);
 };
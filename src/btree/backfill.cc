@@ -175,3 +175,41 @@ THROWS_ONLY(interrupted_exc_t) {
     helper.progress = p;
     btree_parallel_traversal(txn, superblock, slice, &helper, interruptor);
 }
+
+void split_key_range_for_backfill(const key_range_t &key_range,
+                                  const std::vector<store_key_t> &split_keys,
+                                  int max_parts,
+                                  std::vector<key_range_t> *parts_out) {
+    rassert(max_parts > 0);
+    parts_out->clear();
+
+    std::vector<store_key_t> cuts;
+    for (std::vector<store_key_t>::const_iterator it = split_keys.begin();
+         it != split_keys.end();
+         ++it) {
+        if (key_range.contains_key(*it) && key_range.left < *it) {
+            cuts.push_back(*it);
+        }
+    }
+    std::sort(cuts.begin(), cuts.end());
+    cuts.erase(std::unique(cuts.begin(), cuts.end()), cuts.end());
+
+    /* Pick evenly spaced cut points so the parts hold similar numbers of
+    keys. */
+    const size_t num_cuts = std::min<size_t>(max_parts - 1, cuts.size());
+    store_key_t left = key_range.left;
+    for (size_t i = 1; i <= num_cuts; ++i) {
+        const store_key_t &cut = cuts[(i * cuts.size()) / (num_cuts + 1)];
+        if (cut <= left) {
+            continue;
+        }
+        parts_out->push_back(key_range_t(key_range_t::closed, left,
+                                         key_range_t::open, cut));
+        left = cut;
+    }
+
+    key_range_t last;
+    last.left = left;
+    last.right = key_range.right;
+    parts_out->push_back(last);
+}
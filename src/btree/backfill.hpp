@@ -4,6 +4,7 @@
 
 #include <map>
 #include <string>
+#include <vector>
 
 #include "btree/btree_store.hpp"
 #include "btree/secondary_operations.hpp"
@@ -19,6 +20,7 @@ class superblock_t;
 template <class> class value_sizer_t;
 class repli_timestamp_t;
 class signal_t;
+struct store_key_t;
 
 
 class agnostic_backfill_callback_t {
@@ -42,4 +44,15 @@ void do_agnostic_btree_backfill(value_sizer_t<void> *sizer,
         signal_t *interruptor)
 THROWS_ONLY(interrupted_exc_t);
 
+/* `split_key_range_for_backfill()` cuts `key_range` into at most `max_parts`
+contiguous, non-empty subranges whose union is `key_range`. The cuts are made at
+keys taken from `split_keys`, which is typically the (unsorted) output of
+`get_btree_key_distribution()`. Each subrange can then be passed to its own
+`do_agnostic_btree_backfill()` call so the traversals run concurrently. */
+
+void split_key_range_for_backfill(const key_range_t &key_range,
+                                  const std::vector<store_key_t> &split_keys,
+                                  int max_parts,
+                                  std::vector<key_range_t> *parts_out);
+
 #endif  // BTREE_BACKFILL_HPP_
@@ -9,10 +9,16 @@
 #include "stl_utils.hpp"
 
 sindex_not_post_constructed_exc_t::sindex_not_post_constructed_exc_t(
-        std::string sindex_name)
+        std::string sindex_name, progress_completion_fraction_t progress)
     : info(strprintf("Sindex: %s was accessed before it was finished post constructing.",
                 sindex_name.c_str()))
-{ }
+{
+    if (!progress.invalid() && progress.estimate_of_total_nodes > 0) {
+        info += strprintf(" It is about %d%% done.",
+                          100 * progress.estimate_of_released_nodes
+                              / progress.estimate_of_total_nodes);
+    }
+}
 
 const char* sindex_not_post_constructed_exc_t::what() const throw() {
     return info.c_str();
@@ -291,6 +297,36 @@ void btree_store_t<protocol_t>::emergency_deregister_sindex_queue(
     deregister_sindex_queue(disk_backed_queue, &acq);
 }
 
+template <class protocol_t>
+void btree_store_t<protocol_t>::register_sindex_post_construction(
+        const std::set<uuid_u> &sindexes,
+        const traversal_progress_t *progress) {
+    assert_thread();
+    for (auto it = sindexes.begin(); it != sindexes.end(); ++it) {
+        sindex_post_constructions[*it] = progress;
+    }
+}
+
+template <class protocol_t>
+void btree_store_t<protocol_t>::deregister_sindex_post_construction(
+        const std::set<uuid_u> &sindexes) {
+    assert_thread();
+    for (auto it = sindexes.begin(); it != sindexes.end(); ++it) {
+        sindex_post_constructions.erase(*it);
+    }
+}
+
+template <class protocol_t>
+progress_completion_fraction_t btree_store_t<protocol_t>::get_sindex_post_construction_progress(
+        uuid_u sindex) const {
+    assert_thread();
+    auto it = sindex_post_constructions.find(sindex);
+    if (it == sindex_post_constructions.end()) {
+        return progress_completion_fraction_t::make_invalid();
+    }
+    return it->second->guess_completion();
+}
+
 template <class protocol_t>
 void btree_store_t<protocol_t>::sindex_queue_push(const write_message_t &value,
                                                   const mutex_t::acq_t *acq) {
@@ -663,7 +699,8 @@ MUST_USE bool btree_store_t<protocol_t>::acquire_sindex_superblock_for_read(
     }
 
     if (!sindex.post_construction_complete) {
-        throw sindex_not_post_constructed_exc_t(id);
+        throw sindex_not_post_constructed_exc_t(
+            id, get_sindex_post_construction_progress(sindex.id));
     }
 
     buf_lock_t superblock_lock(txn, sindex.superblock, rwi_read);
@@ -693,7 +730,8 @@ MUST_USE bool btree_store_t<protocol_t>::acquire_sindex_superblock_for_write(
     }
 
     if (!sindex.post_construction_complete) {
-        throw sindex_not_post_constructed_exc_t(id);
+        throw sindex_not_post_constructed_exc_t(
+            id, get_sindex_post_construction_progress(sindex.id));
     }
 
 
@@ -20,6 +20,7 @@
 #include "concurrency/auto_drainer.hpp"
 #include "containers/disk_backed_queue.hpp"
 #include "perfmon/perfmon.hpp"
+#include "backfill_progress.hpp"
 #include "protocol_api.hpp"
 
 struct rdb_protocol_t;
@@ -32,7 +33,10 @@ class real_superblock_t;
 
 class sindex_not_post_constructed_exc_t : public std::exception {
 public:
-    explicit sindex_not_post_constructed_exc_t(std::string sindex_name);
+    // `progress` says how far along the index's post-construction is, if it's
+    // known.
+    sindex_not_post_constructed_exc_t(std::string sindex_name,
+                                      progress_completion_fraction_t progress);
     const char* what() const throw();
     ~sindex_not_post_constructed_exc_t() throw();
 private:
@@ -139,6 +143,18 @@ public:
             const write_message_t& value,
             const mutex_t::acq_t *acq);
 
+    /* Post-constructions register their progress here while they run, so that
+    accesses to the indexes they are building can say how far along they are. */
+    void register_sindex_post_construction(
+            const std::set<uuid_u> &sindexes,
+            const traversal_progress_t *progress);
+
+    void deregister_sindex_post_construction(
+            const std::set<uuid_u> &sindexes);
+
+    progress_completion_fraction_t get_sindex_post_construction_progress(
+            uuid_u sindex) const;
+
     void acquire_sindex_block_for_read(
             read_token_pair_t *token_pair,
             transaction_t *txn,
@@ -425,6 +441,8 @@ public:
     std::vector<internal_disk_backed_queue_t *> sindex_queues;
     mutex_t sindex_queue_mutex;
 
+    std::map<uuid_u, const traversal_progress_t *> sindex_post_constructions;
+
     auto_drainer_t drainer;
 
 private:
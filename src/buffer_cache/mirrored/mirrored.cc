@@ -1387,7 +1387,9 @@ void mc_cache_t::maybe_unregister_read_ahead_callback() {
     // Unregister when 90 % of the cache are filled up.
     if (read_ahead_registered && page_repl.is_full(dynamic_config.max_size / serializer->get_block_size().ser_value() / 10 + 1)) {
         read_ahead_registered = false;
-        // unregister_read_ahead_cb requires a coro context, but we might not be in any
-        coro_t::spawn_now_dangerously(boost::bind(&serializer_t::unregister_read_ahead_cb, serializer, this));
+        // unregister_read_ahead_cb requires a coro context, but we might not be in any.
+        // It only hops threads and takes us out of a list, so a small stack does.
+        coro_t::spawn_now_dangerously(boost::bind(&serializer_t::unregister_read_ahead_cb, serializer, this),
+                                      SMALL_CORO_STACK);
     }
 }
@@ -0,0 +1,17 @@
+// Copyright 2010-2013 RethinkDB, all rights reserved.
+#include "concurrency/work_stealing.hpp"
+
+#include "perfmon/perfmon.hpp"
+
+static perfmon_counter_t pm_work_stealing_batches, pm_work_stealing_stolen_batches;
+static perfmon_multi_membership_t pm_work_stealing_membership(&get_global_perfmon_collection(),
+    &pm_work_stealing_batches, "work_stealing_batches",
+    &pm_work_stealing_stolen_batches, "work_stealing_stolen_batches",
+    NULLPTR);
+
+void note_work_stealing_batch(bool stolen) {
+    ++pm_work_stealing_batches;
+    if (stolen) {
+        ++pm_work_stealing_stolen_batches;
+    }
+}
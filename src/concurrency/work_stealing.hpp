@@ -0,0 +1,90 @@
+// Copyright 2010-2013 RethinkDB, all rights reserved.
+#ifndef CONCURRENCY_WORK_STEALING_HPP_
+#define CONCURRENCY_WORK_STEALING_HPP_
+
+#include <stdint.h>
+
+#include <algorithm>
+
+#include "arch/runtime/coroutines.hpp"
+#include "arch/runtime/runtime.hpp"
+#include "concurrency/pmap.hpp"
+
+/* `parallel_for_each_batch()` calls `fun(i)` for every `i` in `[0, count)`,
+spreading the calls across all threads, and returns once they are all done.
+
+Every thread runs a worker that repeatedly claims the next `batch_size` indices
+from a shared counter, runs them, and yields so that the thread's own work gets
+a turn. A thread that is busy with other coroutines gets back to its worker
+less often and so claims fewer batches; idle threads steal the rest. This is
+only worth it for CPU-heavy work on data that isn't tied to a home thread
+(datums, protocol buffers), and `fun` must be safe to call on any thread. It
+must not throw or block. */
+
+/* Counts batches in the `work_stealing_batches` and `work_stealing_stolen_batches`
+perfmons. A batch is stolen if it runs on a thread other than the caller's. */
+void note_work_stealing_batch(bool stolen);
+
+template <class callable_t>
+class work_stealing_runner_t {
+public:
+    work_stealing_runner_t(int64_t _count, int64_t _batch_size, const callable_t *_fun) :
+        count(_count), batch_size(_batch_size), fun(_fun),
+        caller_thread(get_thread_id()), next_index(0) { }
+
+    /* Worker `n` runs on the `n`th thread after the caller's, so the caller's
+    own thread always takes part without a thread switch. */
+    void operator()(int n) {
+        int thread = (caller_thread + n) % get_num_threads();
+        on_thread_t thread_switcher(thread);
+        for (;;) {
+            int64_t begin = __sync_fetch_and_add(&next_index, batch_size);
+            if (begin >= count) {
+                break;
+            }
+            int64_t end = std::min(begin + batch_size, count);
+            for (int64_t i = begin; i < end; ++i) {
+                (*fun)(i);
+            }
+            note_work_stealing_batch(thread != caller_thread);
+            coro_t::yield();
+        }
+    }
+
+private:
+    const int64_t count;
+    const int64_t batch_size;
+    const callable_t *const fun;
+    const int caller_thread;
+    int64_t next_index;
+
+    DISABLE_COPYING(work_stealing_runner_t);
+};
+
+template <class callable_t>
+class work_stealing_runner_ref_t {
+public:
+    explicit work_stealing_runner_ref_t(work_stealing_runner_t<callable_t> *_runner) :
+        runner(_runner) { }
+    void operator()(int n) const {
+        (*runner)(n);
+    }
+private:
+    work_stealing_runner_t<callable_t> *runner;
+};
+
+template <class callable_t>
+void parallel_for_each_batch(int64_t count, int64_t batch_size, const callable_t &fun) {
+    rassert(batch_size > 0);
+    if (count <= batch_size || get_num_threads() == 1) {
+        for (int64_t i = 0; i < count; ++i) {
+            fun(i);
+        }
+        return;
+    }
+    work_stealing_runner_t<callable_t> runner(count, batch_size, &fun);
+    int num_workers = std::min<int64_t>(get_num_threads(), (count + batch_size - 1) / batch_size);
+    pmap(num_workers, work_stealing_runner_ref_t<callable_t>(&runner));
+}
+
+#endif  // CONCURRENCY_WORK_STEALING_HPP_
@@ -124,8 +124,10 @@
 // memcached specifies the maximum value size to be 1MB, but customers asked this to be much higher
 #define MAX_VALUE_SIZE                            (10 * MEGABYTE)
 
-// Values larger than this will be streamed in a get operation
-#define MAX_BUFFERED_GET_SIZE                     MAX_VALUE_SIZE // streaming is too slow for now, so we disable it completely
+// Values larger than this are written to the socket straight from the value's buffer in
+// a get operation, in the same writev() as whatever response data was buffered ahead of
+// them, instead of being copied into the connection's write buffer first
+#define MAX_BUFFERED_GET_SIZE                     (16 * KILOBYTE)
 
 // If a single connection sends this many 'noreply' commands, the next command will
 // have to wait until the first one finishes
@@ -185,10 +187,33 @@
 // doesn't return memory to the OS. If it's set too low, startup will take a longer time.
 #define LBA_READ_BUFFER_SIZE                      GIGABYTE
 
+// How many times in a row a thread delivers cross-thread messages that arrived
+// while it was already delivering messages, before it yields to the rest of
+// its event loop.
+#define MESSAGE_HUB_MAX_DRAIN_PASSES              4
+
 #define COROUTINE_STACK_SIZE                      131072
 
+// Stack size for coroutines spawned with `SMALL_CORO_STACK`
+#define COROUTINE_SMALL_STACK_SIZE                16384
+
+// The stack usage of one in this many coroutines of each type is measured (see
+// `coro_runtime_t::get_stack_high_water_marks()`)
+#define COROUTINE_STACK_PROFILE_INTERVAL          64
+
 #define MAX_COROS_PER_THREAD                      10000
 
+// Each thread keeps this many idle coroutines with their stack memory
+// committed. The stacks of idle coroutines beyond this are returned to the OS
+// with madvise() until they are needed again.
+#define COROUTINE_FREE_LIST_HIGH_WATER            256
+
+// A backfill cuts each region it sends into at most this many key subranges
+// and traverses them concurrently. The cut points are taken from the btree's
+// key distribution, read down to `BACKFILL_SPLIT_DISTRIBUTION_DEPTH` levels.
+#define BACKFILL_TRAVERSALS_PER_REGION            8
+#define BACKFILL_SPLIT_DISTRIBUTION_DEPTH         2
+
 
 // Size of a cache line (used in cache_line_padded_t).
 #define CACHE_LINE_SIZE                           64
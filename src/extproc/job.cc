@@ -7,7 +7,7 @@ namespace extproc {
 int job_t::accept_job(job_control_t *control, void *extra) {
     // Try to receive the job.
     job_t::func_t jobfunc;
-    const int64_t res = force_read(&control->unix_socket, &jobfunc, sizeof(jobfunc));
+    const int64_t res = force_read(&control->channel, &jobfunc, sizeof(jobfunc));
     if (res < static_cast<int64_t>(sizeof(jobfunc))) {
         // Don't log anything if the parent isn't alive, it likely means there was an unclean shutdown,
         //  and the file descriptor is invalid.  We don't want to pollute the output.
@@ -42,8 +42,9 @@ int job_t::send_over(write_stream_t *stream) const {
 }
 
 
-job_control_t::job_control_t(pid_t _pid, pid_t _spawner_pid, scoped_fd_t *fd)
+job_control_t::job_control_t(pid_t _pid, pid_t _spawner_pid, scoped_fd_t *fd, fd_t shm_fd)
     : unix_socket(fd, new blocking_fd_watcher_t()),
+      channel(&unix_socket, shm_fd, shm_channel_t::WORKER_SIDE),
       pid(_pid),
       spawner_pid(_spawner_pid) { }
 
@@ -7,6 +7,7 @@
 #include "arch/runtime/runtime_utils.hpp"
 #include "containers/archive/archive.hpp"
 #include "containers/archive/socket_stream.hpp"
+#include "extproc/shm_channel.hpp"
 
 namespace extproc {
 
@@ -20,10 +21,13 @@ public:
 
     unix_socket_stream_t unix_socket;
 
+    // Talk to the engine through this, not `unix_socket`.
+    shm_channel_t channel;
+
 private:
-    friend void exec_worker(pid_t spawner_pid, fd_t sockfd);
+    friend void exec_worker(pid_t spawner_pid, fd_t sockfd, fd_t shm_fd);
 
-    job_control_t(pid_t pid, pid_t spawner_pid, scoped_fd_t *fd);
+    job_control_t(pid_t pid, pid_t spawner_pid, scoped_fd_t *fd, fd_t shm_fd);
 
     const pid_t pid;
     const pid_t spawner_pid;
@@ -75,7 +79,7 @@ class auto_job_t : public base_job_t {
     static void job_runner_func(job_control_t *control, void *extra) {
         // Get the job instance.
         instance_t job;
-        archive_result_t res = deserialize(&control->unix_socket, &job);
+        archive_result_t res = deserialize(&control->channel, &job);
 
         if (res != ARCHIVE_SUCCESS) {
             control->log("Could not deserialize job: %s",
@@ -4,6 +4,7 @@
 #include "containers/scoped.hpp"
 #include "logger.hpp"
 #include "rpc/serialize_macros.hpp"
+#include "utils.hpp"
 
 namespace extproc {
 
@@ -24,7 +25,8 @@ pool_group_t::pool_group_t(spawner_info_t *info, const config_t &config)
 pool_t::pool_t(pool_group_t *group)
     : group_(group),
       num_spawning_workers_(0),
-      worker_semaphore_(group_->config_.max_workers)
+      worker_semaphore_(group_->config_.max_workers),
+      idle_timer_(pool_group_t::IDLE_CHECK_INTERVAL_MS, this)
 {
     // Spawn initial worker pool.
     repair_invariants();
@@ -71,8 +73,9 @@ pool_worker_t *pool_t::acquire_worker() {
     }
     guarantee(!idle_workers_.empty()); // sanity
 
-    // Grab an idle worker, move it to the busy list, assign it to `handle`.
-    pool_worker_t *worker = idle_workers_.head();
+    // Grab the most recently idled worker, move it to the busy list, assign it
+    // to `handle`.
+    pool_worker_t *worker = idle_workers_.tail();
     idle_workers_.remove(worker);
     busy_workers_.push_back(worker);
     return worker;
@@ -93,12 +96,26 @@ void pool_t::release_worker(pool_worker_t *worker) THROWS_NOTHING {
 
     // Move it from the busy list to the idle list.
     busy_workers_.remove(worker);
+    worker->idle_since_ = current_microtime();
     idle_workers_.push_back(worker);
 
     // Free up worker slot for someone else to use.
     worker_semaphore_.unlock();
 }
 
+void pool_t::on_ring() {
+    assert_thread();
+    const microtime_t now = current_microtime();
+    const microtime_t timeout = pool_group_t::WORKER_IDLE_TIMEOUT_MS * 1000;
+
+    pool_worker_t *worker;
+    while (num_workers() > config()->min_workers
+           && (worker = idle_workers_.head()) != NULL
+           && now - worker->idle_since_ >= timeout) {
+        end_worker(&idle_workers_, worker);
+    }
+}
+
 void pool_t::interrupt_worker(pool_worker_t *worker) THROWS_NOTHING {
     assert_thread();
     rassert(worker && worker->pool_ == this);
@@ -157,25 +174,28 @@ void pool_t::spawn_workers(int num) {
     scoped_array_t<pid_t> pids(num);
     scoped_array_t<scoped_fd_t> fds(num);
     scoped_array_t<scoped_fd_t> other_end_of_fds(num);
+    scoped_array_t<scoped_fd_t> shm_fds(num);
     {
         on_thread_t switcher(spawner()->home_thread());
         for (int i = 0; i < num; ++i) {
-            pids[i] = spawner()->spawn_process(&fds[i], &other_end_of_fds[i]);
+            pids[i] = spawner()->spawn_process(&fds[i], &other_end_of_fds[i], &shm_fds[i]);
             guarantee(-1 != pids[i], "could not spawn worker process");
         }
     }
 
     // For every process spawned, create a corresponding pool_worker_t.
     for (int i = 0; i < num; ++i) {
-        pool_worker_t *worker = new pool_worker_t(this, pids[i], &fds[i], &other_end_of_fds[i]);
+        pool_worker_t *worker = new pool_worker_t(this, pids[i], &fds[i], &other_end_of_fds[i],
+                                                  shm_fds[i].get());
 
         // Send it a job that just loops accepting jobs.
-        const int res = job_acceptor_t().send_over(&worker->unix_socket);
+        const int res = job_acceptor_t().send_over(&worker->channel);
         guarantee(0 == res, "Could not initialize worker process.");
 
         // We've successfully spawned one worker.
         guarantee(num_spawning_workers_ > 0); // sanity
         --num_spawning_workers_;
+        worker->idle_since_ = current_microtime();
         idle_workers_.push_back(worker);
     }
 }
@@ -191,12 +211,15 @@ void pool_t::end_worker(intrusive_list_t<pool_worker_t> *list, pool_worker_t *wo
 }
 
 
-pool_worker_t::pool_worker_t(pool_t *pool, pid_t pid, scoped_fd_t *fd, scoped_fd_t *fd_worker_end)
+pool_worker_t::pool_worker_t(pool_t *pool, pid_t pid, scoped_fd_t *fd, scoped_fd_t *fd_worker_end,
+                             fd_t shm_fd)
     : unix_socket(fd),
+      channel(&unix_socket, shm_fd, shm_channel_t::ENGINE_SIDE),
       other_end_of_unix_socket(fd_worker_end->release()),
       pool_(pool),
       pid_(pid),
-      attached_(true) {
+      attached_(true),
+      idle_since_(0) {
     guarantee(pid > 1 && fd != NULL); // sanity
 }
 
@@ -268,7 +291,7 @@ int64_t job_handle_t::read_interruptible(void *p, int64_t n, signal_t *interrupt
     int res = -1;
     try {
         interruptor_wrapper_t wrapper(this, interruptor);
-        res = worker_->unix_socket.read_interruptible(p, n, &wrapper);
+        res = worker_->channel.read_interruptible(p, n, &wrapper);
     } catch (const interrupted_exc_t &) {
         // We were interrupted, and need to clean up the detached worker created
         // by job_handle_t::interruptor_wrapper_t::run(). We do this by falling
@@ -288,7 +311,7 @@ int64_t job_handle_t::write_interruptible(const void *p, int64_t n, signal_t *in
     int res = -1;
     try {
         interruptor_wrapper_t wrapper(this, interruptor);
-        res = worker_->unix_socket.write_interruptible(p, n, &wrapper);
+        res = worker_->channel.write_interruptible(p, n, &wrapper);
     } catch (const interrupted_exc_t &) {
         // See comments in read_interruptible.
         rassert(worker_ && !worker_->attached_);
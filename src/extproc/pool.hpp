@@ -6,6 +6,7 @@
 
 #include "errors.hpp"
 
+#include "arch/timing.hpp"
 #include "concurrency/one_per_thread.hpp"
 #include "concurrency/semaphore.hpp"
 #include "concurrency/signal.hpp"
@@ -13,6 +14,7 @@
 #include "containers/archive/socket_stream.hpp"
 #include "containers/intrusive_list.hpp"
 #include "extproc/job.hpp"
+#include "extproc/shm_channel.hpp"
 #include "extproc/spawner.hpp"
 
 namespace extproc {
@@ -27,7 +29,12 @@ class pool_group_t {
 
 public:
     static const int DEFAULT_MIN_WORKERS = 2;
-    static const int DEFAULT_MAX_WORKERS = 2;
+    static const int DEFAULT_MAX_WORKERS = 4;
+
+    // Workers beyond `min_workers` that have sat idle for this long get
+    // killed; we check every `IDLE_CHECK_INTERVAL_MS`.
+    static const int64_t WORKER_IDLE_TIMEOUT_MS = 60 * 1000;
+    static const int64_t IDLE_CHECK_INTERVAL_MS = 10 * 1000;
 
     struct config_t {
         config_t()
@@ -55,7 +62,8 @@ class pool_worker_t : public intrusive_list_node_t<pool_worker_t> {
     friend class job_handle_t;
 
 public:
-    pool_worker_t(pool_t *pool, pid_t pid, scoped_fd_t *fd, scoped_fd_t *fd_other_end);
+    pool_worker_t(pool_t *pool, pid_t pid, scoped_fd_t *fd, scoped_fd_t *fd_other_end,
+                  fd_t shm_fd);
     ~pool_worker_t();
 
     // Called when we get an error on a worker process socket, which usually
@@ -70,6 +78,9 @@ public:
     // TODO: Why is this a unix socket?  I don't think this one needs to be a unix socket.  It could be a regular socket or pipe.
     unix_socket_stream_t unix_socket;
 
+    // Jobs' traffic goes through this rather than `unix_socket`.
+    shm_channel_t channel;
+
 private:
     // This is the descriptor for the other end of the unix socket.  We keep it
     // around because the following has race issues with OS X, because OS X is broken.
@@ -93,12 +104,17 @@ private:
     const pid_t pid_;
     bool attached_;
 
+    // When the worker was last moved to the idle list.
+    microtime_t idle_since_;
+
     DISABLE_COPYING(pool_worker_t);
 };
 
 
-// A per-thread worker pool.
-class pool_t : public home_thread_mixin_t {
+// A per-thread worker pool.  It spawns workers as jobs need them, up to
+// `max_workers`, and kills the ones beyond `min_workers` again once they've
+// been idle for a while.
+class pool_t : public home_thread_mixin_t, private repeating_timer_callback_t {
 public:
     explicit pool_t(pool_group_t *group);
     ~pool_t();
@@ -145,10 +161,16 @@ private:
         return idle_workers_.size() + busy_workers_.size() + num_spawning_workers_;
     }
 
+    // Ends idle workers above `min_workers` that have been idle for longer than
+    // `WORKER_IDLE_TIMEOUT_MS`.
+    void on_ring();
+
 private:
     pool_group_t *group_;
 
-    // Worker processes.
+    // Worker processes.  Idle workers are kept in the order they became idle,
+    // and the most recently used one is handed out first, so that the ones at
+    // the head are left alone long enough to time out when load drops.
     intrusive_list_t<pool_worker_t> idle_workers_;
     intrusive_list_t<pool_worker_t> busy_workers_;
 
@@ -162,6 +184,8 @@ private:
     // config_->max_workers workers running.
     semaphore_t worker_semaphore_;
 
+    repeating_timer_t idle_timer_;
+
     DISABLE_COPYING(pool_t);
 };
 
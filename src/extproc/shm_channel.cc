@@ -0,0 +1,178 @@
+// Copyright 2010-2013 RethinkDB, all rights reserved.
+#include "extproc/shm_channel.hpp"
+
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace extproc {
+
+// One direction of a channel.  The positions count every byte ever written to
+// and read from the ring; only the writer advances `write_pos` and only the
+// reader advances `read_pos`.  The `*_waiting` flags are set by a side that is
+// about to block on the socket, and cleared by whichever side wakes it up.
+struct shm_ring_t {
+    volatile uint64_t write_pos;
+    char write_pos_padding[CACHE_LINE_SIZE - sizeof(uint64_t)];
+    volatile uint64_t read_pos;
+    char read_pos_padding[CACHE_LINE_SIZE - sizeof(uint64_t)];
+    volatile int32_t reader_waiting;
+    volatile int32_t writer_waiting;
+    char flags_padding[CACHE_LINE_SIZE - 2 * sizeof(int32_t)];
+    char data[shm_channel_t::RING_SIZE];
+};
+
+struct shm_region_t {
+    shm_ring_t to_worker;
+    shm_ring_t to_engine;
+};
+
+fd_t shm_channel_t::create_shm_fd() {
+#ifdef SYS_memfd_create
+    const fd_t fd = static_cast<fd_t>(syscall(SYS_memfd_create, "rethinkdb-extproc", 0));
+    if (fd == -1) {
+        return INVALID_FD;
+    }
+    // The new memory is zeroed, which is the state both rings start in.
+    if (ftruncate(fd, sizeof(shm_region_t)) != 0) {
+        const int closeres = ::close(fd);
+        guarantee_err(0 == closeres || errno == EINTR, "could not close fd");
+        return INVALID_FD;
+    }
+    return fd;
+#else
+    return INVALID_FD;
+#endif
+}
+
+shm_channel_t::shm_channel_t(unix_socket_stream_t *socket, fd_t shm_fd, side_t side)
+    : socket_(socket), region_(NULL), in_(NULL), out_(NULL) {
+    if (shm_fd == INVALID_FD) {
+        return;
+    }
+
+    void *addr = mmap(NULL, sizeof(shm_region_t), PROT_READ | PROT_WRITE,
+                      MAP_SHARED, shm_fd, 0);
+    guarantee_err(addr != MAP_FAILED, "could not map extproc shared memory");
+    region_ = static_cast<shm_region_t *>(addr);
+    in_ = side == ENGINE_SIDE ? &region_->to_engine : &region_->to_worker;
+    out_ = side == ENGINE_SIDE ? &region_->to_worker : &region_->to_engine;
+}
+
+shm_channel_t::~shm_channel_t() {
+    if (region_ != NULL) {
+        const int res = munmap(region_, sizeof(shm_region_t));
+        guarantee_err(res == 0, "could not unmap extproc shared memory");
+    }
+}
+
+int shm_channel_t::wake_other_side(volatile int32_t *waiting, signal_t *interruptor) {
+    if (!__sync_bool_compare_and_swap(waiting, 1, 0)) {
+        return 0;
+    }
+    const char c = 0;
+    return socket_->write_interruptible(&c, 1, interruptor) == 1 ? 0 : -1;
+}
+
+int64_t shm_channel_t::wait_for_other_side(signal_t *interruptor) {
+    // Wakeups may be stale (the other side can wake us up just after we
+    // stopped waiting), so callers just check the ring again after this.
+    char c;
+    return socket_->read_interruptible(&c, 1, interruptor);
+}
+
+int64_t shm_channel_t::read_interruptible(void *p, int64_t n, signal_t *interruptor) {
+    if (region_ == NULL) {
+        return socket_->read_interruptible(p, n, interruptor);
+    }
+    if (n == 0) {
+        return 0;
+    }
+
+    for (;;) {
+        const uint64_t read_pos = in_->read_pos;
+        const uint64_t available = in_->write_pos - read_pos;
+        if (available > 0) {
+            // Make sure we see the data the writer put there before it moved
+            // `write_pos`.
+            __sync_synchronize();
+            const size_t count = std::min<uint64_t>(n, available);
+            const size_t offset = read_pos % RING_SIZE;
+            const size_t first = std::min(count, RING_SIZE - offset);
+            memcpy(p, in_->data + offset, first);
+            memcpy(static_cast<char *>(p) + first, in_->data, count - first);
+
+            __sync_synchronize();
+            in_->read_pos = read_pos + count;
+            __sync_synchronize();
+            if (wake_other_side(&in_->writer_waiting, interruptor) == -1) {
+                return -1;
+            }
+            return count;
+        }
+
+        // Nothing to read yet: ask to be woken up, then look again, in case
+        // the writer added something before it could see our flag.
+        in_->reader_waiting = 1;
+        __sync_synchronize();
+        if (in_->write_pos != read_pos) {
+            __sync_bool_compare_and_swap(&in_->reader_waiting, 1, 0);
+            continue;
+        }
+
+        const int64_t res = wait_for_other_side(interruptor);
+        if (res <= 0) {
+            return res;
+        }
+    }
+}
+
+int64_t shm_channel_t::write_interruptible(const void *p, int64_t n, signal_t *interruptor) {
+    if (region_ == NULL) {
+        return socket_->write_interruptible(p, n, interruptor);
+    }
+
+    const char *data = static_cast<const char *>(p);
+    int64_t remaining = n;
+    while (remaining > 0) {
+        const uint64_t write_pos = out_->write_pos;
+        const uint64_t space = RING_SIZE - (write_pos - out_->read_pos);
+        if (space > 0) {
+            // Make sure the reader is done with the space before we reuse it.
+            __sync_synchronize();
+            const size_t count = std::min<uint64_t>(remaining, space);
+            const size_t offset = write_pos % RING_SIZE;
+            const size_t first = std::min(count, RING_SIZE - offset);
+            memcpy(out_->data + offset, data, first);
+            memcpy(out_->data, data + first, count - first);
+
+            __sync_synchronize();
+            out_->write_pos = write_pos + count;
+            __sync_synchronize();
+            if (wake_other_side(&out_->reader_waiting, interruptor) == -1) {
+                return -1;
+            }
+            data += count;
+            remaining -= count;
+            continue;
+        }
+
+        // The ring is full: wait for the reader to make room.
+        out_->writer_waiting = 1;
+        __sync_synchronize();
+        if (out_->read_pos + RING_SIZE != write_pos) {
+            __sync_bool_compare_and_swap(&out_->writer_waiting, 1, 0);
+            continue;
+        }
+
+        if (wait_for_other_side(interruptor) <= 0) {
+            return -1;
+        }
+    }
+    return n;
+}
+
+}  // namespace extproc
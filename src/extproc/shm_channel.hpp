@@ -0,0 +1,70 @@
+// Copyright 2010-2013 RethinkDB, all rights reserved.
+#ifndef EXTPROC_SHM_CHANNEL_HPP_
+#define EXTPROC_SHM_CHANNEL_HPP_
+
+#include "errors.hpp"
+
+#include "arch/runtime/runtime_utils.hpp" // fd_t
+#include "config/args.hpp"
+#include "containers/archive/interruptible_stream.hpp"
+#include "containers/archive/socket_stream.hpp"
+
+namespace extproc {
+
+struct shm_ring_t;
+struct shm_region_t;
+
+// The stream that carries a job's traffic between the engine and a worker.
+//
+// If the spawner gave both ends the same shared memory (see
+// `create_shm_fd()`), data goes through a pair of ring buffers in it, one per
+// direction, and the unix socket only carries one-byte wakeups: a side that
+// finds nothing to read (or no room to write) says so in the shared memory and
+// blocks reading the socket, and the other side writes a byte to it once it
+// has made progress.  Otherwise everything goes through the socket, as it
+// used to.
+//
+// Like the socket it wraps, it must only be used by one reader and one writer
+// at a time on each end.
+class shm_channel_t :
+    public interruptible_read_stream_t, public interruptible_write_stream_t
+{
+public:
+    enum side_t { ENGINE_SIDE, WORKER_SIDE };
+
+    // Bytes of buffer space in each direction.
+    static const size_t RING_SIZE = 256 * KILOBYTE;
+
+    // Creates the shared memory for a new channel.  Returns INVALID_FD if we
+    // can't (say, because the platform has no `memfd_create`), in which case
+    // the channel just uses its socket.
+    static fd_t create_shm_fd();
+
+    // Does not take ownership of `socket` or `shm_fd`; `shm_fd` (which may be
+    // INVALID_FD) can be closed as soon as this returns.
+    shm_channel_t(unix_socket_stream_t *socket, fd_t shm_fd, side_t side);
+    ~shm_channel_t();
+
+    bool uses_shm() const { return region_ != NULL; }
+
+    virtual MUST_USE int64_t read_interruptible(void *p, int64_t n, signal_t *interruptor);
+    virtual int64_t write_interruptible(const void *p, int64_t n, signal_t *interruptor);
+
+private:
+    // Wakes up the other end, if it's waiting on us.  Returns -1 on error.
+    int wake_other_side(volatile int32_t *waiting, signal_t *interruptor);
+    // Blocks until the other end wakes us up.  Returns 1, or what the socket
+    // read returned on EOF or error.
+    int64_t wait_for_other_side(signal_t *interruptor);
+
+    unix_socket_stream_t *socket_;
+    shm_region_t *region_;
+    shm_ring_t *in_;
+    shm_ring_t *out_;
+
+    DISABLE_COPYING(shm_channel_t);
+};
+
+}  // namespace extproc
+
+#endif  // EXTPROC_SHM_CHANNEL_HPP_
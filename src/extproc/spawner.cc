@@ -12,12 +12,13 @@
 
 #include "arch/fd_send_recv.hpp"
 #include "extproc/job.hpp"
+#include "extproc/shm_channel.hpp"
 #include "utils.hpp"
 
 namespace extproc {
 
 void exec_spawner(fd_t socket) NORETURN;
-void exec_worker(pid_t spawner_pid, fd_t socket) NORETURN;
+void exec_worker(pid_t spawner_pid, fd_t socket, fd_t shm_fd) NORETURN;
 
 
 
@@ -93,7 +94,8 @@ void spawner_t::create(spawner_info_t *info) {
     info->socket.reset(fds[0]);
 }
 
-pid_t spawner_t::spawn_process(scoped_fd_t *socket, scoped_fd_t *other_end_of_socket) {
+pid_t spawner_t::spawn_process(scoped_fd_t *socket, scoped_fd_t *other_end_of_socket,
+                               scoped_fd_t *shm) {
     assert_thread();
 
     // Create a socket pair.
@@ -103,12 +105,19 @@ pid_t spawner_t::spawn_process(scoped_fd_t *socket, scoped_fd_t *other_end_of_so
         return -1;
     }
 
-    // We need to send the fd & receive the pid atomically with respect to other
-    // calls to spawn_process().
+    shm->reset(shm_channel_t::create_shm_fd());
+
+    // We need to send the fds & receive the pid atomically with respect to
+    // other calls to spawn_process().
     mutex_t::acq_t lock(&mutex_);
 
-    // Send one half to the spawner process.
-    const int send_fd_res = socket_.send_fd(fds[1]);
+    // Send one half (and the shared memory, if any) to the spawner process,
+    // preceded by how many fds there are.
+    fd_t send_fds[2] = { fds[1], shm->get() };
+    const uint8_t num_fds = shm->get() == INVALID_FD ? 1 : 2;
+    const int64_t write_res = socket_.write(&num_fds, sizeof(num_fds));
+    guarantee(sizeof(num_fds) == write_res);
+    const int send_fd_res = socket_.send_fds(num_fds, send_fds);
     guarantee(0 == send_fd_res);
 
     // We can't close fds[1] so quickly after sending it on the unix domain
@@ -155,15 +164,28 @@ void exec_spawner(fd_t socket) {
     pid_t local_spawner_pid = getpid();
 
     for (;;) {
-        // Get an fd from our parent.
-        fd_t fd;
-        fd_recv_result_t fdres = recv_fds(socket, 1, &fd);
-        if (fdres == FD_RECV_EOF) {
+        // Get a socket, and maybe shared memory, from our parent.
+        uint8_t num_fds;
+        ssize_t read_res;
+        do {
+            read_res = ::read(socket, &num_fds, sizeof(num_fds));
+        } while (read_res == -1 && errno == EINTR);
+        if (read_res == 0) {
             // Other end shut down cleanly; we should too.
             exit(EXIT_SUCCESS);
+        } else if (read_res != sizeof(num_fds) || num_fds < 1 || num_fds > 2) {
+            exit(EXIT_FAILURE);
+        }
+
+        fd_t fds[2] = { INVALID_FD, INVALID_FD };
+        fd_recv_result_t fdres = recv_fds(socket, num_fds, fds);
+        if (fdres == FD_RECV_EOF) {
+            exit(EXIT_SUCCESS);
         } else if (fdres != FD_RECV_OK) {
             exit(EXIT_FAILURE);
         }
+        const fd_t fd = fds[0];
+        const fd_t shm_fd = fds[1];
 
         // Fork a worker process.
         pid_t pid = fork();
@@ -174,13 +196,17 @@ void exec_spawner(fd_t socket) {
             // We're the child/worker.
             const int closeres = ::close(socket);
             guarantee_err(0 == closeres || errno == EINTR, "worker: could not close fd");
-            exec_worker(local_spawner_pid, fd);
+            exec_worker(local_spawner_pid, fd, shm_fd);
             unreachable();
         }
 
         // We're the parent.
         const int closeres = ::close(fd);
         guarantee_err(0 == closeres || errno == EINTR, "spawner: couldn't close fd");
+        if (shm_fd != INVALID_FD) {
+            const int shm_closeres = ::close(shm_fd);
+            guarantee_err(0 == shm_closeres || errno == EINTR, "spawner: couldn't close fd");
+        }
 
         // Send back its pid. Wish we could use unix_socket_stream_t for this,
         // but its destructor calls shutdown(), and we can't have that happening
@@ -216,7 +242,7 @@ void check_ppid_for_death(int) {
 }
 
 // Runs the worker process. Does not return.
-void exec_worker(pid_t local_spawner_pid, fd_t sockfd) {
+void exec_worker(pid_t local_spawner_pid, fd_t sockfd, fd_t shm_fd) {
     // Make sure we die when our parent dies.  (The parent, the spawner process, dies when the
     // rethinkdb process dies.)
     {
@@ -237,9 +263,12 @@ void exec_worker(pid_t local_spawner_pid, fd_t sockfd) {
                   "worker: setitimer saw that we already had an itimer!");
     }
 
-    // Receive one job and run it.
+    // Receive one job and run it.  The shared memory stays mapped after we
+    // close it.
     scoped_fd_t fd(sockfd);
-    job_control_t control(getpid(), local_spawner_pid, &fd);
+    scoped_fd_t shm(shm_fd);
+    job_control_t control(getpid(), local_spawner_pid, &fd, shm.get());
+    shm.reset();
     exit(job_t::accept_job(&control, NULL));
 }
 
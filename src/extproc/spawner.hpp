@@ -45,11 +45,15 @@ public:
     // where otherwise, sometimes reading from the descriptor in the spawner
     // process will produce ENOTCONN.
     //
+    // Also hands the process shared memory for a shm_channel_t, if we can
+    // create some; `*shm` is set to it, or left empty if not.
+    //
     // Returns -1 on error.
-    pid_t spawn_process(scoped_fd_t *socket, scoped_fd_t *other_end_of_socket);
+    pid_t spawn_process(scoped_fd_t *socket, scoped_fd_t *other_end_of_socket,
+                        scoped_fd_t *shm);
 
 private:
-    friend void exec_worker(pid_t spawner_pid, fd_t sockfd);
+    friend void exec_worker(pid_t spawner_pid, fd_t sockfd, fd_t shm_fd);
 
     pid_t pid_;
     mutex_t mutex_;             // linearizes access to socket_
@@ -6,8 +6,8 @@
 
 struct memcached_append_prepend_oper_t : public memcached_modify_oper_t {
 
-    memcached_append_prepend_oper_t(counted_t<data_buffer_t> _data, bool _append)
-        : data(_data), append(_append)
+    memcached_append_prepend_oper_t(counted_t<data_buffer_t> _data, bool _append, bool _add_cas)
+        : data(_data), append(_append), add_cas(_add_cas)
     { }
 
     bool operate(transaction_t *txn, scoped_malloc_t<memcached_value_t> *value) {
@@ -22,6 +22,11 @@ struct memcached_append_prepend_oper_t : public memcached_modify_oper_t {
             return false;
         }
 
+        if (add_cas && !(*value)->has_cas()) {
+            // This just makes room; run_memcached_modify_oper() sets the CAS.
+            (*value)->add_cas(txn->get_cache()->get_block_size());
+        }
+
         blob_t b((*value)->value_ref(), blob::btree_maxreflen);
         buffer_group_t buffer_group;
         blob_acq_t acqs;
@@ -54,10 +59,11 @@ struct memcached_append_prepend_oper_t : public memcached_modify_oper_t {
 
     counted_t<data_buffer_t> data;
     bool append;   // true = append, false = prepend
+    bool add_cas;
 };
 
-append_prepend_result_t memcached_append_prepend(const store_key_t &key, btree_slice_t *slice, const counted_t<data_buffer_t>& data, bool append, cas_t proposed_cas, exptime_t effective_time, repli_timestamp_t timestamp, transaction_t *txn, superblock_t *superblock) {
-    memcached_append_prepend_oper_t oper(data, append);
+append_prepend_result_t memcached_append_prepend(const store_key_t &key, btree_slice_t *slice, const counted_t<data_buffer_t>& data, bool append, bool add_cas, cas_t proposed_cas, exptime_t effective_time, repli_timestamp_t timestamp, transaction_t *txn, superblock_t *superblock) {
+    memcached_append_prepend_oper_t oper(data, append, add_cas);
     run_memcached_modify_oper(&oper, slice, key, proposed_cas, effective_time, timestamp, txn, superblock);
     return oper.result;
 }
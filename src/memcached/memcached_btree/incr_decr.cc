@@ -11,8 +11,8 @@
 
 struct memcached_incr_decr_oper_t : public memcached_modify_oper_t {
 
-    memcached_incr_decr_oper_t(bool _increment, uint64_t _delta)
-        : increment(_increment), delta(_delta)
+    memcached_incr_decr_oper_t(bool _increment, uint64_t _delta, cas_t _proposed_cas)
+        : increment(_increment), delta(_delta), proposed_cas(_proposed_cas)
     { }
 
     bool operate(transaction_t *txn, scoped_malloc_t<memcached_value_t> *value) {
@@ -69,6 +69,9 @@ struct memcached_incr_decr_oper_t : public memcached_modify_oper_t {
 
         result.res = incr_decr_result_t::idr_success;
         result.new_value = number;
+        // run_memcached_modify_oper only stores the proposed CAS if the value
+        // already has one.
+        result.new_cas = (*value)->has_cas() ? proposed_cas : 0;
 
         printf_buffer_t tmp("%" PRIu64, number);
         b.clear(txn);
@@ -89,12 +92,13 @@ struct memcached_incr_decr_oper_t : public memcached_modify_oper_t {
 
     bool increment;   // If false, then decrement
     uint64_t delta;   // Amount to increment or decrement by
+    cas_t proposed_cas;
 
     incr_decr_result_t result;
 };
 
 incr_decr_result_t memcached_incr_decr(const store_key_t &key, btree_slice_t *slice, bool increment, uint64_t delta, cas_t proposed_cas, exptime_t effective_time, repli_timestamp_t timestamp, transaction_t *txn, superblock_t *superblock) {
-    memcached_incr_decr_oper_t oper(increment, delta);
+    memcached_incr_decr_oper_t oper(increment, delta, proposed_cas);
     run_memcached_modify_oper(&oper, slice, key, proposed_cas, effective_time, timestamp, txn, superblock);
     return oper.result;
 }
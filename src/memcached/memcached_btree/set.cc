@@ -12,9 +12,10 @@ struct memcached_set_oper_t : public memcached_modify_oper_t {
                          exptime_t _exptime,
                          add_policy_t ap,
                          replace_policy_t rp,
-                         cas_t _req_cas)
+                         cas_t _req_cas,
+                         bool _add_cas)
         : data(_data), mcflags(_mcflags), exptime(_exptime),
-          add_policy(ap), replace_policy(rp), req_cas(_req_cas) { }
+          add_policy(ap), replace_policy(rp), req_cas(_req_cas), add_cas(_add_cas) { }
 
     ~memcached_set_oper_t() { }
 
@@ -67,7 +68,7 @@ struct memcached_set_oper_t : public memcached_modify_oper_t {
 
         {
             scoped_malloc_t<memcached_value_t> tmp(MAX_MEMCACHED_VALUE_SIZE);
-            if ((*value)->has_cas()) {
+            if ((*value)->has_cas() || add_cas) {
                 // run_memcached_modify_oper will set an actual CAS later.
                 metadata_write(&tmp->metadata_flags, tmp->contents, mcflags, exptime, 0xCA5ADDED);
             } else {
@@ -116,6 +117,7 @@ struct memcached_set_oper_t : public memcached_modify_oper_t {
     add_policy_t add_policy;
     replace_policy_t replace_policy;
     cas_t req_cas;
+    bool add_cas;
 
     set_result_t result;
 };
@@ -128,12 +130,13 @@ set_result_t memcached_set(const store_key_t &key,
                            add_policy_t add_policy,
                            replace_policy_t replace_policy,
                            cas_t req_cas,
+                           bool add_cas,
                            cas_t proposed_cas,
                            exptime_t effective_time,
                            repli_timestamp_t timestamp,
                            transaction_t *txn,
                            superblock_t *superblock) {
-    memcached_set_oper_t oper(data, mcflags, exptime, add_policy, replace_policy, req_cas);
+    memcached_set_oper_t oper(data, mcflags, exptime, add_policy, replace_policy, req_cas, add_cas);
     run_memcached_modify_oper(&oper, slice, key, proposed_cas, effective_time, timestamp, txn, superblock);
     return oper.result;
 }
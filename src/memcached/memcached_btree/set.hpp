@@ -16,6 +16,7 @@ set_result_t memcached_set(const store_key_t &key,
                            add_policy_t add_policy,
                            replace_policy_t replace_policy,
                            cas_t req_cas,
+                           bool add_cas,
                            cas_t proposed_cas,
                            exptime_t effective_time,
                            repli_timestamp_t timestamp,
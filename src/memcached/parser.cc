@@ -187,6 +187,14 @@ struct txt_memcached_handler_t : public home_thread_mixin_debug_only_t {
             throw memcached_interface_t::no_more_data_exc_t();
         }
     }
+
+    char peek_byte() THROWS_ONLY(memcached_interface_t::no_more_data_exc_t) {
+        try {
+            return interface->peek_byte(interruptor);
+        } catch (const interrupted_exc_t &) {
+            throw memcached_interface_t::no_more_data_exc_t();
+        }
+    }
 };
 
 class pipeliner_t {
@@ -301,6 +309,34 @@ void do_one_get(txt_memcached_handler_t *rh, bool with_cas, get_t *gets, int i,
     }
 }
 
+/* A plain "get" with several keys reads them all with one `get_multi_query_t`,
+rather than one read (and so one transaction on each shard) per key. */
+void do_multi_get(txt_memcached_handler_t *rh, std::vector<get_t> *gets, order_token_t token) {
+    try {
+        get_multi_query_t get_multi_query;
+        get_multi_query.keys.reserve(gets->size());
+        for (size_t i = 0; i < gets->size(); ++i) {
+            get_multi_query.keys.push_back((*gets)[i].key);
+        }
+        memcached_protocol_t::read_t read(get_multi_query, time(NULL));
+        memcached_protocol_t::read_response_t response;
+        rh->nsi->read(read, &response, token, rh->interruptor);
+        const get_multi_result_t &result = boost::get<get_multi_result_t>(response.result);
+        guarantee(result.results.size() == gets->size());
+        for (size_t i = 0; i < gets->size(); ++i) {
+            (*gets)[i].res = result.results[i].second;
+            (*gets)[i].ok = true;
+        }
+    } catch (const cannot_perform_query_exc_t &e) {
+        for (size_t i = 0; i < gets->size(); ++i) {
+            (*gets)[i].error_message = e.what();
+            (*gets)[i].ok = false;
+        }
+    } catch (const interrupted_exc_t &) {
+        /* do nothing */
+    }
+}
+
 void do_get(txt_memcached_handler_t *rh, pipeliner_t *pipeliner, bool with_cas, int argc, char **argv, order_token_t token) {
     // We should already be spawned within a coroutine.
     pipeliner_acq_t pipeliner_acq(pipeliner);
@@ -336,8 +372,13 @@ void do_get(txt_memcached_handler_t *rh, pipeliner_t *pipeliner, bool with_cas,
 
     block_pm_duration get_timer(&rh->stats->pm_cmd_get);
 
-    /* Now that we're sure they're all valid, send off the requests */
-    pmap(gets.size(), boost::bind(&do_one_get, rh, with_cas, gets.data(), _1, token));
+    /* Now that we're sure they're all valid, send off the requests.  "gets"
+    has to hand out a new CAS for each key, which takes a write per key. */
+    if (with_cas || gets.size() == 1) {
+        pmap(gets.size(), boost::bind(&do_one_get, rh, with_cas, gets.data(), _1, token));
+    } else {
+        do_multi_get(rh, &gets, token);
+    }
 
     if (rh->interruptor->is_pulsed()) {
         pipeliner_acq.begin_write();
@@ -372,7 +413,6 @@ void do_get(txt_memcached_handler_t *rh, pipeliner_t *pipeliner, bool with_cas,
                 if (with_cas) {
                     rh->write_value_header(reinterpret_cast<const char *>(key.contents()), key.size(), res.flags, res.value->size(), res.cas);
                 } else {
-                    guarantee(res.cas == 0);
                     rh->write_value_header(reinterpret_cast<const char *>(key.contents()), key.size(), res.flags, res.value->size());
                 }
 
@@ -623,7 +663,7 @@ void run_storage_command(txt_memcached_handler_t *rh,
 
         try {
             sarc_mutation_t sarc_mutation(key, data, metadata.mcflags, metadata.exptime,
-                add_policy, replace_policy, metadata.unique);
+                add_policy, replace_policy, metadata.unique, false);
             memcached_protocol_t::write_t write(sarc_mutation, rh->generate_cas(), time(NULL));
             memcached_protocol_t::write_response_t result;
             rh->nsi->write(write, &result, token, rh->interruptor);
@@ -682,7 +722,7 @@ void run_storage_command(txt_memcached_handler_t *rh,
         try {
             append_prepend_mutation_t append_prepend_mutation(
                 sc == append_command ? append_prepend_APPEND : append_prepend_PREPEND,
-                key, data);
+                key, data, false);
             memcached_protocol_t::write_t write(append_prepend_mutation, rh->generate_cas(), time(NULL));
             memcached_protocol_t::write_response_t result;
             rh->nsi->write(write, &result, token, rh->interruptor);
@@ -1101,39 +1141,666 @@ void memcached_stats(int argc, char **argv, std::vector<std::string> *stat_respo
     stat_response_lines->push_back(end_marker);
 }
 
-/* Handle memcached, takes a txt_memcached_handler_t and handles the memcached commands that come in on it */
-void handle_memcache(memcached_interface_t *interface,
-        namespace_interface_t<memcached_protocol_t> *nsi,
-        int max_concurrent_queries_per_connection,
-        memcached_stats_t *stats,
-        signal_t *interruptor) {
-    logDBG("Opened memcached stream: %p", coro_t::self());
+/* The binary protocol. Requests and responses are a 24-byte header followed by
+"extras", the key, and the value, in that order; see
+http://code.google.com/p/memcached/wiki/BinaryProtocolRevamped. Values are read off
+the socket straight into the `data_buffer_t` that gets stored, and no line parsing or
+tokenizing is involved. Responses go through the same `pipeliner_t` as text-protocol
+responses, so pipelined requests are answered in order. */
+
+static const uint8_t BINARY_REQUEST_MAGIC = 0x80;
+static const uint8_t BINARY_RESPONSE_MAGIC = 0x81;
+static const size_t BINARY_HEADER_SIZE = 24;
+
+/* Expiration time an incr or decr request sets to mean "don't create the key if it's
+missing". */
+static const exptime_t BINARY_NO_AUTOVIVIFY = 0xffffffff;
+
+enum binary_opcode_t {
+    binary_get = 0x00,
+    binary_set = 0x01,
+    binary_add = 0x02,
+    binary_replace = 0x03,
+    binary_delete = 0x04,
+    binary_increment = 0x05,
+    binary_decrement = 0x06,
+    binary_quit = 0x07,
+    binary_getq = 0x09,
+    binary_noop = 0x0a,
+    binary_version = 0x0b,
+    binary_getk = 0x0c,
+    binary_getkq = 0x0d,
+    binary_append = 0x0e,
+    binary_prepend = 0x0f,
+    binary_setq = 0x11,
+    binary_addq = 0x12,
+    binary_replaceq = 0x13,
+    binary_deleteq = 0x14,
+    binary_incrementq = 0x15,
+    binary_decrementq = 0x16,
+    binary_quitq = 0x17,
+    binary_appendq = 0x19,
+    binary_prependq = 0x1a
+};
 
-    /* This object just exists to group everything together so we don't have to pass a lot of
-    context around. */
-    txt_memcached_handler_t rh(interface, nsi, max_concurrent_queries_per_connection, stats, interruptor);
+enum binary_status_t {
+    binary_no_error = 0x0000,
+    binary_key_not_found = 0x0001,
+    binary_key_exists = 0x0002,
+    binary_value_too_large = 0x0003,
+    binary_invalid_arguments = 0x0004,
+    binary_item_not_stored = 0x0005,
+    binary_non_numeric = 0x0006,
+    binary_unknown_command = 0x0081,
+    binary_internal_error = 0x0084
+};
 
-    /* The commands from each individual memcached handler must be performed in the order
-    that the handler parses them. This `order_source_t` is used to guarantee that. */
-    order_source_t order_source;
+static uint32_t decode_be32(const char *p) {
+    const uint8_t *u = reinterpret_cast<const uint8_t *>(p);
+    return (static_cast<uint32_t>(u[0]) << 24) | (static_cast<uint32_t>(u[1]) << 16)
+        | (static_cast<uint32_t>(u[2]) << 8) | static_cast<uint32_t>(u[3]);
+}
+
+static uint64_t decode_be64(const char *p) {
+    return (static_cast<uint64_t>(decode_be32(p)) << 32) | decode_be32(p + 4);
+}
+
+static uint16_t decode_be16(const char *p) {
+    const uint8_t *u = reinterpret_cast<const uint8_t *>(p);
+    return (static_cast<uint16_t>(u[0]) << 8) | u[1];
+}
+
+static void encode_be16(uint16_t x, char *p) {
+    p[0] = x >> 8;
+    p[1] = x;
+}
+
+static void encode_be32(uint32_t x, char *p) {
+    encode_be16(x >> 16, p);
+    encode_be16(x, p + 2);
+}
+
+static void encode_be64(uint64_t x, char *p) {
+    encode_be32(x >> 32, p);
+    encode_be32(x, p + 4);
+}
+
+struct binary_request_t {
+    /* The opcode as it was sent; `command` is the same with quiet variants mapped to
+    their loud counterparts, and `quiet` says which it was. */
+    uint8_t opcode;
+    binary_opcode_t command;
+    bool quiet;
+
+    uint32_t opaque;
+    cas_t cas;
+    store_key_t key;
+
+    /* Storage commands */
+    mcflags_t mcflags;
+    exptime_t exptime;
+    counted_t<data_buffer_t> value;
+
+    /* "incr" and "decr" */
+    uint64_t delta;
+    uint64_t initial;
+
+    binary_request_t()
+        : opcode(0), command(binary_noop), quiet(false), opaque(0), cas(0),
+          mcflags(0), exptime(0), delta(0), initial(0) { }
+};
+
+/* Returns false if `opcode` isn't one we know about. */
+static bool binary_parse_opcode(uint8_t opcode, binary_opcode_t *command_out, bool *quiet_out) {
+    *quiet_out = true;
+    switch (opcode) {
+    case binary_getq: *command_out = binary_get; return true;
+    case binary_getkq: *command_out = binary_getk; return true;
+    case binary_setq: *command_out = binary_set; return true;
+    case binary_addq: *command_out = binary_add; return true;
+    case binary_replaceq: *command_out = binary_replace; return true;
+    case binary_deleteq: *command_out = binary_delete; return true;
+    case binary_incrementq: *command_out = binary_increment; return true;
+    case binary_decrementq: *command_out = binary_decrement; return true;
+    case binary_quitq: *command_out = binary_quit; return true;
+    case binary_appendq: *command_out = binary_append; return true;
+    case binary_prependq: *command_out = binary_prepend; return true;
+    default: break;
+    }
+
+    *quiet_out = false;
+    switch (opcode) {
+    case binary_get:
+    case binary_getk:
+    case binary_set:
+    case binary_add:
+    case binary_replace:
+    case binary_delete:
+    case binary_increment:
+    case binary_decrement:
+    case binary_quit:
+    case binary_noop:
+    case binary_version:
+    case binary_append:
+    case binary_prepend:
+        *command_out = static_cast<binary_opcode_t>(opcode);
+        return true;
+    default:
+        return false;
+    }
+}
+
+void write_binary_header(txt_memcached_handler_t *rh, const binary_request_t &req, binary_status_t status,
+                         size_t extras_size, size_t key_size, size_t value_size, cas_t cas) THROWS_NOTHING {
+    char header[BINARY_HEADER_SIZE];
+    header[0] = BINARY_RESPONSE_MAGIC;
+    header[1] = req.opcode;
+    encode_be16(key_size, header + 2);
+    header[4] = extras_size;
+    header[5] = 0;  // Data type
+    encode_be16(status, header + 6);
+    encode_be32(extras_size + key_size + value_size, header + 8);
+    encode_be32(req.opaque, header + 12);
+    encode_be64(cas, header + 16);
+    rh->write(header, BINARY_HEADER_SIZE);
+}
+
+void write_binary_error(txt_memcached_handler_t *rh, const binary_request_t &req, binary_status_t status,
+                        const std::string &message) THROWS_NOTHING {
+    write_binary_header(rh, req, status, 0, 0, message.size(), 0);
+    rh->write(message);
+}
+
+void write_binary_error(txt_memcached_handler_t *rh, const binary_request_t &req, binary_status_t status) THROWS_NOTHING {
+    const char *message;
+    switch (status) {
+    case binary_key_not_found: message = "Not found"; break;
+    case binary_key_exists: message = "Data exists for key."; break;
+    case binary_value_too_large: message = "Too large."; break;
+    case binary_invalid_arguments: message = "Invalid arguments"; break;
+    case binary_item_not_stored: message = "Not stored."; break;
+    case binary_non_numeric: message = "Non-numeric server-side value for incr or decr"; break;
+    case binary_unknown_command: message = "Unknown command"; break;
+    case binary_no_error:
+    case binary_internal_error:
+    default: unreachable();
+    }
+    write_binary_error(rh, req, status, message);
+}
+
+/* Writes the response to a successful storage, delete, incr, or decr request,
+unless the request was quiet. */
+void write_binary_success(txt_memcached_handler_t *rh, const binary_request_t &req, cas_t cas) THROWS_NOTHING {
+    if (!req.quiet) {
+        write_binary_header(rh, req, binary_no_error, 0, 0, 0, cas);
+    }
+}
+
+void run_binary_get(txt_memcached_handler_t *rh, pipeliner_acq_t *pipeliner_acq, const binary_request_t &req, order_token_t token) {
+    block_pm_duration get_timer(&rh->stats->pm_cmd_get);
+
+    get_result_t res;
+    std::string error_message;
+    bool ok;
 
+    try {
+        get_query_t get_query(req.key);
+        memcached_protocol_t::read_t read(get_query, time(NULL));
+        memcached_protocol_t::read_response_t response;
+        rh->nsi->read(read, &response, token, rh->interruptor);
+        res = boost::get<get_result_t>(response.result);
+
+        /* Binary responses always carry a CAS, which the client may use for a
+        check-and-set.  Values stored through the binary protocol already have
+        one; others (stored by the text protocol) are given one the first time
+        they're read this way, as the text protocol's "gets" does. */
+        if (res.value.has() && res.cas == 0) {
+            get_cas_mutation_t get_cas_mutation(req.key);
+            memcached_protocol_t::write_t write(get_cas_mutation, rh->generate_cas(), time(NULL));
+            memcached_protocol_t::write_response_t write_response;
+            rh->nsi->write(write, &write_response, token, rh->interruptor);
+            res = boost::get<get_result_t>(write_response.result);
+        }
+        ok = true;
+    } catch (const cannot_perform_query_exc_t &e) {
+        error_message = e.what();
+        ok = false;
+    } catch (const interrupted_exc_t &) {
+        pipeliner_acq->begin_write();
+        pipeliner_acq->end_write();
+        return;
+    }
+
+    pipeliner_acq->begin_write();
+
+    const bool with_key = req.command == binary_getk;
+    if (!ok) {
+        write_binary_error(rh, req, binary_internal_error, error_message);
+    } else if (res.value.has()) {
+        char extras[4];
+        encode_be32(res.flags, extras);
+        const size_t key_size = with_key ? req.key.size() : 0;
+        write_binary_header(rh, req, binary_no_error, sizeof(extras), key_size, res.value->size(), res.cas);
+        rh->write(extras, sizeof(extras));
+        rh->write(reinterpret_cast<const char *>(req.key.contents()), key_size);
+        rh->write_from_data_provider(res.value.get());
+    } else if (!req.quiet) {
+        if (with_key) {
+            write_binary_header(rh, req, binary_key_not_found, 0, req.key.size(), 0, 0);
+            rh->write(reinterpret_cast<const char *>(req.key.contents()), req.key.size());
+        } else {
+            write_binary_error(rh, req, binary_key_not_found);
+        }
+    }
+
+    pipeliner_acq->end_write();
+}
+
+void run_binary_storage(txt_memcached_handler_t *rh, pipeliner_acq_t *pipeliner_acq, const binary_request_t &req, order_token_t token) {
+    block_pm_duration set_timer(&rh->stats->pm_cmd_set);
+
+    const cas_t proposed_cas = rh->generate_cas();
+    memcached_protocol_t::write_response_t result;
+    std::string error_message;
+    bool ok;
+
+    try {
+        if (req.command == binary_append || req.command == binary_prepend) {
+            append_prepend_mutation_t append_prepend_mutation(
+                req.command == binary_append ? append_prepend_APPEND : append_prepend_PREPEND,
+                req.key, req.value, true);
+            memcached_protocol_t::write_t write(append_prepend_mutation, proposed_cas, time(NULL));
+            rh->nsi->write(write, &result, token, rh->interruptor);
+        } else {
+            /* A non-zero CAS makes a "set" or "replace" behave like the text
+            protocol's "cas". */
+            add_policy_t add_policy = req.command == binary_replace ? add_policy_no : add_policy_yes;
+            replace_policy_t replace_policy = req.command == binary_add ? replace_policy_no : replace_policy_yes;
+            cas_t unique = NO_CAS_SUPPLIED;
+            if (req.cas != 0 && req.command != binary_add) {
+                add_policy = add_policy_no;
+                replace_policy = replace_policy_if_cas_matches;
+                unique = req.cas;
+            }
+            sarc_mutation_t sarc_mutation(req.key, req.value, req.mcflags, req.exptime,
+                add_policy, replace_policy, unique, true);
+            memcached_protocol_t::write_t write(sarc_mutation, proposed_cas, time(NULL));
+            rh->nsi->write(write, &result, token, rh->interruptor);
+        }
+        ok = true;
+    } catch (const cannot_perform_query_exc_t &e) {
+        error_message = e.what();
+        ok = false;
+    } catch (const interrupted_exc_t &) {
+        pipeliner_acq->begin_write();
+        pipeliner_acq->end_write();
+        return;
+    }
+
+    pipeliner_acq->begin_write();
+
+    if (!ok) {
+        write_binary_error(rh, req, binary_internal_error, error_message);
+    } else if (const set_result_t *res = boost::get<set_result_t>(&result.result)) {
+        switch (*res) {
+        case sr_stored: write_binary_success(rh, req, proposed_cas); break;
+        case sr_didnt_add: write_binary_error(rh, req, binary_key_not_found); break;
+        case sr_didnt_replace: write_binary_error(rh, req, binary_key_exists); break;
+        case sr_too_large: write_binary_error(rh, req, binary_value_too_large); break;
+        default: unreachable();
+        }
+    } else {
+        switch (boost::get<append_prepend_result_t>(result.result)) {
+        case apr_success: write_binary_success(rh, req, proposed_cas); break;
+        case apr_not_found: write_binary_error(rh, req, binary_item_not_stored); break;
+        case apr_too_large: write_binary_error(rh, req, binary_value_too_large); break;
+        default: unreachable();
+        }
+    }
+
+    pipeliner_acq->end_write();
+}
+
+void run_binary_delete(txt_memcached_handler_t *rh, pipeliner_acq_t *pipeliner_acq, const binary_request_t &req, order_token_t token) {
+    block_pm_duration set_timer(&rh->stats->pm_cmd_set);
+
+    delete_result_t res = delete_result_t(-1);
+    std::string error_message;
+    bool ok;
+
+    try {
+        delete_mutation_t delete_mutation(req.key, false);
+        memcached_protocol_t::write_t write(delete_mutation, INVALID_CAS, time(NULL));
+        memcached_protocol_t::write_response_t result;
+        rh->nsi->write(write, &result, token, rh->interruptor);
+        res = boost::get<delete_result_t>(result.result);
+        ok = true;
+    } catch (const cannot_perform_query_exc_t &e) {
+        error_message = e.what();
+        ok = false;
+    } catch (const interrupted_exc_t &) {
+        pipeliner_acq->begin_write();
+        pipeliner_acq->end_write();
+        return;
+    }
+
+    pipeliner_acq->begin_write();
+
+    if (!ok) {
+        write_binary_error(rh, req, binary_internal_error, error_message);
+    } else {
+        switch (res) {
+        case dr_deleted: write_binary_success(rh, req, 0); break;
+        case dr_not_found: write_binary_error(rh, req, binary_key_not_found); break;
+        default: unreachable();
+        }
+    }
+
+    pipeliner_acq->end_write();
+}
+
+void run_binary_incr_decr(txt_memcached_handler_t *rh, pipeliner_acq_t *pipeliner_acq, const binary_request_t &req, order_token_t token) {
+    block_pm_duration set_timer(&rh->stats->pm_cmd_set);
+
+    const cas_t proposed_cas = rh->generate_cas();
+    incr_decr_result_t res;
+    std::string error_message;
+    bool ok;
+
+    try {
+        /* Unlike the text protocol, a binary incr or decr of a missing key
+        creates it with the request's initial value, unless told not to.  If
+        someone else creates the key first, the incr or decr is tried again. */
+        for (;;) {
+            incr_decr_mutation_t incr_decr_mutation(
+                req.command == binary_increment ? incr_decr_INCR : incr_decr_DECR,
+                req.key, req.delta);
+            memcached_protocol_t::write_t write(incr_decr_mutation, proposed_cas, time(NULL));
+            memcached_protocol_t::write_response_t result;
+            rh->nsi->write(write, &result, token, rh->interruptor);
+            res = boost::get<incr_decr_result_t>(result.result);
+
+            if (res.res != incr_decr_result_t::idr_not_found || req.exptime == BINARY_NO_AUTOVIVIFY) {
+                break;
+            }
+
+            const std::string initial = strprintf("%" PRIu64, req.initial);
+            counted_t<data_buffer_t> value = data_buffer_t::create(initial.size());
+            memcpy(value->buf(), initial.data(), initial.size());
+            sarc_mutation_t sarc_mutation(req.key, value, 0, req.exptime,
+                add_policy_yes, replace_policy_no, NO_CAS_SUPPLIED, true);
+            memcached_protocol_t::write_t add(sarc_mutation, proposed_cas, time(NULL));
+            memcached_protocol_t::write_response_t add_result;
+            rh->nsi->write(add, &add_result, token, rh->interruptor);
+            if (boost::get<set_result_t>(add_result.result) == sr_stored) {
+                res = incr_decr_result_t(incr_decr_result_t::idr_success, req.initial, proposed_cas);
+                break;
+            }
+        }
+        ok = true;
+    } catch (const cannot_perform_query_exc_t &e) {
+        error_message = e.what();
+        ok = false;
+    } catch (const interrupted_exc_t &) {
+        pipeliner_acq->begin_write();
+        pipeliner_acq->end_write();
+        return;
+    }
+
+    pipeliner_acq->begin_write();
+
+    if (!ok) {
+        write_binary_error(rh, req, binary_internal_error, error_message);
+    } else {
+        switch (res.res) {
+        case incr_decr_result_t::idr_success:
+            if (!req.quiet) {
+                char value[8];
+                encode_be64(res.new_value, value);
+                write_binary_header(rh, req, binary_no_error, 0, 0, sizeof(value), res.new_cas);
+                rh->write(value, sizeof(value));
+            }
+            break;
+        case incr_decr_result_t::idr_not_found:
+            write_binary_error(rh, req, binary_key_not_found);
+            break;
+        case incr_decr_result_t::idr_not_numeric:
+            write_binary_error(rh, req, binary_non_numeric);
+            break;
+        default: unreachable();
+        }
+    }
+
+    pipeliner_acq->end_write();
+}
+
+void run_binary_command(txt_memcached_handler_t *rh, pipeliner_acq_t *pipeliner_acq_raw, const binary_request_t &req, order_token_t token) {
+    scoped_ptr_t<pipeliner_acq_t> pipeliner_acq(pipeliner_acq_raw);
+
+    switch (req.command) {
+    case binary_get:
+    case binary_getk:
+        run_binary_get(rh, pipeliner_acq.get(), req, token.with_read_mode());
+        break;
+    case binary_set:
+    case binary_add:
+    case binary_replace:
+    case binary_append:
+    case binary_prepend:
+        run_binary_storage(rh, pipeliner_acq.get(), req, token);
+        break;
+    case binary_delete:
+        run_binary_delete(rh, pipeliner_acq.get(), req, token);
+        break;
+    case binary_increment:
+    case binary_decrement:
+        run_binary_incr_decr(rh, pipeliner_acq.get(), req, token);
+        break;
+    case binary_quit:
+    case binary_noop:
+    case binary_version:
+    case binary_getq:
+    case binary_getkq:
+    case binary_setq:
+    case binary_addq:
+    case binary_replaceq:
+    case binary_deleteq:
+    case binary_incrementq:
+    case binary_decrementq:
+    case binary_quitq:
+    case binary_appendq:
+    case binary_prependq:
+    default:
+        unreachable();
+    }
+}
+
+/* Checks the sizes of the parts of a request's body against what its command
+expects. */
+static bool binary_request_is_valid(binary_opcode_t command, size_t extras_size, size_t key_size, size_t value_size) {
+    switch (command) {
+    case binary_get:
+    case binary_getk:
+    case binary_delete:
+        return extras_size == 0 && key_size > 0 && value_size == 0;
+    case binary_set:
+    case binary_add:
+    case binary_replace:
+        return extras_size == 8 && key_size > 0;
+    case binary_append:
+    case binary_prepend:
+        return extras_size == 0 && key_size > 0;
+    case binary_increment:
+    case binary_decrement:
+        return extras_size == 20 && key_size > 0 && value_size == 0;
+    case binary_quit:
+    case binary_noop:
+    case binary_version:
+        return extras_size == 0 && key_size == 0 && value_size == 0;
+    case binary_getq:
+    case binary_getkq:
+    case binary_setq:
+    case binary_addq:
+    case binary_replaceq:
+    case binary_deleteq:
+    case binary_incrementq:
+    case binary_decrementq:
+    case binary_quitq:
+    case binary_appendq:
+    case binary_prependq:
+    default:
+        unreachable();
+    }
+}
+
+static void binary_discard(txt_memcached_handler_t *rh, size_t size) THROWS_ONLY(memcached_interface_t::no_more_data_exc_t) {
+    char buffer[4 * KILOBYTE];
+    while (size > 0) {
+        const size_t chunk = std::min(size, sizeof(buffer));
+        rh->read(buffer, chunk);
+        size -= chunk;
+    }
+}
+
+/* Handles binary-protocol requests until the client goes away or sends something
+we can't make sense of. */
+void handle_binary_memcache(txt_memcached_handler_t *rh, pipeliner_t *pipeliner, order_source_t *order_source) {
+    /* Declared outside the while-loop so it doesn't repeatedly reallocate its buffer */
+    std::vector<char> extras_and_key;
+
+    while (pipeliner->lock_argparsing(), !rh->interruptor->is_pulsed()) {
+        block_pm_duration read_timer(&rh->stats->pm_conns_reading);
+        char header[BINARY_HEADER_SIZE];
+        try {
+            rh->read(header, BINARY_HEADER_SIZE);
+        } catch (const memcached_interface_t::no_more_data_exc_t &) {
+            break;
+        }
+        read_timer.end();
+
+        block_pm_duration action_timer(&rh->stats->pm_conns_acting);
+
+        scoped_ptr_t<pipeliner_acq_t> pipeliner_acq(new pipeliner_acq_t(pipeliner));
+
+        binary_request_t req;
+        req.opcode = header[1];
+        req.opaque = decode_be32(header + 12);
+        req.cas = decode_be64(header + 16);
+        const size_t key_size = decode_be16(header + 2);
+        const size_t extras_size = static_cast<uint8_t>(header[4]);
+        const size_t body_size = decode_be32(header + 8);
+
+        if (static_cast<uint8_t>(header[0]) != BINARY_REQUEST_MAGIC || extras_size + key_size > body_size) {
+            /* We can't tell where the next request starts, so there's nothing to
+            do but hang up. */
+            pipeliner_acq->done_argparsing();
+            pipeliner_acq->begin_write();
+            pipeliner_acq->end_write();
+            break;
+        }
+        const size_t value_size = body_size - extras_size - key_size;
+
+        binary_status_t status = binary_no_error;
+        try {
+            extras_and_key.resize(extras_size + key_size);
+            rh->read(extras_and_key.data(), extras_and_key.size());
+            const char *extras = extras_and_key.data();
+
+            if (!binary_parse_opcode(req.opcode, &req.command, &req.quiet)) {
+                status = binary_unknown_command;
+            } else if (!binary_request_is_valid(req.command, extras_size, key_size, value_size)
+                       || key_size > MAX_KEY_SIZE) {
+                status = binary_invalid_arguments;
+            } else if (value_size > MAX_VALUE_SIZE) {
+                status = binary_value_too_large;
+            }
+
+            if (status != binary_no_error) {
+                binary_discard(rh, value_size);
+            } else {
+                req.key = store_key_t(key_size, reinterpret_cast<const uint8_t *>(extras + extras_size));
+                if (extras_size == 8) {
+                    req.mcflags = decode_be32(extras);
+                    req.exptime = decode_be32(extras + 4);
+                } else if (extras_size == 20) {
+                    req.delta = decode_be64(extras);
+                    req.initial = decode_be64(extras + 8);
+                    req.exptime = decode_be32(extras + 16);
+                }
+                if (req.command == binary_set || req.command == binary_add || req.command == binary_replace
+                    || req.command == binary_append || req.command == binary_prepend) {
+                    req.value = data_buffer_t::create(value_size);
+                    rh->read(req.value->buf(), value_size);
+                    rh->stats->pm_storage_key_size.record(key_size);
+                    rh->stats->pm_storage_value_size.record(value_size);
+                } else if (req.command == binary_get || req.command == binary_getk) {
+                    rh->stats->pm_get_key_size.record(key_size);
+                } else if (req.command == binary_delete) {
+                    rh->stats->pm_delete_key_size.record(key_size);
+                }
+            }
+        } catch (const memcached_interface_t::no_more_data_exc_t &) {
+            pipeliner_acq->done_argparsing();
+            pipeliner_acq->begin_write();
+            pipeliner_acq->end_write();
+            break;
+        }
+
+        /* Calculate the expiration time the same way the text protocol does */
+        if (req.exptime <= 60*60*24*30 && req.exptime > 0) {
+            req.exptime += time(NULL);
+        }
+
+        pipeliner_acq->done_argparsing();
+
+        if (status != binary_no_error) {
+            pipeliner_acq->begin_write();
+            write_binary_error(rh, req, status);
+            pipeliner_acq->end_write();
+        } else if (req.command == binary_quit) {
+            pipeliner_acq->begin_write();
+            write_binary_success(rh, req, 0);
+            pipeliner_acq->end_write();
+            break;
+        } else if (req.command == binary_noop) {
+            /* Clients send this after a run of quiet requests to find out when
+            they're all done, which the pipeliner takes care of. */
+            pipeliner_acq->begin_write();
+            write_binary_header(rh, req, binary_no_error, 0, 0, 0, 0);
+            pipeliner_acq->end_write();
+        } else if (req.command == binary_version) {
+            const std::string version = strprintf("rethinkdb-%s", RETHINKDB_VERSION);
+            pipeliner_acq->begin_write();
+            write_binary_header(rh, req, binary_no_error, 0, 0, version.size(), 0);
+            rh->write(version);
+            pipeliner_acq->end_write();
+        } else {
+            order_token_t token = order_source->check_in("handle_binary_memcache");
+            coro_t::spawn_now_dangerously(boost::bind(&run_binary_command, rh, pipeliner_acq.release(), req, token));
+        }
+
+        action_timer.end();
+    }
+}
+
+/* Handles text-protocol requests until the client quits, goes away, or the
+connection is interrupted. */
+void handle_text_memcache(txt_memcached_handler_t *rh, pipeliner_t *pipeliner, order_source_t *order_source) {
     /* Declared outside the while-loop so it doesn't repeatedly reallocate its buffer */
     std::vector<char> line;
     std::vector<char*> args;
 
-    pipeliner_t pipeliner(&rh);
-
-    while (pipeliner.lock_argparsing(), !interruptor->is_pulsed()) {
+    while (pipeliner->lock_argparsing(), !rh->interruptor->is_pulsed()) {
         /* Read a line off the socket */
-        block_pm_duration read_timer(&rh.stats->pm_conns_reading);
+        block_pm_duration read_timer(&rh->stats->pm_conns_reading);
         try {
-            rh.read_line(&line);
+            rh->read_line(&line);
         } catch (const memcached_interface_t::no_more_data_exc_t &) {
             break;
         }
         read_timer.end();
 
-        block_pm_duration action_timer(&rh.stats->pm_conns_acting);
+        block_pm_duration action_timer(&rh->stats->pm_conns_acting);
 
         /* Tokenize the line */
         line.push_back('\0');   // Null terminator
@@ -1145,55 +1812,55 @@ void handle_memcache(memcached_interface_t *interface,
         }
 
         if (args.empty()) {
-            pipeliner_acq_t pipeliner_acq(&pipeliner);
+            pipeliner_acq_t pipeliner_acq(pipeliner);
             pipeliner_acq.done_argparsing();
             pipeliner_acq.begin_write();
-            rh.error();
+            rh->error();
             pipeliner_acq.end_write();
             continue;
         }
 
         /* Dispatch to the appropriate subclass */
-        order_token_t token = order_source.check_in(std::string("handle_memcache+") + args[0]);
+        order_token_t token = order_source->check_in(std::string("handle_memcache+") + args[0]);
         if (!strcmp(args[0], "get")) {    // check for retrieval commands
-            coro_t::spawn_now_dangerously(boost::bind(do_get, &rh, &pipeliner, false, args.size(), args.data(), token.with_read_mode()));
+            coro_t::spawn_now_dangerously(boost::bind(do_get, rh, pipeliner, false, args.size(), args.data(), token.with_read_mode()));
         } else if (!strcmp(args[0], "gets")) {
-            coro_t::spawn_now_dangerously(boost::bind(do_get, &rh, &pipeliner, true, args.size(), args.data(), token));
+            coro_t::spawn_now_dangerously(boost::bind(do_get, rh, pipeliner, true, args.size(), args.data(), token));
         } else if (!strcmp(args[0], "rget")) {
-            coro_t::spawn_now_dangerously(boost::bind(do_rget, &rh, &pipeliner, &order_source, args.size(), args.data()));
+            coro_t::spawn_now_dangerously(boost::bind(do_rget, rh, pipeliner, order_source, args.size(), args.data()));
         } else if (!strcmp(args[0], "set")) {     // check for storage commands
-            do_storage(&rh, &pipeliner, set_command, args.size(), args.data(), token);
+            do_storage(rh, pipeliner, set_command, args.size(), args.data(), token);
         } else if (!strcmp(args[0], "add")) {
-            do_storage(&rh, &pipeliner, add_command, args.size(), args.data(), token);
+            do_storage(rh, pipeliner, add_command, args.size(), args.data(), token);
         } else if (!strcmp(args[0], "replace")) {
-            do_storage(&rh, &pipeliner, replace_command, args.size(), args.data(), token);
+            do_storage(rh, pipeliner, replace_command, args.size(), args.data(), token);
         } else if (!strcmp(args[0], "append")) {
-            do_storage(&rh, &pipeliner, append_command, args.size(), args.data(), token);
+            do_storage(rh, pipeliner, append_command, args.size(), args.data(), token);
         } else if (!strcmp(args[0], "prepend")) {
-            do_storage(&rh, &pipeliner, prepend_command, args.size(), args.data(), token);
+            do_storage(rh, pipeliner, prepend_command, args.size(), args.data(), token);
         } else if (!strcmp(args[0], "cas")) {
-            do_storage(&rh, &pipeliner, cas_command, args.size(), args.data(), token);
+            do_storage(rh, pipeliner, cas_command, args.size(), args.data(), token);
         } else if (!strcmp(args[0], "delete")) {
-            coro_t::spawn_now_dangerously(boost::bind(do_delete, &rh, &pipeliner, args.size(), args.data(), token));
+            coro_t::spawn_now_dangerously(boost::bind(do_delete, rh, pipeliner, args.size(), args.data(), token));
         } else if (!strcmp(args[0], "incr")) {
-            coro_t::spawn_now_dangerously(boost::bind(do_incr_decr, &rh, &pipeliner, true, args.size(), args.data(), token));
+            coro_t::spawn_now_dangerously(boost::bind(do_incr_decr, rh, pipeliner, true, args.size(), args.data(), token));
         } else if (!strcmp(args[0], "decr")) {
-            coro_t::spawn_now_dangerously(boost::bind(do_incr_decr, &rh, &pipeliner, false, args.size(), args.data(), token));
+            coro_t::spawn_now_dangerously(boost::bind(do_incr_decr, rh, pipeliner, false, args.size(), args.data(), token));
         } else if (!strcmp(args[0], "quit")) {
             // Make sure there's no more tokens (the kind in args, not
             // order tokens)
             if (args.size() > 1) {
-                pipeliner_acq_t pipeliner_acq(&pipeliner);
+                pipeliner_acq_t pipeliner_acq(pipeliner);
                 // We block everybody, but who cares?
                 pipeliner_acq.done_argparsing();
                 pipeliner_acq.begin_write();
-                rh.error();
+                rh->error();
                 pipeliner_acq.end_write();
             } else {
                 break;
             }
         } else if (!strcmp(args[0], "stats") || !strcmp(args[0], "stat")) {
-            pipeliner_acq_t pipeliner_acq(&pipeliner);
+            pipeliner_acq_t pipeliner_acq(pipeliner);
 
             std::vector<std::string> stat_response_lines;
             memcached_stats(args.size(), args.data(), &stat_response_lines);
@@ -1202,30 +1869,64 @@ void handle_memcache(memcached_interface_t *interface,
             pipeliner_acq.done_argparsing();
             pipeliner_acq.begin_write();
             for (std::vector<std::string>::const_iterator i = stat_response_lines.begin(); i != stat_response_lines.end(); ++i) {
-                rh.write(*i);
+                rh->write(*i);
             }
             pipeliner_acq.end_write();
         } else if (!strcmp(args[0], "version")) {
-            pipeliner_acq_t pipeliner_acq(&pipeliner);
+            pipeliner_acq_t pipeliner_acq(pipeliner);
 
             pipeliner_acq.done_argparsing();
             pipeliner_acq.begin_write();
             if (args.size() == 1) {
-                rh.writef("VERSION rethinkdb-%s\r\n", RETHINKDB_VERSION);
+                rh->writef("VERSION rethinkdb-%s\r\n", RETHINKDB_VERSION);
             } else {
-                rh.error();
+                rh->error();
             }
             pipeliner_acq.end_write();
         } else {
-            pipeliner_acq_t pipeliner_acq(&pipeliner);
+            pipeliner_acq_t pipeliner_acq(pipeliner);
             pipeliner_acq.done_argparsing();
             pipeliner_acq.begin_write();
-            rh.error();
+            rh->error();
             pipeliner_acq.end_write();
         }
 
         action_timer.end();
     }
+}
+
+/* Handle memcached, takes a txt_memcached_handler_t and handles the memcached commands that come in on it */
+void handle_memcache(memcached_interface_t *interface,
+        namespace_interface_t<memcached_protocol_t> *nsi,
+        int max_concurrent_queries_per_connection,
+        memcached_stats_t *stats,
+        signal_t *interruptor) {
+    logDBG("Opened memcached stream: %p", coro_t::self());
+
+    /* This object just exists to group everything together so we don't have to pass a lot of
+    context around. */
+    txt_memcached_handler_t rh(interface, nsi, max_concurrent_queries_per_connection, stats, interruptor);
+
+    /* The commands from each individual memcached handler must be performed in the order
+    that the handler parses them. This `order_source_t` is used to guarantee that. */
+    order_source_t order_source;
+
+    pipeliner_t pipeliner(&rh);
+
+    /* Binary-protocol requests all start with a magic byte that no text-protocol
+    command starts with. */
+    bool binary;
+    try {
+        binary = static_cast<uint8_t>(rh.peek_byte()) == BINARY_REQUEST_MAGIC;
+    } catch (const memcached_interface_t::no_more_data_exc_t &) {
+        binary = false;
+    }
+
+    if (binary) {
+        handle_binary_memcache(&rh, &pipeliner, &order_source);
+    } else {
+        handle_text_memcache(&rh, &pipeliner, &order_source);
+    }
 
     // Make sure anything that would be running has finished.
     pipeliner_acq_t pipeliner_acq(&pipeliner);
@@ -5,6 +5,8 @@
 #include <boost/variant.hpp>
 #include <boost/bind.hpp>
 
+#include "btree/backfill.hpp"
+#include "btree/get_distribution.hpp"
 #include "btree/operations.hpp"
 #include "btree/parallel_traversal.hpp"
 #include "btree/slice.hpp"
@@ -77,18 +79,20 @@ archive_result_t deserialize(read_stream_t *s, counted_t<data_buffer_t> *buf) {
 }
 
 RDB_IMPL_SERIALIZABLE_1(get_query_t, key);
+RDB_IMPL_SERIALIZABLE_1(get_multi_query_t, keys);
 RDB_IMPL_SERIALIZABLE_2(rget_query_t, region, maximum);
 RDB_IMPL_SERIALIZABLE_3(distribution_get_query_t, max_depth, result_limit, region);
 RDB_IMPL_SERIALIZABLE_3(get_result_t, value, flags, cas);
+RDB_IMPL_SERIALIZABLE_1(get_multi_result_t, results);
 RDB_IMPL_SERIALIZABLE_3(key_with_data_buffer_t, key, mcflags, value_provider);
 RDB_IMPL_SERIALIZABLE_2(rget_result_t, pairs, truncated);
 RDB_IMPL_SERIALIZABLE_2(distribution_result_t, region, key_counts);
 RDB_IMPL_SERIALIZABLE_1(get_cas_mutation_t, key);
-RDB_IMPL_SERIALIZABLE_7(sarc_mutation_t, key, data, flags, exptime, add_policy, replace_policy, old_cas);
+RDB_IMPL_SERIALIZABLE_8(sarc_mutation_t, key, data, flags, exptime, add_policy, replace_policy, old_cas, add_cas);
 RDB_IMPL_SERIALIZABLE_2(delete_mutation_t, key, dont_put_in_delete_queue);
 RDB_IMPL_SERIALIZABLE_3(incr_decr_mutation_t, kind, key, amount);
-RDB_IMPL_SERIALIZABLE_2(incr_decr_result_t, res, new_value);
-RDB_IMPL_SERIALIZABLE_3(append_prepend_mutation_t, kind, key, data);
+RDB_IMPL_SERIALIZABLE_3(incr_decr_result_t, res, new_value, new_cas);
+RDB_IMPL_SERIALIZABLE_4(append_prepend_mutation_t, kind, key, data, add_cas);
 RDB_IMPL_SERIALIZABLE_6(backfill_atom_t, key, value, flags, exptime, recency, cas_or_zero);
 
 RDB_IMPL_SERIALIZABLE_1(memcached_protocol_t::read_response_t, result);
@@ -117,6 +121,24 @@ struct read_get_region_visitor_t : public boost::static_visitor<region_t> {
     region_t operator()(get_query_t get) {
         return monokey_region(get.key);
     }
+    region_t operator()(const get_multi_query_t &get_multi) {
+        // The smallest region with all of the keys in it.  Shards that turn
+        // out to have none of them are left out by `read_t::shard()`.
+        guarantee(!get_multi.keys.empty());
+        region_t region = monokey_region(get_multi.keys[0]);
+        for (size_t i = 1; i < get_multi.keys.size(); ++i) {
+            const region_t key_region = monokey_region(get_multi.keys[i]);
+            region.beg = std::min(region.beg, key_region.beg);
+            region.end = std::max(region.end, key_region.end);
+            if (key_region.inner.left < region.inner.left) {
+                region.inner.left = key_region.inner.left;
+            }
+            if (region.inner.right < key_region.inner.right) {
+                region.inner.right = key_region.inner.right;
+            }
+        }
+        return region;
+    }
     region_t operator()(rget_query_t rget) {
         return rget.region;
     }
@@ -149,6 +171,21 @@ struct read_shard_visitor_t : public boost::static_visitor<bool> {
         return ret;
     }
 
+    bool operator()(const get_multi_query_t &get_multi) const {
+        get_multi_query_t tmp;
+        for (size_t i = 0; i < get_multi.keys.size(); ++i) {
+            if (region_contains_key(*region, get_multi.keys[i])) {
+                tmp.keys.push_back(get_multi.keys[i]);
+            }
+        }
+        if (!tmp.keys.empty()) {
+            *read_out = read_t(tmp, effective_time);
+            return true;
+        } else {
+            return false;
+        }
+    }
+
     template <class T>
     bool rangey_query(const T &arg) const {
         const hash_region_t<key_range_t> intersection
@@ -237,6 +274,28 @@ struct read_unshard_visitor_t : public boost::static_visitor<read_response_t> {
         guarantee(count == 1);
         return read_response_t(boost::get<get_result_t>(bits[0].result));
     }
+    read_response_t operator()(const get_multi_query_t &get_multi) {
+        // Each shard answers for its own keys; put them back in the order the
+        // keys were asked for in.
+        std::map<store_key_t, const get_result_t *> found;
+        for (size_t i = 0; i < count; ++i) {
+            const get_multi_result_t *bit = boost::get<get_multi_result_t>(&bits[i].result);
+            guarantee(bit, "Bad boost::get\n");
+            for (size_t j = 0; j < bit->results.size(); ++j) {
+                found[bit->results[j].first] = &bit->results[j].second;
+            }
+        }
+
+        get_multi_result_t result;
+        result.results.reserve(get_multi.keys.size());
+        for (size_t i = 0; i < get_multi.keys.size(); ++i) {
+            std::map<store_key_t, const get_result_t *>::const_iterator it
+                = found.find(get_multi.keys[i]);
+            guarantee(it != found.end());
+            result.results.push_back(std::make_pair(it->first, *it->second));
+        }
+        return read_response_t(result);
+    }
     read_response_t operator()(rget_query_t rget) {
         // TODO: do this without dynamic memory?
         std::vector<key_with_data_buffer_t> pairs;
@@ -425,12 +484,34 @@ store_t::~store_t() {
 
 namespace {
 
+void call_memcached_get(int i, const std::vector<store_key_t> &keys, btree_slice_t *btree,
+                        exptime_t effective_time, transaction_t *txn, superblock_t *superblock,
+                        std::vector<std::pair<store_key_t, get_result_t> > *results_out) {
+    (*results_out)[i] = std::make_pair(keys[i],
+        memcached_get(keys[i], btree, effective_time, txn, superblock));
+}
+
 struct read_visitor_t : public boost::static_visitor<read_response_t> {
     read_response_t operator()(const get_query_t& get) {
         return read_response_t(
             memcached_get(get.key, btree, effective_time, txn, superblock));
     }
 
+    read_response_t operator()(const get_multi_query_t& get_multi) {
+        // All the keys are looked up at once under the one superblock
+        // acquisition, which is released once the last of them has found its
+        // way to the root.
+        guarantee(!get_multi.keys.empty());
+        refcount_superblock_t shared_superblock(superblock, get_multi.keys.size());
+        get_multi_result_t result;
+        result.results.resize(get_multi.keys.size());
+        pmap(get_multi.keys.size(), boost::bind(&call_memcached_get, _1,
+                                                boost::cref(get_multi.keys), btree,
+                                                effective_time, txn, &shared_superblock,
+                                                &result.results));
+        return read_response_t(result);
+    }
+
     read_response_t operator()(const rget_query_t& rget) {
         return read_response_t(
             memcached_rget_slice(btree, rget.region.inner, rget.maximum, effective_time, txn, superblock));
@@ -498,7 +579,7 @@ struct write_visitor_t : public boost::static_visitor<write_response_t> {
     }
     write_response_t operator()(const sarc_mutation_t &m) {
         return write_response_t(
-            memcached_set(m.key, btree, m.data, m.flags, m.exptime, m.add_policy, m.replace_policy, m.old_cas, proposed_cas, effective_time, timestamp, txn, superblock));
+            memcached_set(m.key, btree, m.data, m.flags, m.exptime, m.add_policy, m.replace_policy, m.old_cas, m.add_cas, proposed_cas, effective_time, timestamp, txn, superblock));
     }
     write_response_t operator()(const incr_decr_mutation_t &m) {
         return write_response_t(
@@ -506,7 +587,7 @@ struct write_visitor_t : public boost::static_visitor<write_response_t> {
     }
     write_response_t operator()(const append_prepend_mutation_t &m) {
         return write_response_t(
-            memcached_append_prepend(m.key, btree, m.data, (m.kind == append_prepend_APPEND), proposed_cas, effective_time, timestamp, txn, superblock));
+            memcached_append_prepend(m.key, btree, m.data, (m.kind == append_prepend_APPEND), m.add_cas, proposed_cas, effective_time, timestamp, txn, superblock));
     }
     write_response_t operator()(const delete_mutation_t &m) {
         guarantee(proposed_cas == INVALID_CAS);
@@ -600,6 +681,27 @@ static void call_memcached_backfill(int i, btree_slice_t *btree, const std::vect
     }
 }
 
+/* Cuts every region of `start_point` into key subranges along the btree's key
+distribution, so that `protocol_send_backfill()` can traverse them
+concurrently. Consumes one reference to `superblock`. */
+static void split_regions_for_backfill(const region_map_t<memcached_protocol_t, state_timestamp_t> &start_point,
+                                       btree_slice_t *btree, transaction_t *txn, superblock_t *superblock,
+                                       std::vector<std::pair<region_t, state_timestamp_t> > *regions_out) {
+    int64_t key_count;
+    std::vector<store_key_t> split_keys;
+    get_btree_key_distribution(btree, txn, superblock, BACKFILL_SPLIT_DISTRIBUTION_DEPTH, &key_count, &split_keys);
+
+    for (region_map_t<memcached_protocol_t, state_timestamp_t>::const_iterator it = start_point.begin();
+         it != start_point.end();
+         ++it) {
+        std::vector<key_range_t> parts;
+        split_key_range_for_backfill(it->first.inner, split_keys, BACKFILL_TRAVERSALS_PER_REGION, &parts);
+        for (std::vector<key_range_t>::iterator p = parts.begin(); p != parts.end(); ++p) {
+            regions_out->push_back(std::make_pair(region_t(it->first.beg, it->first.end, *p), it->second));
+        }
+    }
+}
+
 // TODO: Figure out wtf does the backfill filtering, figure out wtf constricts delete range operations to hit only a certain hash-interval, figure out what filters keys.
 void store_t::protocol_send_backfill(const region_map_t<memcached_protocol_t, state_timestamp_t> &start_point,
                                      chunk_fun_callback_t<memcached_protocol_t> *chunk_fun_cb,
@@ -610,7 +712,11 @@ void store_t::protocol_send_backfill(const region_map_t<memcached_protocol_t, st
                                      backfill_progress_t *progress,
                                      signal_t *interruptor)
                                      THROWS_ONLY(interrupted_exc_t) {
-    std::vector<std::pair<region_t, state_timestamp_t> > regions(start_point.begin(), start_point.end());
+    /* One reference is consumed by the distribution traversal and one by
+    `refcount_wrapper`, which hands it out to the backfill traversals. */
+    refcount_superblock_t split_wrapper(superblock, 2);
+    std::vector<std::pair<region_t, state_timestamp_t> > regions;
+    split_regions_for_backfill(start_point, btree, txn, &split_wrapper, &regions);
 
     if (regions.size() > 0) {
         memcached_backfill_callback_t callback(chunk_fun_cb);
@@ -618,7 +724,7 @@ void store_t::protocol_send_backfill(const region_map_t<memcached_protocol_t, st
         // pmapping by regions.size() is now the arguably wrong thing to do,
         // because adjacent regions often have the same value. On the other hand
         // it's harmless, because caching is basically perfect.
-        refcount_superblock_t refcount_wrapper(superblock, regions.size());
+        refcount_superblock_t refcount_wrapper(&split_wrapper, regions.size());
         pmap(regions.size(), boost::bind(&call_memcached_backfill, _1,
                                          btree, regions, &callback, txn, &refcount_wrapper, sindex_block, progress, interruptor));
 
@@ -649,7 +755,7 @@ struct receive_backfill_visitor_t : public boost::static_visitor<> {
         const backfill_atom_t& bf_atom = kv.backfill_atom;
         memcached_set(bf_atom.key, btree,
             bf_atom.value, bf_atom.flags, bf_atom.exptime,
-            add_policy_yes, replace_policy_yes, INVALID_CAS,
+            add_policy_yes, replace_policy_yes, INVALID_CAS, false,
             bf_atom.cas_or_zero, 0, bf_atom.recency,
             txn, superblock);
     }
@@ -49,9 +49,23 @@ struct get_result_t {
     counted_t<data_buffer_t> value;
 
     mcflags_t flags;
+    /* The value's CAS, or 0 if it doesn't have one. */
     cas_t cas;
 };
 
+/* `get` with several keys */
+
+struct get_multi_query_t {
+    std::vector<store_key_t> keys;
+    get_multi_query_t() { }
+    explicit get_multi_query_t(const std::vector<store_key_t> &_keys) : keys(_keys) { }
+};
+
+struct get_multi_result_t {
+    // One for each of the query's keys, in the same order.
+    std::vector<std::pair<store_key_t, get_result_t> > results;
+};
+
 /* `rget` */
 
 struct rget_query_t {
@@ -160,21 +174,27 @@ struct sarc_mutation_t {
     replace_policy_t replace_policy;
     cas_t old_cas;
 
-    sarc_mutation_t() { }
+    /* If true the stored value is given the write's proposed CAS even if the
+    old value didn't have one. */
+    bool add_cas;
+
+    sarc_mutation_t() : add_cas(false) { }
     sarc_mutation_t(const store_key_t& _key,
                     const counted_t<data_buffer_t>& _data,
                     mcflags_t _flags,
                     exptime_t _exptime,
                     add_policy_t _add_policy,
                     replace_policy_t _replace_policy,
-                    cas_t _old_cas) :
+                    cas_t _old_cas,
+                    bool _add_cas) :
         key(_key),
         data(_data),
         flags(_flags),
         exptime(_exptime),
         add_policy(_add_policy),
         replace_policy(_replace_policy),
-        old_cas(_old_cas) { }
+        old_cas(_old_cas),
+        add_cas(_add_cas) { }
 };
 
 void debug_print(printf_buffer_t *buf, const sarc_mutation_t& mut);
@@ -244,8 +264,9 @@ struct incr_decr_result_t {
         idr_not_numeric
     } res;
     uint64_t new_value;   // Valid only if idr_success
+    cas_t new_cas;        // Valid only if idr_success; 0 if the value has no CAS
     incr_decr_result_t() { }
-    explicit incr_decr_result_t(result_t r, uint64_t n = 0) : res(r), new_value(n) { }
+    explicit incr_decr_result_t(result_t r, uint64_t n = 0, cas_t c = 0) : res(r), new_value(n), new_cas(c) { }
 };
 
 ARCHIVE_PRIM_MAKE_RANGED_SERIALIZABLE(incr_decr_result_t::result_t, int8_t, incr_decr_result_t::idr_success, incr_decr_result_t::idr_not_numeric);
@@ -260,12 +281,15 @@ struct append_prepend_mutation_t {
     append_prepend_kind_t kind;
     store_key_t key;
     counted_t<data_buffer_t> data;
+    /* As for `sarc_mutation_t`. */
+    bool add_cas;
 
-    append_prepend_mutation_t() { }
+    append_prepend_mutation_t() : add_cas(false) { }
     append_prepend_mutation_t(append_prepend_kind_t _kind,
                               const store_key_t &_key,
-                              const counted_t<data_buffer_t> &_data)
-        : kind(_kind), key(_key), data(_data) { }
+                              const counted_t<data_buffer_t> &_data,
+                              bool _add_cas)
+        : kind(_kind), key(_key), data(_data), add_cas(_add_cas) { }
 };
 
 void debug_print(printf_buffer_t *buf, const append_prepend_mutation_t& mut);
@@ -53,6 +53,14 @@ struct tcp_conn_memcached_interface_t : public memcached_interface_t, public hom
         }
     }
 
+    char peek_byte(signal_t *interruptor) {
+        try {
+            return *conn->peek(1, interruptor).beg;
+        } catch (const tcp_conn_read_closed_exc_t &) {
+            throw no_more_data_exc_t();
+        }
+    }
+
     void read_line(std::vector<char> *dest, signal_t *interruptor) {
         try {
             for (;;) {
@@ -0,0 +1,60 @@
+// Copyright 2010-2013 RethinkDB, all rights reserved.
+#include "protob/frame_reader.hpp"
+
+#include <string.h>
+
+protob_frame_reader_t::protob_frame_reader_t(tcp_conn_t *conn)
+    : conn_(conn), buffer_(BUFFER_SIZE), start_(0), end_(0) { }
+
+int32_t protob_frame_reader_t::next(const char **data_out, signal_t *closer)
+    THROWS_ONLY(tcp_conn_read_closed_exc_t) {
+    wait_for_frame(closer);
+    const int32_t size = peek_size();
+    start_ += sizeof(int32_t);
+    if (size < 0 || size > MAX_FRAME_SIZE) {
+        return size;
+    }
+
+    *data_out = buffer_.data() + start_;
+    start_ += size;
+    return size;
+}
+
+void protob_frame_reader_t::wait_for_frame(signal_t *closer)
+    THROWS_ONLY(tcp_conn_read_closed_exc_t) {
+    fill(sizeof(int32_t), closer);
+    const int32_t size = peek_size();
+    if (size > 0 && size <= MAX_FRAME_SIZE) {
+        fill(sizeof(int32_t) + size, closer);
+    }
+}
+
+int32_t protob_frame_reader_t::peek_size() const {
+    CT_ASSERT(sizeof(int) == sizeof(int32_t));
+    rassert(end_ - start_ >= sizeof(int32_t));
+    int32_t size;
+    memcpy(&size, buffer_.data() + start_, sizeof(int32_t));
+    return size;
+}
+
+void protob_frame_reader_t::fill(size_t size, signal_t *closer)
+    THROWS_ONLY(tcp_conn_read_closed_exc_t) {
+    if (end_ - start_ >= size) {
+        return;
+    }
+
+    // What's left over is less than one frame, so moving it is cheap.
+    memmove(buffer_.data(), buffer_.data() + start_, end_ - start_);
+    end_ -= start_;
+    start_ = 0;
+
+    if (buffer_.size() < size) {
+        buffer_.resize(size);
+    } else if (buffer_.size() > BUFFER_SIZE && size <= BUFFER_SIZE && end_ <= BUFFER_SIZE) {
+        std::vector<char>(buffer_.begin(), buffer_.begin() + BUFFER_SIZE).swap(buffer_);
+    }
+
+    while (end_ < size) {
+        end_ += conn_->read_some(buffer_.data() + end_, buffer_.size() - end_, closer);
+    }
+}
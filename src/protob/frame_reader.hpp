@@ -0,0 +1,60 @@
+// Copyright 2010-2013 RethinkDB, all rights reserved.
+#ifndef PROTOB_FRAME_READER_HPP_
+#define PROTOB_FRAME_READER_HPP_
+
+#include <vector>
+
+#include "errors.hpp"
+
+#include "arch/io/network.hpp"
+#include "config/args.hpp"
+
+namespace unittest {
+void run_frame_reader_buffer_test();
+}
+
+// Reads the frames (an int32_t size, then that many bytes) that protobufs
+// arrive in on a client connection.  Rather than two reads per frame, it reads
+// whatever the socket has ready into a buffer that lives as long as the
+// connection, so a client that pipelines small queries gets them all parsed
+// out of one read.
+class protob_frame_reader_t {
+public:
+    explicit protob_frame_reader_t(tcp_conn_t *conn);
+
+    // We won't buffer a frame bigger than this for a client.
+    static const int32_t MAX_FRAME_SIZE = 64 * MEGABYTE;
+
+    // Returns the next frame's size, and points `*data_out` at its bytes, which
+    // stay valid until the next call.  A size that's negative or over
+    // `MAX_FRAME_SIZE` is returned as is (and `*data_out` left alone): its
+    // frame isn't read, so the connection can't be trusted after that.
+    int32_t next(const char **data_out, signal_t *closer) THROWS_ONLY(tcp_conn_read_closed_exc_t);
+
+    // Blocks until the next frame has been read in whole (or, if its size is
+    // negative or too big, just its size), without consuming it.
+    void wait_for_frame(signal_t *closer) THROWS_ONLY(tcp_conn_read_closed_exc_t);
+
+private:
+    friend void unittest::run_frame_reader_buffer_test();
+
+    // The size of the frame at `start_`, whose size must have been read.
+    int32_t peek_size() const;
+
+    // Makes sure at least `size` unconsumed bytes are buffered.
+    void fill(size_t size, signal_t *closer) THROWS_ONLY(tcp_conn_read_closed_exc_t);
+
+    // How much we try to read at once.  The buffer grows to fit larger frames,
+    // and shrinks back to this once they're consumed.
+    static const size_t BUFFER_SIZE = 16 * IO_BUFFER_SIZE;
+
+    tcp_conn_t *conn_;
+    std::vector<char> buffer_;
+    // Bytes in [start_, end_) have been read but not consumed.
+    size_t start_;
+    size_t end_;
+
+    DISABLE_COPYING(protob_frame_reader_t);
+};
+
+#endif  // PROTOB_FRAME_READER_HPP_
@@ -2,21 +2,30 @@
 #ifndef PROTOB_PROTOB_HPP_
 #define PROTOB_PROTOB_HPP_
 
+#include <deque>
 #include <set>
 #include <map>
 #include <string>
+#include <vector>
 
 #include "errors.hpp"
 #include <boost/function.hpp>
 #include <boost/ptr_container/ptr_map.hpp>
 #include <boost/ptr_container/ptr_vector.hpp>
 
+#include "arch/io/event_watcher.hpp"
 #include "arch/runtime/runtime.hpp"
 #include "arch/timing.hpp"
 #include "concurrency/auto_drainer.hpp"
 #include "concurrency/cross_thread_signal.hpp"
+#include "concurrency/mutex.hpp"
+#include "concurrency/semaphore.hpp"
+#include "concurrency/wait_any.hpp"
 #include "containers/archive/archive.hpp"
+#include "containers/scoped.hpp"
 #include "http/http.hpp"
+#include "protob/frame_reader.hpp"
+#include "utils.hpp"
 
 enum protob_server_callback_mode_t {
     INLINE, //protobs that arrive will be called inline
@@ -100,7 +109,16 @@ private:
 // request_t::protob_type *underlying_protob_value(request_t *request);
 //
 // "request_t::protob_type" does not actually have to be defined.
+//
+// In CORO_UNORDERED mode the protocol buffers object must also have a
+// `token()`: requests with different tokens run concurrently, but requests
+// that share a token run one at a time, in the order they arrived.
+
 
+namespace unittest {
+void run_thread_load_test();
+void run_send_buffer_test();
+}
 
 template <class request_t, class response_t, class context_t>
 class protob_server_t : public http_app_t {
@@ -116,9 +134,65 @@ public:
 
     int get_port() const;
 private:
+    friend void unittest::run_thread_load_test();
+    friend void unittest::run_send_buffer_test();
+
+    // At most this many requests per connection are in flight (running or
+    // waiting behind another with the same token) in CORO_UNORDERED mode;
+    // past that we stop reading from the connection.
+    static const int MAX_CONCURRENT_REQUESTS_PER_CONN = 64;
+
+    // Connections are placed on (and, between queries, moved to) the thread
+    // with the least load: each request running on a thread counts this much,
+    // and each connection served by it one.
+    static const int32_t REQUEST_LOAD = 16;
+    // Moving a connection costs it a couple of thread switches, so it only
+    // moves if its thread's load is at least this much over another's.
+    static const int32_t MIN_LOAD_IMBALANCE_TO_MOVE = 2 * REQUEST_LOAD;
+
+    // Updated by each thread for itself, and read by all of them.
+    struct thread_load_t {
+        thread_load_t() : requests(0), connections(0) { }
+        int32_t requests;
+        int32_t connections;
+    };
+    // Counts something towards a thread's load for as long as it exists.
+    class load_counter_t {
+    public:
+        explicit load_counter_t(int32_t *_counter) : counter(_counter) {
+            __sync_fetch_and_add(counter, 1);
+        }
+        ~load_counter_t() { __sync_fetch_and_sub(counter, 1); }
+    private:
+        int32_t *counter;
+        DISABLE_COPYING(load_counter_t);
+    };
+    int32_t thread_load(int thread) const;
+    // Ties go to the first thread at or after `start`.
+    int least_loaded_thread(int start) const;
+
+    // A connection that got through the handshake, and what we keep around
+    // for it between requests.
+    class client_conn_t;
+
+    // What the coroutines serving one connection in CORO_UNORDERED mode share.
+    class conn_requests_t;
 
     void handle_conn(const scoped_ptr_t<tcp_conn_descriptor_t> &nconn, auto_drainer_t::lock_t);
-    void send(const response_t &, tcp_conn_t *conn, signal_t *closer) THROWS_ONLY(tcp_conn_write_closed_exc_t);
+    // Takes ownership of `client`, whose connection must be on this thread,
+    // and serves its requests until it closes or moves to another thread.
+    void serve_conn(client_conn_t *client, auto_drainer_t::lock_t keepalive);
+    // Takes `client`'s connection (which belongs to no thread) to `thread`
+    // and serves it there.
+    void move_conn(client_conn_t *client, int thread, auto_drainer_t::lock_t keepalive);
+    void handle_token_requests(conn_requests_t *requests, int64_t token,
+                               auto_drainer_t::lock_t keepalive);
+    // Writes the size-prefixed response in one write, using `buffer` (which is
+    // reused across the connection's responses) to put it together.  A buffer
+    // that had to grow past `SEND_BUFFER_SIZE` shrinks back to it afterwards.
+    static void send(const response_t &, tcp_conn_t *conn, signal_t *closer,
+                     std::vector<char> *buffer) THROWS_ONLY(tcp_conn_write_closed_exc_t);
+    static const size_t SEND_BUFFER_SIZE = 16 * IO_BUFFER_SIZE;
     static auth_key_t read_auth_key(tcp_conn_t *conn, signal_t *interruptor);
 
     // For HTTP server
@@ -146,6 +220,66 @@ private:
     scoped_ptr_t<tcp_listener_t> tcp_listener;
 
     unsigned next_thread;
+    scoped_array_t<cache_line_padded_t<thread_load_t> > thread_loads;
+};
+
+template <class request_t, class response_t, class context_t>
+class protob_server_t<request_t, response_t, context_t>::client_conn_t {
+public:
+    explicit client_conn_t(const scoped_ptr_t<tcp_conn_descriptor_t> &nconn);
+
+    scoped_ptr_t<tcp_conn_t> conn;
+    context_t ctx;
+    // Requests can't share storage: a query's protobuf lives on in the stream
+    // cache for as long as its cursor does.  So what we reuse across requests
+    // are the buffers they're read from and their responses are written from.
+    scoped_ptr_t<protob_frame_reader_t> frame_reader;
+    std::vector<char> send_buffer;
+
+private:
+    DISABLE_COPYING(client_conn_t);
+};
+
+template <class request_t, class response_t, class context_t>
+class protob_server_t<request_t, response_t, context_t>::conn_requests_t {
+public:
+    conn_requests_t(tcp_conn_t *_conn, context_t *_ctx, signal_t *_closer,
+                    signal_t *shutdown_signal);
+
+    tcp_conn_t *conn;
+    context_t *ctx;
+    // For writes.
+    signal_t *closer;
+
+    // Pulsed once we stop reading from the connection.
+    cond_t stopping;
+#ifdef __linux
+    linux_event_watcher_t::watch_t conn_interrupted;
+#endif  // __linux
+    // Every request on the connection runs with this.
+    wait_any_t interruptor;
+
+    // Keeps responses from being interleaved with each other, and protects
+    // `send_buffer`.
+    mutex_t send_mutex;
+    std::vector<char> send_buffer;
+    semaphore_t semaphore;
+
+    // Requests not yet answered, by token.  The one at the front of each queue
+    // is running.
+    std::map<int64_t, std::deque<request_t> > pending;
+
+    /* WARNING: The order here is fragile.  Requests are interrupted before we
+    wait for them to finish. */
+    auto_drainer_t drainer;
+    struct pulse_on_destruct_t {
+        explicit pulse_on_destruct_t(cond_t *_cond) : cond(_cond) { }
+        ~pulse_on_destruct_t() { cond->pulse(); }
+        cond_t *cond;
+    } pulse_stopping_on_destruct;
+
+private:
+    DISABLE_COPYING(conn_requests_t);
 };
 
 //TODO figure out how to do 0 copy serialization with this.
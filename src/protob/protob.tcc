@@ -13,6 +13,7 @@
 #include "arch/arch.hpp"
 #include "arch/io/network.hpp"
 #include "concurrency/cross_thread_signal.hpp"
+#include "protob/frame_reader.hpp"
 #include "utils.hpp"
 
 template <class request_t, class response_t, class context_t>
@@ -29,7 +30,8 @@ protob_server_t<request_t, response_t, context_t>::protob_server_t(
       cb_mode(_cb_mode),
       shutting_down_conds(get_num_threads()),
       pulse_sdc_on_shutdown(&main_shutting_down_cond),
-      next_thread(0) {
+      next_thread(0),
+      thread_loads(get_num_db_threads()) {
 
     for (int i = 0; i < get_num_threads(); ++i) {
         cross_thread_signal_t *s =
@@ -56,6 +58,36 @@ int protob_server_t<request_t, response_t, context_t>::get_port() const {
     return tcp_listener->get_port();
 }
 
+template <class request_t, class response_t, class context_t>
+int32_t protob_server_t<request_t, response_t, context_t>::thread_load(int thread) const {
+    // Other threads update these as we go, so this is only ever approximate.
+    const thread_load_t &load = thread_loads[thread].value;
+    return load.requests * REQUEST_LOAD + load.connections;
+}
+
+template <class request_t, class response_t, class context_t>
+int protob_server_t<request_t, response_t, context_t>::least_loaded_thread(int start) const {
+    const int num_threads = thread_loads.size();
+    int best_thread = start % num_threads;
+    int32_t best_load = thread_load(best_thread);
+    for (int i = 1; i < num_threads; ++i) {
+        const int thread = (start + i) % num_threads;
+        const int32_t load = thread_load(thread);
+        if (load < best_load) {
+            best_thread = thread;
+            best_load = load;
+        }
+    }
+    return best_thread;
+}
+
+template <class request_t, class response_t, class context_t>
+protob_server_t<request_t, response_t, context_t>::client_conn_t::client_conn_t(
+    const scoped_ptr_t<tcp_conn_descriptor_t> &nconn) {
+    nconn->make_overcomplicated(&conn);
+    frame_reader.init(new protob_frame_reader_t(conn.get()));
+}
+
 struct protob_server_exc_t : public std::exception {
 public:
     explicit protob_server_exc_t(const std::string& data) : info(data) { }
@@ -95,12 +127,13 @@ void protob_server_t<request_t, response_t, context_t>::handle_conn(
     // This must be read here because of home threads and stuff
     const vclock_t<auth_key_t> auth_vclock = auth_metadata->get().auth_key;
 
-    int chosen_thread = (next_thread++) % get_num_db_threads();
+    // Ties are broken round-robin, so that an idle server spreads its
+    // connections out.
+    int chosen_thread = least_loaded_thread((next_thread++) % get_num_db_threads());
     cross_thread_signal_t ct_keepalive(keepalive.get_drain_signal(), chosen_thread);
     on_thread_t rethreader(chosen_thread);
-    context_t ctx;
-    scoped_ptr_t<tcp_conn_t> conn;
-    nconn->make_overcomplicated(&conn);
+    scoped_ptr_t<client_conn_t> client(new client_conn_t(nconn));
+    tcp_conn_t *conn = client->conn.get();
 
     std::string init_error;
 
@@ -117,7 +150,7 @@ void protob_server_t<request_t, response_t, context_t>::handle_conn(
                 throw protob_server_exc_t("authorization required, client does not support it");
             }
         } else if (client_magic_number == context_t::auth_magic_number) {
-            auth_key_t provided_auth = read_auth_key(conn.get(), &ct_keepalive);
+            auth_key_t provided_auth = read_auth_key(conn, &ct_keepalive);
             if (!timing_sensitive_equals(provided_auth, auth_vclock.get())) {
                 throw protob_server_exc_t("incorrect authorization key");
             }
@@ -142,89 +175,226 @@ void protob_server_t<request_t, response_t, context_t>::handle_conn(
         return;
     }
 
-    //TODO figure out how to do this with less copying
-    for (;;) {
-        request_t request;
-        make_empty_protob_bearer(&request);
-        bool force_response = false;
-        response_t forced_response;
-        std::string err;
-        try {
-            int32_t size;
-            conn->read(&size, sizeof(int32_t), &ct_keepalive);
-            if (size < 0) {
-                err = strprintf("Negative protobuf size (%d).", size);
-                forced_response = on_unparsable_query(request_t(), err);
-                force_response = true;
-            } else {
-                scoped_array_t<char> data(size);
-                conn->read(data.data(), size, &ct_keepalive);
-
-                const bool res
-                    = underlying_protob_value(&request)->ParseFromArray(data.data(), size);
-                if (!res) {
-                    err = "Client is buggy (failed to deserialize protobuf).";
-                    forced_response = on_unparsable_query(request, err);
+    serve_conn(client.release(), keepalive);
+}
+
+template <class request_t, class response_t, class context_t>
+void protob_server_t<request_t, response_t, context_t>::serve_conn(
+    client_conn_t *_client, auto_drainer_t::lock_t keepalive) {
+    scoped_ptr_t<client_conn_t> client(_client);
+    tcp_conn_t *conn = client->conn.get();
+    context_t *ctx = &client->ctx;
+    const int thread = get_thread_id();
+    // `keepalive`'s drain signal isn't pulsed before this is.
+    signal_t *closer = shutdown_signal();
+    int move_to_thread = thread;
+
+    {
+        load_counter_t connection_counter(&thread_loads[thread].value.connections);
+
+        scoped_ptr_t<conn_requests_t> requests;
+        if (cb_mode == CORO_UNORDERED) {
+            requests.init(new conn_requests_t(conn, ctx, closer, shutdown_signal()));
+            ctx->interruptor = &requests->interruptor;
+        }
+
+        for (;;) {
+            request_t request;
+            make_empty_protob_bearer(&request);
+            bool force_response = false;
+            // Set if we can't read the connection past this request.
+            bool close_after_response = false;
+            response_t forced_response;
+            std::string err;
+            try {
+                // Between queries (none running, and the next one read in
+                // whole), see if the connection is better off elsewhere.  It
+                // can't move while it has cursors open: they belong to this
+                // thread.
+                client->frame_reader->wait_for_frame(closer);
+                if ((!requests.has() || requests->pending.empty())
+                    && ctx->can_rethread()) {
+                    const int best_thread = least_loaded_thread(thread);
+                    if (thread_load(thread) - thread_load(best_thread)
+                        >= MIN_LOAD_IMBALANCE_TO_MOVE) {
+                        move_to_thread = best_thread;
+                        break;
+                    }
+                }
+
+                const char *data;
+                const int32_t size = client->frame_reader->next(&data, closer);
+                if (size < 0) {
+                    err = strprintf("Negative protobuf size (%d).", size);
+                    forced_response = on_unparsable_query(request_t(), err);
+                    force_response = true;
+                } else if (size > protob_frame_reader_t::MAX_FRAME_SIZE) {
+                    err = strprintf("Protobuf size (%d) is over the limit of %d.",
+                                    size, protob_frame_reader_t::MAX_FRAME_SIZE);
+                    forced_response = on_unparsable_query(request_t(), err);
                     force_response = true;
+                    close_after_response = true;
+                } else {
+                    const bool res
+                        = underlying_protob_value(&request)->ParseFromArray(data, size);
+                    if (!res) {
+                        err = "Client is buggy (failed to deserialize protobuf).";
+                        forced_response = on_unparsable_query(request, err);
+                        force_response = true;
+                    }
                 }
+            } catch (const tcp_conn_read_closed_exc_t &) {
+                //TODO need to figure out what blocks us up here in non inline cb
+                //mode
+                return;
             }
-        } catch (const tcp_conn_read_closed_exc_t &) {
-            //TODO need to figure out what blocks us up here in non inline cb
-            //mode
-            return;
-        }
 
-        try {
-            switch (cb_mode) {
-            case INLINE:
-                if (force_response) {
-                    send(forced_response, conn.get(), &ct_keepalive);
-                } else {
+            try {
+                switch (cb_mode) {
+                case INLINE:
+                    if (force_response) {
+                        send(forced_response, conn, closer, &client->send_buffer);
+                    } else {
 #ifdef __linux
-                    linux_event_watcher_t *ew = conn->get_event_watcher();
-                    linux_event_watcher_t::watch_t conn_interrupted(
-                        ew, poll_event_rdhup);
-                    wait_any_t interruptor(&conn_interrupted, shutdown_signal());
-                    ctx.interruptor = &interruptor;
+                        linux_event_watcher_t *ew = conn->get_event_watcher();
+                        linux_event_watcher_t::watch_t conn_interrupted(
+                            ew, poll_event_rdhup);
+                        wait_any_t interruptor(&conn_interrupted, shutdown_signal());
+                        ctx->interruptor = &interruptor;
 #else
-                    ctx.interruptor = shutdown_signal();
+                        ctx->interruptor = shutdown_signal();
 #endif  // __linux
-                    response_t response;
-                    bool response_needed = f(request, &response, &ctx);
-                    if (response_needed) {
-                        send(response, conn.get(), &ct_keepalive);
+                        response_t response;
+                        bool response_needed;
+                        {
+                            load_counter_t request_counter(
+                                &thread_loads[thread].value.requests);
+                            response_needed = f(request, &response, ctx);
+                        }
+                        if (response_needed) {
+                            send(response, conn, closer, &client->send_buffer);
+                        }
+                    }
+                    break;
+                case CORO_ORDERED:
+                    crash("unimplemented");
+                    break;
+                case CORO_UNORDERED:
+                    if (force_response) {
+                        mutex_t::acq_t send_lock(&requests->send_mutex);
+                        send(forced_response, conn, closer, &requests->send_buffer);
+                    } else {
+                        // Stop reading once too many requests are in flight.
+                        requests->semaphore.co_lock();
+                        const int64_t token = underlying_protob_value(&request)->token();
+                        std::deque<request_t> *queue = &requests->pending[token];
+                        queue->push_back(request);
+                        // Otherwise the coroutine running the token's earlier
+                        // requests gets to this one.
+                        if (queue->size() == 1) {
+                            coro_t::spawn_sometime(boost::bind(
+                                &protob_server_t<request_t, response_t, context_t>::handle_token_requests,
+                                this, requests.get(), token,
+                                auto_drainer_t::lock_t(&requests->drainer)));
+                        }
                     }
+                    break;
+                default:
+                    crash("unreachable");
+                    break;
                 }
-                break;
-            case CORO_ORDERED:
-                crash("unimplemented");
-                break;
-            case CORO_UNORDERED:
-                crash("unimplemented");
-                break;
-            default:
-                crash("unreachable");
-                break;
+            } catch (const tcp_conn_write_closed_exc_t &) {
+                //TODO need to figure out what blocks us up here in non inline cb
+                //mode
+                return;
+            }
+
+            if (close_after_response) {
+                return;
+            }
+        }
+        // `requests` watches the connection on this thread, so it has to go
+        // before the connection can leave.
+    }
+
+    guarantee(move_to_thread != thread);
+    ctx->interruptor = NULL;
+    conn->rethread(INVALID_THREAD);
+    coro_t::spawn_sometime(boost::bind(
+        &protob_server_t<request_t, response_t, context_t>::move_conn,
+        this, client.release(), move_to_thread, keepalive));
+}
+
+template <class request_t, class response_t, class context_t>
+void protob_server_t<request_t, response_t, context_t>::move_conn(
+    client_conn_t *client, int thread, auto_drainer_t::lock_t keepalive) {
+    on_thread_t rethreader(thread);
+    client->conn->rethread(thread);
+    serve_conn(client, keepalive);
+}
+
+template <class request_t, class response_t, class context_t>
+protob_server_t<request_t, response_t, context_t>::conn_requests_t::conn_requests_t(
+    tcp_conn_t *_conn, context_t *_ctx, signal_t *_closer, signal_t *shutdown_signal)
+    : conn(_conn), ctx(_ctx), closer(_closer),
+#ifdef __linux
+      conn_interrupted(conn->get_event_watcher(), poll_event_rdhup),
+      interruptor(&conn_interrupted, shutdown_signal, &stopping),
+#else
+      interruptor(shutdown_signal, &stopping),
+#endif  // __linux
+      semaphore(MAX_CONCURRENT_REQUESTS_PER_CONN),
+      pulse_stopping_on_destruct(&stopping) { }
+
+template <class request_t, class response_t, class context_t>
+void protob_server_t<request_t, response_t, context_t>::handle_token_requests(
+    conn_requests_t *requests, int64_t token, UNUSED auto_drainer_t::lock_t keepalive) {
+    typename std::map<int64_t, std::deque<request_t> >::iterator it
+        = requests->pending.find(token);
+    guarantee(it != requests->pending.end());
+
+    // Requests stay at the front of the queue until they're answered, so that
+    // new ones with the same token queue up behind them.
+    while (!it->second.empty()) {
+        response_t response;
+        bool response_needed;
+        {
+            load_counter_t request_counter(
+                &thread_loads[get_thread_id()].value.requests);
+            response_needed = f(it->second.front(), &response, requests->ctx);
+        }
+        if (response_needed) {
+            try {
+                mutex_t::acq_t send_lock(&requests->send_mutex);
+                send(response, requests->conn, requests->closer, &requests->send_buffer);
+            } catch (const tcp_conn_write_closed_exc_t &) {
+                // The connection is going away; `handle_conn()` will notice.
             }
-        } catch (const tcp_conn_write_closed_exc_t &) {
-            //TODO need to figure out what blocks us up here in non inline cb
-            //mode
-            return;
         }
+        it->second.pop_front();
+        requests->semaphore.unlock();
     }
+    requests->pending.erase(it);
 }
 
 template <class request_t, class response_t, class context_t>
 void protob_server_t<request_t, response_t, context_t>::send(
     const response_t &res,
     tcp_conn_t *conn,
-    signal_t *closer) THROWS_ONLY(tcp_conn_write_closed_exc_t) {
-    int size = res.ByteSize();
-    conn->write(&size, sizeof(res.ByteSize()), closer);
-    scoped_array_t<char> data(size);
-
-    res.SerializeToArray(data.data(), size);
-    conn->write(data.data(), size, closer);
+    signal_t *closer,
+    std::vector<char> *buffer) THROWS_ONLY(tcp_conn_write_closed_exc_t) {
+    CT_ASSERT(sizeof(int) == sizeof(int32_t));
+    const int32_t size = res.ByteSize();
+    buffer->resize(sizeof(size) + size);
+    memcpy(buffer->data(), &size, sizeof(size));
+    res.SerializeToArray(buffer->data() + sizeof(size), size);
+    conn->write(buffer->data(), buffer->size(), closer);
+
+    // Don't hold on to the memory of an unusually large response for as long
+    // as the connection stays open.
+    if (buffer->capacity() > SEND_BUFFER_SIZE) {
+        std::vector<char>(SEND_BUFFER_SIZE).swap(*buffer);
+    }
 }
 
 template <class request_t, class response_t, class context_t>
@@ -283,7 +453,10 @@ http_res_t protob_server_t<request_t, response_t, context_t>::handle(
         bool response_needed;
         response_t response;
         switch (cb_mode) {
-        case INLINE: {
+        // Each HTTP request carries one query, so there is nothing to run
+        // concurrently here.
+        case INLINE:
+        case CORO_UNORDERED: {
             boost::shared_ptr<typename http_conn_cache_t<context_t>::http_conn_t> conn =
                 http_conn_cache.find(conn_id);
             if (!parseSucceeded) {
@@ -302,7 +475,6 @@ http_res_t protob_server_t<request_t, response_t, context_t>::handle(
             }
         } break;
         case CORO_ORDERED:
-        case CORO_UNORDERED:
             crash("unimplemented");
         default:
             crash("unreachable");
@@ -0,0 +1,108 @@
+// Copyright 2010-2013 RethinkDB, all rights reserved.
+#include "rdb_protocol/aggregate.hpp"
+
+#include <vector>
+
+namespace ql {
+
+static counted_t<const datum_t> make_pair_datum(double lhs, double rhs) {
+    std::vector<counted_t<const datum_t> > pair;
+    pair.push_back(make_counted<const datum_t>(lhs));
+    pair.push_back(make_counted<const datum_t>(rhs));
+    return make_counted<const datum_t>(pair);
+}
+
+counted_t<const datum_t> aggregator_t::empty() const {
+    switch (kind) {
+    case AGGREGATE_COUNT:
+    case AGGREGATE_SUM:
+        return make_counted<const datum_t>(0.0);
+    case AGGREGATE_AVG:
+        return make_pair_datum(0.0, 0.0);
+    case AGGREGATE_MIN:
+    case AGGREGATE_MAX:
+        return make_counted<const datum_t>(datum_t::R_ARRAY);
+    default: unreachable();
+    }
+}
+
+counted_t<const datum_t> aggregator_t::field(counted_t<const datum_t> row) const {
+    counted_t<const datum_t> val = row->get(attr, NOTHROW);
+    if (val.has() && val->get_type() == datum_t::R_NULL) {
+        return counted_t<const datum_t>();
+    }
+    return val;
+}
+
+counted_t<const datum_t> aggregator_t::keep_extreme(counted_t<const datum_t> partial,
+                                                    counted_t<const datum_t> val) const {
+    if (partial->size() != 0) {
+        const datum_t &current = *partial->get(0);
+        if (kind == AGGREGATE_MIN ? !(*val < current) : !(*val > current)) {
+            return partial;
+        }
+    }
+    return make_counted<const datum_t>(std::vector<counted_t<const datum_t> >(1, val));
+}
+
+counted_t<const datum_t> aggregator_t::add_row(counted_t<const datum_t> partial,
+                                               counted_t<const datum_t> row) const {
+    if (kind == AGGREGATE_COUNT) {
+        return make_counted<const datum_t>(partial->as_num() + 1.0);
+    }
+
+    counted_t<const datum_t> val = field(row);
+    if (!val.has()) {
+        return partial;
+    }
+    switch (kind) {
+    case AGGREGATE_SUM:
+        return make_counted<const datum_t>(partial->as_num() + val->as_num());
+    case AGGREGATE_AVG:
+        return make_pair_datum(partial->get(0)->as_num() + val->as_num(),
+                               partial->get(1)->as_num() + 1.0);
+    case AGGREGATE_MIN:
+    case AGGREGATE_MAX:
+        return keep_extreme(partial, val);
+    case AGGREGATE_COUNT:
+    default: unreachable();
+    }
+}
+
+counted_t<const datum_t> aggregator_t::combine(counted_t<const datum_t> lhs,
+                                               counted_t<const datum_t> rhs) const {
+    switch (kind) {
+    case AGGREGATE_COUNT:
+    case AGGREGATE_SUM:
+        return make_counted<const datum_t>(lhs->as_num() + rhs->as_num());
+    case AGGREGATE_AVG:
+        return make_pair_datum(lhs->get(0)->as_num() + rhs->get(0)->as_num(),
+                               lhs->get(1)->as_num() + rhs->get(1)->as_num());
+    case AGGREGATE_MIN:
+    case AGGREGATE_MAX:
+        return rhs->size() == 0 ? lhs : keep_extreme(lhs, rhs->get(0));
+    default: unreachable();
+    }
+}
+
+counted_t<const datum_t> aggregator_t::finish(counted_t<const datum_t> partial) const {
+    switch (kind) {
+    case AGGREGATE_COUNT:
+    case AGGREGATE_SUM:
+        return partial;
+    case AGGREGATE_AVG: {
+        double count = partial->get(1)->as_num();
+        rcheck_target(partial.get(), base_exc_t::GENERIC, count != 0,
+                      "Cannot divide by zero.");
+        return make_counted<const datum_t>(partial->get(0)->as_num() / count);
+    }
+    case AGGREGATE_MIN:
+    case AGGREGATE_MAX:
+        return partial->size() == 0
+            ? make_counted<const datum_t>(datum_t::R_NULL)
+            : partial->get(0);
+    default: unreachable();
+    }
+}
+
+}  // namespace ql
@@ -0,0 +1,62 @@
+// Copyright 2010-2013 RethinkDB, all rights reserved.
+#ifndef RDB_PROTOCOL_AGGREGATE_HPP_
+#define RDB_PROTOCOL_AGGREGATE_HPP_
+
+#include <string>
+
+#include "containers/archive/archive.hpp"
+#include "containers/counted.hpp"
+#include "rdb_protocol/datum.hpp"
+#include "rpc/serialize_macros.hpp"
+
+namespace ql {
+
+enum aggregate_kind_t {
+    AGGREGATE_COUNT,
+    AGGREGATE_SUM,
+    AGGREGATE_AVG,
+    AGGREGATE_MIN,
+    AGGREGATE_MAX
+};
+
+ARCHIVE_PRIM_MAKE_RANGED_SERIALIZABLE(
+    aggregate_kind_t, int8_t, AGGREGATE_COUNT, AGGREGATE_MAX);
+
+// One of `groupBy`'s aggregators (`{SUM: 'attr'}` and friends), evaluated
+// without going through the interpreter.  Rows are folded into partial
+// aggregates on the shards, partials from different shards are combined on
+// the parsing node, and `finish` turns the result into what the user sees:
+//   COUNT    -- the number of rows.
+//   SUM      -- the sum of `attr`, with rows lacking it counting as 0.
+//   AVG      -- `[sum, count]` of the rows that have `attr`.
+//   MIN, MAX -- `[]`, or `[extreme]` once a row had `attr`.
+class aggregator_t {
+public:
+    aggregator_t() : kind(AGGREGATE_COUNT) { }
+    aggregator_t(aggregate_kind_t _kind, const std::string &_attr)
+        : kind(_kind), attr(_attr) { }
+
+    // The partial aggregate of a group with no rows.
+    counted_t<const datum_t> empty() const;
+    counted_t<const datum_t> add_row(counted_t<const datum_t> partial,
+                                     counted_t<const datum_t> row) const;
+    counted_t<const datum_t> combine(counted_t<const datum_t> lhs,
+                                     counted_t<const datum_t> rhs) const;
+    counted_t<const datum_t> finish(counted_t<const datum_t> partial) const;
+
+private:
+    // Returns `row[attr]`, or NULL if `row` has no such field (or it's null).
+    counted_t<const datum_t> field(counted_t<const datum_t> row) const;
+    counted_t<const datum_t> keep_extreme(counted_t<const datum_t> partial,
+                                          counted_t<const datum_t> val) const;
+
+    aggregate_kind_t kind;
+    std::string attr;
+
+public:
+    RDB_MAKE_ME_SERIALIZABLE_2(kind, attr);
+};
+
+}  // namespace ql
+
+#endif  // RDB_PROTOCOL_AGGREGATE_HPP_
@@ -1,4 +1,5 @@
 // Copyright 2010-2013 RethinkDB, all rights reserved.
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -12,11 +13,13 @@
 #include "btree/get_distribution.hpp"
 #include "btree/operations.hpp"
 #include "btree/parallel_traversal.hpp"
+#include "btree/superblock.hpp"
 #include "buffer_cache/blob.hpp"
 #include "containers/archive/buffer_group_stream.hpp"
 #include "containers/archive/vector_stream.hpp"
 #include "containers/scoped.hpp"
 #include "rdb_protocol/btree.hpp"
+#include "rdb_protocol/datum_json.hpp"
 #include "rdb_protocol/transform_visitors.hpp"
 
 typedef std::list<boost::shared_ptr<scoped_cJSON_t> > json_list_t;
@@ -99,6 +102,22 @@ boost::shared_ptr<scoped_cJSON_t> get_data(const rdb_value_t *value,
     return data;
 }
 
+counted_t<const ql::datum_t> get_datum(const rdb_value_t *value,
+                                       transaction_t *txn) {
+    blob_t blob(const_cast<rdb_value_t *>(value)->value_ref(), blob::btree_maxreflen);
+
+    counted_t<const ql::datum_t> data;
+
+    blob_acq_t acq_group;
+    buffer_group_t buffer_group;
+    blob.expose_all(txn, rwi_read, &buffer_group, &acq_group);
+    buffer_group_read_stream_t read_stream(const_view(&buffer_group));
+    int res = ql::deserialize_cjson_as_datum(&read_stream, &data);
+    guarantee_err(res == 0, "corruption detected... this should probably be an exception\n");
+
+    return data;
+}
+
 bool btree_value_fits(block_size_t bs, int data_length, const rdb_value_t *value) {
     return blob::ref_fits(bs, data_length, value->value_ref(), blob::btree_maxreflen);
 }
@@ -183,10 +202,8 @@ void rdb_replace_and_return_superblock(
         } else {
             // Otherwise pass the entry with this key to the function.
             started_empty = false;
-            boost::shared_ptr<scoped_cJSON_t> old_val_json =
-                get_data(kv_location.value.get(), txn);
-            guarantee(old_val_json->GetObjectItem(primary_key.c_str()));
-            old_val = make_counted<ql::datum_t>(old_val_json);
+            old_val = get_datum(kv_location.value.get(), txn);
+            guarantee(old_val->get(primary_key, ql::NOTHROW).has());
         }
         guarantee(old_val.has());
         if (return_vals == RETURN_VALS) {
@@ -621,6 +638,7 @@ public:
                                               const key_range_t &range,
                                               const key_range_t &_primary_key_range,
                                               direction_t _direction,
+                                              const covering_sindex_read_t &_covering,
                                               rget_read_response_t *_response) :
         bad_init(false),
         transaction(txn),
@@ -630,7 +648,8 @@ public:
         transform(_transform),
         terminal(_terminal),
         primary_key_range(_primary_key_range),
-        direction(_direction)
+        direction(_direction),
+        covering(_covering)
     {
         init(range);
     }
@@ -671,8 +690,9 @@ public:
         if (bad_init) {
             return false;
         }
+        std::string pk;
         if (primary_key_range) {
-            std::string pk = ql::datum_t::unprint_secondary(
+            pk = ql::datum_t::unprint_secondary(
                     key_to_unescaped_str(store_key_t(key)));
             if (!primary_key_range->contains_key(store_key_t(pk))) {
                 return true;
@@ -688,7 +708,40 @@ public:
             const rdb_value_t *rdb_value = reinterpret_cast<const rdb_value_t *>(value);
 
             json_list_t data;
-            data.push_back(get_data(rdb_value, transaction));
+            if (covering.covered_range) {
+                // The covering sindex stores [index value, covered fields].
+                boost::shared_ptr<scoped_cJSON_t> entry = get_data(rdb_value, transaction);
+                guarantee(entry->type() == cJSON_Array
+                          && cJSON_GetArraySize(entry->get()) == 2,
+                          "Corrupted covering sindex entry.");
+                counted_t<const ql::datum_t> index
+                    = make_counted<ql::datum_t>(cJSON_GetArrayItem(entry->get(), 0));
+                if (!covering.covered_range->contains(index)) {
+                    return true;
+                }
+                data.push_back(boost::shared_ptr<scoped_cJSON_t>(new scoped_cJSON_t(
+                    cJSON_DetachItemFromArray(entry->get(), 1))));
+            } else if (covering.primary_slice != NULL) {
+                // The sindex doesn't have all of the row, so we go and get it.
+                // The extra reference keeps the lookup from releasing the
+                // primary superblock, which the next row will need too.
+                rassert(primary_key_range);
+                refcount_superblock_t primary_superblock(covering.primary_superblock, 2);
+                keyvalue_location_t<rdb_value_t> kv_location;
+                find_keyvalue_location_for_read(transaction, &primary_superblock,
+                                                store_key_t(pk).btree_key(),
+                                                &kv_location,
+                                                covering.primary_slice->root_eviction_priority,
+                                                &covering.primary_slice->stats);
+                if (!kv_location.value.has()) {
+                    // The sindex is updated along with the primary btree, so
+                    // this shouldn't happen.
+                    return true;
+                }
+                data.push_back(get_data(kv_location.value.get(), transaction));
+            } else {
+                data.push_back(get_data(rdb_value, transaction));
+            }
 
             // Apply transforms to the data
             {
@@ -763,6 +816,7 @@ public:
     /* Only present if we're doing a sindex read.*/
     boost::optional<key_range_t> primary_key_range;
     direction_t direction;
+    covering_sindex_read_t covering;
 };
 
 class result_finalizer_visitor_t : public boost::static_visitor<void> {
@@ -812,8 +866,9 @@ void rdb_rget_secondary_slice(btree_slice_t *slice, const key_range_t &range,
                     const boost::optional<rdb_protocol_details::terminal_t> &terminal,
                     const key_range_t &pk_range,
                     direction_t direction,
+                    const covering_sindex_read_t &covering,
                     rget_read_response_t *response) {
-    rdb_rget_depth_first_traversal_callback_t callback(txn, ql_env, transform, terminal, range, pk_range, direction, response);
+    rdb_rget_depth_first_traversal_callback_t callback(txn, ql_env, transform, terminal, range, pk_range, direction, covering, response);
     btree_depth_first_traversal(slice, txn, superblock, range, &callback, direction);
 
     if (callback.cumulative_size >= rget_max_chunk_size) {
@@ -925,6 +980,9 @@ void rdb_modification_report_cb_t::replace_row(const store_key_t &primary_key,
 }
 
 rdb_modification_report_cb_t::~rdb_modification_report_cb_t() {
+    // The reports are already in the sindex queue, so they have to be applied
+    // to the post-constructed sindexes whatever happened to the write.
+    flush();
     if (token_pair_->sindex_write_token.has()) {
         token_pair_->sindex_write_token.reset();
     }
@@ -950,11 +1008,69 @@ void rdb_modification_report_cb_t::on_mod_report(
     wm << rdb_sindex_change_t(mod_report);
     store_->sindex_queue_push(wm, &acq);
 
-    rdb_update_sindexes(sindexes_, &mod_report, txn_);
+    pending_mod_reports_.push_back(mod_report);
+}
+
+void rdb_modification_report_cb_t::flush() {
+    if (pending_mod_reports_.empty()) {
+        return;
+    }
+    rdb_update_sindexes(sindexes_, pending_mod_reports_, txn_);
+    pending_mod_reports_.clear();
 }
 
 typedef btree_store_t<rdb_protocol_t>::sindex_access_vector_t sindex_access_vector_t;
 
+void serialize_sindex_info(write_message_t *wm,
+                           const ql::map_wire_func_t &mapping,
+                           const std::vector<std::string> &covered_fields) {
+    *wm << mapping;
+    if (!covered_fields.empty()) {
+        *wm << covered_fields;
+    }
+}
+
+void deserialize_sindex_info(const std::vector<char> &data,
+                             ql::map_wire_func_t *mapping,
+                             std::vector<std::string> *covered_fields) {
+    vector_read_stream_t read_stream(&data);
+    int success = deserialize(&read_stream, mapping);
+    guarantee(success == ARCHIVE_SUCCESS, "Corrupted sindex description.");
+
+    success = deserialize(&read_stream, covered_fields);
+    if (success == ARCHIVE_SOCK_EOF) {
+        covered_fields->clear();
+    } else {
+        guarantee(success == ARCHIVE_SUCCESS, "Corrupted sindex description.");
+    }
+}
+
+/* What a sindex stores for `row` (of which `row_json` is the JSON), given the
+row's `index` value: the whole row, or for a covering sindex an array of the
+index value and the covered fields of the row. */
+boost::shared_ptr<scoped_cJSON_t> sindex_entry_value(
+        const boost::shared_ptr<scoped_cJSON_t> &row_json,
+        counted_t<const ql::datum_t> row,
+        counted_t<const ql::datum_t> index,
+        const std::vector<std::string> &covered_fields) {
+    if (covered_fields.empty()) {
+        return row_json;
+    }
+
+    scoped_ptr_t<ql::datum_t> covered(new ql::datum_t(ql::datum_t::R_OBJECT));
+    for (auto it = covered_fields.begin(); it != covered_fields.end(); ++it) {
+        counted_t<const ql::datum_t> field = row->get(*it, ql::NOTHROW);
+        if (field.has()) {
+            UNUSED bool b = covered->add(*it, field);
+        }
+    }
+
+    std::vector<counted_t<const ql::datum_t> > entry;
+    entry.push_back(index);
+    entry.push_back(counted_t<const ql::datum_t>(covered.release()));
+    return ql::datum_t(entry).as_json();
+}
+
 /* Used below by rdb_update_sindexes. */
 void rdb_update_single_sindex(
         const btree_store_t<rdb_protocol_t>::sindex_access_t *sindex,
@@ -968,9 +1084,8 @@ void rdb_update_single_sindex(
     guarantee(modification->primary_key.size() != 0);
 
     ql::map_wire_func_t mapping;
-    vector_read_stream_t read_stream(&sindex->sindex.opaque_definition);
-    int success = deserialize(&read_stream, &mapping);
-    guarantee(success == ARCHIVE_SUCCESS, "Corrupted sindex description.");
+    std::vector<std::string> covered_fields;
+    deserialize_sindex_info(sindex->sindex.opaque_definition, &mapping, &covered_fields);
 
     //TODO we just use a NULL environment here. People should not be able
     //to do anything that requires an environment like gets from other
@@ -1038,8 +1153,9 @@ void rdb_update_single_sindex(
                                              &dummy);
 
             kv_location_set(&kv_location, sindex_key,
-                            modification->info.added, sindex->btree,
-                            repli_timestamp_t::distant_past, txn);
+                            sindex_entry_value(modification->info.added, added,
+                                               index, covered_fields),
+                            sindex->btree, repli_timestamp_t::distant_past, txn);
         } catch (const ql::base_exc_t &) {
             // Do nothing (we just drop the row from the index).
         }
@@ -1060,6 +1176,107 @@ void rdb_update_sindexes(const sindex_access_vector_t &sindexes,
     }
 }
 
+/* A change to a sindex: what to store under the key, or nothing to delete
+whatever is there. */
+typedef std::pair<store_key_t, boost::shared_ptr<scoped_cJSON_t> > sindex_change_t;
+
+bool sindex_change_less(const sindex_change_t &a, const sindex_change_t &b) {
+    return a.first < b.first;
+}
+
+/* Used below by rdb_update_sindexes. */
+void rdb_update_single_sindex_batched(
+        const btree_store_t<rdb_protocol_t>::sindex_access_t *sindex,
+        const std::vector<rdb_modification_report_t> *modifications,
+        transaction_t *txn,
+        auto_drainer_t::lock_t) {
+    ql::map_wire_func_t mapping;
+    std::vector<std::string> covered_fields;
+    deserialize_sindex_info(sindex->sindex.opaque_definition, &mapping, &covered_fields);
+
+    // See `rdb_update_single_sindex` about the NULL environment.
+    cond_t non_interruptor;
+    ql::env_t env(&non_interruptor);
+    counted_t<ql::func_t> func = mapping.compile(&env);
+
+    /* Work out all the changes to the sindex first, so that we can make them
+    in key order: consecutive changes then mostly land in the leaf that the
+    previous one did, which is already in cache. The sort is stable so that
+    changes to the same key still happen in the order the modifications
+    did. */
+    std::vector<sindex_change_t> changes;
+    changes.reserve(modifications->size());
+    for (auto it = modifications->begin(); it != modifications->end(); ++it) {
+        // See `rdb_update_single_sindex` about default constructed reports.
+        guarantee(it->primary_key.size() != 0);
+
+        if (it->info.deleted) {
+            try {
+                counted_t<const ql::datum_t> index
+                    = func->call(make_counted<ql::datum_t>(it->info.deleted))->as_datum();
+                changes.push_back(sindex_change_t(
+                    store_key_t(index->print_secondary(it->primary_key)),
+                    boost::shared_ptr<scoped_cJSON_t>()));
+            } catch (const ql::base_exc_t &) {
+                // Do nothing (it wasn't actually in the index).
+            }
+        }
+
+        if (it->info.added) {
+            try {
+                counted_t<const ql::datum_t> added = make_counted<ql::datum_t>(it->info.added);
+                counted_t<const ql::datum_t> index = func->call(added)->as_datum();
+                changes.push_back(sindex_change_t(
+                    store_key_t(index->print_secondary(it->primary_key)),
+                    sindex_entry_value(it->info.added, added, index, covered_fields)));
+            } catch (const ql::base_exc_t &) {
+                // Do nothing (we just drop the row from the index).
+            }
+        }
+    }
+    std::stable_sort(changes.begin(), changes.end(), &sindex_change_less);
+
+    superblock_t *super_block = sindex->super_block.get();
+    for (auto it = changes.begin(); it != changes.end(); ++it) {
+        keyvalue_location_t<rdb_value_t> kv_location;
+
+        promise_t<superblock_t *> dummy;
+        find_keyvalue_location_for_write(txn,
+                                         super_block,
+                                         it->first.btree_key(),
+                                         &kv_location,
+                                         &sindex->btree->root_eviction_priority,
+                                         &sindex->btree->stats,
+                                         &dummy);
+
+        if (it->second) {
+            kv_location_set(&kv_location, it->first, it->second, sindex->btree,
+                            repli_timestamp_t::distant_past, txn);
+        } else if (kv_location.value.has()) {
+            kv_location_delete(&kv_location, it->first,
+                               sindex->btree, repli_timestamp_t::distant_past, txn);
+        }
+    }
+}
+
+void rdb_update_sindexes(const sindex_access_vector_t &sindexes,
+        const std::vector<rdb_modification_report_t> &modifications,
+        transaction_t *txn) {
+    if (modifications.empty()) {
+        return;
+    }
+
+    auto_drainer_t drainer;
+
+    for (sindex_access_vector_t::const_iterator it  = sindexes.begin();
+                                                it != sindexes.end();
+                                                ++it) {
+        coro_t::spawn_sometime(boost::bind(
+                    &rdb_update_single_sindex_batched, &*it,
+                    &modifications, txn, auto_drainer_t::lock_t(&drainer)));
+    }
+}
+
 void rdb_erase_range_sindexes(const sindex_access_vector_t &sindexes,
         const rdb_erase_range_report_t *erase_range,
         transaction_t *txn, signal_t *interruptor) {
@@ -1070,6 +1287,15 @@ void rdb_erase_range_sindexes(const sindex_access_vector_t &sindexes,
             false, /* don't release the superblock */ interruptor);
 }
 
+/* Reads the rows out of the primary btree and writes them to the sindexes, a
+leaf at a time. Each leaf's rows go to the sindexes together (so in key order,
+see `rdb_update_sindexes`), in a write transaction that is begun while the leaf
+is still locked, so that it's ordered before any write that changes the leaf
+after we've read it.
+
+The traversal reads leaves concurrently, but since each leaf's write takes a
+write token and the sindex superblocks, the writes themselves happen one leaf
+after another. The sindexes are built by ordinary inserts, not bottom-up. */
 class post_construct_traversal_helper_t : public btree_traversal_helper_t {
 public:
     post_construct_traversal_helper_t(
@@ -1137,19 +1363,19 @@ public:
 
         const leaf_node_t *leaf_node = static_cast<const leaf_node_t *>(leaf_node_buf->get_data_read());
 
+        std::vector<rdb_modification_report_t> mod_reports;
         for (auto it = leaf::begin(*leaf_node); it != leaf::end(*leaf_node); ++it) {
             /* Grab relevant values from the leaf node. */
             const btree_key_t *key = (*it).first;
             const void *value = (*it).second;
             guarantee(key);
 
-            store_key_t pk(key);
-            rdb_modification_report_t mod_report(pk);
             const rdb_value_t *rdb_value = static_cast<const rdb_value_t *>(value);
-            mod_report.info.added = get_data(rdb_value, txn);
-
-            rdb_update_sindexes(sindexes, &mod_report, wtxn.get());
+            mod_reports.push_back(rdb_modification_report_t(store_key_t(key)));
+            mod_reports.back().info.added = get_data(rdb_value, txn);
         }
+
+        rdb_update_sindexes(sindexes, mod_reports, wtxn.get());
     }
 
     void postprocess_internal_node(buf_lock_t *) { }
@@ -1182,20 +1408,31 @@ void post_construct_secondary_indexes(
     post_construct_traversal_helper_t helper(store,
             sindexes_to_post_construct, &local_interruptor, interruptor);
 
-    object_buffer_t<fifo_enforcer_sink_t::exit_read_t> read_token;
-    store->new_read_token(&read_token);
-
-    scoped_ptr_t<transaction_t> txn;
-    scoped_ptr_t<real_superblock_t> superblock;
-
-    store->acquire_superblock_for_read(
-        rwi_read,
-        &read_token,
-        &txn,
-        &superblock,
-        interruptor,
-        true /* USE_SNAPSHOT */);
-
-    btree_parallel_traversal(txn.get(), superblock.get(),
-            store->btree.get(), &helper, &wait_any);
+    // Only `sindex_not_post_constructed_exc_t` reports this; the progress app
+    // doesn't know about post-constructions.
+    parallel_traversal_progress_t progress;
+    helper.progress = &progress;
+    store->register_sindex_post_construction(sindexes_to_post_construct, &progress);
+    try {
+        object_buffer_t<fifo_enforcer_sink_t::exit_read_t> read_token;
+        store->new_read_token(&read_token);
+
+        scoped_ptr_t<transaction_t> txn;
+        scoped_ptr_t<real_superblock_t> superblock;
+
+        store->acquire_superblock_for_read(
+            rwi_read,
+            &read_token,
+            &txn,
+            &superblock,
+            interruptor,
+            true /* USE_SNAPSHOT */);
+
+        btree_parallel_traversal(txn.get(), superblock.get(),
+                store->btree.get(), &helper, &wait_any);
+    } catch (const interrupted_exc_t &) {
+        store->deregister_sindex_post_construction(sindexes_to_post_construct);
+        throw;
+    }
+    store->deregister_sindex_post_construction(sindexes_to_post_construct);
 }
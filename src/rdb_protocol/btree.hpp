@@ -164,6 +164,23 @@ void rdb_rget_slice(btree_slice_t *slice, const key_range_t &range,
                     direction_t direction,
                     rget_read_response_t *response);
 
+/* How `rdb_rget_secondary_slice` gets at the rows of a covering sindex (see
+`sindex_create_t::covered_fields`), which only has some of each row's fields.
+Reads through other sindexes leave all of this unset. */
+struct covering_sindex_read_t {
+    covering_sindex_read_t() : primary_slice(NULL), primary_superblock(NULL) { }
+
+    /* Set if the read only needs covered fields. The rows then come straight
+    from the sindex, and those whose index value isn't in `covered_range` are
+    skipped (the transform shouldn't filter on the sindex mapping). */
+    boost::optional<rdb_protocol_t::sindex_range_t> covered_range;
+
+    /* Set otherwise, in which case each row is read from the primary btree.
+    `primary_superblock` must stay acquired until the read is done. */
+    btree_slice_t *primary_slice;
+    superblock_t *primary_superblock;
+};
+
 void rdb_rget_secondary_slice(btree_slice_t *slice, const key_range_t &range,
                     transaction_t *txn, superblock_t *superblock,
                     ql::env_t *ql_env,
@@ -171,6 +188,7 @@ void rdb_rget_secondary_slice(btree_slice_t *slice, const key_range_t &range,
                     const boost::optional<rdb_protocol_details::terminal_t> &terminal,
                     const key_range_t &pk_range,
                     direction_t direction,
+                    const covering_sindex_read_t &covering,
                     rget_read_response_t *response);
 
 void rdb_distribution_get(btree_slice_t *slice, int max_depth, const store_key_t &left_key,
@@ -178,6 +196,16 @@ void rdb_distribution_get(btree_slice_t *slice, int max_depth, const store_key_t
 
 /* Secondary Indexes */
 
+/* A sindex's opaque definition is its mapping, followed by the fields it
+covers if it's a covering sindex. (Sindexes made before there were covering
+sindexes just have the mapping.) */
+void serialize_sindex_info(write_message_t *wm,
+                           const ql::map_wire_func_t &mapping,
+                           const std::vector<std::string> &covered_fields);
+void deserialize_sindex_info(const std::vector<char> &data,
+                             ql::map_wire_func_t *mapping,
+                             std::vector<std::string> *covered_fields);
+
 struct rdb_modification_info_t {
     boost::shared_ptr<scoped_cJSON_t> deleted;
     boost::shared_ptr<scoped_cJSON_t> added;
@@ -223,10 +251,15 @@ public:
             boost::shared_ptr<scoped_cJSON_t> added,
             boost::shared_ptr<scoped_cJSON_t> removed);
 
+    /* Records the change in the sindex queue, and saves it to be applied to
+    the sindexes along with the rest of the changes reported to this callback,
+    all together, when it's destroyed. */
     void on_mod_report(const rdb_modification_report_t &mod_report);
 
     ~rdb_modification_report_cb_t();
 private:
+    /* Applies the changes reported so far to the sindexes. */
+    void flush();
 
     /* Fields initialized by the constructor. */
     btree_store_t<rdb_protocol_t> *store_;
@@ -238,6 +271,7 @@ private:
     /* Fields initialized by calls to on_mod_report */
     scoped_ptr_t<buf_lock_t> sindex_block_;
     btree_store_t<rdb_protocol_t>::sindex_access_vector_t sindexes_;
+    std::vector<rdb_modification_report_t> pending_mod_reports_;
 };
 
 void rdb_update_sindexes(
@@ -245,6 +279,13 @@ void rdb_update_sindexes(
         const rdb_modification_report_t *modification,
         transaction_t *txn);
 
+/* Applies all of `modifications` to each sindex, with the sindexes being updated
+concurrently and each one's changes made in key order. */
+void rdb_update_sindexes(
+        const btree_store_t<rdb_protocol_t>::sindex_access_vector_t &sindexes,
+        const std::vector<rdb_modification_report_t> &modifications,
+        transaction_t *txn);
+
 void rdb_erase_range_sindexes(
         const btree_store_t<rdb_protocol_t>::sindex_access_vector_t &sindexes,
         const rdb_erase_range_report_t *erase_range,
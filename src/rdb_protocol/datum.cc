@@ -6,12 +6,56 @@
 #include <math.h>
 #include <algorithm>
 
+#include "rdb_protocol/datum_json.hpp"
 #include "rdb_protocol/env.hpp"
 #include "rdb_protocol/error.hpp"
 #include "rdb_protocol/proto_utils.hpp"
 
 namespace ql {
 
+datum_object_t::datum_object_t(
+    const std::map<std::string, counted_t<const datum_t> > &map)
+    : fields(map.begin(), map.end()) { }
+
+bool datum_object_t::key_less(const field_t &field, const std::string &key) {
+    return field.first < key;
+}
+
+datum_object_t::const_iterator datum_object_t::find(const std::string &key) const {
+    const_iterator it = std::lower_bound(fields.begin(), fields.end(), key, key_less);
+    return it != fields.end() && it->first == key ? it : end();
+}
+
+bool datum_object_t::set(const std::string &key, counted_t<const datum_t> val,
+                         bool clobber) {
+    // Objects are usually built in key order, from another object or a
+    // protobuf, so check for that before searching.
+    if (fields.empty() || fields.back().first < key) {
+        fields.push_back(field_t(key, std::move(val)));
+        return false;
+    }
+    std::vector<field_t>::iterator it
+        = std::lower_bound(fields.begin(), fields.end(), key, key_less);
+    if (it != fields.end() && it->first == key) {
+        if (clobber) {
+            it->second = std::move(val);
+        }
+        return true;
+    }
+    fields.insert(it, field_t(key, std::move(val)));
+    return false;
+}
+
+bool datum_object_t::erase(const std::string &key) {
+    std::vector<field_t>::iterator it
+        = std::lower_bound(fields.begin(), fields.end(), key, key_less);
+    if (it != fields.end() && it->first == key) {
+        fields.erase(it);
+        return true;
+    }
+    return false;
+}
+
 datum_t::datum_t(type_t _type, bool _bool) : type(_type), r_bool(_bool) {
     r_sanity_check(_type == R_BOOL);
 }
@@ -30,8 +74,9 @@ datum_t::datum_t(const char *cstr)
 datum_t::datum_t(const std::vector<counted_t<const datum_t> > &_array)
     : type(R_ARRAY), r_array(new std::vector<counted_t<const datum_t> >(_array)) { }
 datum_t::datum_t(const std::map<std::string, counted_t<const datum_t> > &_object)
-    : type(R_OBJECT),
-      r_object(new std::map<std::string, counted_t<const datum_t> >(_object)) { }
+    : type(R_OBJECT), r_object(new datum_object_t(_object)) { }
+datum_t::datum_t(const datum_object_t &_object)
+    : type(R_OBJECT), r_object(new datum_object_t(_object)) { }
 datum_t::datum_t(datum_t::type_t _type) : type(_type) {
     r_sanity_check(type == R_ARRAY || type == R_OBJECT || type == R_NULL);
     switch (type) {
@@ -45,7 +90,7 @@ datum_t::datum_t(datum_t::type_t _type) : type(_type) {
         r_array = new std::vector<counted_t<const datum_t> >();
     } break;
     case R_OBJECT: {
-        r_object = new std::map<std::string, counted_t<const datum_t> >();
+        r_object = new datum_object_t();
     } break;
     case UNINITIALIZED: //fallthru
     default: unreachable();
@@ -86,7 +131,7 @@ void datum_t::init_array() {
 
 void datum_t::init_object() {
     type = R_OBJECT;
-    r_object = new std::map<std::string, counted_t<const datum_t> >();
+    r_object = new datum_object_t();
 }
 
 void datum_t::init_json(cJSON *json) {
@@ -122,6 +167,7 @@ void datum_t::init_json(cJSON *json) {
     } break;
     case cJSON_Object: {
         init_object();
+        r_object->reserve(cJSON_GetArraySize(json));
         for (int i = 0; i < cJSON_GetArraySize(json); ++i) {
             cJSON *el = cJSON_GetArrayItem(json, i);
             bool conflict = add(el->string, make_counted<datum_t>(el));
@@ -170,7 +216,9 @@ const char *datum_t::get_type_name() const {
 }
 
 std::string datum_t::print() const {
-    return as_json()->Print();
+    std::string res;
+    datum_to_json(*this, &res);
+    return res;
 }
 
 std::string datum_t::trunc_print() const {
@@ -469,8 +517,7 @@ counted_t<const datum_t> datum_t::get(size_t index, throw_bool_t throw_bool) con
 
 counted_t<const datum_t> datum_t::get(const std::string &key,
                                       throw_bool_t throw_bool) const {
-    std::map<std::string, counted_t<const datum_t> >::const_iterator it
-        = as_object().find(key);
+    datum_object_t::const_iterator it = as_object().find(key);
     if (it != as_object().end()) return it->second;
     if (throw_bool == THROW) {
         rfail(base_exc_t::NON_EXISTENCE,
@@ -479,7 +526,7 @@ counted_t<const datum_t> datum_t::get(const std::string &key,
     return counted_t<const datum_t>();
 }
 
-const std::map<std::string, counted_t<const datum_t> > &datum_t::as_object() const {
+const datum_object_t &datum_t::as_object() const {
     check_type(R_OBJECT);
     return *r_object;
 }
@@ -499,7 +546,7 @@ cJSON *datum_t::as_raw_json() const {
     } break;
     case R_OBJECT: {
         scoped_cJSON_t obj(cJSON_CreateObject());
-        for (std::map<std::string, counted_t<const datum_t> >::const_iterator
+        for (datum_object_t::const_iterator
                  it = as_object().begin(); it != as_object().end(); ++it) {
             obj.AddItemToObject(it->first.c_str(), it->second->as_raw_json());
         }
@@ -547,9 +594,7 @@ MUST_USE bool datum_t::add(const std::string &key, counted_t<const datum_t> val,
     check_type(R_OBJECT);
     check_str_validity(key);
     r_sanity_check(val.has());
-    bool key_in_obj = r_object->count(key) > 0;
-    if (!key_in_obj || (clobber_bool == CLOBBER)) (*r_object)[key] = val;
-    return key_in_obj;
+    return r_object->set(key, std::move(val), clobber_bool == CLOBBER);
 }
 
 MUST_USE bool datum_t::delete_key(const std::string &key) {
@@ -558,7 +603,7 @@ MUST_USE bool datum_t::delete_key(const std::string &key) {
 
 counted_t<const datum_t> datum_t::merge(counted_t<const datum_t> rhs) const {
     scoped_ptr_t<datum_t> d(new datum_t(as_object()));
-    const std::map<std::string, counted_t<const datum_t> > &rhs_obj = rhs->as_object();
+    const datum_object_t &rhs_obj = rhs->as_object();
     for (auto it = rhs_obj.begin(); it != rhs_obj.end(); ++it) {
         UNUSED bool b = d->add(it->first, it->second, CLOBBER);
     }
@@ -567,7 +612,7 @@ counted_t<const datum_t> datum_t::merge(counted_t<const datum_t> rhs) const {
 
 counted_t<const datum_t> datum_t::merge(counted_t<const datum_t> rhs, merge_res_f f) const {
     scoped_ptr_t<datum_t> d(new datum_t(as_object()));
-    const std::map<std::string, counted_t<const datum_t> > &rhs_obj = rhs->as_object();
+    const datum_object_t &rhs_obj = rhs->as_object();
     for (auto it = rhs_obj.begin(); it != rhs_obj.end(); ++it) {
         if (counted_t<const datum_t> left = get(it->first, NOTHROW)) {
             bool b = d->add(it->first,
@@ -611,9 +656,8 @@ int datum_t::cmp(const datum_t &rhs) const {
         return i == rhs.as_array().size() ? 0 : -1;
     } unreachable();
     case R_OBJECT: {
-        const std::map<std::string, counted_t<const datum_t> > &obj = as_object();
-        const std::map<std::string, counted_t<const datum_t> > &rhs_obj
-            = rhs.as_object();
+        const datum_object_t &obj = as_object();
+        const datum_object_t &rhs_obj = rhs.as_object();
         auto it = obj.begin();
         auto it2 = rhs_obj.begin();
         while (it != obj.end() && it2 != rhs_obj.end()) {
@@ -682,14 +726,17 @@ void datum_t::init_from_pb(const Datum *d) {
     } break;
     case Datum::R_OBJECT: {
         init_object();
-        for (int i = 0; i < d->r_object_size(); ++i) {
+        r_object->reserve(d->r_object_size());
+        // We write objects out in reverse (see `write_to_protobuf`), so
+        // reading them backwards adds the keys in order.
+        for (int i = d->r_object_size() - 1; i >= 0; --i) {
             const Datum_AssocPair *ap = &d->r_object(i);
             const std::string &key = ap->key();
             check_str_validity(key);
-            rcheck(r_object->count(key) == 0,
+            bool conflict = r_object->set(key, make_counted<datum_t>(&ap->val()), false);
+            rcheck(!conflict,
                    base_exc_t::GENERIC,
                    strprintf("Duplicate key %s in object.", key.c_str()));
-            (*r_object)[key] = make_counted<datum_t>(&ap->val());
         }
     } break;
     default: unreachable();
@@ -739,7 +786,7 @@ void datum_t::write_to_protobuf(Datum *d) const {
     case R_OBJECT: {
         d->set_type(Datum::R_OBJECT);
         // We use rbegin and rend so that things print the way we expect.
-        for (std::map<std::string, counted_t<const datum_t> >::const_reverse_iterator
+        for (datum_object_t::const_reverse_iterator
                  it = r_object->rbegin(); it != r_object->rend(); ++it) {
             Datum_AssocPair *ap = d->add_r_object();
             ap->set_key(it->first);
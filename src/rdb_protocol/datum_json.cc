@@ -0,0 +1,481 @@
+// Copyright 2010-2013 RethinkDB, all rights reserved.
+#include "rdb_protocol/datum_json.hpp"
+
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "http/json.hpp"
+#include "rdb_protocol/datum.hpp"
+#include "rdb_protocol/error.hpp"
+
+namespace ql {
+
+// Strings are scanned a word at a time: we only look at the bytes one by one
+// in words that have something interesting in them.  See "Determine if a word
+// has a zero byte" in Sean Anderson's "Bit Twiddling Hacks"; the tests below
+// never miss a matching byte, and a word without one never matches.
+static const uint64_t ONES = 0x0101010101010101ULL;
+static const uint64_t HIGHS = 0x8080808080808080ULL;
+static const size_t WORD_SIZE = sizeof(uint64_t);
+
+static inline uint64_t load_word(const char *p) {
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+    return word;
+}
+
+// Whether the word has a control character, a quote or a backslash in it: the
+// bytes that have to be escaped in a JSON string.  (The high bit of `~word` is
+// the same as that of `~(word ^ c)` for both of those ASCII characters.)
+static inline bool has_byte_to_escape(uint64_t word) {
+    const uint64_t quotes = word ^ (ONES * '"');
+    const uint64_t backslashes = word ^ (ONES * '\\');
+    return (((word - ONES * 0x20) | (quotes - ONES) | (backslashes - ONES))
+            & ~word & HIGHS) != 0;
+}
+
+// Whether the word has a NUL, a quote or a backslash in it: the bytes that end
+// a run of plain characters in a JSON string we're parsing.
+static inline bool has_byte_ending_run(uint64_t word) {
+    const uint64_t quotes = word ^ (ONES * '"');
+    const uint64_t backslashes = word ^ (ONES * '\\');
+    return (((word - ONES) | (quotes - ONES) | (backslashes - ONES))
+            & ~word & HIGHS) != 0;
+}
+
+static void write_json_number(double d, std::string *out) {
+    // Integers print without a decimal point, like `cJSON` prints them.
+    char buf[64];
+    int len;
+    if (d <= INT_MAX && d >= INT_MIN
+        && fabs(static_cast<double>(static_cast<int>(d)) - d) <= DBL_EPSILON) {
+        len = snprintf(buf, sizeof(buf), "%d", static_cast<int>(d));
+    } else {
+        len = snprintf(buf, sizeof(buf), "%.32g", d);
+    }
+    guarantee(len > 0 && static_cast<size_t>(len) < sizeof(buf));
+    out->append(buf, len);
+}
+
+static void write_json_string(const std::string &str, std::string *out) {
+    out->push_back('"');
+    const char *p = str.data();
+    const char *const end = p + str.size();
+    while (p < end) {
+        const char *run = p;
+        while (end - p >= static_cast<ptrdiff_t>(WORD_SIZE)
+               && !has_byte_to_escape(load_word(p))) {
+            p += WORD_SIZE;
+        }
+        while (p < end && static_cast<unsigned char>(*p) > 31
+               && *p != '"' && *p != '\\') {
+            ++p;
+        }
+        out->append(run, p - run);
+        if (p == end) {
+            break;
+        }
+
+        const unsigned char c = *p++;
+        switch (c) {
+        case '\\': out->append("\\\\"); break;
+        case '"': out->append("\\\""); break;
+        case '\b': out->append("\\b"); break;
+        case '\f': out->append("\\f"); break;
+        case '\n': out->append("\\n"); break;
+        case '\r': out->append("\\r"); break;
+        case '\t': out->append("\\t"); break;
+        default: {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out->append(buf);
+        } break;
+        }
+    }
+    out->push_back('"');
+}
+
+static void write_json(const datum_t &d, int depth, std::string *out) {
+    switch (d.get_type()) {
+    case datum_t::R_NULL: out->append("null"); break;
+    case datum_t::R_BOOL: out->append(d.as_bool() ? "true" : "false"); break;
+    case datum_t::R_NUM: write_json_number(d.as_num(), out); break;
+    case datum_t::R_STR: write_json_string(d.as_str(), out); break;
+    case datum_t::R_ARRAY: {
+        const std::vector<counted_t<const datum_t> > &arr = d.as_array();
+        out->push_back('[');
+        for (size_t i = 0; i < arr.size(); ++i) {
+            if (i != 0) {
+                out->append(", ");
+            }
+            write_json(*arr[i], depth + 1, out);
+        }
+        out->push_back(']');
+    } break;
+    case datum_t::R_OBJECT: {
+        const datum_object_t &obj = d.as_object();
+        out->append("{\n");
+        for (auto it = obj.begin(); it != obj.end(); ++it) {
+            out->append(depth + 1, '\t');
+            write_json_string(it->first, out);
+            out->append(":\t");
+            write_json(*it->second, depth + 1, out);
+            if (it + 1 != obj.end()) {
+                out->push_back(',');
+            }
+            out->push_back('\n');
+        }
+        out->append(depth, '\t');
+        out->push_back('}');
+    } break;
+    case datum_t::UNINITIALIZED: // fallthru
+    default: unreachable();
+    }
+}
+
+void datum_to_json(const datum_t &d, std::string *out) {
+    write_json(d, 0, out);
+}
+
+// The parser follows `cJSON`'s closely, down to what it lets slide.  Each
+// `parse_*` function returns where it stopped, or NULL if the input isn't
+// JSON.  Like `cJSON`'s, it takes a NUL for the end of the input, and only
+// looks at a whole word at a time if the word is all before the end.
+class json_parser_t {
+public:
+    // `c_str()` is what gets us the NUL at the end.
+    explicit json_parser_t(const std::string &json)
+        : start_(json.c_str()), end_(json.c_str() + json.size()) { }
+
+    // Like `cJSON_Parse`, this ignores anything after the first value.
+    const char *parse(counted_t<const datum_t> *out) {
+        return parse_value(skip(start_), out);
+    }
+
+private:
+    static const char *skip(const char *p) {
+        while (*p != '\0' && static_cast<unsigned char>(*p) <= 32) {
+            ++p;
+        }
+        return p;
+    }
+
+    const char *parse_value(const char *p, counted_t<const datum_t> *out);
+    const char *parse_number(const char *p, counted_t<const datum_t> *out);
+    const char *parse_string(const char *p, std::string *out);
+    const char *parse_array(const char *p, counted_t<const datum_t> *out);
+    const char *parse_object(const char *p, counted_t<const datum_t> *out);
+
+    // Reads up to four hex digits, like `sscanf("%4x")`.
+    static unsigned parse_hex4(const char *p);
+
+    const char *const start_;
+    const char *const end_;
+};
+
+const char *json_parser_t::parse_value(const char *p, counted_t<const datum_t> *out) {
+    if (strncmp(p, "null", 4) == 0) {
+        *out = make_counted<const datum_t>(datum_t::R_NULL);
+        return p + 4;
+    }
+    if (strncmp(p, "false", 5) == 0) {
+        *out = make_counted<const datum_t>(datum_t::R_BOOL, false);
+        return p + 5;
+    }
+    if (strncmp(p, "true", 4) == 0) {
+        *out = make_counted<const datum_t>(datum_t::R_BOOL, true);
+        return p + 4;
+    }
+    if (*p == '"') {
+        std::string str;
+        p = parse_string(p, &str);
+        *out = make_counted<const datum_t>(str);
+        return p;
+    }
+    if (*p == '-' || (*p >= '0' && *p <= '9')) {
+        return parse_number(p, out);
+    }
+    if (*p == '[') {
+        return parse_array(p, out);
+    }
+    if (*p == '{') {
+        return parse_object(p, out);
+    }
+    return NULL;
+}
+
+const char *json_parser_t::parse_number(const char *p, counted_t<const datum_t> *out) {
+    // This is `cJSON`'s arithmetic, so that we get the same doubles it did.
+    double n = 0, sign = 1, scale = 0;
+    int subscale = 0, signsubscale = 1;
+    if (*p == '-') {
+        sign = -1;
+        ++p;
+    }
+    if (*p == '0') {
+        ++p;
+    }
+    if (*p >= '1' && *p <= '9') {
+        do {
+            n = (n * 10.0) + (*p++ - '0');
+        } while (*p >= '0' && *p <= '9');
+    }
+    if (*p == '.' && p[1] >= '0' && p[1] <= '9') {
+        ++p;
+        do {
+            n = (n * 10.0) + (*p++ - '0');
+            --scale;
+        } while (*p >= '0' && *p <= '9');
+    }
+    if (*p == 'e' || *p == 'E') {
+        ++p;
+        if (*p == '+') {
+            ++p;
+        } else if (*p == '-') {
+            signsubscale = -1;
+            ++p;
+        }
+        while (*p >= '0' && *p <= '9') {
+            subscale = (subscale * 10) + (*p++ - '0');
+        }
+    }
+    n = sign * n * pow(10.0, (scale + subscale * signsubscale));
+
+    // so we can use `isfinite` in a GCC 4.4.3-compatible way
+    using namespace std;  // NOLINT(build/namespaces)
+    rcheck_toplevel(isfinite(n), base_exc_t::GENERIC,
+                    strprintf("Non-finite value `%lf` in JSON.", n));
+    *out = make_counted<const datum_t>(n);
+    return p;
+}
+
+unsigned json_parser_t::parse_hex4(const char *p) {
+    unsigned res = 0;
+    for (int i = 0; i < 4; ++i, ++p) {
+        if (*p >= '0' && *p <= '9') {
+            res = res * 16 + (*p - '0');
+        } else if (*p >= 'a' && *p <= 'f') {
+            res = res * 16 + (*p - 'a' + 10);
+        } else if (*p >= 'A' && *p <= 'F') {
+            res = res * 16 + (*p - 'A' + 10);
+        } else {
+            break;
+        }
+    }
+    return res;
+}
+
+const char *json_parser_t::parse_string(const char *p, std::string *out) {
+    static const unsigned char first_byte_mark[5] = { 0x00, 0x00, 0xC0, 0xE0, 0xF0 };
+
+    if (*p != '"') {
+        return NULL;
+    }
+    ++p;
+    for (;;) {
+        const char *run = p;
+        while (end_ - p >= static_cast<ptrdiff_t>(WORD_SIZE)
+               && !has_byte_ending_run(load_word(p))) {
+            p += WORD_SIZE;
+        }
+        while (*p != '\0' && *p != '"' && *p != '\\') {
+            ++p;
+        }
+        out->append(run, p - run);
+        // Like `cJSON`, we take the end of the input as the end of the string.
+        if (*p != '\\') {
+            break;
+        }
+
+        ++p;
+        switch (*p) {
+        case '\0': return p;
+        case 'b': out->push_back('\b'); break;
+        case 'f': out->push_back('\f'); break;
+        case 'n': out->push_back('\n'); break;
+        case 'r': out->push_back('\r'); break;
+        case 't': out->push_back('\t'); break;
+        case 'u': {
+            // Transcode UTF-16 to UTF-8, skipping what isn't valid.
+            unsigned uc = parse_hex4(p + 1);
+            for (int i = 0; i < 4 && p[1] != '\0'; ++i) {
+                ++p;
+            }
+            if ((uc >= 0xDC00 && uc <= 0xDFFF) || uc == 0) {
+                break;
+            }
+            if (uc >= 0xD800 && uc <= 0xDBFF) {
+                if (p[1] != '\\' || p[2] != 'u') {
+                    break;
+                }
+                const unsigned uc2 = parse_hex4(p + 3);
+                for (int i = 0; i < 6 && p[1] != '\0'; ++i) {
+                    ++p;
+                }
+                if (uc2 < 0xDC00 || uc2 > 0xDFFF) {
+                    break;
+                }
+                uc = 0x10000 | ((uc & 0x3FF) << 10) | (uc2 & 0x3FF);
+            }
+
+            const int len = uc < 0x80 ? 1 : uc < 0x800 ? 2 : uc < 0x10000 ? 3 : 4;
+            char utf8[4];
+            for (int i = len - 1; i > 0; --i) {
+                utf8[i] = (uc | 0x80) & 0xBF;
+                uc >>= 6;
+            }
+            utf8[0] = uc | first_byte_mark[len];
+            out->append(utf8, len);
+        } break;
+        default: out->push_back(*p); break;
+        }
+        ++p;
+    }
+    if (*p == '"') {
+        ++p;
+    }
+    return p;
+}
+
+const char *json_parser_t::parse_array(const char *p, counted_t<const datum_t> *out) {
+    rassert(*p == '[');
+    scoped_ptr_t<datum_t> arr(new datum_t(datum_t::R_ARRAY));
+    p = skip(p + 1);
+    if (*p != ']') {
+        for (;;) {
+            counted_t<const datum_t> item;
+            p = parse_value(skip(p), &item);
+            if (p == NULL) {
+                return NULL;
+            }
+            arr->add(item);
+            p = skip(p);
+            if (*p != ',') {
+                break;
+            }
+            ++p;
+        }
+        if (*p != ']') {
+            return NULL;
+        }
+    }
+    *out = counted_t<const datum_t>(arr.release());
+    return p + 1;
+}
+
+const char *json_parser_t::parse_object(const char *p, counted_t<const datum_t> *out) {
+    rassert(*p == '{');
+    scoped_ptr_t<datum_t> obj(new datum_t(datum_t::R_OBJECT));
+    p = skip(p + 1);
+    if (*p != '}') {
+        for (;;) {
+            std::string key;
+            p = parse_string(skip(p), &key);
+            if (p == NULL) {
+                return NULL;
+            }
+            p = skip(p);
+            if (*p != ':') {
+                return NULL;
+            }
+            counted_t<const datum_t> val;
+            p = parse_value(skip(p + 1), &val);
+            if (p == NULL) {
+                return NULL;
+            }
+            const bool conflict = obj->add(key, val);
+            rcheck_toplevel(!conflict, base_exc_t::GENERIC,
+                            strprintf("Duplicate key `%s` in JSON.", key.c_str()));
+            p = skip(p);
+            if (*p != ',') {
+                break;
+            }
+            ++p;
+        }
+        if (*p != '}') {
+            return NULL;
+        }
+    }
+    *out = counted_t<const datum_t>(obj.release());
+    return p + 1;
+}
+
+counted_t<const datum_t> json_to_datum(const std::string &json) {
+    json_parser_t parser(json);
+    counted_t<const datum_t> res;
+    if (parser.parse(&res) == NULL) {
+        return counted_t<const datum_t>();
+    }
+    return res;
+}
+
+archive_result_t deserialize_cjson_as_datum(read_stream_t *s,
+                                            counted_t<const datum_t> *out) {
+    // This is the format `operator<<(write_message_t &, const cJSON &)` writes.
+    int type;
+    archive_result_t res = deserialize(s, &type);
+    if (res) { return res; }
+
+    switch (type) {
+    case cJSON_False: // fallthru
+    case cJSON_True:
+        *out = make_counted<const datum_t>(datum_t::R_BOOL, type == cJSON_True);
+        return ARCHIVE_SUCCESS;
+    case cJSON_NULL:
+        *out = make_counted<const datum_t>(datum_t::R_NULL);
+        return ARCHIVE_SUCCESS;
+    case cJSON_Number: {
+        double num;
+        res = deserialize(s, &num);
+        if (res) { return res; }
+        *out = make_counted<const datum_t>(num);
+        return ARCHIVE_SUCCESS;
+    }
+    case cJSON_String: {
+        std::string str;
+        res = deserialize(s, &str);
+        if (res) { return res; }
+        *out = make_counted<const datum_t>(str);
+        return ARCHIVE_SUCCESS;
+    }
+    case cJSON_Array: {
+        int size;
+        res = deserialize(s, &size);
+        if (res) { return res; }
+        scoped_ptr_t<datum_t> arr(new datum_t(datum_t::R_ARRAY));
+        for (int i = 0; i < size; ++i) {
+            counted_t<const datum_t> item;
+            res = deserialize_cjson_as_datum(s, &item);
+            if (res) { return res; }
+            arr->add(item);
+        }
+        *out = counted_t<const datum_t>(arr.release());
+        return ARCHIVE_SUCCESS;
+    }
+    case cJSON_Object: {
+        int size;
+        res = deserialize(s, &size);
+        if (res) { return res; }
+        scoped_ptr_t<datum_t> obj(new datum_t(datum_t::R_OBJECT));
+        for (int i = 0; i < size; ++i) {
+            std::string key;
+            res = deserialize(s, &key);
+            if (res) { return res; }
+            counted_t<const datum_t> val;
+            res = deserialize_cjson_as_datum(s, &val);
+            if (res) { return res; }
+            UNUSED bool conflict = obj->add(key, val);
+        }
+        *out = counted_t<const datum_t>(obj.release());
+        return ARCHIVE_SUCCESS;
+    }
+    default:
+        return ARCHIVE_RANGE_ERROR;
+    }
+}
+
+}  // namespace ql
@@ -0,0 +1,33 @@
+// Copyright 2010-2013 RethinkDB, all rights reserved.
+#ifndef RDB_PROTOCOL_DATUM_JSON_HPP_
+#define RDB_PROTOCOL_DATUM_JSON_HPP_
+
+#include <string>
+
+#include "containers/archive/archive.hpp"
+#include "containers/counted.hpp"
+
+namespace ql {
+
+class datum_t;
+
+// These convert between datums and JSON without going through a `cJSON` tree,
+// which costs an allocation or two per node.  They print and accept what the
+// `cJSON` functions they replace do.
+
+// Appends `d` to `out` the way `cJSON_Print` would print it.
+void datum_to_json(const datum_t &d, std::string *out);
+
+// Parses the JSON in `json` the way `cJSON_Parse` would, but straight into a
+// datum.  Returns an empty `counted_t` if it isn't JSON, and throws if it is
+// but isn't a valid datum (say, because an object has duplicate keys).
+counted_t<const datum_t> json_to_datum(const std::string &json);
+
+// Reads a datum that was written out as a `cJSON` (which is how rows are
+// stored on disk), without building the `cJSON`.
+MUST_USE archive_result_t deserialize_cjson_as_datum(read_stream_t *s,
+                                                     counted_t<const datum_t> *out);
+
+}  // namespace ql
+
+#endif  // RDB_PROTOCOL_DATUM_JSON_HPP_
@@ -3,6 +3,10 @@
 #include <map>
 
 #include "clustering/administration/metadata.hpp"
+#include "concurrency/cond_var.hpp"
+#include "concurrency/pmap.hpp"
+#include "concurrency/work_stealing.hpp"
+#include "containers/scoped.hpp"
 #include "rdb_protocol/env.hpp"
 #include "rdb_protocol/term.hpp"
 #include "rdb_protocol/val.hpp"
@@ -56,6 +60,7 @@ std::vector<counted_t<const datum_t> > datum_stream_t::next_batch() {
 }
 
 counted_t<const datum_t> eager_datum_stream_t::count() {
+    draining = true;
     int64_t i = 0;
     for (;;) {
         counted_t<const datum_t> value = next();
@@ -67,6 +72,7 @@ counted_t<const datum_t> eager_datum_stream_t::count() {
 
 counted_t<const datum_t> eager_datum_stream_t::reduce(counted_t<val_t> base_val,
                                                       counted_t<func_t> f) {
+    draining = true;
     counted_t<const datum_t> base = base_val.has() ? base_val->as_datum() : next();
     rcheck(base.has(), base_exc_t::NON_EXISTENCE, empty_stream_msg);
 
@@ -80,6 +86,7 @@ counted_t<const datum_t> eager_datum_stream_t::gmr(counted_t<func_t> group,
                                                    counted_t<func_t> map,
                                                    counted_t<const datum_t> base,
                                                    counted_t<func_t> reduce) {
+    draining = true;
     wire_datum_map_t wd_map;
     while (counted_t<const datum_t> el = next()) {
         counted_t<const datum_t> el_group = group->call(el)->as_datum();
@@ -94,6 +101,19 @@ counted_t<const datum_t> eager_datum_stream_t::gmr(counted_t<func_t> group,
     return wd_map.to_arr();
 }
 
+counted_t<const datum_t> eager_datum_stream_t::grouped_aggregate(
+    counted_t<func_t> group, const aggregator_t &aggregator) {
+    draining = true;
+    wire_datum_map_t wd_map;
+    while (counted_t<const datum_t> el = next()) {
+        counted_t<const datum_t> el_group = group->call(el)->as_datum();
+        counted_t<const datum_t> partial =
+            wd_map.has(el_group) ? wd_map.get(el_group) : aggregator.empty();
+        wd_map.set(el_group, aggregator.add_row(partial, el));
+    }
+    return wd_map.to_arr();
+}
+
 counted_t<datum_stream_t> eager_datum_stream_t::filter(counted_t<func_t> f) {
     return make_counted<filter_datum_stream_t>(env, f, this->counted_from_this());
 }
@@ -105,6 +125,7 @@ counted_t<datum_stream_t> eager_datum_stream_t::concatmap(counted_t<func_t> f) {
 }
 
 counted_t<const datum_t> eager_datum_stream_t::as_array() {
+    draining = true;
     scoped_ptr_t<datum_t> arr(new datum_t(datum_t::R_ARRAY));
     while (counted_t<const datum_t> d = next()) {
         arr->add(d);
@@ -237,6 +258,16 @@ counted_t<const datum_t> lazy_datum_stream_t::gmr(counted_t<func_t> g,
     }
 }
 
+counted_t<const datum_t> lazy_datum_stream_t::grouped_aggregate(
+    counted_t<func_t> g, const aggregator_t &aggregator) {
+    rdb_protocol_t::rget_read_response_t::result_t res =
+        run_terminal(grouped_aggregate_wire_func_t(env, g, aggregator));
+    wire_datum_map_t *dm = boost::get<wire_datum_map_t>(&res);
+    r_sanity_check(dm);
+    dm->compile();
+    return dm->to_arr();
+}
+
 counted_t<const datum_t> lazy_datum_stream_t::next_impl() {
     boost::shared_ptr<scoped_cJSON_t> json = json_stream->next();
     return json ? make_counted<datum_t>(json) : counted_t<datum_t>();
@@ -258,15 +289,6 @@ counted_t<const datum_t> array_datum_stream_t::next_impl() {
 }
 
 // MAP_DATUM_STREAM_T
-counted_t<const datum_t> map_datum_stream_t::next_impl() {
-    counted_t<const datum_t> arg = source->next();
-    if (!arg.has()) {
-        return counted_t<const datum_t>();
-    } else {
-        return f->call(arg)->as_datum();
-    }
-}
-
 // INDEXES_OF_DATUM_STREAM_T
 counted_t<const datum_t> indexes_of_datum_stream_t::next_impl() {
     for (;;) {
@@ -281,30 +303,191 @@ counted_t<const datum_t> indexes_of_datum_stream_t::next_impl() {
     }
 }
 
+// FUNC_DATUM_STREAM_T
+
+// A copy of a function compiled in an `env_t` of its own, for evaluating it on
+// another thread.  It must be created and destroyed on that thread.
+class thread_func_t {
+public:
+    explicit thread_func_t(const wire_func_t &_wire_func)
+        : wire_func(_wire_func), env(&non_interruptor) {
+        func = wire_func.compile(&env);
+    }
+
+    func_t *get() { return func.get(); }
+
+private:
+    wire_func_t wire_func;
+    cond_t non_interruptor;
+    env_t env;
+    counted_t<func_t> func;
+
+    DISABLE_COPYING(thread_func_t);
+};
+
+class parallel_apply_t {
+public:
+    parallel_apply_t(func_datum_stream_t *_stream, const wire_func_t *_wire_func,
+                     scoped_array_t<scoped_ptr_t<thread_func_t> > *_thread_funcs)
+        : stream(_stream), wire_func(_wire_func), thread_funcs(_thread_funcs) { }
+
+    void operator()(int64_t i) const {
+        try {
+            scoped_ptr_t<thread_func_t> *thread_func = &(*thread_funcs)[get_thread_id()];
+            if (!thread_func->has()) {
+                thread_func->init(new thread_func_t(*wire_func));
+            }
+            stream->results[i] = stream->apply(thread_func->get()->get(), stream->args[i]);
+        } catch (const std::exception &) {
+            stream->failed[i] = 1;
+        }
+    }
+
+private:
+    func_datum_stream_t *stream;
+    const wire_func_t *wire_func;
+    scoped_array_t<scoped_ptr_t<thread_func_t> > *thread_funcs;
+};
+
+class destroy_thread_func_t {
+public:
+    explicit destroy_thread_func_t(scoped_array_t<scoped_ptr_t<thread_func_t> > *_thread_funcs)
+        : thread_funcs(_thread_funcs) { }
+
+    void operator()(int thread) const {
+        if ((*thread_funcs)[thread].has()) {
+            on_thread_t thread_switcher(thread);
+            (*thread_funcs)[thread].reset();
+        }
+    }
+
+private:
+    scoped_array_t<scoped_ptr_t<thread_func_t> > *thread_funcs;
+};
+
+func_datum_stream_t::func_datum_stream_t(env_t *env, counted_t<func_t> _f,
+                                         counted_t<datum_stream_t> _source)
+    : eager_datum_stream_t(env, _source->backtrace()), f(_f), source(_source), position(0) {
+    guarantee(f.has() && source.has());
+}
+
+void func_datum_stream_t::fill_chunk() {
+    args.clear();
+    results.clear();
+    failed.clear();
+    position = 0;
+
+    // Reading ahead is only harmless for a source that's already in memory,
+    // and for a JS function only if every element is going to be asked for.
+    if (!source->is_array() || !((f->is_js() && draining) || f->is_deterministic())) {
+        return;
+    }
+
+    while (args.size() < PARALLEL_EVAL_CHUNK_SIZE) {
+        counted_t<const datum_t> arg = source->next();
+        if (!arg.has()) {
+            break;
+        }
+        args.push_back(arg);
+    }
+
+    // A JS function is called on the whole chunk in one round trip to its
+    // worker; the usual `f->call()`s then pick up the results in order.
+    if (f->is_js()) {
+        if (!args.empty()) {
+            f->prefetch_js_calls(args);
+        }
+        return;
+    }
+
+    // Small chunks are just handed back to be evaluated the usual way.
+    if (args.size() < PARALLEL_EVAL_MIN_CHUNK_SIZE) {
+        return;
+    }
+
+    results.resize(args.size());
+    failed.resize(args.size(), 0);
+
+    wire_func_t wire_func(env, f);
+    scoped_array_t<scoped_ptr_t<thread_func_t> > thread_funcs(get_num_threads());
+    parallel_for_each_batch(args.size(), PARALLEL_EVAL_BATCH_SIZE,
+                            parallel_apply_t(this, &wire_func, &thread_funcs));
+    pmap(get_num_threads(), destroy_thread_func_t(&thread_funcs));
+}
+
+counted_t<const datum_t> func_datum_stream_t::next_arg(bool *computed_out,
+                                                       counted_t<const datum_t> *result_out) {
+    *computed_out = false;
+    if (position == args.size()) {
+        fill_chunk();
+        if (args.empty()) {
+            return source->next();
+        }
+    }
+
+    const size_t i = position++;
+    if (!results.empty() && !failed[i]) {
+        *computed_out = true;
+        *result_out = results[i];
+    }
+    return args[i];
+}
+
+// MAP_DATUM_STREAM_T
+counted_t<const datum_t> map_datum_stream_t::next_impl() {
+    bool computed;
+    counted_t<const datum_t> result;
+    counted_t<const datum_t> arg = next_arg(&computed, &result);
+    if (!arg.has()) {
+        return counted_t<const datum_t>();
+    } else if (computed) {
+        return result;
+    } else {
+        return f->call(arg)->as_datum();
+    }
+}
+
+counted_t<const datum_t> map_datum_stream_t::apply(func_t *func, counted_t<const datum_t> arg) {
+    return func->call(arg)->as_datum();
+}
+
 // FILTER_DATUM_STREAM_T
 counted_t<const datum_t> filter_datum_stream_t::next_impl() {
     for (;;) {
-        counted_t<const datum_t> arg = source->next();
+        bool computed;
+        counted_t<const datum_t> result;
+        counted_t<const datum_t> arg = next_arg(&computed, &result);
 
         if (!arg.has()) {
             return counted_t<const datum_t>();
         }
 
-        if (f->filter_call(arg)) {
+        if (computed ? result.has() : f->filter_call(arg)) {
             return arg;
         }
     }
 }
 
+// Returns `arg` if it passes the filter, and NULL otherwise.
+counted_t<const datum_t> filter_datum_stream_t::apply(func_t *func, counted_t<const datum_t> arg) {
+    return func->filter_call(arg) ? arg : counted_t<const datum_t>();
+}
+
 // CONCATMAP_DATUM_STREAM_T
 counted_t<const datum_t> concatmap_datum_stream_t::next_impl() {
     for (;;) {
         if (!subsource.has()) {
-            counted_t<const datum_t> arg = source->next();
+            bool computed;
+            counted_t<const datum_t> result;
+            counted_t<const datum_t> arg = next_arg(&computed, &result);
             if (!arg.has()) {
                 return counted_t<const datum_t>();
             }
-            subsource = f->call(arg)->as_seq();
+            if (computed && result.has()) {
+                subsource = result->as_datum_stream(env, backtrace());
+            } else {
+                subsource = f->call(arg)->as_seq();
+            }
         }
 
         counted_t<const datum_t> datum = subsource->next();
@@ -316,6 +499,20 @@ counted_t<const datum_t> concatmap_datum_stream_t::next_impl() {
     }
 }
 
+// Returns the array `arg` maps to, or NULL if it maps to anything else (which
+// is then left for `next_impl()` to deal with).
+counted_t<const datum_t> concatmap_datum_stream_t::apply(func_t *func,
+                                                         counted_t<const datum_t> arg) {
+    counted_t<val_t> val = func->call(arg);
+    if (val->get_type().is_convertible(val_t::type_t::DATUM)) {
+        counted_t<const datum_t> datum = val->as_datum();
+        if (datum->get_type() == datum_t::R_ARRAY) {
+            return datum;
+        }
+    }
+    return counted_t<const datum_t>();
+}
+
 // SLICE_DATUM_STREAM_T
 slice_datum_stream_t::slice_datum_stream_t(env_t *env, size_t _left, size_t _right,
                                            counted_t<datum_stream_t> _src)
@@ -439,6 +636,25 @@ counted_t<const datum_t> union_datum_stream_t::gmr(
     return dm.to_arr();
 }
 
+counted_t<const datum_t> union_datum_stream_t::grouped_aggregate(
+    counted_t<func_t> g, const aggregator_t &aggregator) {
+    wire_datum_map_t dm;
+    for (auto it = streams.begin(); it != streams.end(); ++it) {
+        counted_t<const datum_t> d = (*it)->grouped_aggregate(g, aggregator);
+        for (size_t i = 0; i < d->size(); ++i) {
+            counted_t<const datum_t> el = d->get(i);
+            counted_t<const datum_t> el_group = el->get("group");
+            counted_t<const datum_t> el_partial = el->get("reduction");
+            if (!dm.has(el_group)) {
+                dm.set(el_group, el_partial);
+            } else {
+                dm.set(el_group, aggregator.combine(dm.get(el_group), el_partial));
+            }
+        }
+    }
+    return dm.to_arr();
+}
+
 bool union_datum_stream_t::is_array() {
     for (auto it = streams.begin(); it != streams.end(); ++it) {
         if (!(*it)->is_array()) {
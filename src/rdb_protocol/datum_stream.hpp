@@ -35,6 +35,10 @@ public:
                                          counted_t<func_t> m,
                                          counted_t<const datum_t> d,
                                          counted_t<func_t> r) = 0;
+    // Returns each group's partial aggregate, as an array of `{group, reduction}`
+    // objects; see `aggregator_t`.
+    virtual counted_t<const datum_t> grouped_aggregate(counted_t<func_t> g,
+                                                       const aggregator_t &aggregator) = 0;
 
 
     // stream -> stream (always eager)
@@ -67,7 +71,7 @@ private:
 class eager_datum_stream_t : public datum_stream_t {
 public:
     eager_datum_stream_t(env_t *env, const protob_t<const Backtrace> &bt_src)
-        : datum_stream_t(env, bt_src) { }
+        : datum_stream_t(env, bt_src), draining(false) { }
 
     virtual counted_t<datum_stream_t> filter(counted_t<func_t> f);
     virtual counted_t<datum_stream_t> map(counted_t<func_t> f);
@@ -80,9 +84,16 @@ public:
                                          counted_t<func_t> m,
                                          counted_t<const datum_t> d,
                                          counted_t<func_t> r);
+    virtual counted_t<const datum_t> grouped_aggregate(counted_t<func_t> g,
+                                                       const aggregator_t &aggregator);
 
     virtual bool is_array() { return true; }
     virtual counted_t<const datum_t> as_array();
+
+protected:
+    // Set once one of the methods above has started reading the whole stream,
+    // so every element that's left is going to be asked for.
+    bool draining;
 };
 
 class wrapper_datum_stream_t : public eager_datum_stream_t {
@@ -99,10 +110,10 @@ protected:
     const counted_t<datum_stream_t> source;
 };
 
-class map_datum_stream_t : public eager_datum_stream_t {
+class indexes_of_datum_stream_t : public eager_datum_stream_t {
 public:
-    map_datum_stream_t(env_t *env, counted_t<func_t> _f, counted_t<datum_stream_t> _source)
-        : eager_datum_stream_t(env, _source->backtrace()), f(_f), source(_source) {
+    indexes_of_datum_stream_t(env_t *env, counted_t<func_t> _f, counted_t<datum_stream_t> _source)
+        : eager_datum_stream_t(env, _source->backtrace()), f(_f), source(_source), index(0) {
         guarantee(f.has() && source.has());
     }
 private:
@@ -110,49 +121,83 @@ private:
 
     counted_t<func_t> f;
     counted_t<datum_stream_t> source;
+
+    int64_t index;
 };
 
-class indexes_of_datum_stream_t : public eager_datum_stream_t {
-public:
-    indexes_of_datum_stream_t(env_t *env, counted_t<func_t> _f, counted_t<datum_stream_t> _source)
-        : eager_datum_stream_t(env, _source->backtrace()), f(_f), source(_source), index(0) {
-        guarantee(f.has() && source.has());
-    }
-private:
-    counted_t<const datum_t> next_impl();
+// Base class for the eager streams that apply a function to every element of
+// their source.  If the function is deterministic and the source is an
+// in-memory array, elements are pulled off the source a chunk at a time and
+// the function is evaluated on them on all threads at once, each thread using
+// its own `env_t` and its own compiled copy of the function.  Results come
+// back in the source's order.  A JS function instead gets called on the whole
+// chunk in one round trip to its worker process, but only while the stream is
+// being drained: JS isn't deterministic, so it mustn't run on elements that
+// nothing asks for.
+class func_datum_stream_t : public eager_datum_stream_t {
+protected:
+    func_datum_stream_t(env_t *env, counted_t<func_t> _f, counted_t<datum_stream_t> _source);
+
+    // Returns the next element of the source, or NULL at the end.  If the
+    // function was already applied to it, sets `*computed_out` and puts the
+    // result of `apply()` in `*result_out`.  Otherwise the caller has to call
+    // `f` itself (which is also how errors get reported).
+    counted_t<const datum_t> next_arg(bool *computed_out, counted_t<const datum_t> *result_out);
 
     counted_t<func_t> f;
     counted_t<datum_stream_t> source;
 
-    int64_t index;
+private:
+    friend class parallel_apply_t;
+
+    // Applies `func`, a copy of `f` compiled for the current thread, to `arg`.
+    // Called on any thread.
+    virtual counted_t<const datum_t> apply(func_t *func, counted_t<const datum_t> arg) = 0;
+
+    void fill_chunk();
+
+    // Chunks of at least `PARALLEL_EVAL_MIN_CHUNK_SIZE` elements are evaluated
+    // in batches of `PARALLEL_EVAL_BATCH_SIZE`; see `parallel_for_each_batch()`.
+    static const size_t PARALLEL_EVAL_CHUNK_SIZE = 1024;
+    static const size_t PARALLEL_EVAL_MIN_CHUNK_SIZE = 256;
+    static const int64_t PARALLEL_EVAL_BATCH_SIZE = 32;
+
+    std::vector<counted_t<const datum_t> > args;
+    std::vector<counted_t<const datum_t> > results;
+    // Set for the elements whose evaluation threw; those are evaluated again
+    // by the caller, on this thread, to get the error.
+    std::vector<char> failed;
+    size_t position;
 };
 
-class filter_datum_stream_t : public eager_datum_stream_t {
+class map_datum_stream_t : public func_datum_stream_t {
+public:
+    map_datum_stream_t(env_t *env, counted_t<func_t> _f, counted_t<datum_stream_t> _source)
+        : func_datum_stream_t(env, _f, _source) { }
+private:
+    counted_t<const datum_t> next_impl();
+    counted_t<const datum_t> apply(func_t *func, counted_t<const datum_t> arg);
+};
+
+class filter_datum_stream_t : public func_datum_stream_t {
 public:
     filter_datum_stream_t(env_t *env, counted_t<func_t> _f, counted_t<datum_stream_t> _source)
-        : eager_datum_stream_t(env, _source->backtrace()), f(_f), source(_source) {
-        guarantee(f.has() && source.has());
-    }
+        : func_datum_stream_t(env, _f, _source) { }
 
 private:
     counted_t<const datum_t> next_impl();
-
-    counted_t<func_t> f;
-    counted_t<datum_stream_t> source;
+    counted_t<const datum_t> apply(func_t *func, counted_t<const datum_t> arg);
 };
 
-class concatmap_datum_stream_t : public eager_datum_stream_t {
+class concatmap_datum_stream_t : public func_datum_stream_t {
 public:
     concatmap_datum_stream_t(env_t *env, counted_t<func_t> _f, counted_t<datum_stream_t> _source)
-        : eager_datum_stream_t(env, _source->backtrace()), f(_f), source(_source) {
-        guarantee(f.has() && source.has());
-    }
+        : func_datum_stream_t(env, _f, _source) { }
 
 private:
     counted_t<const datum_t> next_impl();
+    counted_t<const datum_t> apply(func_t *func, counted_t<const datum_t> arg);
 
-    counted_t<func_t> f;
-    counted_t<datum_stream_t> source;
     counted_t<datum_stream_t> subsource;
 };
 
@@ -187,6 +232,8 @@ public:
                                          counted_t<func_t> m,
                                          counted_t<const datum_t> base,
                                          counted_t<func_t> r);
+    virtual counted_t<const datum_t> grouped_aggregate(counted_t<func_t> g,
+                                                       const aggregator_t &aggregator);
     virtual bool is_array() { return false; }
     virtual counted_t<const datum_t> as_array() {
         return counted_t<const datum_t>();  // Cannot be converted implicitly.
@@ -315,6 +362,8 @@ public:
                                          counted_t<func_t> m,
                                          counted_t<const datum_t> base,
                                          counted_t<func_t> r);
+    virtual counted_t<const datum_t> grouped_aggregate(counted_t<func_t> g,
+                                                       const aggregator_t &aggregator);
     virtual bool is_array();
     virtual counted_t<const datum_t> as_array();
 private:
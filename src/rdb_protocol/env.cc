@@ -95,14 +95,14 @@ void env_t::pop_implicit() {
 }
 
 void env_t::push_var(int var, counted_t<const datum_t> *val) {
-    vars[var].push(val);
+    var_bindings.push_back(std::make_pair(var, val));
 }
 
 static counted_t<const datum_t> sindex_error_dummy_datum;
 void env_t::push_special_var(int var, special_var_t special_var) {
     switch (special_var) {
     case SINDEX_ERROR_VAR: {
-        vars[var].push(&sindex_error_dummy_datum);
+        push_var(var, &sindex_error_dummy_datum);
     } break;
     default: unreachable();
     }
@@ -123,23 +123,37 @@ env_t::special_var_shadower_t::~special_var_shadower_t() {
 }
 
 counted_t<const datum_t> *env_t::top_var(int var, const rcheckable_t *caller) {
-    rcheck_target(caller, base_exc_t::GENERIC, !vars[var].empty(),
+    counted_t<const datum_t> *var_val = NULL;
+    for (auto it = var_bindings.rbegin(); it != var_bindings.rend(); ++it) {
+        if (it->first == var) {
+            var_val = it->second;
+            break;
+        }
+    }
+    rcheck_target(caller, base_exc_t::GENERIC, var_val != NULL,
                   strprintf("Unrecognized variabled %d", var));
-    counted_t<const datum_t> *var_val = vars[var].top();
     rcheck_target(caller, base_exc_t::GENERIC,
                   var_val != &sindex_error_dummy_datum,
                   "Cannot reference external variables from inside an index.");
     return var_val;
 }
 void env_t::pop_var(int var) {
-    vars[var].pop();
+    // Bindings are almost always popped in LIFO order, but
+    // `special_var_shadower_t` pops them in the order it pushed them.
+    for (auto it = var_bindings.rbegin(); it != var_bindings.rend(); ++it) {
+        if (it->first == var) {
+            var_bindings.erase(--it.base());
+            return;
+        }
+    }
+    r_sanity_check(false);
 }
 void env_t::dump_scope(std::map<int64_t, counted_t<const datum_t> *> *out) {
-    for (std::map<int64_t, std::stack<counted_t<const datum_t> *> >::iterator
-             it = vars.begin(); it != vars.end(); ++it) {
-        if (it->second.size() == 0) continue;
-        r_sanity_check(it->second.top());
-        (*out)[it->first] = it->second.top();
+    // Walk from the innermost binding out, so that `insert` keeps the binding
+    // that shadows the others.
+    for (auto it = var_bindings.rbegin(); it != var_bindings.rend(); ++it) {
+        r_sanity_check(it->second);
+        out->insert(*it);
     }
 }
 void env_t::push_scope(std::map<int64_t, Datum> *in) {
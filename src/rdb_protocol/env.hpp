@@ -83,7 +83,10 @@ public:
     // Discard a previously-pushed scope and restore original scope.
     void pop_scope();
 private:
-    std::map<int64_t, std::stack<counted_t<const datum_t> *> > vars;
+    // Variable bindings in the order they were pushed, innermost last.  Only a
+    // handful of variables are ever in scope at once, so scanning this from
+    // the back is cheaper than keeping a stack per variable in a map.
+    std::vector<std::pair<int64_t, counted_t<const datum_t> *> > var_bindings;
     std::stack<std::vector<std::pair<int, counted_t<const datum_t> > > > scope_stack;
 
 public:
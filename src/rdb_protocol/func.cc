@@ -87,30 +87,59 @@ func_t::func_t(env_t *env, protob_t<const Term> _source)
     env->dump_scope(&scope);
 }
 
+void func_t::prefetch_js_calls(const std::vector<counted_t<const datum_t> > &args) {
+    r_sanity_check(is_js() && js_env != NULL && !js_id.empty());
+    std::vector<std::vector<boost::shared_ptr<scoped_cJSON_t> > > arg_tuples(args.size());
+    for (size_t i = 0; i < args.size(); ++i) {
+        arg_tuples[i].push_back(args[i]->as_json());
+    }
+
+    std::vector<js::js_result_t> results
+        = js_env->get_js_runner()->call_batch(js_id.get(), arg_tuples);
+
+    js_prefetched.clear();
+    for (size_t i = 0; i < args.size(); ++i) {
+        js_prefetched.push_back(std::make_pair(args[i], results[i]));
+    }
+}
+
 counted_t<val_t> func_t::call(const std::vector<counted_t<const datum_t> > &args) {
+    return call(args.data(), args.size());
+}
+
+counted_t<val_t> func_t::call(const counted_t<const datum_t> *args, size_t num_args) {
     try {
         if (js_parent.has()) {
             r_sanity_check(!body.has() && source.has() && js_env != NULL);
-            // Convert datum args to cJSON args for the JS runner
-            std::vector<boost::shared_ptr<scoped_cJSON_t> > json_args;
-            for (auto arg_iter = args.begin(); arg_iter != args.end(); ++arg_iter) {
-                json_args.push_back((*arg_iter)->as_json());
-            }
+            js::js_result_t result;
+            if (num_args == 1 && !js_prefetched.empty()
+                && js_prefetched.front().first.get() == args[0].get()) {
+                result = js_prefetched.front().second;
+                js_prefetched.pop_front();
+            } else {
+                // Convert datum args to cJSON args for the JS runner
+                std::vector<boost::shared_ptr<scoped_cJSON_t> > json_args;
+                for (size_t i = 0; i < num_args; ++i) {
+                    json_args.push_back(args[i]->as_json());
+                }
 
-            boost::shared_ptr<js::runner_t> js = js_env->get_js_runner();
-            r_sanity_check(!js_id.empty());
-            js::js_result_t result = js->call(js_id.get(), json_args);
+                boost::shared_ptr<js::runner_t> js = js_env->get_js_runner();
+                r_sanity_check(!js_id.empty());
+                result = js->call(js_id.get(), json_args);
+            }
 
             return boost::apply_visitor(
                 js_result_visitor_t(js_env, std::string(), js_parent),
                 result);
         } else {
             r_sanity_check(body.has() && source.has() && js_env == NULL);
-            rcheck(args.size() == static_cast<size_t>(argptrs.size())
+            rcheck(num_args == static_cast<size_t>(argptrs.size())
                    || argptrs.size() == 0,
                    base_exc_t::GENERIC,
                    strprintf("Expected %zd argument(s) but found %zu.",
-                             argptrs.size(), args.size()));
+                             argptrs.size(), num_args));
+            // The body's `var_term_t`s were bound to these slots when it was
+            // compiled, so filling them in is all it takes to bind arguments.
             for (size_t i = 0; i < argptrs.size(); ++i) {
                 r_sanity_check(args[i].has());
                 argptrs[i] = args[i];
@@ -123,23 +152,20 @@ counted_t<val_t> func_t::call(const std::vector<counted_t<const datum_t> > &args
     }
 }
 
+// These are called once per row by `map`, `filter` and friends, so they pass
+// their arguments on the stack rather than building a `std::vector`.
 counted_t<val_t> func_t::call() {
-    std::vector<counted_t<const datum_t> > args;
-    return call(args);
+    return call(NULL, 0);
 }
 
 counted_t<val_t> func_t::call(counted_t<const datum_t> arg) {
-    std::vector<counted_t<const datum_t> > args;
-    args.push_back(arg);
-    return call(args);
+    return call(&arg, 1);
 }
 
 counted_t<val_t> func_t::call(counted_t<const datum_t> arg1,
                               counted_t<const datum_t> arg2) {
-    std::vector<counted_t<const datum_t> > args;
-    args.push_back(arg1);
-    args.push_back(arg2);
-    return call(args);
+    counted_t<const datum_t> args[2] = { arg1, arg2 };
+    return call(args, 2);
 }
 
 void func_t::dump_scope(std::map<int64_t, Datum> *out) const {
@@ -150,6 +176,9 @@ void func_t::dump_scope(std::map<int64_t, Datum> *out) const {
     }
 }
 bool func_t::is_deterministic() const {
+    if (default_filter_val.has() && !default_filter_val->is_deterministic()) {
+        return false;
+    }
     return body.has() ? body->is_deterministic() : false;
 }
 void func_t::assert_deterministic(const char *extra_msg) const {
@@ -233,7 +262,7 @@ bool func_t::filter_call(counted_t<const datum_t> arg) {
         if (d->get_type() == datum_t::R_OBJECT &&
             (source->args(1).type() == Term::MAKE_OBJ ||
              source->args(1).type() == Term::DATUM)) {
-            const std::map<std::string, counted_t<const datum_t> > &obj = d->as_object();
+            const datum_object_t &obj = d->as_object();
             for (auto it = obj.begin(); it != obj.end(); ++it) {
                 r_sanity_check(it->second.has());
                 counted_t<const datum_t> elt = arg->get(it->first, NOTHROW);
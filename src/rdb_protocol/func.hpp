@@ -1,6 +1,7 @@
 #ifndef RDB_PROTOCOL_FUNC_HPP_
 #define RDB_PROTOCOL_FUNC_HPP_
 
+#include <deque>
 #include <map>
 #include <string>
 #include <utility>
@@ -10,6 +11,7 @@
 #include <boost/optional.hpp>
 
 #include "containers/counted.hpp"
+#include "rdb_protocol/aggregate.hpp"
 #include "rdb_protocol/datum.hpp"
 #include "rdb_protocol/js.hpp"
 #include "rdb_protocol/term.hpp"
@@ -47,6 +49,15 @@ public:
     counted_t<val_t> call(counted_t<const datum_t> arg1, counted_t<const datum_t> arg2);
     bool filter_call(counted_t<const datum_t> arg);
 
+    // Whether this is an `r.js` function, each call of which is a round trip
+    // to a JS worker process.
+    bool is_js() const { return js_parent.has(); }
+    // Calls a JS function on each of `args` in a single round trip to the
+    // worker and holds on to the results: the next one-argument calls with
+    // these same datums, in this order, use them instead of calling into the
+    // worker again.  Errors come out of those calls, as usual.
+    void prefetch_js_calls(const std::vector<counted_t<const datum_t> > &args);
+
     void dump_scope(std::map<int64_t, Datum> *out) const;
     bool is_deterministic() const;
     void assert_deterministic(const char *extra_msg) const;
@@ -55,6 +66,8 @@ public:
     void set_default_filter_val(counted_t<func_t> func);
     protob_t<const Term> get_source();
 private:
+    counted_t<val_t> call(const counted_t<const datum_t> *args, size_t num_args);
+
     // Pointers to this function's arguments.
     scoped_array_t<counted_t<const datum_t> > argptrs;
     counted_t<term_t> body; // body to evaluate with functions bound
@@ -75,6 +88,7 @@ private:
     env_t *js_env;
     boost::shared_ptr<js::runner_t> js_runner;
     js::scoped_id_t js_id;
+    std::deque<std::pair<counted_t<const datum_t>, js::js_result_t> > js_prefetched;
 };
 
 
@@ -185,6 +199,29 @@ public:
     RDB_MAKE_ME_SERIALIZABLE_3(group, map, reduce);
 };
 
+// Grouped aggregation with one of `groupBy`'s built-in aggregators.  Unlike
+// `gmr_wire_func_t`, only the grouping function goes through the interpreter;
+// the shards send back partial aggregates (see `aggregator_t`).
+class grouped_aggregate_wire_func_t {
+public:
+    grouped_aggregate_wire_func_t() { }
+    grouped_aggregate_wire_func_t(env_t *env, counted_t<func_t> _group,
+                                  const aggregator_t &_aggregator)
+        : group(env, _group), aggregator(_aggregator) { }
+    counted_t<func_t> compile_group(env_t *env) { return group.compile(env); }
+    const aggregator_t &get_aggregator() const { return aggregator; }
+
+    protob_t<const Backtrace> get_bt() const {
+        return group.get_bt();
+    }
+
+private:
+    map_wire_func_t group;
+    aggregator_t aggregator;
+public:
+    RDB_MAKE_ME_SERIALIZABLE_2(group, aggregator);
+};
+
 // Evaluating this returns a `func_t` wrapped in a `val_t`.
 class func_term_t : public term_t {
 public:
@@ -2,6 +2,8 @@
 #define __STDC_LIMIT_MACROS
 #include <stdint.h>
 
+#include <deque>
+
 #include "errors.hpp"
 #include <boost/optional.hpp>
 
@@ -207,7 +209,76 @@ void runner_t::release_id(id_t id) {
     used_ids_.erase(it);
 }
 
+// Sends a task's result back to the runner_t.
+template <class T>
+static void send_result(env_t *env, const T &result) {
+    write_message_t msg;
+    msg << result;
+    int sendres = send_write_message(&env->control()->channel, &msg);
+    guarantee(0 == sendres);
+}
+
 // ----- eval() -----
+
+// Scripts that eval_task_t has compiled, by source.  A worker process outlives
+// the runner_job_t (and env_t) of any one query, so keeping these around lets
+// later queries that evaluate the same `r.js` source skip compiling it again.
+// Only the compiled code is shared: the scripts are context-independent and are
+// run afresh in each task's own context, so no values (closures, globals) leak
+// from one query into another.
+class script_cache_t {
+public:
+    static const size_t MAX_SIZE = 1024;
+
+    // Returns an empty handle if `src` isn't cached.  Needs a HandleScope.
+    v8::Local<v8::Script> find(const std::string &src) {
+        std::map<std::string, v8::Persistent<v8::Script> *>::iterator it = scripts_.find(src);
+        if (it == scripts_.end()) {
+            return v8::Local<v8::Script>();
+        }
+#ifdef V8_PRE_3_19
+        return v8::Local<v8::Script>::New(*it->second);
+#else
+        return v8::Local<v8::Script>::New(v8::Isolate::GetCurrent(), *it->second);
+#endif
+    }
+
+    void insert(const std::string &src, const v8::Handle<v8::Script> &script) {
+        if (scripts_.count(src) != 0) {
+            return;
+        }
+        if (scripts_.size() >= MAX_SIZE) {
+            // Evict the oldest entry.
+            std::map<std::string, v8::Persistent<v8::Script> *>::iterator oldest
+                = scripts_.find(insertion_order_.front());
+            oldest->second->Dispose();
+            delete oldest->second;
+            scripts_.erase(oldest);
+            insertion_order_.pop_front();
+        }
+
+#ifdef V8_PRE_3_19
+        v8::Persistent<v8::Script> *handle = new v8::Persistent<v8::Script>(
+            v8::Persistent<v8::Script>::New(script));
+#else
+        v8::Persistent<v8::Script> *handle = new v8::Persistent<v8::Script>();
+        handle->Reset(v8::Isolate::GetCurrent(), script);
+#endif
+        scripts_.insert(std::make_pair(src, handle));
+        insertion_order_.push_back(src);
+    }
+
+private:
+    std::map<std::string, v8::Persistent<v8::Script> *> scripts_;
+    std::deque<std::string> insertion_order_;
+};
+
+// Never destroyed: the handles in it are only valid as long as V8 is.
+static script_cache_t *worker_script_cache() {
+    static script_cache_t *cache = new script_cache_t();
+    return cache;
+}
+
 struct eval_task_t : auto_task_t<eval_task_t> {
     eval_task_t() {}
     explicit eval_task_t(const std::string &src) : src_(src) {}
@@ -221,15 +292,24 @@ struct eval_task_t : auto_task_t<eval_task_t> {
 
         v8::HandleScope handle_scope;
 
-        // TODO(rntz): use an "external resource" to avoid copy?
-        v8::Handle<v8::String> src = v8::String::New(src_.data(), src_.size());
-
         // This constructor registers itself with v8 so that any errors generated
         // within v8 will be available within this object.
         v8::TryCatch try_catch;
 
-        // Firstly, compilation may fail (because of say a syntax error)
-        v8::Handle<v8::Script> script = v8::Script::Compile(src);
+        v8::Handle<v8::Script> script = worker_script_cache()->find(src_);
+        if (script.IsEmpty()) {
+            // TODO(rntz): use an "external resource" to avoid copy?
+            v8::Handle<v8::String> src = v8::String::New(src_.data(), src_.size());
+
+            // Firstly, compilation may fail (because of say a syntax error).
+            // `Script::New` (unlike `Script::Compile`) isn't bound to the
+            // current context, so the cached script can be run in later ones.
+            script = v8::Script::New(src);
+            if (!script.IsEmpty()) {
+                worker_script_cache()->insert(src_, script);
+            }
+        }
+
         if (script.IsEmpty()) {
 
             // Get the error out of the TryCatch object
@@ -267,10 +347,7 @@ struct eval_task_t : auto_task_t<eval_task_t> {
             }
         }
 
-        write_message_t msg;
-        msg << result;
-        int sendres = send_write_message(&env->control()->unix_socket, &msg);
-        guarantee(0 == sendres);
+        send_result(env, result);
     }
 };
 
@@ -295,81 +372,92 @@ js_result_t runner_t::eval(
     return result;
 }
 
-struct call_task_t : auto_task_t<call_task_t> {
-    call_task_t() {}
-    call_task_t(id_t id, const std::vector<boost::shared_ptr<scoped_cJSON_t> > &args)
-        : func_id_(id), args_(args)
-    { }
+// ----- call() and call_batch() -----
 
-    id_t func_id_;
-    std::vector<boost::shared_ptr<scoped_cJSON_t> > args_;
-    RDB_MAKE_ME_SERIALIZABLE_2(func_id_, args_);
+// Looks up the function remembered as `func_id`.  Needs a HandleScope.
+static v8::Local<v8::Function> find_function(env_t *env, id_t func_id) {
+    const boost::shared_ptr<v8::Persistent<v8::Value> > found_value = env->findValue(func_id);
+    guarantee(!found_value->IsEmpty());
 
-    v8::Handle<v8::Value> eval(v8::Handle<v8::Function> func, std::string *errmsg) {
-        v8::TryCatch try_catch;
-        v8::HandleScope scope;
+    // Construct local handle from persistent handle
 
-        // Construct receiver object.
-        v8::Handle<v8::Object> obj = v8::Object::New();
-        guarantee(!obj.IsEmpty());
-
-        // Construct arguments.
-        size_t nargs = args_.size();
+#ifdef V8_PRE_3_19
+    v8::Local<v8::Value> local_handle = v8::Local<v8::Value>::New(*found_value);
+#else
+    v8::Local<v8::Value> local_handle = v8::Local<v8::Value>::New(v8::Isolate::GetCurrent(), *found_value);
+#endif
+    return v8::Local<v8::Function>::Cast(local_handle);
+}
 
-        scoped_array_t<v8::Handle<v8::Value> > handles(nargs);
-        for (size_t i = 0; i < nargs; ++i) {
-            handles[i] = fromJSON(*args_[i]->get());
-            guarantee(!handles[i].IsEmpty());
-        }
+static v8::Handle<v8::Value> eval_call(v8::Handle<v8::Function> func,
+                                       const std::vector<boost::shared_ptr<scoped_cJSON_t> > &args,
+                                       std::string *errmsg) {
+    v8::TryCatch try_catch;
+    v8::HandleScope scope;
 
-        // Call function with environment as its receiver.
-        v8::Handle<v8::Value> result = func->Call(obj, nargs, handles.data());
-        if (result.IsEmpty()) {
-            append_caught_error(errmsg, try_catch);
-        }
-        return scope.Close(result);
-    }
+    // Construct receiver object.
+    v8::Handle<v8::Object> obj = v8::Object::New();
+    guarantee(!obj.IsEmpty());
 
-    void run(env_t *env) {
-        // TODO(rntz): This is very similar to compile_task_t::run(). Refactor?
-        js_result_t result("");
-        std::string *errmsg = boost::get<std::string>(&result);
+    // Construct arguments.
+    size_t nargs = args.size();
 
-        const boost::shared_ptr<v8::Persistent<v8::Value> > found_value = env->findValue(func_id_);
-        guarantee(!found_value->IsEmpty());
+    scoped_array_t<v8::Handle<v8::Value> > handles(nargs);
+    for (size_t i = 0; i < nargs; ++i) {
+        handles[i] = fromJSON(*args[i]->get());
+        guarantee(!handles[i].IsEmpty());
+    }
 
-        v8::HandleScope handle_scope;
+    // Call function with environment as its receiver.
+    v8::Handle<v8::Value> result = func->Call(obj, nargs, handles.data());
+    if (result.IsEmpty()) {
+        append_caught_error(errmsg, try_catch);
+    }
+    return scope.Close(result);
+}
 
-        // Construct local handle from persistent handle
+static js_result_t call_function(env_t *env, v8::Handle<v8::Function> func,
+                                 const std::vector<boost::shared_ptr<scoped_cJSON_t> > &args) {
+    js_result_t result("");
+    std::string *errmsg = boost::get<std::string>(&result);
 
-#ifdef V8_PRE_3_19
-        v8::Local<v8::Value> local_handle = v8::Local<v8::Value>::New(*found_value);
-#else
-        v8::Local<v8::Value> local_handle = v8::Local<v8::Value>::New(v8::Isolate::GetCurrent(), *found_value);
-#endif
-        v8::Local<v8::Function> func = v8::Local<v8::Function>::Cast(local_handle);
+    v8::HandleScope handle_scope;
 
-        v8::Handle<v8::Value> value = eval(func, errmsg);
-        if (!value.IsEmpty()) {
+    v8::Handle<v8::Value> value = eval_call(func, args, errmsg);
+    if (!value.IsEmpty()) {
 
-            if (value->IsFunction()) {
-                v8::Handle<v8::Function> sub_func
-                    = v8::Handle<v8::Function>::Cast(value);
-                result = env->rememberValue(sub_func);
-            } else {
+        if (value->IsFunction()) {
+            v8::Handle<v8::Function> sub_func
+                = v8::Handle<v8::Function>::Cast(value);
+            result = env->rememberValue(sub_func);
+        } else {
 
-                // JSONify result.
-                boost::shared_ptr<scoped_cJSON_t> json = toJSON(value, errmsg);
-                if (json) {
-                    result = json;
-                }
+            // JSONify result.
+            boost::shared_ptr<scoped_cJSON_t> json = toJSON(value, errmsg);
+            if (json) {
+                result = json;
             }
         }
+    }
 
-        write_message_t msg;
-        msg << result;
-        int sendres = send_write_message(&env->control()->unix_socket, &msg);
-        guarantee(0 == sendres);
+    return result;
+}
+
+struct call_task_t : auto_task_t<call_task_t> {
+    call_task_t() {}
+    call_task_t(id_t id, const std::vector<boost::shared_ptr<scoped_cJSON_t> > &args)
+        : func_id_(id), args_(args)
+    { }
+
+    id_t func_id_;
+    std::vector<boost::shared_ptr<scoped_cJSON_t> > args_;
+    RDB_MAKE_ME_SERIALIZABLE_2(func_id_, args_);
+
+    void run(env_t *env) {
+        v8::HandleScope handle_scope;
+        js_result_t result = call_function(env, find_function(env, func_id_), args_);
+
+        send_result(env, result);
     }
 };
 
@@ -389,4 +477,46 @@ js_result_t runner_t::call(
     return result;
 }
 
+struct call_batch_task_t : auto_task_t<call_batch_task_t> {
+    call_batch_task_t() {}
+    call_batch_task_t(id_t id,
+                      const std::vector<std::vector<boost::shared_ptr<scoped_cJSON_t> > > &arg_tuples)
+        : func_id_(id), arg_tuples_(arg_tuples)
+    { }
+
+    id_t func_id_;
+    std::vector<std::vector<boost::shared_ptr<scoped_cJSON_t> > > arg_tuples_;
+    RDB_MAKE_ME_SERIALIZABLE_2(func_id_, arg_tuples_);
+
+    void run(env_t *env) {
+        v8::HandleScope handle_scope;
+        v8::Local<v8::Function> func = find_function(env, func_id_);
+
+        std::vector<js_result_t> results;
+        results.reserve(arg_tuples_.size());
+        for (size_t i = 0; i < arg_tuples_.size(); ++i) {
+            results.push_back(call_function(env, func, arg_tuples_[i]));
+        }
+
+        send_result(env, results);
+    }
+};
+
+std::vector<js_result_t> runner_t::call_batch(
+    id_t func_id,
+    const std::vector<std::vector<boost::shared_ptr<scoped_cJSON_t> > > &arg_tuples,
+    const req_config_t *config)
+{
+    std::vector<js_result_t> results;
+
+    {
+        run_task_t run(this, config, call_batch_task_t(func_id, arg_tuples));
+        int res = deserialize(&run, &results);
+        guarantee(ARCHIVE_SUCCESS == res);
+    }
+
+    guarantee(results.size() == arg_tuples.size());
+    return results;
+}
+
 } // namespace js
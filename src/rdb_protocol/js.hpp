@@ -127,6 +127,13 @@ public:
         const std::vector<boost::shared_ptr<scoped_cJSON_t> > &args,
         const req_config_t *config = NULL);
 
+    // Calls a previously compiled function once for each of `arg_tuples`, in a
+    // single round trip to the worker.  Returns the results in the same order.
+    std::vector<js_result_t> call_batch(
+        id_t func_id,
+        const std::vector<std::vector<boost::shared_ptr<scoped_cJSON_t> > > &arg_tuples,
+        const req_config_t *config = NULL);
+
     // TODO (rntz): a way to send streams over to javascript.
     // TODO (rntz): a way to get streams back from javascript.
 
@@ -25,7 +25,7 @@ query2_server_t::query2_server_t(const std::set<ip_address_t> &local_addresses,
            boost::bind(&query2_server_t::handle, this, _1, _2, _3),
            &on_unparsable_query2,
            _ctx->auth_metadata,
-           INLINE),
+           CORO_UNORDERED),
     ctx(_ctx), parser_id(generate_uuid()), thread_counters(0)
 { }
 
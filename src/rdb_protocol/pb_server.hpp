@@ -33,6 +33,9 @@ public:
         context_t() : interruptor(0) { }
         static const int32_t no_auth_magic_number = VersionDummy::V0_1;
         static const int32_t auth_magic_number = VersionDummy::V0_2;
+        // Whether the connection can be served from another thread: the
+        // `env_t`s of open cursors belong to this one.
+        bool can_rethread() const { return stream_cache2.empty(); }
         ql::stream_cache2_t stream_cache2;
         signal_t *interruptor;
     };
@@ -8,7 +8,9 @@
 #include <boost/make_shared.hpp>
 
 #include "arch/io/disk.hpp"
+#include "btree/backfill.hpp"
 #include "btree/erase_range.hpp"
+#include "btree/get_distribution.hpp"
 #include "btree/parallel_traversal.hpp"
 #include "btree/slice.hpp"
 #include "btree/superblock.hpp"
@@ -806,6 +808,39 @@ private:
                     }
                 }
                 boost::get<ql::wire_datum_map_t>(rg_response->result).finalize();
+            } else if (const ql::grouped_aggregate_wire_func_t *aggregate_func =
+                    boost::get<ql::grouped_aggregate_wire_func_t>(&rg.terminal->variant)) {
+                // The partial aggregates are combined natively, without
+                // compiling anything.
+                const ql::aggregator_t &aggregator = aggregate_func->get_aggregator();
+                rg_response->result = ql::wire_datum_map_t();
+                ql::wire_datum_map_t *map =
+                    boost::get<ql::wire_datum_map_t>(&rg_response->result);
+
+                for (size_t i = 0; i < count; ++i) {
+                    const rget_read_response_t *_rr =
+                        boost::get<rget_read_response_t>(&responses[i].response);
+                    guarantee(_rr);
+                    const ql::wire_datum_map_t *rhs =
+                        boost::get<ql::wire_datum_map_t>(&(_rr->result));
+                    r_sanity_check(rhs);
+                    ql::wire_datum_map_t local_rhs = *rhs;
+                    local_rhs.compile();
+
+                    counted_t<const ql::datum_t> rhs_arr = local_rhs.to_arr();
+                    for (size_t f = 0; f < rhs_arr->size(); ++f) {
+                        counted_t<const ql::datum_t> key
+                            = rhs_arr->get(f)->get("group");
+                        counted_t<const ql::datum_t> val
+                            = rhs_arr->get(f)->get("reduction");
+                        if (!map->has(key)) {
+                            map->set(key, val);
+                        } else {
+                            map->set(key, aggregator.combine(map->get(key), val));
+                        }
+                    }
+                }
+                map->finalize();
             } else {
                 unreachable();
             }
@@ -1093,6 +1128,47 @@ store_t::~store_t() {
     assert_thread();
 }
 
+/* Whether `transform` starts by plucking some of `covered_fields` out of each
+row, in which case a covering sindex has all the read needs. (A pluck on a
+sequence is a map of `function(x) { return x.pluck(fields...); }`.) */
+bool only_plucks_covered_fields(const rdb_protocol_details::transform_t &transform,
+                                const std::vector<std::string> &covered_fields) {
+    if (transform.empty()) {
+        return false;
+    }
+    const ql::map_wire_func_t *map
+        = boost::get<ql::map_wire_func_t>(&transform.front().variant);
+    if (map == NULL) {
+        return false;
+    }
+
+    const Term &func = map->get_term();
+    if (func.type() != Term::FUNC || func.args_size() != 2
+        || func.args(0).type() != Term::DATUM
+        || func.args(0).datum().r_array_size() != 1) {
+        return false;
+    }
+    const Term &body = func.args(1);
+    if (body.type() != Term::PLUCK || body.args_size() < 2) {
+        return false;
+    }
+    const Term &var = body.args(0);
+    if (var.type() != Term::VAR || var.args_size() != 1
+        || var.args(0).type() != Term::DATUM
+        || var.args(0).datum().r_num() != func.args(0).datum().r_array(0).r_num()) {
+        return false;
+    }
+    for (int i = 1; i < body.args_size(); ++i) {
+        const Term &field = body.args(i);
+        if (field.type() != Term::DATUM || field.datum().type() != Datum::R_STR
+            || std::find(covered_fields.begin(), covered_fields.end(),
+                         field.datum().r_str()) == covered_fields.end()) {
+            return false;
+        }
+    }
+    return true;
+}
+
 // TODO: get rid of this extra response_t copy on the stack
 struct rdb_read_visitor_t : public boost::static_visitor<void> {
     void operator()(const point_read_t &get) {
@@ -1148,28 +1224,41 @@ struct rdb_read_visitor_t : public boost::static_visitor<void> {
             //  we construct a filter function that ensures all returned items lie
             //  between sindex_start_value and sindex_end_value.
             ql::map_wire_func_t sindex_mapping;
-            vector_read_stream_t read_stream(&sindex_mapping_data);
-            int success = deserialize(&read_stream, &sindex_mapping);
-            guarantee(success == ARCHIVE_SUCCESS, "Corrupted sindex description.");
-
-            Term filter_term;
-            rget.sindex_range->write_filter_func(
-                &ql_env, &filter_term, sindex_mapping.get_term());
-            Backtrace dummy_backtrace;
-            ql::propagate_backtrace(&filter_term, &dummy_backtrace);
-            ql::filter_wire_func_t sindex_filter(
-                filter_term, std::map<int64_t, Datum>());
-
-            // We then add this new filter to the beginning of the transform stack
+            std::vector<std::string> covered_fields;
+            deserialize_sindex_info(sindex_mapping_data, &sindex_mapping, &covered_fields);
+
+            covering_sindex_read_t covering;
             rdb_protocol_details::transform_t sindex_transform(rget.transform);
-            sindex_transform.push_front(rdb_protocol_details::transform_atom_t(
-                                            sindex_filter, backtrace_t()));
+            if (!covered_fields.empty()
+                && only_plucks_covered_fields(rget.transform, covered_fields)) {
+                // The rows stored in the sindex have their index values
+                // alongside, so there's no need for the filter below.
+                covering.covered_range = *rget.sindex_range;
+            } else {
+                if (!covered_fields.empty()) {
+                    covering.primary_slice = btree;
+                    covering.primary_superblock = superblock;
+                }
+
+                Term filter_term;
+                rget.sindex_range->write_filter_func(
+                    &ql_env, &filter_term, sindex_mapping.get_term());
+                Backtrace dummy_backtrace;
+                ql::propagate_backtrace(&filter_term, &dummy_backtrace);
+                ql::filter_wire_func_t sindex_filter(
+                    filter_term, std::map<int64_t, Datum>());
+
+                // We then add this new filter to the beginning of the transform stack
+                sindex_transform.push_front(rdb_protocol_details::transform_atom_t(
+                                                sindex_filter, backtrace_t()));
+            }
 
             rdb_rget_secondary_slice(
                     store->get_sindex_slice(*rget.sindex),
                     rget.sindex_region->inner,
                     txn, sindex_sb.get(), &ql_env, sindex_transform,
-                    rget.terminal, rget.region.inner, rget.direction, res);
+                    rget.terminal, rget.region.inner, rget.direction,
+                    covering, res);
         }
     }
 
@@ -1318,7 +1407,7 @@ struct rdb_write_visitor_t : public boost::static_visitor<void> {
         sindex_create_response_t res;
 
         write_message_t wm;
-        wm << c.mapping;
+        serialize_sindex_info(&wm, c.mapping, c.covered_fields);
 
         vector_stream_t stream;
         int write_res = send_write_message(&stream, &wm);
@@ -1510,6 +1599,27 @@ static void call_rdb_backfill(int i, btree_slice_t *btree, const std::vector<std
     }
 }
 
+/* Cuts every region of `start_point` into key subranges along the btree's key
+distribution, so that `protocol_send_backfill()` can traverse them
+concurrently. Consumes one reference to `superblock`. */
+static void split_regions_for_backfill(const region_map_t<rdb_protocol_t, state_timestamp_t> &start_point,
+                                       btree_slice_t *btree, transaction_t *txn, superblock_t *superblock,
+                                       std::vector<std::pair<region_t, state_timestamp_t> > *regions_out) {
+    int64_t key_count;
+    std::vector<store_key_t> split_keys;
+    get_btree_key_distribution(btree, txn, superblock, BACKFILL_SPLIT_DISTRIBUTION_DEPTH, &key_count, &split_keys);
+
+    for (region_map_t<rdb_protocol_t, state_timestamp_t>::const_iterator it = start_point.begin();
+         it != start_point.end();
+         ++it) {
+        std::vector<key_range_t> parts;
+        split_key_range_for_backfill(it->first.inner, split_keys, BACKFILL_TRAVERSALS_PER_REGION, &parts);
+        for (std::vector<key_range_t>::iterator p = parts.begin(); p != parts.end(); ++p) {
+            regions_out->push_back(std::make_pair(region_t(it->first.beg, it->first.end, *p), it->second));
+        }
+    }
+}
+
 void store_t::protocol_send_backfill(const region_map_t<rdb_protocol_t, state_timestamp_t> &start_point,
                                      chunk_fun_callback_t<rdb_protocol_t> *chunk_fun_cb,
                                      superblock_t *superblock,
@@ -1520,8 +1630,14 @@ void store_t::protocol_send_backfill(const region_map_t<rdb_protocol_t, state_ti
                                      signal_t *interruptor)
                                      THROWS_ONLY(interrupted_exc_t) {
     rdb_backfill_callback_impl_t callback(chunk_fun_cb);
-    std::vector<std::pair<region_t, state_timestamp_t> > regions(start_point.begin(), start_point.end());
-    refcount_superblock_t refcount_wrapper(superblock, regions.size());
+
+    /* One reference is consumed by the distribution traversal and one by
+    `refcount_wrapper`, which hands it out to the backfill traversals. */
+    refcount_superblock_t split_wrapper(superblock, 2);
+    std::vector<std::pair<region_t, state_timestamp_t> > regions;
+    split_regions_for_backfill(start_point, btree, txn, &split_wrapper, &regions);
+
+    refcount_superblock_t refcount_wrapper(&split_wrapper, regions.size());
     pmap(regions.size(), boost::bind(&call_rdb_backfill, _1,
         btree, regions, &callback, txn, &refcount_wrapper, sindex_block, progress, interruptor));
 
@@ -1591,6 +1707,9 @@ struct rdb_receive_backfill_visitor_t : public boost::static_visitor<void> {
     }
 
 private:
+    /* A backfill chunk carries a single row and is written in its own
+    transaction, so unlike a batched replace there's no batch of changes to
+    apply to the sindexes together. */
     void update_sindexes(rdb_modification_report_t *mod_report) const {
         scoped_ptr_t<buf_lock_t> sindex_block;
         // Don't allow interruption here, or we may end up with inconsistent data
@@ -1691,6 +1810,17 @@ void rdb_protocol_t::sindex_range_t::write_filter_func(
        N2(FUNCALL, *arg = sindex_mapping, NVAR(arg1)));
 }
 
+bool rdb_protocol_t::sindex_range_t::contains(
+    counted_t<const ql::datum_t> value) const {
+    if (start.has() && (start_open ? *value <= *start : *value < *start)) {
+        return false;
+    }
+    if (end.has() && (end_open ? *value >= *end : *value > *end)) {
+        return false;
+    }
+    return true;
+}
+
 region_t rdb_protocol_t::sindex_range_t ::to_region() const {
     return region_t(rdb_protocol_t::sindex_key_range(
         start != NULL ? start->truncated_secondary() : store_key_t::min(),
@@ -1735,7 +1865,7 @@ RDB_IMPL_ME_SERIALIZABLE_1(rdb_protocol_t::batched_replaces_t, point_replaces);
 RDB_IMPL_ME_SERIALIZABLE_3(rdb_protocol_t::point_write_t, key, data, overwrite);
 RDB_IMPL_ME_SERIALIZABLE_1(rdb_protocol_t::point_delete_t, key);
 
-RDB_IMPL_ME_SERIALIZABLE_3(rdb_protocol_t::sindex_create_t, id, mapping, region);
+RDB_IMPL_ME_SERIALIZABLE_4(rdb_protocol_t::sindex_create_t, id, mapping, covered_fields, region);
 RDB_IMPL_ME_SERIALIZABLE_2(rdb_protocol_t::sindex_drop_t, id, region);
 
 RDB_IMPL_ME_SERIALIZABLE_2(rdb_protocol_t::write_t, write, durability_requirement);
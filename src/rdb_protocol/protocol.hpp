@@ -101,7 +101,8 @@ typedef std::list<transform_atom_t> transform_t;
 
 typedef boost::variant<ql::gmr_wire_func_t,
                        ql::count_wire_func_t,
-                       ql::reduce_wire_func_t> terminal_variant_t;
+                       ql::reduce_wire_func_t,
+                       ql::grouped_aggregate_wire_func_t> terminal_variant_t;
 
 struct terminal_t {
     terminal_t() { }
@@ -279,6 +280,9 @@ struct rdb_protocol_t {
             : start(_start), end(_end), start_open(_start_open), end_open(_end_open) { }
         void write_filter_func(ql::env_t *env, Term *filter,
                                const Term &sindex_mapping) const;
+        // The same test as the filter written by `write_filter_func`, done
+        // directly on a secondary index value.
+        bool contains(counted_t<const ql::datum_t> value) const;
         region_t to_region() const;
         RDB_DECLARE_ME_SERIALIZABLE;
     private:
@@ -561,12 +565,18 @@ struct rdb_protocol_t {
     class sindex_create_t {
     public:
         sindex_create_t() { }
-        sindex_create_t(const std::string &_id, const ql::map_wire_func_t &_mapping)
-            : id(_id), mapping(_mapping), region(region_t::universe())
+        sindex_create_t(const std::string &_id, const ql::map_wire_func_t &_mapping,
+                        const std::vector<std::string> &_covered_fields)
+            : id(_id), mapping(_mapping), covered_fields(_covered_fields),
+              region(region_t::universe())
         { }
 
         std::string id;
         ql::map_wire_func_t mapping;
+        /* If this isn't empty the sindex stores just these fields of each row
+        (and the row's index value) rather than the whole row, and reads that
+        only pluck these fields never have to look at the primary btree. */
+        std::vector<std::string> covered_fields;
         region_t region;
 
         RDB_DECLARE_ME_SERIALIZABLE;
@@ -1,5 +1,6 @@
 #include "rdb_protocol/stream_cache.hpp"
 
+#include "concurrency/work_stealing.hpp"
 #include "rdb_protocol/env.hpp"
 
 namespace ql {
@@ -22,6 +23,38 @@ void stream_cache2_t::erase(int64_t key) {
     guarantee(num_erased == 1);
 }
 
+class encode_datum_t {
+public:
+    encode_datum_t(const std::vector<counted_t<const datum_t> > *_chunk,
+                   Response *_res, int _offset)
+        : chunk(_chunk), res(_res), offset(_offset) { }
+    void operator()(int64_t i) const {
+        (*chunk)[i]->write_to_protobuf(res->mutable_response(offset + i));
+    }
+private:
+    const std::vector<counted_t<const datum_t> > *chunk;
+    Response *res;
+    int offset;
+};
+
+void stream_cache2_t::encode_chunk(const std::vector<counted_t<const datum_t> > &chunk,
+                                   Response *res) {
+    if (chunk.size() < PARALLEL_ENCODING_MIN_CHUNK_SIZE) {
+        for (size_t i = 0; i < chunk.size(); ++i) {
+            chunk[i]->write_to_protobuf(res->add_response());
+        }
+        return;
+    }
+    // Allocate the slots here so that each encoding task only touches its own
+    // `Datum`.
+    int offset = res->response_size();
+    for (size_t i = 0; i < chunk.size(); ++i) {
+        res->add_response();
+    }
+    parallel_for_each_batch(chunk.size(), PARALLEL_ENCODING_BATCH_SIZE,
+                            encode_datum_t(&chunk, res, offset));
+}
+
 bool stream_cache2_t::serve(int64_t key, Response *res, signal_t *interruptor) {
     boost::ptr_map<int64_t, entry_t>::iterator it = streams.find(key);
     if (it == streams.end()) return false;
@@ -38,8 +71,11 @@ bool stream_cache2_t::serve(int64_t key, Response *res, signal_t *interruptor) {
             ++chunk_size;
             entry->next_datum.reset();
         }
+        // Pulling datums off the stream has to happen on this thread, but
+        // encoding them doesn't, so we collect them and encode them all at once.
+        std::vector<counted_t<const datum_t> > chunk;
         while (counted_t<const datum_t> d = entry->stream->next()) {
-            d->write_to_protobuf(res->add_response());
+            chunk.push_back(d);
             if (entry->max_chunk_size && ++chunk_size >= entry->max_chunk_size) {
                 if (counted_t<const datum_t> next_d = entry->stream->next()) {
                     r_sanity_check(!entry->next_datum.has());
@@ -50,6 +86,7 @@ bool stream_cache2_t::serve(int64_t key, Response *res, signal_t *interruptor) {
                 break;
             }
         }
+        encode_chunk(chunk, res);
     } catch (const std::exception &e) {
         erase(key);
         throw;
@@ -5,6 +5,7 @@
 #include <time.h>
 
 #include <map>
+#include <vector>
 
 #include "utils.hpp"
 #include <boost/shared_ptr.hpp>
@@ -25,6 +26,7 @@ class stream_cache2_t {
 public:
     stream_cache2_t() { }
     MUST_USE bool contains(int64_t key);
+    bool empty() const { return streams.empty(); }
     void insert(int64_t key,
                 scoped_ptr_t<env_t> *val_env, counted_t<datum_stream_t> val_stream);
     void erase(int64_t key);
@@ -32,6 +34,14 @@ public:
 private:
     void maybe_evict();
 
+    // Chunks of at least this many datums are encoded in batches of
+    // `PARALLEL_ENCODING_BATCH_SIZE` spread across all threads; see
+    // `parallel_for_each_batch()`.
+    static const size_t PARALLEL_ENCODING_MIN_CHUNK_SIZE = 256;
+    static const int64_t PARALLEL_ENCODING_BATCH_SIZE = 64;
+    static void encode_chunk(const std::vector<counted_t<const datum_t> > &chunk,
+                             Response *res);
+
     struct entry_t {
         ~entry_t(); // `env_t` is incomplete
 #ifndef NDEBUG
@@ -1,5 +1,7 @@
 #include "rdb_protocol/terms/terms.hpp"
 
+#include <string>
+
 #include "rdb_protocol/op.hpp"
 #include "rdb_protocol/error.hpp"
 #include "rdb_protocol/pb_utils.hpp"
@@ -24,6 +26,86 @@ private:
     virtual const char *name() const { return "grouped_map_reduce"; }
 };
 
+// `groupBy` with one of the built-in aggregators.  This used to be rewritten
+// into a `grouped_map_reduce`; evaluating it directly lets tables compute the
+// aggregates natively on the shards (see `aggregator_t`).
+class groupby_term_t : public op_term_t {
+public:
+    groupby_term_t(env_t *env, protob_t<const Term> term)
+        : op_term_t(env, term, argspec_t(3)) {
+        check_aggregator_syntax(&term->args(2));
+    }
+private:
+    static bool is_aggregator_name(const std::string &name) {
+        return name == "COUNT" || name == "SUM" || name == "AVG"
+            || name == "MIN" || name == "MAX";
+    }
+
+    // The aggregator has to be written out as an object literal, so that bad
+    // ones are caught when the query is compiled.
+    void check_aggregator_syntax(const Term *t) {
+        std::string errmsg = "Invalid aggregator for GROUPBY.";
+        std::string name;
+        if (t->type() == Term::MAKE_OBJ) {
+            rcheck(t->optargs_size() == 1, base_exc_t::GENERIC, errmsg);
+            name = t->optargs(0).key();
+        } else if (t->type() == Term::DATUM) {
+            rcheck(t->has_datum(), base_exc_t::GENERIC, errmsg);
+            const Datum *d = &t->datum();
+            rcheck(d->type() == Datum::R_OBJECT && d->r_object_size() == 1,
+                   base_exc_t::GENERIC, errmsg);
+            name = d->r_object(0).key();
+        } else {
+            rfail(base_exc_t::GENERIC, "%s", errmsg.c_str());
+        }
+        rcheck(is_aggregator_name(name), base_exc_t::GENERIC,
+               strprintf("Unrecognized GROUPBY aggregator `%s`.", name.c_str()));
+    }
+
+    aggregator_t parse_aggregator(counted_t<const datum_t> obj) {
+        // `check_aggregator_syntax` has already vetted the shape and the name.
+        r_sanity_check(obj->get_type() == datum_t::R_OBJECT && obj->as_object().size() == 1);
+        const std::string &name = obj->as_object().begin()->first;
+        counted_t<const datum_t> attr = obj->as_object().begin()->second;
+        if (name == "COUNT") {
+            return aggregator_t(AGGREGATE_COUNT, "");
+        } else if (name == "SUM") {
+            return aggregator_t(AGGREGATE_SUM, attr->as_str());
+        } else if (name == "AVG") {
+            return aggregator_t(AGGREGATE_AVG, attr->as_str());
+        } else if (name == "MIN") {
+            return aggregator_t(AGGREGATE_MIN, attr->as_str());
+        } else if (name == "MAX") {
+            return aggregator_t(AGGREGATE_MAX, attr->as_str());
+        } else {
+            unreachable();
+        }
+    }
+
+    virtual counted_t<val_t> eval_impl() {
+        counted_t<datum_stream_t> seq = arg(0)->as_seq();
+        counted_t<func_t> g = arg(1)->as_func(PLUCK_SHORTCUT);
+        aggregator_t aggregator = parse_aggregator(arg(2)->as_datum());
+
+        counted_t<const datum_t> partials = seq->grouped_aggregate(g, aggregator);
+        scoped_ptr_t<datum_t> arr(new datum_t(datum_t::R_ARRAY));
+        for (size_t i = 0; i < partials->size(); ++i) {
+            counted_t<const datum_t> el = partials->get(i);
+            scoped_ptr_t<datum_t> obj(new datum_t(datum_t::R_OBJECT));
+            bool b1 = obj->add("group", el->get("group"));
+            bool b2 = obj->add("reduction", aggregator.finish(el->get("reduction")));
+            r_sanity_check(!b1 && !b2);
+            arr->add(counted_t<const datum_t>(obj.release()));
+        }
+        return new_val(counted_t<const datum_t>(arr.release()));
+    }
+    virtual const char *name() const { return "groupby"; }
+};
+
+counted_t<term_t> make_groupby_term(env_t *env, protob_t<const Term> term) {
+    return make_counted<groupby_term_t>(env, term);
+}
+
 counted_t<term_t> make_gmr_term(env_t *env, protob_t<const Term> term) {
     return make_counted<gmr_term_t>(env, term);
 }
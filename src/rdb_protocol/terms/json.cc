@@ -1,3 +1,4 @@
+#include "rdb_protocol/datum_json.hpp"
 #include "rdb_protocol/op.hpp"
 #include "rdb_protocol/term.hpp"
 #include "rdb_protocol/terms/terms.hpp"
@@ -10,11 +11,11 @@ public:
 
     counted_t<val_t> eval_impl() {
         std::string data = arg(0)->as_str();
-        scoped_cJSON_t cjson(cJSON_Parse(data.c_str()));
-        rcheck(cjson.get() != NULL, base_exc_t::GENERIC,
+        counted_t<const datum_t> res = json_to_datum(data);
+        rcheck(res.has(), base_exc_t::GENERIC,
                strprintf("Failed to parse \"%s\" as JSON.",
                  (data.size() > 40 ? (data.substr(0, 37) + "...").c_str() : data.c_str())));
-        return new_val(make_counted<const datum_t>(cjson.get()));
+        return new_val(res);
     }
 
     bool is_deterministic_impl() const {
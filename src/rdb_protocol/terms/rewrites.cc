@@ -43,125 +43,6 @@ private:
     counted_t<term_t> real;
 };
 
-class groupby_term_t : public rewrite_term_t {
-public:
-    groupby_term_t(env_t *env, protob_t<const Term> term)
-        : rewrite_term_t(env, term, argspec_t(3), rewrite) { }
-
-    static protob_t<Term> rewrite(env_t *env, protob_t<const Term> in,
-                                  const protob_t<Term> out,
-                                  const pb_rcheckable_t *bt_src) {
-        std::string dc;
-        Term dc_arg;
-        parse_dc(&in->args(2), &dc, &dc_arg, bt_src);
-        Term *arg = out.get();
-        arg = final_wrap(env, arg, dc, &dc_arg);
-        N4(GROUPED_MAP_REDUCE,
-           *arg = in->args(0),
-           *arg = in->args(1),
-           map_fn(env, arg, dc, &dc_arg),
-           reduce_fn(env, arg, dc, &dc_arg));
-        return out;
-    }
-
-private:
-
-    // This logic is ugly because we need to handle both MAKE_OBJ and R_OBJECT
-    // as syntax rather than just parsing them both into an object (since we're
-    // doing this at compile-time rather than runtime).
-    static void parse_dc(const Term *t, std::string *dc_out,
-                         Term *dc_arg_out, const pb_rcheckable_t *bt_src) {
-        std::string errmsg = "Invalid aggregator for GROUPBY.";
-        if (t->type() == Term::MAKE_OBJ) {
-            rcheck_target(bt_src, base_exc_t::GENERIC,
-                          t->optargs_size() == 1, errmsg);
-            const Term_AssocPair *ap = &t->optargs(0);
-            *dc_out = ap->key();
-            rcheck_target(
-                bt_src, base_exc_t::GENERIC,
-                *dc_out == "SUM" || *dc_out == "AVG" || *dc_out == "COUNT",
-                strprintf("Unrecognized GROUPBY aggregator `%s`.", dc_out->c_str()));
-            *dc_arg_out = ap->val();
-        } else if (t->type() == Term::DATUM) {
-            rcheck_target(bt_src, base_exc_t::GENERIC, t->has_datum(), errmsg);
-            const Datum *d = &t->datum();
-            rcheck_target(bt_src, base_exc_t::GENERIC,
-                          d->type() == Datum::R_OBJECT, errmsg);
-            rcheck_target(bt_src, base_exc_t::GENERIC,
-                          d->r_object_size() == 1, errmsg);
-            const Datum_AssocPair *ap = &d->r_object(0);
-            *dc_out = ap->key();
-            rcheck_target(
-                bt_src, base_exc_t::GENERIC,
-                *dc_out == "SUM" || *dc_out == "AVG" || *dc_out == "COUNT",
-                strprintf("Unrecognized GROUPBY aggregator `%s`.", dc_out->c_str()));
-            dc_arg_out->set_type(Term::DATUM);
-            *dc_arg_out->mutable_datum() = ap->val();
-        } else {
-            rcheck_target(bt_src, base_exc_t::GENERIC,
-                          t->type() == Term::MAKE_OBJ, errmsg);
-            unreachable();
-        }
-    }
-
-    static void map_fn(env_t *env, Term *arg,
-                       const std::string &dc, const Term *dc_arg) {
-        int obj = env->gensym(), attr = env->gensym();
-        arg = pb::set_func(arg, obj);
-        if (dc == "COUNT") {
-            NDATUM(1.0);
-        } else if (dc == "SUM") {
-            N2(FUNCALL, arg = pb::set_func(arg, attr);
-               N3(BRANCH,
-                  N2(HAS_FIELDS, NVAR(obj), NVAR(attr)),
-                  N2(GET_FIELD, NVAR(obj), NVAR(attr)),
-                  NDATUM(0.0)),
-               *arg = *dc_arg);
-        } else if (dc == "AVG") {
-            N2(FUNCALL, arg = pb::set_func(arg, attr);
-               N3(BRANCH,
-                  N2(HAS_FIELDS, NVAR(obj), NVAR(attr)),
-                  N2(MAKE_ARRAY, N2(GET_FIELD, NVAR(obj), NVAR(attr)), NDATUM(1.0)),
-                  N2(MAKE_ARRAY, NDATUM(0.0), NDATUM(0.0))),
-               *arg = *dc_arg);
-        } else if (dc == "AVG") {
-        } else { unreachable(); }
-    }
-    static void reduce_fn(env_t *env, Term *arg,
-                          const std::string &dc, UNUSED const Term *dc_arg) {
-        int a = env->gensym(), b = env->gensym();
-        arg = pb::set_func(arg, a, b);
-        if (dc == "COUNT" || dc == "SUM") {
-            N2(ADD, NVAR(a), NVAR(b));
-        } else if (dc == "AVG") {
-            N2(MAKE_ARRAY,
-               N2(ADD, N2(NTH, NVAR(a), NDATUM(0.0)),
-                       N2(NTH, NVAR(b), NDATUM(0.0))),
-               N2(ADD, N2(NTH, NVAR(a), NDATUM(1.0)),
-                       N2(NTH, NVAR(b), NDATUM(1.0))));
-        } else { unreachable(); }
-    }
-    static Term *final_wrap(env_t *env, Term *arg,
-                            const std::string &dc, UNUSED const Term *dc_arg) {
-        if (dc == "COUNT" || dc == "SUM") return arg;
-
-        int val = env->gensym(), obj = env->gensym();
-        Term *argout = 0;
-        if (dc == "AVG") {
-            N2(MAP, argout = arg, arg = pb::set_func(arg, obj);
-               OPT2(MAKE_OBJ,
-                    "group", N2(GET_FIELD, NVAR(obj), NDATUM("group")),
-                    "reduction",
-                    N2(FUNCALL, arg = pb::set_func(arg, val);
-                       N2(DIV, N2(NTH, NVAR(val), NDATUM(0.0)),
-                               N2(NTH, NVAR(val), NDATUM(1.0))),
-                       N2(GET_FIELD, NVAR(obj), NDATUM("reduction")))));
-        }
-        return argout;
-    }
-    virtual const char *name() const { return "groupby"; }
-};
-
 class inner_join_term_t : public rewrite_term_t {
 public:
     inner_join_term_t(env_t *env, protob_t<const Term> term)
@@ -382,9 +263,6 @@ private:
 counted_t<term_t> make_skip_term(env_t *env, protob_t<const Term> term) {
     return make_counted<skip_term_t>(env, term);
 }
-counted_t<term_t> make_groupby_term(env_t *env, protob_t<const Term> term) {
-    return make_counted<groupby_term_t>(env, term);
-}
 counted_t<term_t> make_inner_join_term(env_t *env, protob_t<const Term> term) {
     return make_counted<inner_join_term_t>(env, term);
 }
@@ -1,6 +1,8 @@
 #include "rdb_protocol/terms/terms.hpp"
 
+#include <algorithm>
 #include <string>
+#include <vector>
 
 #include "rdb_protocol/error.hpp"
 #include "rdb_protocol/op.hpp"
@@ -17,7 +19,7 @@ class sindex_create_term_t : private env_t::special_var_shadower_t, public op_te
 public:
     sindex_create_term_t(env_t *env, protob_t<const Term> term)
         : env_t::special_var_shadower_t(env, env_t::SINDEX_ERROR_VAR),
-          op_term_t(env, term, argspec_t(2, 3)) { }
+          op_term_t(env, term, argspec_t(2, 3), optargspec_t({"covering"})) { }
 
     virtual counted_t<val_t> eval_impl() {
         counted_t<table_t> table = arg(0)->as_table();
@@ -43,7 +45,21 @@ public:
         }
         r_sanity_check(index_func.has());
 
-        bool success = table->sindex_create(name, index_func);
+        // The fields the index should store so that plucking them doesn't
+        // need the rest of the row.
+        std::vector<std::string> covered_fields;
+        if (counted_t<val_t> v = optarg("covering")) {
+            counted_t<const datum_t> fields = v->as_datum();
+            for (size_t i = 0; i < fields->size(); ++i) {
+                covered_fields.push_back(fields->get(i)->as_str());
+            }
+            std::sort(covered_fields.begin(), covered_fields.end());
+            covered_fields.erase(
+                std::unique(covered_fields.begin(), covered_fields.end()),
+                covered_fields.end());
+        }
+
+        bool success = table->sindex_create(name, index_func, covered_fields);
         if (success) {
             scoped_ptr_t<datum_t> res(new datum_t(datum_t::R_OBJECT));
             UNUSED bool b = res->add("created", make_counted<datum_t>(1.0));
@@ -24,6 +24,10 @@ public:
         *res_out = exc_t(exc, func.get_bt().get(), 1);
     }
 
+    void operator()(const grouped_aggregate_wire_func_t &func) const {
+        *res_out = exc_t(exc, func.get_bt().get(), 1);
+    }
+
 private:
     const datum_exc_t exc;
     rget_read_response_t::result_t *res_out;
@@ -150,6 +154,7 @@ public:
     // This is a non-const reference because it caches the compiled function
     void operator()(ql::gmr_wire_func_t &) const;
     void operator()(ql::reduce_wire_func_t &) const;
+    void operator()(ql::grouped_aggregate_wire_func_t &) const;
 private:
     boost::shared_ptr<scoped_cJSON_t> json;
     ql::env_t *ql_env;
@@ -203,6 +208,20 @@ void terminal_visitor_t::operator()(ql::reduce_wire_func_t &func) const {  // NO
     }
 }
 
+void terminal_visitor_t::operator()(ql::grouped_aggregate_wire_func_t &func) const {  // NOLINT(runtime/references)
+    ql::wire_datum_map_t *obj = boost::get<ql::wire_datum_map_t>(out);
+    guarantee(obj);
+
+    counted_t<const ql::datum_t> el(new ql::datum_t(json));
+    counted_t<const ql::datum_t> el_group
+        = func.compile_group(ql_env)->call(el)->as_datum();
+
+    const ql::aggregator_t &aggregator = func.get_aggregator();
+    counted_t<const ql::datum_t> partial
+        = obj->has(el_group) ? obj->get(el_group) : aggregator.empty();
+    obj->set(el_group, aggregator.add_row(partial, el));
+}
+
 void terminal_apply(ql::env_t *ql_env,
                     const backtrace_t &backtrace,
                     boost::shared_ptr<scoped_cJSON_t> json,
@@ -240,6 +259,12 @@ public:
         *out = rget_read_response_t::empty_t();
     }
 
+    void operator()(ql::grouped_aggregate_wire_func_t &f) const {  // NOLINT(runtime/references)
+        counted_t<ql::func_t> group = f.compile_group(ql_env);
+        guarantee(group.has());
+        *out = ql::wire_datum_map_t();
+    }
+
 private:
     rget_read_response_t::result_t *out;
     ql::env_t *ql_env;
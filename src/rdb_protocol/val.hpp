@@ -68,7 +68,8 @@ public:
         bool upsert,
         durability_requirement_t durability_requirement);
 
-    MUST_USE bool sindex_create(const std::string &name, counted_t<func_t> index_func);
+    MUST_USE bool sindex_create(const std::string &name, counted_t<func_t> index_func,
+                                const std::vector<std::string> &covered_fields);
     MUST_USE bool sindex_drop(const std::string &name);
     counted_t<const datum_t> sindex_list();
 
@@ -3,6 +3,7 @@
 #define RPC_DIRECTORY_READ_MANAGER_HPP_
 
 #include <map>
+#include <string>
 
 #include "errors.hpp"
 #include <boost/ptr_container/ptr_map.hpp>
@@ -14,6 +15,7 @@
 #include "containers/scoped.hpp"
 #include "rpc/connectivity/connectivity.hpp"
 #include "rpc/connectivity/messages.hpp"
+#include "rpc/serialized_delta.hpp"
 
 template<class metadata_t>
 class directory_read_manager_t :
@@ -39,6 +41,9 @@ private:
         const uuid_u session_id;
         cond_t got_initial_message;
         scoped_ptr_t<fifo_enforcer_sink_t> metadata_fifo_sink;
+        /* The peer's serialized metadata as of the last update we applied.
+        Updates arrive as `serialized_delta_t`s against this. */
+        std::string value_bytes;
         auto_drainer_t drainer;
     };
 
@@ -54,8 +59,8 @@ private:
     void on_disconnect(peer_id_t peer) THROWS_NOTHING;
 
     /* These are meant to be spawned in new coroutines */
-    void propagate_initialization(peer_id_t peer, uuid_u session_id, metadata_t new_value, fifo_enforcer_state_t metadata_fifo_state, auto_drainer_t::lock_t per_thread_keepalive) THROWS_NOTHING;
-    void propagate_update(peer_id_t peer, uuid_u session_id, metadata_t new_value, fifo_enforcer_write_token_t metadata_fifo_token, auto_drainer_t::lock_t per_thread_keepalive) THROWS_NOTHING;
+    void propagate_initialization(peer_id_t peer, uuid_u session_id, const std::string &initial_bytes, fifo_enforcer_state_t metadata_fifo_state, auto_drainer_t::lock_t per_thread_keepalive) THROWS_NOTHING;
+    void propagate_update(peer_id_t peer, uuid_u session_id, const serialized_delta_t &delta, fifo_enforcer_write_token_t metadata_fifo_token, auto_drainer_t::lock_t per_thread_keepalive) THROWS_NOTHING;
     void interrupt_updates_and_free_session(session_t *session, auto_drainer_t::lock_t global_keepalive) THROWS_NOTHING;
 
     /* The connectivity service telling us which peers are connected */
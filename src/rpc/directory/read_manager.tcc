@@ -43,10 +43,10 @@ void directory_read_manager_t<metadata_t>::on_message(peer_id_t source_peer, str
     switch (code) {
         case 'I': {
             /* Initial message from another peer */
-            metadata_t initial_value = metadata_t();
+            std::string initial_bytes;
             fifo_enforcer_state_t metadata_fifo_state;
             {
-                int res = deserialize(s, &initial_value);
+                int res = deserialize(s, &initial_bytes);
                 guarantee(!res);  // In the spirit of unreachable...
                 res = deserialize(s, &metadata_fifo_state);
                 guarantee(!res);
@@ -57,7 +57,7 @@ void directory_read_manager_t<metadata_t>::on_message(peer_id_t source_peer, str
             coro_t::spawn_sometime(boost::bind(
                 &directory_read_manager_t::propagate_initialization, this,
                 source_peer, connectivity_service->get_connection_session_id(source_peer),
-                initial_value, metadata_fifo_state,
+                initial_bytes, metadata_fifo_state,
                 auto_drainer_t::lock_t(per_thread_drainers.get())));
 
             break;
@@ -65,10 +65,10 @@ void directory_read_manager_t<metadata_t>::on_message(peer_id_t source_peer, str
 
         case 'U': {
             /* Update from another peer */
-            metadata_t new_value = metadata_t();
+            serialized_delta_t delta;
             fifo_enforcer_write_token_t metadata_fifo_token;
             {
-                int res = deserialize(s, &new_value);
+                int res = deserialize(s, &delta);
                 guarantee(!res);  // In the spirit of unreachable...
                 res = deserialize(s, &metadata_fifo_token);
                 guarantee(!res);  // In the spirit of unreachable...
@@ -77,11 +77,13 @@ void directory_read_manager_t<metadata_t>::on_message(peer_id_t source_peer, str
             }
 
             /* Spawn a new coroutine because we might not be on the home thread
-            and `on_message()` isn't supposed to block very long */
+            and `on_message()` isn't supposed to block very long. The delta
+            can only be applied on the home thread, once all earlier updates
+            from this peer have been applied. */
             coro_t::spawn_sometime(boost::bind(
                 &directory_read_manager_t::propagate_update, this,
                 source_peer, connectivity_service->get_connection_session_id(source_peer),
-                new_value, metadata_fifo_token,
+                delta, metadata_fifo_token,
                 auto_drainer_t::lock_t(per_thread_drainers.get())));
 
             break;
@@ -123,7 +125,7 @@ void directory_read_manager_t<metadata_t>::on_disconnect(peer_id_t peer) THROWS_
 }
 
 template<class metadata_t>
-void directory_read_manager_t<metadata_t>::propagate_initialization(peer_id_t peer, uuid_u session_id, metadata_t initial_value, fifo_enforcer_state_t metadata_fifo_state, auto_drainer_t::lock_t per_thread_keepalive) THROWS_NOTHING {
+void directory_read_manager_t<metadata_t>::propagate_initialization(peer_id_t peer, uuid_u session_id, const std::string &initial_bytes, fifo_enforcer_state_t metadata_fifo_state, auto_drainer_t::lock_t per_thread_keepalive) THROWS_NOTHING {
     per_thread_keepalive.assert_is_holding(per_thread_drainers.get());
     on_thread_t thread_switcher(home_thread());
 
@@ -142,6 +144,13 @@ void directory_read_manager_t<metadata_t>::propagate_initialization(peer_id_t pe
         return;
     }
 
+    metadata_t initial_value = metadata_t();
+    {
+        int res = deserialize_from_string(initial_bytes, &initial_value);
+        guarantee(!res, "Directory initialization from peer does not deserialize.");
+    }
+    session->value_bytes = initial_bytes;
+
     /* Notify that the peer has connected */
     {
         DEBUG_VAR mutex_assertion_t::acq_t acq(&variable_lock);
@@ -164,7 +173,7 @@ void directory_read_manager_t<metadata_t>::propagate_initialization(peer_id_t pe
 }
 
 template<class metadata_t>
-void directory_read_manager_t<metadata_t>::propagate_update(peer_id_t peer, uuid_u session_id, metadata_t new_value, fifo_enforcer_write_token_t metadata_fifo_token, auto_drainer_t::lock_t per_thread_keepalive) THROWS_NOTHING {
+void directory_read_manager_t<metadata_t>::propagate_update(peer_id_t peer, uuid_u session_id, const serialized_delta_t &delta, fifo_enforcer_write_token_t metadata_fifo_token, auto_drainer_t::lock_t per_thread_keepalive) THROWS_NOTHING {
     per_thread_keepalive.assert_is_holding(per_thread_drainers.get());
     on_thread_t thread_switcher(home_thread());
 
@@ -199,6 +208,20 @@ void directory_read_manager_t<metadata_t>::propagate_update(peer_id_t peer, uuid
                                                      metadata_fifo_token);
         wait_interruptible(&fifo_exit, session_keepalive.get_drain_signal());
 
+        /* Every earlier update from this peer has been applied, so
+        `value_bytes` is exactly the base the sender computed `delta` from. */
+        std::string new_bytes;
+        {
+            bool ok = delta.apply(session->value_bytes, &new_bytes);
+            guarantee(ok, "Directory update from peer does not fit our copy of its metadata.");
+        }
+        metadata_t new_value = metadata_t();
+        {
+            int res = deserialize_from_string(new_bytes, &new_value);
+            guarantee(!res, "Directory update from peer does not deserialize.");
+        }
+        session->value_bytes.swap(new_bytes);
+
         {
             DEBUG_VAR mutex_assertion_t::acq_t acq(&variable_lock);
             std::map<peer_id_t, metadata_t> map = variable.get_watchable()->get();
@@ -2,13 +2,22 @@
 #ifndef RPC_DIRECTORY_WRITE_MANAGER_HPP_
 #define RPC_DIRECTORY_WRITE_MANAGER_HPP_
 
+#include <string>
+
 #include "concurrency/auto_drainer.hpp"
 #include "concurrency/fifo_enforcer.hpp"
 #include "concurrency/watchable.hpp"
 #include "rpc/connectivity/connectivity.hpp"
+#include "rpc/serialized_delta.hpp"
 
 class message_service_t;
 
+/* `directory_write_manager_t` sends our directory metadata to every connected
+peer. A newly connected peer gets the whole serialized value; after that, each
+change is sent as a `serialized_delta_t` against the previous one. The FIFO
+enforcer guarantees that every peer applies the deltas in order, so all peers
+share the same base. Changes that don't alter the serialized value aren't sent
+at all. */
 template<class metadata_t>
 class directory_write_manager_t : private peers_list_callback_t {
 public:
@@ -22,14 +31,17 @@ private:
     void on_disconnect(UNUSED peer_id_t p) { }
     void on_change() THROWS_NOTHING;
 
-    void send_initialization(peer_id_t peer, const metadata_t &initial_value, fifo_enforcer_state_t metadata_fifo_state, auto_drainer_t::lock_t keepalive) THROWS_NOTHING;
-    void send_update(peer_id_t peer, const metadata_t &new_value, fifo_enforcer_write_token_t metadata_fifo_token, auto_drainer_t::lock_t keepalive) THROWS_NOTHING;
+    void send_initialization(peer_id_t peer, const std::string &initial_bytes, fifo_enforcer_state_t metadata_fifo_state, auto_drainer_t::lock_t keepalive) THROWS_NOTHING;
+    void send_update(peer_id_t peer, const serialized_delta_t &delta, fifo_enforcer_write_token_t metadata_fifo_token, auto_drainer_t::lock_t keepalive) THROWS_NOTHING;
 
     class initialization_writer_t;
     class update_writer_t;
 
     message_service_t *const message_service;
     clone_ptr_t<watchable_t<metadata_t> > value_watchable;
+    /* The serialized value as of the last update we sent. Every connected peer
+    has this value, or will once the updates in flight arrive. */
+    std::string last_sent_bytes;
     fifo_enforcer_source_t metadata_fifo_source;
     auto_drainer_t drainer;
     typename watchable_t<metadata_t>::subscription_t value_subscription;
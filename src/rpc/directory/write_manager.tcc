@@ -5,6 +5,7 @@
 #include "rpc/directory/write_manager.hpp"
 
 #include <set>
+#include <string>
 
 #include "rpc/connectivity/messages.hpp"
 
@@ -19,6 +20,7 @@ directory_write_manager_t<metadata_t>::directory_write_manager_t(
     typename watchable_t<metadata_t>::freeze_t value_freeze(value_watchable);
     connectivity_service_t::peers_list_freeze_t connectivity_freeze(message_service->get_connectivity_service());
     guarantee(message_service->get_connectivity_service()->get_peers_list().empty());
+    last_sent_bytes = serialize_to_string(value_watchable->get());
     value_subscription.reset(value_watchable, &value_freeze);
     connectivity_subscription.reset(message_service->get_connectivity_service(), &connectivity_freeze);
 }
@@ -28,11 +30,13 @@ directory_write_manager_t<metadata_t>::~directory_write_manager_t() { }
 
 template<class metadata_t>
 void directory_write_manager_t<metadata_t>::on_connect(peer_id_t peer) THROWS_NOTHING {
+    /* We send `last_sent_bytes` rather than re-serializing the current value
+    so that the next delta is guaranteed to apply to what the peer has. */
     typename watchable_t<metadata_t>::freeze_t freeze(value_watchable);
     coro_t::spawn_sometime(boost::bind(
         &directory_write_manager_t::send_initialization, this,
         peer,
-        value_watchable->get(), metadata_fifo_source.get_state(),
+        last_sent_bytes, metadata_fifo_source.get_state(),
         auto_drainer_t::lock_t(&drainer)));
 }
 
@@ -43,13 +47,21 @@ void directory_write_manager_t<metadata_t>::on_change() THROWS_NOTHING {
     crash on the receiving end because the receiving FIFO would get a duplicate
     update.) */
     connectivity_service_t::peers_list_freeze_t freeze(message_service->get_connectivity_service());
+    std::string new_bytes = serialize_to_string(value_watchable->get());
+    if (new_bytes == last_sent_bytes) {
+        /* Nothing visible to our peers changed. We don't enter the FIFO, so
+        skipping the update doesn't leave a gap for the receivers. */
+        return;
+    }
+    serialized_delta_t delta = serialized_delta_t::make(last_sent_bytes, new_bytes);
+    last_sent_bytes.swap(new_bytes);
     fifo_enforcer_write_token_t metadata_fifo_token = metadata_fifo_source.enter_write();
     std::set<peer_id_t> peers = message_service->get_connectivity_service()->get_peers_list();
     for (std::set<peer_id_t>::iterator it = peers.begin(); it != peers.end(); it++) {
         coro_t::spawn_sometime(boost::bind(
             &directory_write_manager_t::send_update, this,
             *it,
-            value_watchable->get(), metadata_fifo_token,
+            delta, metadata_fifo_token,
             auto_drainer_t::lock_t(&drainer)));
     }
 }
@@ -57,15 +69,15 @@ void directory_write_manager_t<metadata_t>::on_change() THROWS_NOTHING {
 template <class metadata_t>
 class directory_write_manager_t<metadata_t>::initialization_writer_t : public send_message_write_callback_t {
 public:
-    initialization_writer_t(const metadata_t &_initial_value, fifo_enforcer_state_t _metadata_fifo_state) :
-        initial_value(_initial_value), metadata_fifo_state(_metadata_fifo_state) { }
+    initialization_writer_t(const std::string &_initial_bytes, fifo_enforcer_state_t _metadata_fifo_state) :
+        initial_bytes(_initial_bytes), metadata_fifo_state(_metadata_fifo_state) { }
     ~initialization_writer_t() { }
 
     void write(write_stream_t *stream) {
         write_message_t msg;
         uint8_t code = 'I';
         msg << code;
-        msg << initial_value;
+        msg << initial_bytes;
         msg << metadata_fifo_state;
         int res = send_write_message(stream, &msg);
         if (res) {
@@ -73,22 +85,22 @@ public:
         }
     }
 private:
-    const metadata_t &initial_value;
+    const std::string &initial_bytes;
     fifo_enforcer_state_t metadata_fifo_state;
 };
 
 template <class metadata_t>
 class directory_write_manager_t<metadata_t>::update_writer_t : public send_message_write_callback_t {
 public:
-    update_writer_t(const metadata_t &_new_value, fifo_enforcer_write_token_t _metadata_fifo_token) :
-        new_value(_new_value), metadata_fifo_token(_metadata_fifo_token) { }
+    update_writer_t(const serialized_delta_t &_delta, fifo_enforcer_write_token_t _metadata_fifo_token) :
+        delta(_delta), metadata_fifo_token(_metadata_fifo_token) { }
     ~update_writer_t() { }
 
     void write(write_stream_t *stream) {
         write_message_t msg;
         uint8_t code = 'U';
         msg << code;
-        msg << new_value;
+        msg << delta;
         msg << metadata_fifo_token;
         int res = send_write_message(stream, &msg);
         if (res) {
@@ -96,19 +108,19 @@ public:
         }
     }
 private:
-    const metadata_t &new_value;
+    const serialized_delta_t &delta;
     fifo_enforcer_write_token_t metadata_fifo_token;
 };
 
 template<class metadata_t>
-void directory_write_manager_t<metadata_t>::send_initialization(peer_id_t peer, const metadata_t &initial_value, fifo_enforcer_state_t metadata_fifo_state, auto_drainer_t::lock_t) THROWS_NOTHING {
-    initialization_writer_t writer(initial_value, metadata_fifo_state);
+void directory_write_manager_t<metadata_t>::send_initialization(peer_id_t peer, const std::string &initial_bytes, fifo_enforcer_state_t metadata_fifo_state, auto_drainer_t::lock_t) THROWS_NOTHING {
+    initialization_writer_t writer(initial_bytes, metadata_fifo_state);
     message_service->send_message(peer, &writer);
 }
 
 template<class metadata_t>
-void directory_write_manager_t<metadata_t>::send_update(peer_id_t peer, const metadata_t &new_value, fifo_enforcer_write_token_t metadata_fifo_token, auto_drainer_t::lock_t) THROWS_NOTHING {
-    update_writer_t writer(new_value, metadata_fifo_token);
+void directory_write_manager_t<metadata_t>::send_update(peer_id_t peer, const serialized_delta_t &delta, fifo_enforcer_write_token_t metadata_fifo_token, auto_drainer_t::lock_t) THROWS_NOTHING {
+    update_writer_t writer(delta, metadata_fifo_token);
     message_service->send_message(peer, &writer);
 }
 
@@ -88,21 +88,55 @@ mailbox_manager_t::mailbox_manager_t(message_service_t *ms) :
     message_service(ms)
     { }
 
-mailbox_manager_t::mailbox_table_t::mailbox_table_t() {
-    next_mailbox_id = (UINT64_MAX / get_num_threads()) * get_thread_id();
-}
+const uint32_t mailbox_manager_t::mailbox_table_t::NO_SLOT = UINT32_MAX;
+
+mailbox_manager_t::mailbox_table_t::mailbox_table_t() :
+    first_free(NO_SLOT), num_mailboxes(0) { }
 
 mailbox_manager_t::mailbox_table_t::~mailbox_table_t() {
-    guarantee(mailboxes.empty(), "Please destroy all mailboxes before destroying the cluster");
+    guarantee(num_mailboxes == 0, "Please destroy all mailboxes before destroying the cluster");
 }
 
 raw_mailbox_t *mailbox_manager_t::mailbox_table_t::find_mailbox(raw_mailbox_t::id_t id) {
-    std::map<raw_mailbox_t::id_t, raw_mailbox_t *>::iterator it = mailboxes.find(id);
-    if (it == mailboxes.end()) {
+    uint64_t index = id & 0xFFFFFFFFull;
+    uint32_t generation = id >> 32;
+    if (index >= slots.size() || slots[index].generation != generation) {
         return NULL;
+    }
+    return slots[index].mailbox;
+}
+
+raw_mailbox_t::id_t mailbox_manager_t::mailbox_table_t::add_mailbox(raw_mailbox_t *mb) {
+    uint32_t index;
+    if (first_free != NO_SLOT) {
+        index = first_free;
+        first_free = slots[index].next_free;
     } else {
-        return it->second;
+        guarantee(slots.size() < NO_SLOT, "Too many mailboxes on one thread");
+        index = slots.size();
+        slots.push_back(slot_t());
     }
+    slot_t *slot = &slots[index];
+    slot->mailbox = mb;
+    slot->next_free = NO_SLOT;
+    ++num_mailboxes;
+    return (static_cast<raw_mailbox_t::id_t>(slot->generation) << 32) | index;
+}
+
+void mailbox_manager_t::mailbox_table_t::remove_mailbox(raw_mailbox_t::id_t id) {
+    uint64_t index = id & 0xFFFFFFFFull;
+    guarantee(index < slots.size());
+    slot_t *slot = &slots[index];
+    guarantee(slot->generation == id >> 32 && slot->mailbox != NULL);
+    slot->mailbox = NULL;
+    /* Generation zero is never handed out, so that no mailbox ID is zero. */
+    ++slot->generation;
+    if (slot->generation == 0) {
+        slot->generation = 1;
+    }
+    slot->next_free = first_free;
+    first_free = index;
+    --num_mailboxes;
 }
 
 void mailbox_manager_t::on_message(UNUSED peer_id_t source_peer, string_read_stream_t *stream) {
@@ -143,22 +177,10 @@ void mailbox_manager_t::mailbox_read_coroutine(int dest_thread,
     }
 }
 
-raw_mailbox_t::id_t mailbox_manager_t::generate_mailbox_id() {
-    raw_mailbox_t::id_t id = ++mailbox_tables.get()->next_mailbox_id;
-    return id;
-}
-
 raw_mailbox_t::id_t mailbox_manager_t::register_mailbox(raw_mailbox_t *mb) {
-    raw_mailbox_t::id_t id = generate_mailbox_id();
-    std::map<raw_mailbox_t::id_t, raw_mailbox_t *> *mailboxes = &mailbox_tables.get()->mailboxes;
-    std::pair<std::map<raw_mailbox_t::id_t, raw_mailbox_t *>::iterator, bool> res
-        = mailboxes->insert(std::make_pair(id, mb));
-    guarantee(res.second);  // Assert a new element was inserted.
-    return id;
+    return mailbox_tables.get()->add_mailbox(mb);
 }
 
 void mailbox_manager_t::unregister_mailbox(raw_mailbox_t::id_t id) {
-    size_t num_elements_erased = mailbox_tables.get()->mailboxes.erase(id);
-    guarantee(num_elements_erased == 1);
+    mailbox_tables.get()->remove_mailbox(id);
 }
-
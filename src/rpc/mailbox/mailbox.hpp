@@ -4,6 +4,7 @@
 
 #include <map>
 #include <string>
+#include <vector>
 
 #include "containers/archive/archive.hpp"
 #include "rpc/connectivity/cluster.hpp"
@@ -118,18 +119,36 @@ private:
 
     message_service_t *message_service;
 
+    /* `mailbox_table_t` maps mailbox IDs to mailboxes on one thread. It's a
+    slab of slots indexed by the low 32 bits of the mailbox ID; the high 32 bits
+    are the slot's generation, which is bumped whenever the slot is freed. That
+    makes lookups a single array access, and a message for a mailbox that has
+    been destroyed won't reach a new mailbox that reuses its slot. Each table is
+    only touched from its own thread, so it needs no locking. */
     struct mailbox_table_t {
         mailbox_table_t();
         ~mailbox_table_t();
-        raw_mailbox_t::id_t next_mailbox_id;
-        // TODO: use a buffered structure to reduce dynamic allocation
-        std::map<raw_mailbox_t::id_t, raw_mailbox_t *> mailboxes;
         raw_mailbox_t *find_mailbox(raw_mailbox_t::id_t);
+        raw_mailbox_t::id_t add_mailbox(raw_mailbox_t *mb);
+        void remove_mailbox(raw_mailbox_t::id_t id);
+
+    private:
+        struct slot_t {
+            slot_t() : generation(1), mailbox(NULL), next_free(NO_SLOT) { }
+            uint32_t generation;
+            raw_mailbox_t *mailbox;
+            uint32_t next_free;
+        };
+        static const uint32_t NO_SLOT;
+
+        std::vector<slot_t> slots;
+        uint32_t first_free;
+        size_t num_mailboxes;
+
+        DISABLE_COPYING(mailbox_table_t);
     };
     one_per_thread_t<mailbox_table_t> mailbox_tables;
 
-    raw_mailbox_t::id_t generate_mailbox_id();
-
     raw_mailbox_t::id_t register_mailbox(raw_mailbox_t *mb);
     void unregister_mailbox(raw_mailbox_t::id_t id);
 
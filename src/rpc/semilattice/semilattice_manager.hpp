@@ -3,10 +3,13 @@
 #define RPC_SEMILATTICE_SEMILATTICE_MANAGER_HPP_
 
 #include <map>
+#include <set>
+#include <string>
 #include <utility>
 
 #include "rpc/mailbox/mailbox.hpp"
 #include "rpc/semilattice/view.hpp"
+#include "rpc/serialized_delta.hpp"
 
 class cond_t;
 template <class> class promise_t;
@@ -30,7 +33,29 @@ constraints:
     `*a` to the semilattice-join of `*a` and `b`.
 
 Currently it's not thread-safe at all; all accesses to the metadata must be on
-the home thread of the `semilattice_manager_t`. */
+the home thread of the `semilattice_manager_t`.
+
+Peers exchange the serialized form of their whole metadata, but only the first
+message after connecting carries it in full. After that, each message carries
+the bytes that changed since the previous message to that peer, together with
+the sequence number of the message it is based on. If a peer sees a gap in the
+sequence, it asks the sender to start over with a full copy. */
+
+/* `semilattice_update_t` is what goes over the wire: a description of the
+sender's serialized metadata as of update `seq`. If `base_seq` is zero,
+`delta.bytes` is the whole thing. Otherwise, `delta` applies to the metadata
+the receiver got in update `base_seq`. */
+class semilattice_update_t {
+public:
+    semilattice_update_t() : base_seq(0), seq(0) { }
+
+    bool is_full() const { return base_seq == 0; }
+
+    uint64_t base_seq, seq;
+    serialized_delta_t delta;
+
+    RDB_MAKE_ME_SERIALIZABLE_3(base_seq, seq, delta);
+};
 
 template<class metadata_t>
 class semilattice_manager_t : public home_thread_mixin_t, public message_handler_t, private peers_list_callback_t {
@@ -56,7 +81,16 @@ private:
         publisher_t<boost::function<void()> > *get_publisher();
     };
 
+    /* The serialized metadata we last sent to or received from a peer, and the
+    sequence number of the update that carried it. */
+    struct peer_metadata_copy_t {
+        peer_metadata_copy_t() : seq(0) { }
+        uint64_t seq;
+        std::string bytes;
+    };
+
     class metadata_writer_t;
+    class resync_query_writer_t;
     class sync_from_query_writer_t;
     class sync_from_reply_writer_t;
     class sync_to_query_writer_t;
@@ -69,13 +103,24 @@ private:
     void on_disconnect(peer_id_t);
 
     /* These are spawned in new coroutines. */
-    void send_metadata_to_peer(peer_id_t, metadata_t, metadata_version_t, auto_drainer_t::lock_t);
-    void deliver_metadata_on_home_thread(peer_id_t sender, metadata_t, metadata_version_t, auto_drainer_t::lock_t);
+    void send_update_to_peer(peer_id_t, semilattice_update_t, metadata_version_t, auto_drainer_t::lock_t);
+    void send_resync_query_to_peer(peer_id_t, auto_drainer_t::lock_t);
+    void deliver_update_on_home_thread(peer_id_t sender, semilattice_update_t, metadata_version_t, auto_drainer_t::lock_t);
+    void deliver_resync_query_on_home_thread(peer_id_t sender, auto_drainer_t::lock_t);
     void deliver_sync_from_query_on_home_thread(peer_id_t sender, sync_from_query_id_t query_id, auto_drainer_t::lock_t);
     void deliver_sync_from_reply_on_home_thread(peer_id_t sender, sync_from_query_id_t query_id, metadata_version_t version, auto_drainer_t::lock_t);
     void deliver_sync_to_query_on_home_thread(peer_id_t sender, sync_to_query_id_t query_id, metadata_version_t version, auto_drainer_t::lock_t);
     void deliver_sync_to_reply_on_home_thread(peer_id_t sender, sync_to_query_id_t query_id, auto_drainer_t::lock_t);
 
+    /* `schedule_update_for_peer()` diffs `serialized_metadata` against what we
+    last sent to `peer` and spawns a coroutine to send the result. It doesn't
+    block, so updates are sent in the order they were scheduled. */
+    void schedule_update_for_peer(peer_id_t peer, const std::string &serialized_metadata, metadata_version_t);
+    /* `apply_update_from_peer()` reconstructs the serialized metadata carried by
+    `update`. It returns false if the update is stale or if we are missing the
+    update it is based on; in the latter case it asks the sender to resync. */
+    bool apply_update_from_peer(peer_id_t sender, const semilattice_update_t &update, std::string *serialized_metadata_out);
+
     static void call_function_with_no_args(const boost::function<void()> &);
     void join_metadata_locally(metadata_t);
     void wait_for_version_from_peer(peer_id_t peer, metadata_version_t version, signal_t *interruptor) THROWS_ONLY(interrupted_exc_t, sync_failed_exc_t);
@@ -85,6 +130,11 @@ private:
 
     metadata_version_t metadata_version;
     metadata_t metadata;
+
+    uint64_t next_update_seq;
+    std::map<peer_id_t, peer_metadata_copy_t> last_sent_to_peer;
+    std::map<peer_id_t, peer_metadata_copy_t> last_received_from_peer;
+    std::set<peer_id_t> resync_queries_outstanding;
     publisher_controller_t<boost::function<void()> > metadata_publisher;
     rwi_lock_assertion_t metadata_mutex;
 
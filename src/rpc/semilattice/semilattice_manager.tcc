@@ -4,6 +4,7 @@
 #include <algorithm>
 #include <map>
 #include <set>
+#include <string>
 #include <utility>
 
 #include "errors.hpp"
@@ -22,6 +23,7 @@ semilattice_manager_t<metadata_t>::semilattice_manager_t(message_service_t *ms,
     root_view(boost::make_shared<root_view_t>(this)),
     metadata_version(0),
     metadata(initial_metadata),
+    next_update_seq(0),
     next_sync_from_query_id(0), next_sync_to_query_id(0),
     event_watcher(this) {
     ASSERT_FINITE_CORO_WAITING;
@@ -66,19 +68,18 @@ void semilattice_manager_t<metadata_t>::root_view_t::join(const metadata_t &adde
     /* Distribute changes to all peers we can currently see. If we can't
     currently see a peer, that's OK; it will hear about the metadata change when
     it reconnects, via the `semilattice_manager_t`'s `on_connect()` handler. */
+    std::string serialized_metadata = serialize_to_string(parent->metadata);
     DEBUG_VAR connectivity_service_t::peers_list_freeze_t freeze(parent->message_service->get_connectivity_service());
     std::set<peer_id_t> peers = parent->message_service->get_connectivity_service()->get_peers_list();
     for (std::set<peer_id_t>::iterator it = peers.begin(); it != peers.end(); it++) {
         if (*it != parent->message_service->get_connectivity_service()->get_me()) {
-            coro_t::spawn_sometime(boost::bind(
-                &semilattice_manager_t<metadata_t>::send_metadata_to_peer, parent,
-                *it, added_metadata, new_version,
-                auto_drainer_t::lock_t(parent->drainers.get())));
+            parent->schedule_update_for_peer(*it, serialized_metadata, new_version);
         }
     }
 }
 
 static const char message_code_metadata = 'M';
+static const char message_code_resync_query = 'R';
 static const char message_code_sync_from_query = 'F';
 static const char message_code_sync_from_reply = 'f';
 static const char message_code_sync_to_query = 'T';
@@ -87,23 +88,37 @@ static const char message_code_sync_to_reply = 't';
 template <class metadata_t>
 class semilattice_manager_t<metadata_t>::metadata_writer_t : public send_message_write_callback_t {
 public:
-    metadata_writer_t(const metadata_t &_md, metadata_version_t _mdv) :
-        md(_md), mdv(_mdv) { }
+    metadata_writer_t(const semilattice_update_t &_update, metadata_version_t _mdv) :
+        update(_update), mdv(_mdv) { }
 
     void write(write_stream_t *stream) {
         write_message_t msg;
         uint8_t code = message_code_metadata;
         msg << code;
-        msg << md;
+        msg << update;
         msg << mdv;
         int res = send_write_message(stream, &msg);
         if (res) { throw fake_archive_exc_t(); }
     }
 private:
-    const metadata_t &md;
+    const semilattice_update_t &update;
     metadata_version_t mdv;
 };
 
+template <class metadata_t>
+class semilattice_manager_t<metadata_t>::resync_query_writer_t : public send_message_write_callback_t {
+public:
+    resync_query_writer_t() { }
+
+    void write(write_stream_t *stream) {
+        write_message_t msg;
+        uint8_t code = message_code_resync_query;
+        msg << code;
+        int res = send_write_message(stream, &msg);
+        if (res) { throw fake_archive_exc_t(); }
+    }
+};
+
 template <class metadata_t>
 class semilattice_manager_t<metadata_t>::sync_from_query_writer_t : public send_message_write_callback_t {
 public:
@@ -233,17 +248,23 @@ void semilattice_manager_t<metadata_t>::on_message(peer_id_t sender, string_read
 
     switch (code) {
         case message_code_metadata: {
-            metadata_t added_metadata;
+            semilattice_update_t update;
             metadata_version_t change_version;
             {
-                int res = deserialize(stream, &added_metadata);
+                int res = deserialize(stream, &update);
                 if (res) { throw fake_archive_exc_t(); }
                 res = deserialize(stream, &change_version);
                 if (res) { throw fake_archive_exc_t(); }
             }
             coro_t::spawn_sometime(boost::bind(
-                &semilattice_manager_t<metadata_t>::deliver_metadata_on_home_thread, this,
-                sender, added_metadata, change_version, auto_drainer_t::lock_t(drainers.get())));
+                &semilattice_manager_t<metadata_t>::deliver_update_on_home_thread, this,
+                sender, update, change_version, auto_drainer_t::lock_t(drainers.get())));
+            break;
+        }
+        case message_code_resync_query: {
+            coro_t::spawn_sometime(boost::bind(
+                &semilattice_manager_t<metadata_t>::deliver_resync_query_on_home_thread, this,
+                sender, auto_drainer_t::lock_t(drainers.get())));
             break;
         }
         case message_code_sync_from_query: {
@@ -309,29 +330,111 @@ template<class metadata_t>
 void semilattice_manager_t<metadata_t>::on_connect(peer_id_t peer) {
     assert_thread();
 
-    /* We have to spawn this in a separate coroutine because `on_connect()` is
-    not supposed to block. */
-    coro_t::spawn_sometime(boost::bind(
-        &semilattice_manager_t<metadata_t>::send_metadata_to_peer, this,
-        peer, metadata, metadata_version, auto_drainer_t::lock_t(drainers.get())));
+    /* A new connection always starts with a full copy of the metadata.
+    `schedule_update_for_peer()` spawns the send in a separate coroutine
+    because `on_connect()` is not supposed to block. */
+    last_sent_to_peer.erase(peer);
+    schedule_update_for_peer(peer, serialize_to_string(metadata), metadata_version);
 }
 
 template<class metadata_t>
-void semilattice_manager_t<metadata_t>::on_disconnect(peer_id_t) {
+void semilattice_manager_t<metadata_t>::on_disconnect(peer_id_t peer) {
     assert_thread();
 
-    /* ignore */
+    last_sent_to_peer.erase(peer);
+    last_received_from_peer.erase(peer);
+    resync_queries_outstanding.erase(peer);
 }
 
 template<class metadata_t>
-void semilattice_manager_t<metadata_t>::send_metadata_to_peer(peer_id_t peer, metadata_t m, metadata_version_t mv, auto_drainer_t::lock_t) {
-    metadata_writer_t writer(m, mv);
+void semilattice_manager_t<metadata_t>::schedule_update_for_peer(peer_id_t peer, const std::string &serialized_metadata, metadata_version_t mv) {
+    assert_thread();
+    ASSERT_NO_CORO_WAITING;
+
+    semilattice_update_t update;
+    update.seq = ++next_update_seq;
+
+    peer_metadata_copy_t *last_sent = &last_sent_to_peer[peer];
+    if (last_sent->seq != 0) {
+        /* Most changes touch a single contiguous stretch of the serialized
+        metadata, so the bytes they share with the last copy we sent are
+        a common prefix and a common suffix. */
+        serialized_delta_t delta = serialized_delta_t::make(last_sent->bytes, serialized_metadata);
+        if (delta.prefix_length + delta.suffix_length >= serialized_metadata.size() / 2) {
+            update.base_seq = last_sent->seq;
+            update.delta = delta;
+        }
+    }
+    if (update.is_full()) {
+        update.delta.bytes = serialized_metadata;
+    }
+
+    last_sent->seq = update.seq;
+    last_sent->bytes = serialized_metadata;
+
+    coro_t::spawn_sometime(boost::bind(
+        &semilattice_manager_t<metadata_t>::send_update_to_peer, this,
+        peer, update, mv, auto_drainer_t::lock_t(drainers.get())));
+}
+
+template<class metadata_t>
+void semilattice_manager_t<metadata_t>::send_update_to_peer(peer_id_t peer, semilattice_update_t update, metadata_version_t mv, auto_drainer_t::lock_t) {
+    metadata_writer_t writer(update, mv);
+    message_service->send_message(peer, &writer);
+}
+
+template<class metadata_t>
+void semilattice_manager_t<metadata_t>::send_resync_query_to_peer(peer_id_t peer, auto_drainer_t::lock_t) {
+    resync_query_writer_t writer;
     message_service->send_message(peer, &writer);
 }
 
 template<class metadata_t>
-void semilattice_manager_t<metadata_t>::deliver_metadata_on_home_thread(peer_id_t sender, metadata_t md, metadata_version_t mv, auto_drainer_t::lock_t) {
+bool semilattice_manager_t<metadata_t>::apply_update_from_peer(peer_id_t sender, const semilattice_update_t &update, std::string *serialized_metadata_out) {
+    assert_thread();
+    ASSERT_NO_CORO_WAITING;
+
+    peer_metadata_copy_t *last_received = &last_received_from_peer[sender];
+    if (update.seq <= last_received->seq) {
+        /* Every update describes the sender's entire metadata, so we already
+        have everything this one could tell us. */
+        return false;
+    }
+
+    if (update.is_full()) {
+        last_received->bytes = update.delta.bytes;
+        resync_queries_outstanding.erase(sender);
+    } else {
+        std::string new_bytes;
+        if (update.base_seq != last_received->seq
+            || !update.delta.apply(last_received->bytes, &new_bytes)) {
+            /* We missed the update this one is based on. Ask for a full copy,
+            unless we already did. */
+            if (resync_queries_outstanding.insert(sender).second) {
+                coro_t::spawn_sometime(boost::bind(
+                    &semilattice_manager_t<metadata_t>::send_resync_query_to_peer, this,
+                    sender, auto_drainer_t::lock_t(drainers.get())));
+            }
+            return false;
+        }
+        last_received->bytes.swap(new_bytes);
+    }
+
+    last_received->seq = update.seq;
+    *serialized_metadata_out = last_received->bytes;
+    return true;
+}
+
+template<class metadata_t>
+void semilattice_manager_t<metadata_t>::deliver_update_on_home_thread(peer_id_t sender, semilattice_update_t update, metadata_version_t mv, auto_drainer_t::lock_t) {
     on_thread_t thread_switcher(home_thread());
+    std::string serialized_metadata;
+    if (!apply_update_from_peer(sender, update, &serialized_metadata)) {
+        return;
+    }
+    metadata_t md;
+    int res = deserialize_from_string(std::move(serialized_metadata), &md);
+    guarantee(res == 0, "Semilattice update from peer does not deserialize.");
     join_metadata_locally(md);
     DEBUG_VAR mutex_assertion_t::acq_t acq(&peer_version_mutex);
     std::pair<typename std::map<peer_id_t, metadata_version_t>::iterator, bool> inserted =
@@ -347,6 +450,13 @@ void semilattice_manager_t<metadata_t>::deliver_metadata_on_home_thread(peer_id_
     }
 }
 
+template<class metadata_t>
+void semilattice_manager_t<metadata_t>::deliver_resync_query_on_home_thread(peer_id_t sender, auto_drainer_t::lock_t) {
+    on_thread_t thread_switcher(home_thread());
+    last_sent_to_peer.erase(sender);
+    schedule_update_for_peer(sender, serialize_to_string(metadata), metadata_version);
+}
+
 template<class metadata_t>
 void semilattice_manager_t<metadata_t>::deliver_sync_from_query_on_home_thread(peer_id_t sender, sync_from_query_id_t query_id, auto_drainer_t::lock_t) {
     on_thread_t thread_switcher(home_thread());
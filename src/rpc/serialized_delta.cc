@@ -0,0 +1,37 @@
+// Copyright 2010-2013 RethinkDB, all rights reserved.
+#include "rpc/serialized_delta.hpp"
+
+#include <algorithm>
+
+serialized_delta_t serialized_delta_t::make(const std::string &old_bytes, const std::string &new_bytes) {
+    size_t max_common = std::min(old_bytes.size(), new_bytes.size());
+    size_t prefix = 0;
+    while (prefix < max_common && old_bytes[prefix] == new_bytes[prefix]) {
+        ++prefix;
+    }
+    /* The suffix must not overlap the prefix in either string. */
+    size_t suffix = 0;
+    while (suffix < max_common - prefix
+           && old_bytes[old_bytes.size() - 1 - suffix] == new_bytes[new_bytes.size() - 1 - suffix]) {
+        ++suffix;
+    }
+
+    serialized_delta_t delta;
+    delta.prefix_length = prefix;
+    delta.suffix_length = suffix;
+    delta.bytes = new_bytes.substr(prefix, new_bytes.size() - prefix - suffix);
+    return delta;
+}
+
+bool serialized_delta_t::apply(const std::string &old_bytes, std::string *new_bytes_out) const {
+    if (prefix_length > old_bytes.size()
+        || suffix_length > old_bytes.size() - prefix_length) {
+        return false;
+    }
+    new_bytes_out->clear();
+    new_bytes_out->reserve(prefix_length + bytes.size() + suffix_length);
+    new_bytes_out->append(old_bytes, 0, prefix_length);
+    new_bytes_out->append(bytes);
+    new_bytes_out->append(old_bytes, old_bytes.size() - suffix_length, suffix_length);
+    return true;
+}
@@ -0,0 +1,53 @@
+// Copyright 2010-2013 RethinkDB, all rights reserved.
+#ifndef RPC_SERIALIZED_DELTA_HPP_
+#define RPC_SERIALIZED_DELTA_HPP_
+
+#include <string>
+#include <utility>
+
+#include "containers/archive/archive.hpp"
+#include "containers/archive/string_stream.hpp"
+#include "rpc/serialize_macros.hpp"
+
+/* `serialized_delta_t` describes how a serialized value changed from one
+version to the next. The receiver keeps the first `prefix_length` and the last
+`suffix_length` bytes of the previous version and puts `bytes` between them.
+A change to one field of a value usually touches one contiguous stretch of its
+serialized form, so the delta is much smaller than the value. The directory and
+the semilattice managers both send their metadata to peers this way. */
+class serialized_delta_t {
+public:
+    serialized_delta_t() : prefix_length(0), suffix_length(0) { }
+
+    /* Computes the delta that turns `old_bytes` into `new_bytes`. */
+    static serialized_delta_t make(const std::string &old_bytes, const std::string &new_bytes);
+
+    /* Reconstructs the new serialized value from `old_bytes`. Returns false if
+    the delta doesn't fit `old_bytes`. */
+    bool apply(const std::string &old_bytes, std::string *new_bytes_out) const;
+
+    uint64_t prefix_length, suffix_length;
+    std::string bytes;
+
+    RDB_MAKE_ME_SERIALIZABLE_3(prefix_length, suffix_length, bytes);
+};
+
+/* `serialize_to_string()` produces the bytes that `serialized_delta_t` diffs.
+`deserialize_from_string()` turns them back into a value. */
+template <class value_t>
+std::string serialize_to_string(const value_t &value) {
+    write_message_t msg;
+    msg << value;
+    string_stream_t stream;
+    int res = send_write_message(&stream, &msg);
+    guarantee(res == 0);
+    return stream.str();
+}
+
+template <class value_t>
+MUST_USE int deserialize_from_string(std::string bytes, value_t *value_out) {
+    string_read_stream_t stream(std::move(bytes), 0);
+    return deserialize(&stream, value_out);
+}
+
+#endif /* RPC_SERIALIZED_DELTA_HPP_ */
@@ -0,0 +1,63 @@
+// Copyright 2010-2013 RethinkDB, all rights reserved.
+#include "unittest/gtest.hpp"
+
+#include "btree/backfill.hpp"
+#include "btree/keys.hpp"
+
+namespace unittest {
+
+void check_parts_cover(const key_range_t &range, const std::vector<key_range_t> &parts) {
+    ASSERT_FALSE(parts.empty());
+    ASSERT_TRUE(parts.front().left == range.left);
+    ASSERT_TRUE(parts.back().right == range.right);
+    for (size_t i = 0; i < parts.size(); ++i) {
+        ASSERT_FALSE(parts[i].is_empty());
+        if (i + 1 < parts.size()) {
+            ASSERT_FALSE(parts[i].right.unbounded);
+            ASSERT_TRUE(parts[i].right.key == parts[i + 1].left);
+        }
+    }
+}
+
+TEST(BackfillSplitTest, NoSplitKeys) {
+    key_range_t range = key_range_t::universe();
+    std::vector<store_key_t> split_keys;
+    std::vector<key_range_t> parts;
+    split_key_range_for_backfill(range, split_keys, 8, &parts);
+    ASSERT_EQ(1u, parts.size());
+    check_parts_cover(range, parts);
+}
+
+TEST(BackfillSplitTest, IgnoresKeysOutsideRange) {
+    key_range_t range(key_range_t::closed, store_key_t("d"), key_range_t::open, store_key_t("m"));
+    std::vector<store_key_t> split_keys;
+    split_keys.push_back(store_key_t("z"));
+    split_keys.push_back(store_key_t("h"));
+    split_keys.push_back(store_key_t("a"));
+    split_keys.push_back(store_key_t("d"));
+    split_keys.push_back(store_key_t("m"));
+    split_keys.push_back(store_key_t("h"));
+    std::vector<key_range_t> parts;
+    split_key_range_for_backfill(range, split_keys, 8, &parts);
+    ASSERT_EQ(2u, parts.size());
+    check_parts_cover(range, parts);
+    ASSERT_TRUE(parts[1].left == store_key_t("h"));
+}
+
+TEST(BackfillSplitTest, RespectsMaxParts) {
+    key_range_t range = key_range_t::universe();
+    std::vector<store_key_t> split_keys;
+    for (char c = 'z'; c >= 'a'; --c) {
+        split_keys.push_back(store_key_t(std::string(1, c)));
+    }
+    std::vector<key_range_t> parts;
+    split_key_range_for_backfill(range, split_keys, 4, &parts);
+    ASSERT_EQ(4u, parts.size());
+    check_parts_cover(range, parts);
+
+    split_key_range_for_backfill(range, split_keys, 1, &parts);
+    ASSERT_EQ(1u, parts.size());
+    check_parts_cover(range, parts);
+}
+
+}  // namespace unittest
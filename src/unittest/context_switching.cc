@@ -63,6 +63,43 @@ TEST(ContextSwitchingTest, SwitchToContextRepeatedly) {
     original_context = NULL;
 }
 
+static int touch_stack(int depth) {
+    volatile char buffer[4096];
+    buffer[0] = depth;
+    return depth == 0 ? buffer[0] : touch_stack(depth - 1) + buffer[0];
+}
+
+static void release_memory_test(void) {
+    int local = 42;
+    test_int = touch_stack(16);
+    context_switch(artificial_stack_1_context, original_context);
+    /* The pages `touch_stack()` used have been released, but our own frame
+    must have survived. */
+    test_int = local + touch_stack(16);
+    context_switch(artificial_stack_1_context, original_context);
+}
+
+TEST(ContextSwitchingTest, ReleaseUnusedMemory) {
+    scoped_ptr_t<context_ref_t> orig_context_local(new context_ref_t);
+    original_context = orig_context_local.get();
+    {
+        artificial_stack_t a(&release_memory_test, 1024*1024);
+        artificial_stack_1_context = &a.context;
+
+        /* A fresh stack has nothing to release, but it must not break. */
+        a.release_unused_memory();
+
+        context_switch(original_context, artificial_stack_1_context);
+        EXPECT_EQ(136, test_int);
+        EXPECT_GE(a.get_committed_size(), 16u * 4096u);
+        a.release_unused_memory();
+        EXPECT_LT(a.get_committed_size(), 16u * 4096u);
+        context_switch(original_context, artificial_stack_1_context);
+        EXPECT_EQ(42 + 136, test_int);
+    }
+    original_context = NULL;
+}
+
 static void first_switch(void) {
     test_int++;
     context_switch(artificial_stack_1_context, artificial_stack_2_context);
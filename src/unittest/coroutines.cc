@@ -0,0 +1,39 @@
+// Copyright 2010-2013 RethinkDB, all rights reserved.
+#include "arch/runtime/coroutines.hpp"
+
+#include "errors.hpp"
+#include <boost/bind.hpp>
+
+#include "unittest/gtest.hpp"
+#include "unittest/unittest_utils.hpp"
+
+namespace unittest {
+
+static void record_stack_size(size_t *size_out) {
+    artificial_stack_t *stack = coro_t::self()->get_stack();
+    *size_out = static_cast<char *>(stack->get_stack_base())
+        - static_cast<char *>(stack->get_stack_bound());
+}
+
+static void run_stack_class_test() {
+    // Spawned one after another, so each can reuse the stack the previous
+    // coroutine of its class left behind.
+    for (int i = 0; i < 3; ++i) {
+        size_t small_size = 0;
+        coro_t::spawn_now_dangerously(boost::bind(&record_stack_size, &small_size),
+                                      SMALL_CORO_STACK);
+        EXPECT_EQ(static_cast<size_t>(COROUTINE_SMALL_STACK_SIZE), small_size);
+
+        size_t default_size = 0;
+        coro_t::spawn_now_dangerously(boost::bind(&record_stack_size, &default_size));
+        EXPECT_EQ(static_cast<size_t>(COROUTINE_STACK_SIZE), default_size);
+
+        let_stuff_happen();
+    }
+}
+
+TEST(CoroutinesTest, StackClasses) {
+    run_in_thread_pool(&run_stack_class_test);
+}
+
+}  // namespace unittest
@@ -5,6 +5,7 @@
 #include "unittest/unittest_utils.hpp"
 
 #include "containers/archive/archive.hpp"
+#include "containers/archive/stl_types.hpp"
 #include "extproc/job.hpp"
 #include "extproc/pool.hpp"
 #include "extproc/spawner.hpp"
@@ -53,7 +54,7 @@ struct fib_job_t : public extproc::auto_job_t<fib_job_t> {
         int res = fib(n_);
         write_message_t msg;
         msg << res;
-        const int write_res = send_write_message(&control->unix_socket, &msg);
+        const int write_res = send_write_message(&control->channel, &msg);
         guarantee(0 == write_res);
     }
 };
@@ -72,7 +73,7 @@ struct collatz_job_t : public extproc::auto_job_t<collatz_job_t> {
             // Send current value.
             write_message_t msg;
             msg << n_;
-            const int write_res = send_write_message(&control->unix_socket, &msg);
+            const int write_res = send_write_message(&control->channel, &msg);
             guarantee(0 == write_res);
 
             // We're done once we hit 1.
@@ -82,7 +83,7 @@ struct collatz_job_t : public extproc::auto_job_t<collatz_job_t> {
 
             // Wait for signal to proceed.
             char c;
-            const int64_t read_res = force_read(&control->unix_socket, &c, 1);
+            const int64_t read_res = force_read(&control->channel, &c, 1);
             guarantee(1 == read_res);
 
             n_ = collatz(n_);
@@ -97,6 +98,23 @@ private:
     DISABLE_COPYING(collatz_job_t);
 };
 
+struct reverse_job_t : public extproc::auto_job_t<reverse_job_t> {
+    // Sends back its string, reversed.
+    reverse_job_t() {}
+    explicit reverse_job_t(const std::string &s) : s_(s) {}
+
+    std::string s_;
+    RDB_MAKE_ME_SERIALIZABLE_1(s_);
+
+    void run_job(extproc::job_control_t *control, UNUSED void *extra) {
+        std::string reversed(s_.rbegin(), s_.rend());
+        write_message_t msg;
+        msg << reversed;
+        const int write_res = send_write_message(&control->channel, &msg);
+        guarantee(0 == write_res);
+    }
+};
+
 struct job_loop_t : public extproc::auto_job_t<job_loop_t> {
     // Receives a job and runs it.
     job_loop_t() {}
@@ -107,7 +125,7 @@ struct job_loop_t : public extproc::auto_job_t<job_loop_t> {
         // Loops accepting jobs until we tell it to quit.
         for (;;) {
             bool quit;
-            const archive_result_t res = deserialize(&control->unix_socket, &quit);
+            const archive_result_t res = deserialize(&control->channel, &quit);
             guarantee(res == ARCHIVE_SUCCESS);
             if (quit) {
                 break;
@@ -117,7 +135,7 @@ struct job_loop_t : public extproc::auto_job_t<job_loop_t> {
         }
 
         // Sends signal that it has quit.
-        const int64_t write_res = control->unix_socket.write("done", 4);
+        const int64_t write_res = control->channel.write("done", 4);
         guarantee(4 == write_res);
     }
 };
@@ -164,6 +182,27 @@ void run_talkativejob_test(extproc::pool_t *pool) {
 
 TEST(ExtProc, TalkativeJob) { main_extproc_test(run_talkativejob_test); }
 
+void run_largejob_test(extproc::pool_t *pool) {
+    // Big enough to wrap around the shared memory rings a few times.
+    std::string s;
+    for (size_t i = 0; i < 3 * extproc::shm_channel_t::RING_SIZE + 17; ++i) {
+        s.push_back('a' + i % 23);
+    }
+
+    extproc::job_handle_t handle;
+    const int begin_res = handle.begin(pool, reverse_job_t(s));
+    ASSERT_EQ(0, begin_res);
+
+    std::string job_result;
+    const archive_result_t res = deserialize(&handle, &job_result);
+    ASSERT_EQ(ARCHIVE_SUCCESS, res);
+    ASSERT_EQ(std::string(s.rbegin(), s.rend()), job_result);
+
+    handle.release();
+}
+
+TEST(ExtProc, LargeJob) { main_extproc_test(run_largejob_test); }
+
 void run_serialjob_test(extproc::pool_t *pool) {
     extproc::job_handle_t handle;
     int begin_res = handle.begin(pool, job_loop_t());
@@ -123,6 +123,31 @@ void run_get_set_test(namespace_interface_t<memcached_protocol_t> *nsi, order_so
         }
     }
 
+    {
+        std::vector<store_key_t> keys;
+        keys.push_back(store_key_t("z"));
+        keys.push_back(store_key_t("a"));
+        keys.push_back(store_key_t("a"));
+        memcached_protocol_t::read_t read(get_multi_query_t(keys), time(NULL));
+
+        cond_t interruptor;
+        memcached_protocol_t::read_response_t result;
+        nsi->read(read, &result, order_source->check_in("unittest::run_get_set_test(memcached_protocol.cc-B2)").with_read_mode(), &interruptor);
+
+        if (get_multi_result_t *maybe_get_multi_result = boost::get<get_multi_result_t>(&result.result)) {
+            ASSERT_EQ(3u, maybe_get_multi_result->results.size());
+            EXPECT_EQ(store_key_t("z"), maybe_get_multi_result->results[0].first);
+            EXPECT_TRUE(maybe_get_multi_result->results[0].second.value.get() == NULL);
+            for (size_t i = 1; i < 3; ++i) {
+                EXPECT_EQ(store_key_t("a"), maybe_get_multi_result->results[i].first);
+                EXPECT_TRUE(maybe_get_multi_result->results[i].second.value.get() != NULL);
+                EXPECT_EQ(123u, maybe_get_multi_result->results[i].second.flags);
+            }
+        } else {
+            ADD_FAILURE() << "got wrong type of result back";
+        }
+    }
+
     {
         rget_query_t rget(hash_region_t<key_range_t>::universe(), 1000);
         memcached_protocol_t::read_t read(rget, time(NULL));
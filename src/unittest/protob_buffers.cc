@@ -0,0 +1,226 @@
+// Copyright 2010-2013 RethinkDB, all rights reserved.
+#include "unittest/gtest.hpp"
+
+#include <algorithm>
+
+#include "arch/io/network.hpp"
+#include "arch/timing.hpp"
+#include "clustering/administration/metadata.hpp"
+#include "protob/frame_reader.hpp"
+#include "protob/protob.hpp"
+#include "rdb_protocol/counted_term.hpp"
+#include "rdb_protocol/pb_server.hpp"
+#include "unittest/unittest_utils.hpp"
+
+namespace unittest {
+
+namespace {
+
+/* Both ends of a TCP connection to ourselves. */
+class conn_pair_t {
+public:
+    conn_pair_t()
+        : listener(get_unittest_addresses(), ANY_PORT,
+                   boost::bind(&conn_pair_t::accept, this, _1)),
+          client_conn(*get_unittest_addresses().begin(), listener.get_port(),
+                      &non_interruptor) {
+        accepted.wait();
+    }
+
+    tcp_conn_t *server() { return server_conn.get(); }
+    tcp_conn_t *client() { return &client_conn; }
+
+private:
+    void accept(scoped_ptr_t<tcp_conn_descriptor_t> &nconn) {  // NOLINT(runtime/references)
+        nconn->make_overcomplicated(&server_conn);
+        accepted.pulse();
+    }
+
+    cond_t non_interruptor;
+    cond_t accepted;
+    scoped_ptr_t<tcp_conn_t> server_conn;
+    tcp_listener_t listener;
+    tcp_conn_t client_conn;
+
+    DISABLE_COPYING(conn_pair_t);
+};
+
+std::string size_prefix(int32_t size) {
+    return std::string(reinterpret_cast<const char *>(&size), sizeof(size));
+}
+
+std::string frame(const std::string &body) {
+    return size_prefix(body.size()) + body;
+}
+
+/* Writes `data` to `conn` `chunk_size` bytes at a time, napping in between so
+that each chunk gets read on its own. */
+void write_in_chunks(tcp_conn_t *conn, const std::string &data, size_t chunk_size,
+                     cond_t *done) {
+    cond_t non_interruptor;
+    for (size_t i = 0; i < data.size(); i += chunk_size) {
+        conn->write(data.data() + i, std::min(chunk_size, data.size() - i), &non_interruptor);
+        nap(10);
+    }
+    done->pulse();
+}
+
+std::string next_frame(protob_frame_reader_t *reader) {
+    cond_t non_interruptor;
+    const char *data;
+    const int32_t size = reader->next(&data, &non_interruptor);
+    guarantee(size >= 0);
+    return std::string(data, size);
+}
+
+void run_split_frame_test() {
+    conn_pair_t conns;
+    protob_frame_reader_t reader(conns.server());
+
+    // Three bytes at a time splits the size prefixes as well as the bodies.
+    cond_t written;
+    coro_t::spawn_sometime(boost::bind(&write_in_chunks, conns.client(),
+                                       frame("hello") + frame("world"), 3, &written));
+    EXPECT_EQ("hello", next_frame(&reader));
+    EXPECT_EQ("world", next_frame(&reader));
+    written.wait();
+}
+
+TEST(ProtobBuffers, SplitFrame) {
+    run_in_thread_pool(&run_split_frame_test);
+}
+
+void run_several_frames_in_one_read_test() {
+    conn_pair_t conns;
+    protob_frame_reader_t reader(conns.server());
+
+    cond_t non_interruptor;
+    const std::string data = frame("a") + frame("bb") + frame("") + frame("ccc");
+    conns.client()->write(data.data(), data.size(), &non_interruptor);
+    conns.client()->shutdown_write();
+
+    // Once the first read has them all, the rest are handed out from the
+    // buffer even though there's nothing more to read.
+    EXPECT_EQ("a", next_frame(&reader));
+    EXPECT_EQ("bb", next_frame(&reader));
+    EXPECT_EQ("", next_frame(&reader));
+    EXPECT_EQ("ccc", next_frame(&reader));
+
+    const char *frame_data;
+    EXPECT_THROW(reader.next(&frame_data, &non_interruptor), tcp_conn_read_closed_exc_t);
+}
+
+TEST(ProtobBuffers, SeveralFramesInOneRead) {
+    run_in_thread_pool(&run_several_frames_in_one_read_test);
+}
+
+void run_bad_frame_size_test() {
+    conn_pair_t conns;
+    protob_frame_reader_t reader(conns.server());
+
+    cond_t non_interruptor;
+    const int32_t oversized = protob_frame_reader_t::MAX_FRAME_SIZE + 1;
+    const std::string data = size_prefix(-5) + size_prefix(oversized);
+    conns.client()->write(data.data(), data.size(), &non_interruptor);
+    // Were the reader to wait for the bodies, it would find the connection
+    // closed instead.
+    conns.client()->shutdown_write();
+
+    const char *frame_data = NULL;
+    EXPECT_EQ(-5, reader.next(&frame_data, &non_interruptor));
+    EXPECT_EQ(oversized, reader.next(&frame_data, &non_interruptor));
+    EXPECT_TRUE(frame_data == NULL);
+}
+
+TEST(ProtobBuffers, BadFrameSize) {
+    run_in_thread_pool(&run_bad_frame_size_test);
+}
+
+void read_responses(tcp_conn_t *conn, int count, std::vector<Response> *responses_out,
+                    cond_t *done) {
+    cond_t non_interruptor;
+    for (int i = 0; i < count; ++i) {
+        int32_t size;
+        conn->read(&size, sizeof(size), &non_interruptor);
+        std::vector<char> data(size);
+        conn->read(data.data(), size, &non_interruptor);
+        responses_out->push_back(Response());
+        guarantee(responses_out->back().ParseFromArray(data.data(), size));
+    }
+    done->pulse();
+}
+
+}  // namespace
+
+void run_frame_reader_buffer_test() {
+    conn_pair_t conns;
+    protob_frame_reader_t reader(conns.server());
+    const size_t buffer_size = protob_frame_reader_t::BUFFER_SIZE;
+    EXPECT_EQ(buffer_size, reader.buffer_.size());
+
+    const std::string big(2 * buffer_size, 'x');
+    cond_t written;
+    coro_t::spawn_sometime(boost::bind(&write_in_chunks, conns.client(),
+                                       frame(big) + frame("small"), 4 * buffer_size,
+                                       &written));
+
+    // The buffer grows to fit an oversized frame...
+    EXPECT_EQ(big, next_frame(&reader));
+    EXPECT_LE(sizeof(int32_t) + big.size(), reader.buffer_.size());
+    // ...and shrinks back once it's been consumed.
+    EXPECT_EQ("small", next_frame(&reader));
+    EXPECT_EQ(buffer_size, reader.buffer_.size());
+    written.wait();
+}
+
+TEST(ProtobBuffers, FrameReaderBufferShrinks) {
+    run_in_thread_pool(&run_frame_reader_buffer_test);
+}
+
+typedef protob_server_t<ql::protob_t<Query>, Response, query2_server_t::context_t>
+    query_server_t;
+
+void run_send_buffer_test() {
+    conn_pair_t conns;
+    const size_t send_buffer_size = query_server_t::SEND_BUFFER_SIZE;
+
+    std::vector<Response> received;
+    cond_t all_received;
+    coro_t::spawn_sometime(boost::bind(&read_responses, conns.client(), 3,
+                                       &received, &all_received));
+
+    Response small;
+    small.set_token(1);
+    Response big;
+    big.set_token(2);
+    Datum *datum = big.add_response();
+    datum->set_type(Datum::R_STR);
+    datum->set_r_str(std::string(2 * send_buffer_size, 'x'));
+
+    cond_t closer;
+    std::vector<char> buffer;
+    query_server_t::send(small, conns.server(), &closer, &buffer);
+    EXPECT_GE(send_buffer_size, buffer.capacity());
+
+    // A response too big for the buffer leaves it the usual size...
+    query_server_t::send(big, conns.server(), &closer, &buffer);
+    EXPECT_EQ(send_buffer_size, buffer.capacity());
+
+    // ...which the next response fits in.
+    query_server_t::send(small, conns.server(), &closer, &buffer);
+    EXPECT_EQ(send_buffer_size, buffer.capacity());
+
+    all_received.wait();
+    ASSERT_EQ(3u, received.size());
+    EXPECT_EQ(1, received[0].token());
+    EXPECT_EQ(2, received[1].token());
+    ASSERT_EQ(1, received[1].response_size());
+    EXPECT_EQ(2 * send_buffer_size, received[1].response(0).r_str().size());
+    EXPECT_EQ(1, received[2].token());
+}
+
+TEST(ProtobBuffers, SendBufferShrinks) {
+    run_in_thread_pool(&run_send_buffer_test);
+}
+
+}  // namespace unittest
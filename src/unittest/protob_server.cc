@@ -0,0 +1,297 @@
+// Copyright 2010-2013 RethinkDB, all rights reserved.
+#include "unittest/gtest.hpp"
+
+#include "arch/io/network.hpp"
+#include "arch/timing.hpp"
+#include "clustering/administration/metadata.hpp"
+#include "concurrency/wait_any.hpp"
+#include "protob/protob.hpp"
+#include "rdb_protocol/counted_term.hpp"
+#include "rdb_protocol/pb_server.hpp"
+#include "unittest/dummy_metadata_controller.hpp"
+#include "unittest/unittest_utils.hpp"
+
+namespace unittest {
+
+namespace {
+
+struct test_context_t {
+    test_context_t() : interruptor(NULL) { ++live_contexts; }
+    ~test_context_t() { --live_contexts; }
+    static const int32_t no_auth_magic_number = VersionDummy::V0_1;
+    static const int32_t auth_magic_number = VersionDummy::V0_2;
+    bool can_rethread() const { return true; }
+    signal_t *interruptor;
+
+    // How many connections the server is holding on to.
+    static int live_contexts;
+};
+
+int test_context_t::live_contexts = 0;
+
+/* Answers each query once the test opens the gate for its token, and keeps a
+log of when each query began and ended. */
+class test_handler_t {
+public:
+    static const int NUM_TOKENS = 8;
+
+    test_handler_t() : running(0), interrupted(0) { }
+
+    bool handle(ql::protob_t<Query> query, Response *response, test_context_t *ctx) {
+        const int64_t token = query->token();
+        guarantee(token >= 0 && token < NUM_TOKENS);
+        response->set_token(token);
+
+        log.push_back(strprintf("begin %d %d", static_cast<int>(token), query->type()));
+        ++running;
+        try {
+            wait_interruptible(&gates[token], ctx->interruptor);
+            response->set_type(Response::SUCCESS_ATOM);
+        } catch (const interrupted_exc_t &) {
+            ++interrupted;
+        }
+        --running;
+        log.push_back(strprintf("end %d %d", static_cast<int>(token), query->type()));
+        return true;
+    }
+
+    cond_t gates[NUM_TOKENS];
+    std::vector<std::string> log;
+    int running;
+    int interrupted;
+};
+
+Response on_unparsable_query(ql::protob_t<Query>, std::string) {
+    ADD_FAILURE() << "the server couldn't parse a query";
+    return Response();
+}
+
+typedef protob_server_t<ql::protob_t<Query>, Response, test_context_t> test_server_t;
+
+/* A client connection to a `test_server_t`. */
+class test_client_t {
+public:
+    explicit test_client_t(int port)
+        : conn(*get_unittest_addresses().begin(), port, &non_interruptor) {
+        const int32_t magic_number = test_context_t::no_auth_magic_number;
+        conn.write(&magic_number, sizeof(magic_number), &non_interruptor);
+    }
+
+    void send_query(int64_t token, Query::QueryType type) {
+        Query query;
+        query.set_type(type);
+        query.set_token(token);
+        const int32_t size = query.ByteSize();
+        std::vector<char> data(sizeof(size) + size);
+        memcpy(data.data(), &size, sizeof(size));
+        query.SerializeToArray(data.data() + sizeof(size), size);
+        conn.write(data.data(), data.size(), &non_interruptor);
+    }
+
+    Response read_response() {
+        int32_t size;
+        conn.read(&size, sizeof(size), &non_interruptor);
+        std::vector<char> data(size);
+        conn.read(data.data(), size, &non_interruptor);
+        Response response;
+        guarantee(response.ParseFromArray(data.data(), size));
+        return response;
+    }
+
+private:
+    cond_t non_interruptor;
+    tcp_conn_t conn;
+};
+
+/* Naps until `done()` is true, or fails the test if that takes too long. */
+void wait_until(const boost::function<bool()> &done) {
+    for (int i = 0; i < 100 && !done(); ++i) {
+        nap(50);
+    }
+    ASSERT_TRUE(done());
+}
+
+bool no_live_contexts() {
+    return test_context_t::live_contexts == 0;
+}
+
+void run_two_tokens_test() {
+    test_handler_t handler;
+    dummy_semilattice_controller_t<auth_semilattice_metadata_t> auth((auth_semilattice_metadata_t()));
+    test_server_t server(get_unittest_addresses(), ANY_PORT,
+                         boost::bind(&test_handler_t::handle, &handler, _1, _2, _3),
+                         &on_unparsable_query, auth.get_view(), CORO_UNORDERED);
+    test_client_t client(server.get_port());
+
+    // Whichever of two tokens finishes first is answered first.
+    client.send_query(1, Query::START);
+    client.send_query(2, Query::START);
+    let_stuff_happen();
+    EXPECT_EQ(2, handler.running);
+    handler.gates[2].pulse();
+    EXPECT_EQ(2, client.read_response().token());
+    handler.gates[1].pulse();
+    EXPECT_EQ(1, client.read_response().token());
+
+    client.send_query(3, Query::START);
+    client.send_query(4, Query::START);
+    let_stuff_happen();
+    EXPECT_EQ(2, handler.running);
+    handler.gates[3].pulse();
+    EXPECT_EQ(3, client.read_response().token());
+    handler.gates[4].pulse();
+    EXPECT_EQ(4, client.read_response().token());
+}
+
+TEST(ProtobServer, TwoTokens) {
+    run_in_thread_pool(&run_two_tokens_test);
+}
+
+void run_continue_running_token_test() {
+    test_handler_t handler;
+    dummy_semilattice_controller_t<auth_semilattice_metadata_t> auth((auth_semilattice_metadata_t()));
+    test_server_t server(get_unittest_addresses(), ANY_PORT,
+                         boost::bind(&test_handler_t::handle, &handler, _1, _2, _3),
+                         &on_unparsable_query, auth.get_view(), CORO_UNORDERED);
+    test_client_t client(server.get_port());
+
+    client.send_query(1, Query::START);
+    let_stuff_happen();
+    // A CONTINUE and a STOP for a token that's still running wait their turn,
+    // while another token goes ahead.
+    client.send_query(1, Query::CONTINUE);
+    client.send_query(1, Query::STOP);
+    client.send_query(2, Query::START);
+    handler.gates[2].pulse();
+    EXPECT_EQ(2, client.read_response().token());
+    EXPECT_EQ(1, handler.running);
+
+    handler.gates[1].pulse();
+    for (int i = 0; i < 3; ++i) {
+        EXPECT_EQ(1, client.read_response().token());
+    }
+
+    std::vector<std::string> expected;
+    expected.push_back(strprintf("begin 1 %d", Query::START));
+    expected.push_back(strprintf("begin 2 %d", Query::START));
+    expected.push_back(strprintf("end 2 %d", Query::START));
+    expected.push_back(strprintf("end 1 %d", Query::START));
+    expected.push_back(strprintf("begin 1 %d", Query::CONTINUE));
+    expected.push_back(strprintf("end 1 %d", Query::CONTINUE));
+    expected.push_back(strprintf("begin 1 %d", Query::STOP));
+    expected.push_back(strprintf("end 1 %d", Query::STOP));
+    EXPECT_EQ(expected, handler.log);
+}
+
+TEST(ProtobServer, ContinueRunningToken) {
+    run_in_thread_pool(&run_continue_running_token_test);
+}
+
+void run_disconnect_with_queries_in_flight_test() {
+    test_handler_t handler;
+    dummy_semilattice_controller_t<auth_semilattice_metadata_t> auth((auth_semilattice_metadata_t()));
+    test_server_t server(get_unittest_addresses(), ANY_PORT,
+                         boost::bind(&test_handler_t::handle, &handler, _1, _2, _3),
+                         &on_unparsable_query, auth.get_view(), CORO_UNORDERED);
+
+    {
+        test_client_t client(server.get_port());
+        client.send_query(1, Query::START);
+        client.send_query(2, Query::START);
+        client.send_query(1, Query::CONTINUE);
+        let_stuff_happen();
+        EXPECT_EQ(2, handler.running);
+        EXPECT_EQ(1, test_context_t::live_contexts);
+    }
+
+    // Closing the connection interrupts the running queries, and the server
+    // lets go of the connection only once they (and the one queued behind
+    // them) are done.
+    wait_until(&no_live_contexts);
+    EXPECT_EQ(0, handler.running);
+    EXPECT_EQ(3, handler.interrupted);
+    EXPECT_EQ(6u, handler.log.size());
+}
+
+TEST(ProtobServer, DisconnectWithQueriesInFlight) {
+    run_in_thread_pool(&run_disconnect_with_queries_in_flight_test);
+}
+
+bool echo_query(ql::protob_t<Query> query, Response *response, test_context_t *) {
+    response->set_token(query->token());
+    response->set_type(Response::SUCCESS_ATOM);
+    return true;
+}
+
+}  // namespace
+
+void run_thread_load_test() {
+    dummy_semilattice_controller_t<auth_semilattice_metadata_t> auth((auth_semilattice_metadata_t()));
+    test_server_t server(get_unittest_addresses(), ANY_PORT, &echo_query,
+                         &on_unparsable_query, auth.get_view(), CORO_UNORDERED);
+    const int num_threads = get_num_db_threads();
+    ASSERT_EQ(4, num_threads);
+
+    // Each request counts for more than each connection.
+    server.thread_loads[0].value.connections = 3;
+    server.thread_loads[1].value.requests = 1;
+    server.thread_loads[2].value.connections = 2;
+    server.thread_loads[3].value.connections = 2;
+    EXPECT_EQ(2, server.least_loaded_thread(0));
+    EXPECT_EQ(2, server.least_loaded_thread(1));
+    // Ties go to the first thread at or after the one we start at.
+    EXPECT_EQ(3, server.least_loaded_thread(3));
+    server.thread_loads[1].value.requests = 0;
+    EXPECT_EQ(1, server.least_loaded_thread(3));
+    for (int i = 0; i < num_threads; ++i) {
+        server.thread_loads[i].value.connections = 0;
+    }
+
+    int32_t counter = 0;
+    {
+        test_server_t::load_counter_t first(&counter);
+        EXPECT_EQ(1, counter);
+        {
+            test_server_t::load_counter_t second(&counter);
+            EXPECT_EQ(2, counter);
+        }
+        EXPECT_EQ(1, counter);
+    }
+    EXPECT_EQ(0, counter);
+
+    test_client_t client(server.get_port());
+    int conn_thread = -1;
+    for (int i = 0; i < 100 && conn_thread == -1; ++i) {
+        nap(50);
+        for (int thread = 0; thread < num_threads; ++thread) {
+            if (server.thread_loads[thread].value.connections == 1) {
+                conn_thread = thread;
+            }
+        }
+    }
+    ASSERT_NE(-1, conn_thread);
+
+    // Make the connection's thread busy enough that its next query moves it
+    // to the next thread along.
+    const int32_t busy = test_server_t::MIN_LOAD_IMBALANCE_TO_MOVE / test_server_t::REQUEST_LOAD;
+    __sync_fetch_and_add(&server.thread_loads[conn_thread].value.requests, busy);
+    client.send_query(0, Query::START);
+    EXPECT_EQ(0, client.read_response().token());
+
+    // The connection was counted off its old thread and onto its new one, and
+    // the query counted on the new one until it was done.
+    const int new_thread = (conn_thread + 1) % num_threads;
+    for (int thread = 0; thread < num_threads; ++thread) {
+        EXPECT_EQ(thread == new_thread ? 1 : 0,
+                  server.thread_loads[thread].value.connections);
+        EXPECT_EQ(thread == conn_thread ? busy : 0,
+                  server.thread_loads[thread].value.requests);
+    }
+    __sync_fetch_and_sub(&server.thread_loads[conn_thread].value.requests, busy);
+}
+
+TEST(ProtobServer, ThreadLoad) {
+    run_in_thread_pool(&run_thread_load_test, 4);
+}
+
+}  // namespace unittest
@@ -0,0 +1,63 @@
+// Copyright 2010-2013 RethinkDB, all rights reserved.
+#include <map>
+#include <string>
+#include <vector>
+
+#include "rdb_protocol/aggregate.hpp"
+#include "unittest/gtest.hpp"
+
+namespace unittest {
+
+counted_t<const ql::datum_t> make_row(double score) {
+    std::map<std::string, counted_t<const ql::datum_t> > obj;
+    obj["score"] = make_counted<const ql::datum_t>(score);
+    return make_counted<const ql::datum_t>(obj);
+}
+
+counted_t<const ql::datum_t> make_empty_row() {
+    return make_counted<const ql::datum_t>(std::map<std::string, counted_t<const ql::datum_t> >());
+}
+
+// Aggregates `scores` split across two "shards" at `split`, plus a row without
+// a score on each.
+counted_t<const ql::datum_t> aggregate_split(const ql::aggregator_t &aggregator,
+                                             const std::vector<double> &scores,
+                                             size_t split) {
+    counted_t<const ql::datum_t> lhs = aggregator.add_row(aggregator.empty(), make_empty_row());
+    counted_t<const ql::datum_t> rhs = aggregator.add_row(aggregator.empty(), make_empty_row());
+    for (size_t i = 0; i < scores.size(); ++i) {
+        if (i < split) {
+            lhs = aggregator.add_row(lhs, make_row(scores[i]));
+        } else {
+            rhs = aggregator.add_row(rhs, make_row(scores[i]));
+        }
+    }
+    return aggregator.finish(aggregator.combine(lhs, rhs));
+}
+
+TEST(RDBAggregate, CombinesPartials) {
+    std::vector<double> scores;
+    scores.push_back(4);
+    scores.push_back(-2);
+    scores.push_back(7);
+    scores.push_back(3);
+
+    for (size_t split = 0; split <= scores.size(); ++split) {
+        EXPECT_EQ(6, aggregate_split(ql::aggregator_t(ql::AGGREGATE_COUNT, ""), scores, split)->as_num());
+        EXPECT_EQ(12, aggregate_split(ql::aggregator_t(ql::AGGREGATE_SUM, "score"), scores, split)->as_num());
+        EXPECT_EQ(3, aggregate_split(ql::aggregator_t(ql::AGGREGATE_AVG, "score"), scores, split)->as_num());
+        EXPECT_EQ(-2, aggregate_split(ql::aggregator_t(ql::AGGREGATE_MIN, "score"), scores, split)->as_num());
+        EXPECT_EQ(7, aggregate_split(ql::aggregator_t(ql::AGGREGATE_MAX, "score"), scores, split)->as_num());
+    }
+}
+
+TEST(RDBAggregate, NoValues) {
+    std::vector<double> scores;
+    ql::aggregator_t max(ql::AGGREGATE_MAX, "score");
+    EXPECT_EQ(ql::datum_t::R_NULL, aggregate_split(max, scores, 0)->get_type());
+
+    ql::aggregator_t avg(ql::AGGREGATE_AVG, "score");
+    EXPECT_THROW(aggregate_split(avg, scores, 0), ql::datum_exc_t);
+}
+
+}  // namespace unittest
@@ -72,7 +72,57 @@ void insert_rows_and_pulse_when_done(int start, int finish,
     pulse_when_done->pulse();
 }
 
-std::string create_sindex(btree_store_t<rdb_protocol_t> *store) {
+void delete_rows(int start, int finish, btree_store_t<rdb_protocol_t> *store) {
+    guarantee(start <= finish);
+    for (int i = start; i < finish; ++i) {
+        cond_t dummy_interruptor;
+        scoped_ptr_t<transaction_t> txn;
+        scoped_ptr_t<real_superblock_t> superblock;
+        write_token_pair_t token_pair;
+        store->new_write_token_pair(&token_pair);
+        store->acquire_superblock_for_write(rwi_write, repli_timestamp_t::invalid,
+                                            1, WRITE_DURABILITY_SOFT,
+                                            &token_pair, &txn, &superblock, &dummy_interruptor);
+        block_id_t sindex_block_id = superblock->get_sindex_block_id();
+
+        point_delete_response_t response;
+
+        store_key_t pk(cJSON_print_primary(scoped_cJSON_t(cJSON_CreateNumber(i)).get(), backtrace_t()));
+        rdb_modification_report_t mod_report(pk);
+        rdb_delete(pk, store->btree.get(), repli_timestamp_t::invalid, txn.get(),
+                   superblock.get(), &response, &mod_report.info);
+
+        {
+            scoped_ptr_t<buf_lock_t> sindex_block;
+            store->acquire_sindex_block_for_write(
+                    &token_pair, txn.get(), &sindex_block,
+                    sindex_block_id, &dummy_interruptor);
+
+            btree_store_t<rdb_protocol_t>::sindex_access_vector_t sindexes;
+            store->aquire_post_constructed_sindex_superblocks_for_write(
+                     sindex_block.get(), txn.get(), &sindexes);
+            rdb_update_sindexes(sindexes, &mod_report, txn.get());
+
+            mutex_t::acq_t acq;
+            store->lock_sindex_queue(sindex_block.get(), &acq);
+
+            write_message_t wm;
+            wm << rdb_sindex_change_t(mod_report);
+
+            store->sindex_queue_push(wm, &acq);
+        }
+    }
+}
+
+void delete_rows_and_pulse_when_done(int start, int finish,
+        btree_store_t<rdb_protocol_t> *store, cond_t *pulse_when_done) {
+    delete_rows(start, finish, store);
+    pulse_when_done->pulse();
+}
+
+std::string create_sindex(btree_store_t<rdb_protocol_t> *store,
+        const std::vector<std::string> &covered_fields = std::vector<std::string>(),
+        const char *field = "sid") {
     cond_t dummy_interruptor;
     std::string sindex_id = uuid_to_str(generate_uuid());
     write_token_pair_t token_pair;
@@ -87,12 +137,12 @@ std::string create_sindex(btree_store_t<rdb_protocol_t> *store) {
 
     Term mapping;
     Term *arg = ql::pb::set_func(&mapping, 1);
-    N2(GET_FIELD, NVAR(1), NDATUM("sid"));
+    N2(GET_FIELD, NVAR(1), NDATUM(field));
 
     ql::map_wire_func_t m(mapping, std::map<int64_t, Datum>());
 
     write_message_t wm;
-    wm << m;
+    serialize_sindex_info(&wm, m, covered_fields);
 
     vector_stream_t stream;
     int res = send_write_message(&stream, &wm);
@@ -160,8 +210,9 @@ void bring_sindexes_up_to_date(
     nap(1000);
 }
 
+/* Runs `background_writes` while the sindex is being brought up to date. */
 void spawn_writes_and_bring_sindexes_up_to_date(btree_store_t<rdb_protocol_t> *store,
-        std::string sindex_id, cond_t *background_inserts_done) {
+        std::string sindex_id, const boost::function<void()> &background_writes) {
     cond_t dummy_interruptor;
     write_token_pair_t token_pair;
     store->new_write_token_pair(&token_pair);
@@ -178,9 +229,7 @@ void spawn_writes_and_bring_sindexes_up_to_date(btree_store_t<rdb_protocol_t> *s
             super_block->get_sindex_block_id(),
             &dummy_interruptor);
 
-    coro_t::spawn_sometime(boost::bind(&insert_rows_and_pulse_when_done,
-                (TOTAL_KEYS_TO_INSERT * 9) / 10, TOTAL_KEYS_TO_INSERT,
-                store, background_inserts_done));
+    coro_t::spawn_sometime(background_writes);
 
     std::set<std::string> created_sindexes;
     created_sindexes.insert(sindex_id);
@@ -189,9 +238,49 @@ void spawn_writes_and_bring_sindexes_up_to_date(btree_store_t<rdb_protocol_t> *s
             sindex_block.get(), txn.get());
 }
 
-void check_keys_are_present(btree_store_t<rdb_protocol_t> *store,
+void spawn_writes_and_bring_sindexes_up_to_date(btree_store_t<rdb_protocol_t> *store,
+        std::string sindex_id, cond_t *background_inserts_done) {
+    spawn_writes_and_bring_sindexes_up_to_date(store, sindex_id,
+            boost::bind(&insert_rows_and_pulse_when_done,
+                        (TOTAL_KEYS_TO_INSERT * 9) / 10, TOTAL_KEYS_TO_INSERT,
+                        store, background_inserts_done));
+}
+
+void wait_for_sindex_post_construction(btree_store_t<rdb_protocol_t> *store,
         std::string sindex_id) {
     cond_t dummy_interruptor;
+    for (;;) {
+        read_token_pair_t token_pair;
+        store->new_read_token_pair(&token_pair);
+
+        scoped_ptr_t<transaction_t> txn;
+        scoped_ptr_t<real_superblock_t> super_block;
+
+        store->acquire_superblock_for_read(rwi_read,
+                &token_pair.main_read_token, &txn, &super_block,
+                &dummy_interruptor, true);
+
+        scoped_ptr_t<real_superblock_t> sindex_sb;
+        try {
+            bool sindex_exists = store->acquire_sindex_superblock_for_read(sindex_id,
+                    super_block->get_sindex_block_id(), &token_pair,
+                    txn.get(), &sindex_sb,
+                    static_cast<std::vector<char>*>(NULL), &dummy_interruptor);
+            ASSERT_TRUE(sindex_exists);
+            return;
+        } catch (const sindex_not_post_constructed_exc_t &) {
+        }
+
+        txn.reset();
+        nap(100);
+    }
+}
+
+/* If `covering` is set the sindex is expected to cover just the "id" field, so
+that each entry is the index value and the row's id rather than the whole row. */
+void check_keys_are_present(btree_store_t<rdb_protocol_t> *store,
+        std::string sindex_id, bool covering = false) {
+    cond_t dummy_interruptor;
     for (int i = 0; i < TOTAL_KEYS_TO_INSERT; ++i) {
         read_token_pair_t token_pair;
         store->new_read_token_pair(&token_pair);
@@ -222,7 +311,9 @@ void check_keys_are_present(btree_store_t<rdb_protocol_t> *store,
         ASSERT_TRUE(stream != NULL);
         ASSERT_EQ(1ul, stream->size());
 
-        std::string expected_data = strprintf("{\"id\" : %d, \"sid\" : %d}", i, i * i);
+        std::string expected_data = covering
+            ? strprintf("[%d, {\"id\" : %d}]", i * i, i)
+            : strprintf("{\"id\" : %d, \"sid\" : %d}", i, i * i);
         scoped_cJSON_t expected_value(cJSON_Parse(expected_data.c_str()));
 
         ASSERT_EQ(0, query_language::json_cmp(expected_value.get(), stream->front().second->get()));
@@ -309,6 +400,242 @@ TEST(RDBBtree, SindexPostConstruct) {
     run_in_thread_pool(&run_sindex_post_construction);
 }
 
+void run_covering_sindex_post_construction() {
+    recreate_temporary_directory(base_path_t("."));
+    temp_file_t temp_file;
+
+    io_backender_t io_backender;
+
+    filepath_file_opener_t file_opener(temp_file.name(), &io_backender);
+    standard_serializer_t::create(
+        &file_opener,
+        standard_serializer_t::static_config_t());
+
+    standard_serializer_t serializer(
+        standard_serializer_t::dynamic_config_t(),
+        &file_opener,
+        &get_global_perfmon_collection());
+
+    rdb_protocol_t::store_t store(
+            &serializer,
+            "unit_test_store",
+            GIGABYTE,
+            true,
+            &get_global_perfmon_collection(),
+            NULL,
+            &io_backender,
+            base_path_t("."));
+
+    insert_rows(0, (TOTAL_KEYS_TO_INSERT * 9) / 10, &store);
+
+    std::vector<std::string> covered_fields;
+    covered_fields.push_back("id");
+    std::string sindex_id = create_sindex(&store, covered_fields);
+
+    cond_t background_inserts_done;
+    spawn_writes_and_bring_sindexes_up_to_date(&store, sindex_id,
+            &background_inserts_done);
+    background_inserts_done.wait();
+
+    // Both the rows post-construction put in the sindex and the ones written
+    // while it ran are stored as `[index value, covered fields]`.
+    check_keys_are_present(&store, sindex_id, true);
+}
+
+TEST(RDBBtree, CoveringSindexPostConstruct) {
+    run_in_thread_pool(&run_covering_sindex_post_construction);
+}
+
+boost::shared_ptr<scoped_cJSON_t> make_row(const std::string &data) {
+    return boost::shared_ptr<scoped_cJSON_t>(new scoped_cJSON_t(cJSON_Parse(data.c_str())));
+}
+
+store_key_t row_primary_key(int id) {
+    return store_key_t(cJSON_print_primary(scoped_cJSON_t(cJSON_CreateNumber(id)).get(), backtrace_t()));
+}
+
+/* Checks that the sindex holds exactly `expected`, in that order. */
+void check_sindex_contents(btree_store_t<rdb_protocol_t> *store,
+        std::string sindex_id, const std::vector<std::string> &expected) {
+    cond_t dummy_interruptor;
+    read_token_pair_t token_pair;
+    store->new_read_token_pair(&token_pair);
+
+    scoped_ptr_t<transaction_t> txn;
+    scoped_ptr_t<real_superblock_t> super_block;
+
+    store->acquire_superblock_for_read(rwi_read,
+            &token_pair.main_read_token, &txn, &super_block,
+            &dummy_interruptor, true);
+
+    scoped_ptr_t<real_superblock_t> sindex_sb;
+
+    bool sindex_exists = store->acquire_sindex_superblock_for_read(sindex_id,
+            super_block->get_sindex_block_id(), &token_pair,
+            txn.get(), &sindex_sb,
+            static_cast<std::vector<char>*>(NULL), &dummy_interruptor);
+    ASSERT_TRUE(sindex_exists);
+
+    rdb_protocol_t::rget_read_response_t res;
+    rdb_rget_slice(store->get_sindex_slice(sindex_id), key_range_t::universe(),
+           txn.get(), sindex_sb.get(), NULL, rdb_protocol_details::transform_t(),
+           boost::optional<rdb_protocol_details::terminal_t>(), FORWARD, &res);
+
+    rdb_protocol_t::rget_read_response_t::stream_t *stream = boost::get<rdb_protocol_t::rget_read_response_t::stream_t>(&res.result);
+    ASSERT_TRUE(stream != NULL);
+    ASSERT_EQ(expected.size(), stream->size());
+
+    for (size_t i = 0; i < expected.size(); ++i) {
+        scoped_cJSON_t expected_value(cJSON_Parse(expected[i].c_str()));
+        ASSERT_EQ(0, query_language::json_cmp(expected_value.get(), stream->at(i).second->get()))
+            << "entry " << i << " should be " << expected[i];
+    }
+}
+
+void run_batched_sindex_update_test() {
+    recreate_temporary_directory(base_path_t("."));
+    temp_file_t temp_file;
+
+    io_backender_t io_backender;
+
+    filepath_file_opener_t file_opener(temp_file.name(), &io_backender);
+    standard_serializer_t::create(
+        &file_opener,
+        standard_serializer_t::static_config_t());
+
+    standard_serializer_t serializer(
+        standard_serializer_t::dynamic_config_t(),
+        &file_opener,
+        &get_global_perfmon_collection());
+
+    rdb_protocol_t::store_t store(
+            &serializer,
+            "unit_test_store",
+            GIGABYTE,
+            true,
+            &get_global_perfmon_collection(),
+            NULL,
+            &io_backender,
+            base_path_t("."));
+
+    std::string sid_index = create_sindex(&store);
+    std::string id_index = create_sindex(&store, std::vector<std::string>(), "id");
+    bring_sindexes_up_to_date(&store, sid_index);
+    bring_sindexes_up_to_date(&store, id_index);
+    wait_for_sindex_post_construction(&store, sid_index);
+    wait_for_sindex_post_construction(&store, id_index);
+
+    // The sids are a permutation of the ids, so the two sindexes put the rows
+    // in different orders, neither of them the order they're reported in.
+    const int num_rows = 20;
+    std::vector<std::string> rows;
+    for (int i = 0; i < num_rows; ++i) {
+        rows.push_back(strprintf("{\"id\" : %d, \"sid\" : %d}", i, (i * 7) % num_rows));
+    }
+    const std::string replaced_row = strprintf("{\"id\" : 0, \"sid\" : 0, \"x\" : 1}");
+    const std::string transient_row = strprintf("{\"id\" : %d, \"sid\" : %d}", num_rows, num_rows);
+
+    {
+        cond_t dummy_interruptor;
+        write_token_pair_t token_pair;
+        store.new_write_token_pair(&token_pair);
+
+        scoped_ptr_t<transaction_t> txn;
+        scoped_ptr_t<real_superblock_t> super_block;
+        store.acquire_superblock_for_write(rwi_write, repli_timestamp_t::invalid,
+                                           1, WRITE_DURABILITY_SOFT,
+                                           &token_pair, &txn, &super_block, &dummy_interruptor);
+
+        auto_drainer_t drainer;
+        rdb_modification_report_cb_t sindex_cb(&store, &token_pair, txn.get(),
+                                               super_block->get_sindex_block_id(),
+                                               auto_drainer_t::lock_t(&drainer));
+
+        for (int i = 0; i < num_rows; ++i) {
+            sindex_cb.add_row(row_primary_key(i), make_row(rows[i]));
+        }
+
+        // Replacing a row without changing its index values deletes and adds
+        // the same sindex keys, which only works if the sort keeps the delete
+        // ahead of the add (and both behind the earlier add).
+        sindex_cb.replace_row(row_primary_key(0), make_row(replaced_row), make_row(rows[0]));
+
+        // A row added and deleted in the same batch shouldn't be left behind.
+        sindex_cb.add_row(row_primary_key(num_rows), make_row(transient_row));
+        sindex_cb.delete_row(row_primary_key(num_rows), make_row(transient_row));
+
+        sindex_cb.delete_row(row_primary_key(1), make_row(rows[1]));
+
+        // Nothing has been applied yet; destroying `sindex_cb` applies it all.
+    }
+
+    std::vector<std::string> by_id;
+    by_id.push_back(replaced_row);
+    for (int i = 2; i < num_rows; ++i) {
+        by_id.push_back(rows[i]);
+    }
+    check_sindex_contents(&store, id_index, by_id);
+
+    std::vector<std::string> by_sid(num_rows);
+    for (int i = 0; i < num_rows; ++i) {
+        by_sid[(i * 7) % num_rows] = rows[i];
+    }
+    by_sid[0] = replaced_row;
+    by_sid.erase(by_sid.begin() + 7);
+    check_sindex_contents(&store, sid_index, by_sid);
+}
+
+TEST(RDBBtree, BatchedSindexUpdate) {
+    run_in_thread_pool(&run_batched_sindex_update_test);
+}
+
+void run_sindex_post_construction_with_deletes() {
+    recreate_temporary_directory(base_path_t("."));
+    temp_file_t temp_file;
+
+    io_backender_t io_backender;
+
+    filepath_file_opener_t file_opener(temp_file.name(), &io_backender);
+    standard_serializer_t::create(
+        &file_opener,
+        standard_serializer_t::static_config_t());
+
+    standard_serializer_t serializer(
+        standard_serializer_t::dynamic_config_t(),
+        &file_opener,
+        &get_global_perfmon_collection());
+
+    rdb_protocol_t::store_t store(
+            &serializer,
+            "unit_test_store",
+            GIGABYTE,
+            true,
+            &get_global_perfmon_collection(),
+            NULL,
+            &io_backender,
+            base_path_t("."));
+
+    insert_rows(0, TOTAL_KEYS_TO_INSERT, &store);
+
+    std::string sindex_id = create_sindex(&store);
+
+    /* Delete the rows while the sindex is being built: none of them may turn
+    up in it afterwards, whether post-construction got to them before or after
+    they were deleted. */
+    cond_t background_deletes_done;
+    spawn_writes_and_bring_sindexes_up_to_date(&store, sindex_id,
+            boost::bind(&delete_rows_and_pulse_when_done,
+                        0, TOTAL_KEYS_TO_INSERT, &store, &background_deletes_done));
+    background_deletes_done.wait();
+    wait_for_sindex_post_construction(&store, sindex_id);
+
+    check_keys_are_NOT_present(&store, sindex_id);
+}
+
+TEST(RDBBtree, SindexPostConstructWithDeletes) {
+    run_in_thread_pool(&run_sindex_post_construction_with_deletes);
+}
+
 void run_erase_range_test() {
     recreate_temporary_directory(base_path_t("."));
     temp_file_t temp_file;
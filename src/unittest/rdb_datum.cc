@@ -0,0 +1,119 @@
+// Copyright 2010-2013 RethinkDB, all rights reserved.
+#include <string>
+#include <vector>
+
+#include "containers/archive/vector_stream.hpp"
+#include "rdb_protocol/datum.hpp"
+#include "rdb_protocol/datum_json.hpp"
+#include "rdb_protocol/ql2.pb.h"
+#include "unittest/gtest.hpp"
+
+namespace unittest {
+
+counted_t<const ql::datum_t> make_object(const char *const *keys, size_t n) {
+    scoped_ptr_t<ql::datum_t> obj(new ql::datum_t(ql::datum_t::R_OBJECT));
+    for (size_t i = 0; i < n; ++i) {
+        UNUSED bool b = obj->add(keys[i], make_counted<const ql::datum_t>(static_cast<double>(i)));
+    }
+    return counted_t<const ql::datum_t>(obj.release());
+}
+
+TEST(RDBDatum, ObjectFieldsAreSorted) {
+    const char *keys[] = { "m", "b", "z", "a", "q" };
+    counted_t<const ql::datum_t> obj = make_object(keys, 5);
+
+    std::string last;
+    for (auto it = obj->as_object().begin(); it != obj->as_object().end(); ++it) {
+        EXPECT_LT(last, it->first);
+        last = it->first;
+    }
+    EXPECT_EQ(5u, obj->as_object().size());
+    EXPECT_EQ(3, obj->get("a")->as_num());
+    EXPECT_EQ(2, obj->get("z")->as_num());
+    EXPECT_FALSE(obj->get("c", ql::NOTHROW).has());
+
+    // The same fields, inserted in a different order, make an equal object.
+    const char *reordered[] = { "a", "q", "m", "z", "b" };
+    scoped_ptr_t<ql::datum_t> other(new ql::datum_t(ql::datum_t::R_OBJECT));
+    for (size_t i = 0; i < 5; ++i) {
+        UNUSED bool b = other->add(reordered[i], obj->get(reordered[i]));
+    }
+    EXPECT_EQ(*obj, *other);
+}
+
+TEST(RDBDatum, ObjectAddAndDelete) {
+    scoped_ptr_t<ql::datum_t> obj(new ql::datum_t(ql::datum_t::R_OBJECT));
+    EXPECT_FALSE(obj->add("b", make_counted<const ql::datum_t>(1.0)));
+    EXPECT_FALSE(obj->add("a", make_counted<const ql::datum_t>(2.0)));
+    EXPECT_TRUE(obj->add("b", make_counted<const ql::datum_t>(3.0)));
+    EXPECT_EQ(1, obj->get("b")->as_num());
+    EXPECT_TRUE(obj->add("b", make_counted<const ql::datum_t>(3.0), ql::CLOBBER));
+    EXPECT_EQ(3, obj->get("b")->as_num());
+
+    EXPECT_TRUE(obj->delete_key("a"));
+    EXPECT_FALSE(obj->delete_key("a"));
+    EXPECT_EQ(1u, obj->as_object().size());
+}
+
+TEST(RDBDatum, ObjectProtobufRoundTrip) {
+    const char *keys[] = { "id", "name", "age", "email" };
+    counted_t<const ql::datum_t> obj = make_object(keys, 4);
+
+    Datum pb;
+    obj->write_to_protobuf(&pb);
+    counted_t<const ql::datum_t> copy = make_counted<const ql::datum_t>(&pb);
+    EXPECT_EQ(*obj, *copy);
+
+    Datum_AssocPair *dup = pb.add_r_object();
+    dup->set_key("age");
+    dup->mutable_val()->set_type(Datum::R_NULL);
+    EXPECT_THROW(make_counted<const ql::datum_t>(&pb), ql::base_exc_t);
+}
+
+const char *const json_samples[] = {
+    "null", "true", "false", "0", "-17", "3.25", "1e300", "-2.5e-7", "2147483648",
+    "\"\"", "\"plain ascii that is longer than a word\"",
+    "\"esc\\\"aped\\\\ \\/ \\b\\f\\n\\r\\t\\u0001 \\u00e9\\u20ac \\ud83d\\ude00\"",
+    "\"bad \\udc00 surrogates \\ud800x and \\u0000\"",
+    "[]", "{}", "[1, [2, [3, {}]], \"x\"]",
+    "{\"b\": {\"d\": [true, null], \"c\": {}}, \"a\": \"\\u001f\", \"\": -0.5}",
+    "  [1 , 2 ]  trailing",
+    "\"unterminated", "[1, 2", "{\"a\" 1}", "nul", "[1,]", "{\"a\": 1,}"
+};
+
+TEST(RDBDatum, JSONMatchesCJSON) {
+    for (size_t i = 0; i < sizeof(json_samples) / sizeof(json_samples[0]); ++i) {
+        SCOPED_TRACE(json_samples[i]);
+        scoped_cJSON_t cjson(cJSON_Parse(json_samples[i]));
+        counted_t<const ql::datum_t> d = ql::json_to_datum(json_samples[i]);
+        ASSERT_EQ(cjson.get() != NULL, d.has());
+        if (d.has()) {
+            counted_t<const ql::datum_t> expected
+                = make_counted<const ql::datum_t>(cjson.get());
+            EXPECT_EQ(*expected, *d);
+            EXPECT_EQ(expected->as_json()->Print(), d->print());
+        }
+    }
+}
+
+TEST(RDBDatum, JSONDuplicateKeys) {
+    EXPECT_THROW(ql::json_to_datum("{\"a\": 1, \"a\": 2}"), ql::base_exc_t);
+}
+
+TEST(RDBDatum, CJSONArchive) {
+    counted_t<const ql::datum_t> d = ql::json_to_datum(
+        "{\"b\": [1.5, \"two\", {\"c\": null}], \"a\": {\"d\": false}}");
+    ASSERT_TRUE(d.has());
+
+    write_message_t msg;
+    msg << *d->as_json()->get();
+    vector_stream_t stream;
+    ASSERT_EQ(0, send_write_message(&stream, &msg));
+
+    vector_read_stream_t read_stream(&stream.vector());
+    counted_t<const ql::datum_t> read;
+    ASSERT_EQ(ARCHIVE_SUCCESS, ql::deserialize_cjson_as_datum(&read_stream, &read));
+    EXPECT_EQ(*d, *read);
+}
+
+}  // namespace unittest
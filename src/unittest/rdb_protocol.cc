@@ -11,6 +11,7 @@
 #include "rdb_protocol/pb_utils.hpp"
 #include "rdb_protocol/proto_utils.hpp"
 #include "rdb_protocol/protocol.hpp"
+#include "rdb_protocol/term_walker.hpp"
 #include "rpc/directory/read_manager.hpp"
 #include "rpc/semilattice/semilattice_manager.hpp"
 #include "serializer/config.hpp"
@@ -167,7 +168,9 @@ TEST(RDBProtocol, OvershardedGetSet) {
 }
 
 std::string create_sindex(namespace_interface_t<rdb_protocol_t> *nsi,
-                          order_source_t *osource) {
+                          order_source_t *osource,
+                          const std::vector<std::string> &covered_fields
+                              = std::vector<std::string>()) {
     std::string id = uuid_to_str(generate_uuid());
     Term mapping;
     Term *arg = ql::pb::set_func(&mapping, 1);
@@ -175,7 +178,7 @@ std::string create_sindex(namespace_interface_t<rdb_protocol_t> *nsi,
 
     ql::map_wire_func_t m(mapping, std::map<int64_t, Datum>());
 
-    rdb_protocol_t::write_t write(rdb_protocol_t::sindex_create_t(id, m));
+    rdb_protocol_t::write_t write(rdb_protocol_t::sindex_create_t(id, m, covered_fields));
     rdb_protocol_t::write_response_t response;
 
     cond_t interruptor;
@@ -295,6 +298,111 @@ void run_create_drop_sindex_test(namespace_interface_t<rdb_protocol_t> *nsi, ord
     ASSERT_TRUE(drop_sindex(nsi, osource, id));
 }
 
+/* Reads `id` for rows with a `sid` of 1, plucking `pluck_field` if it isn't
+NULL, and checks that the one row that comes back is `expected`. */
+void check_covering_sindex_read(namespace_interface_t<rdb_protocol_t> *nsi,
+                                order_source_t *osource,
+                                const std::string &id,
+                                const rdb_protocol_t::sindex_range_t &range,
+                                const char *pluck_field,
+                                const char *expected) {
+    rdb_protocol_details::transform_t transform;
+    std::map<std::string, ql::wire_func_t> optargs;
+    if (pluck_field != NULL) {
+        Backtrace dummy_backtrace;
+
+        Term pluck;
+        Term *arg = ql::pb::set_func(&pluck, 1);
+        N2(PLUCK, NVAR(1), NDATUM(pluck_field));
+        ql::propagate_backtrace(&pluck, &dummy_backtrace);
+        transform.push_back(rdb_protocol_details::transform_atom_t(
+            ql::map_wire_func_t(pluck, std::map<int64_t, Datum>()), backtrace_t()));
+
+        // Reads with a transform are expected to have some optargs.
+        Term optarg;
+        arg = &optarg;
+        N2(FUNC, N0(MAKE_ARRAY), NDATUM("test"));
+        ql::propagate_backtrace(&optarg, &dummy_backtrace);
+        optargs["db"] = ql::wire_func_t(optarg, std::map<int64_t, Datum>());
+    }
+
+    rdb_protocol_t::read_t read(rdb_protocol_t::rget_read_t(
+        range.to_region(), id, range, transform, optargs));
+    rdb_protocol_t::read_response_t response;
+
+    cond_t interruptor;
+    nsi->read(read, &response, osource->check_in("unittest::check_covering_sindex_read(rdb_protocol_t.cc-A"), &interruptor);
+
+    if (rdb_protocol_t::rget_read_response_t *rget_resp = boost::get<rdb_protocol_t::rget_read_response_t>(&response.response)) {
+        rdb_protocol_t::rget_read_response_t::stream_t *stream = boost::get<rdb_protocol_t::rget_read_response_t::stream_t>(&rget_resp->result);
+        ASSERT_TRUE(stream != NULL);
+        if (expected == NULL) {
+            ASSERT_EQ(0u, stream->size());
+            return;
+        }
+        ASSERT_EQ(1u, stream->size());
+        scoped_cJSON_t expected_json(cJSON_Parse(expected));
+        ASSERT_EQ(0, query_language::json_cmp(stream->at(0).second->get(), expected_json.get()));
+    } else {
+        ADD_FAILURE() << "got wrong type of result back";
+    }
+}
+
+void run_covering_sindex_test(namespace_interface_t<rdb_protocol_t> *nsi, order_source_t *osource) {
+    query_language::backtrace_t b;
+
+    std::vector<std::string> covered_fields;
+    covered_fields.push_back("name");
+    std::string id = create_sindex(nsi, osource, covered_fields);
+
+    const char *row = "{\"id\" : 0, \"sid\" : 1, \"name\" : \"a\", \"other\" : \"b\"}";
+    boost::shared_ptr<scoped_cJSON_t> data(new scoped_cJSON_t(cJSON_Parse(row)));
+    ASSERT_TRUE(data->get());
+    store_key_t pk = store_key_t(cJSON_print_primary(cJSON_GetObjectItem(data->get(), "id"), b));
+    {
+        rdb_protocol_t::write_t write(rdb_protocol_t::point_write_t(pk, data),
+                                      DURABILITY_REQUIREMENT_DEFAULT);
+        rdb_protocol_t::write_response_t response;
+
+        cond_t interruptor;
+        nsi->write(write, &response, osource->check_in("unittest::run_covering_sindex_test(rdb_protocol_t.cc-A"), &interruptor);
+
+        if (rdb_protocol_t::point_write_response_t *maybe_point_write_response = boost::get<rdb_protocol_t::point_write_response_t>(&response.response)) {
+            ASSERT_EQ(maybe_point_write_response->result, STORED);
+        } else {
+            ADD_FAILURE() << "got wrong type of result back";
+        }
+    }
+
+    counted_t<const ql::datum_t> zero = make_counted<ql::datum_t>(0.0);
+    counted_t<const ql::datum_t> one = make_counted<ql::datum_t>(1.0);
+    counted_t<const ql::datum_t> two = make_counted<ql::datum_t>(2.0);
+    rdb_protocol_t::sindex_range_t range(one, false, one, false);
+
+    // Plucking a covered field is answered from the sindex alone...
+    check_covering_sindex_read(nsi, osource, id, range, "name", "{\"name\" : \"a\"}");
+    // ...while anything else still sees the whole row.
+    check_covering_sindex_read(nsi, osource, id, range, "other", "{\"other\" : \"b\"}");
+    check_covering_sindex_read(nsi, osource, id, range, NULL, row);
+
+    // The key ranges of these include the row's index value, which is only
+    // left out by the open bound.
+    check_covering_sindex_read(nsi, osource, id,
+        rdb_protocol_t::sindex_range_t(one, true, two, false), "name", NULL);
+    check_covering_sindex_read(nsi, osource, id,
+        rdb_protocol_t::sindex_range_t(zero, false, one, true), "name", NULL);
+
+    ASSERT_TRUE(drop_sindex(nsi, osource, id));
+}
+
+TEST(RDBProtocol, CoveringSindex) {
+    run_in_thread_pool_with_namespace_interface(&run_covering_sindex_test, false);
+}
+
+TEST(RDBProtocol, OvershardedCoveringSindex) {
+    run_in_thread_pool_with_namespace_interface(&run_covering_sindex_test, true);
+}
+
 TEST(RDBProtocol, SindexCreateDrop) {
     run_in_thread_pool_with_namespace_interface(&run_create_drop_sindex_test, false);
 }
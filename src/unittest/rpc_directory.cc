@@ -5,6 +5,7 @@
 #include "rpc/connectivity/cluster.hpp"
 #include "rpc/directory/read_manager.hpp"
 #include "rpc/directory/write_manager.hpp"
+#include "rpc/serialized_delta.hpp"
 #include "unittest/unittest_utils.hpp"
 
 namespace unittest {
@@ -92,6 +93,46 @@ TEST(RPCDirectoryTest, Update) {
     unittest::run_in_thread_pool(&run_update_test, 1);
 }
 
+/* `RepeatedUpdates` tests that a run of updates, including ones that don't
+change the value, arrives intact now that updates are sent as deltas. */
+
+void run_repeated_updates_test() {
+    connectivity_cluster_t c1, c2;
+    directory_read_manager_t<int> rm1(&c1), rm2(&c2);
+    watchable_variable_t<int> w1(101), w2(202);
+    directory_write_manager_t<int> wm1(&c1, w1.get_watchable()), wm2(&c2, w2.get_watchable());
+    connectivity_cluster_t::run_t cr1(&c1, get_unittest_addresses(), peer_address_t(), ANY_PORT, &rm1, 0, NULL);
+    connectivity_cluster_t::run_t cr2(&c2, get_unittest_addresses(), peer_address_t(), ANY_PORT, &rm2, 0, NULL);
+    cr2.join(c1.get_peer_address(c1.get_me()));
+    let_stuff_happen();
+    for (int i = 0; i < 1000; ++i) {
+        w1.set_value(i / 2);
+    }
+    let_stuff_happen();
+    ASSERT_EQ(1u, rm2.get_root_view()->get().count(c1.get_me()));
+    EXPECT_EQ(499, rm2.get_root_view()->get().find(c1.get_me())->second);
+}
+TEST(RPCDirectoryTest, RepeatedUpdates) {
+    unittest::run_in_thread_pool(&run_repeated_updates_test, 1);
+}
+
+/* `Delta` tests that `serialized_delta_t` reconstructs the new bytes. */
+
+TEST(RPCDirectoryTest, Delta) {
+    const char *values[] = { "", "a", "abc", "abXc", "Xabc", "abcX", "aaaa", "aa", "xyz" };
+    const size_t num_values = sizeof(values) / sizeof(values[0]);
+    for (size_t i = 0; i < num_values; ++i) {
+        for (size_t j = 0; j < num_values; ++j) {
+            std::string old_bytes(values[i]), new_bytes(values[j]);
+            serialized_delta_t delta = serialized_delta_t::make(old_bytes, new_bytes);
+            EXPECT_LE(delta.bytes.size(), new_bytes.size());
+            std::string result;
+            ASSERT_TRUE(delta.apply(old_bytes, &result));
+            EXPECT_EQ(new_bytes, result);
+        }
+    }
+}
+
 /* `DestructorRace` tests a nasty race condition that we had at some point. */
 
 void run_destructor_race_test() {
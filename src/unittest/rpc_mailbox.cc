@@ -56,6 +56,9 @@ public:
     void expect(int message) {
         EXPECT_EQ(1u, inbox.count(message));
     }
+    void expect_not(int message) {
+        EXPECT_EQ(0u, inbox.count(message));
+    }
     raw_mailbox_t mailbox;
 };
 
@@ -143,6 +146,34 @@ TEST(RPCMailboxTest, DeadMailbox) {
 TEST(RPCMailboxTest, DeadMailboxMultiThread) {
     unittest::run_in_thread_pool(&run_dead_mailbox_test, 3);
 }
+
+/* `ReusedMailbox` sends a message to a defunct mailbox after another mailbox
+has been created in its place. The new mailbox must not receive it. */
+
+void run_reused_mailbox_test() {
+    connectivity_cluster_t c;
+    mailbox_manager_t m(&c);
+    connectivity_cluster_t::run_t r(&c, get_unittest_addresses(), peer_address_t(), ANY_PORT, &m, 0, NULL);
+
+    raw_mailbox_t::address_t old_address;
+    {
+        dummy_mailbox_t mbox(&m);
+        old_address = mbox.mailbox.get_address();
+    }
+
+    dummy_mailbox_t mbox(&m);
+    send(&m, old_address, 555);
+    send(&m, mbox.mailbox.get_address(), 666);
+
+    let_stuff_happen();
+
+    mbox.expect_not(555);
+    mbox.expect(666);
+}
+TEST(RPCMailboxTest, ReusedMailbox) {
+    unittest::run_in_thread_pool(&run_reused_mailbox_test);
+}
+
 /* `MailboxAddressSemantics` makes sure that `raw_mailbox_t::address_t` behaves as
 expected. */
 
@@ -112,6 +112,13 @@ void run_metadata_exchange_test() {
 
     slm1.get_root_view()->sync_to(cluster2.get_me(), &non_interruptor);
     EXPECT_EQ(7u, slm2.get_root_view()->get().i);
+
+    /* Successive changes are sent as deltas against the previous update. */
+    for (uint64_t bit = 8; bit < (1ull << 20); bit <<= 1) {
+        slm1.get_root_view()->join(sl_int_t(bit));
+    }
+    slm1.get_root_view()->sync_to(cluster2.get_me(), &non_interruptor);
+    EXPECT_EQ((1ull << 20) - 1, slm2.get_root_view()->get().i);
 }
 TEST(RPCSemilatticeTest, MetadataExchange) {
     unittest::run_in_thread_pool(&run_metadata_exchange_test, 2);
@@ -2,7 +2,9 @@
 #include "unittest/gtest.hpp"
 
 #include "arch/timing.hpp"
+#include "concurrency/cond_var.hpp"
 #include "concurrency/pmap.hpp"
+#include "containers/scoped.hpp"
 #include "unittest/unittest_utils.hpp"
 #include "utils.hpp"
 
@@ -33,6 +35,63 @@ TEST(TimerTest, TestApproximateWaitTimes) {
     unittest::run_in_thread_pool(run_TestApproximateWaitTimes);
 }
 
+// These straddle the boundaries between the timer wheel's levels.
+const int64_t wheel_wait_times[] = { 1, 2, 63, 64, 65, 127, 128, 200, 300 };
+
+void run_TestCanceledTimers() {
+    const size_t num_times = sizeof(wheel_wait_times) / sizeof(wheel_wait_times[0]);
+    const ticks_t start = get_ticks();
+
+    scoped_array_t<scoped_ptr_t<signal_timer_t> > timers(2 * num_times);
+    for (size_t i = 0; i < timers.size(); ++i) {
+        timers[i].init(new signal_timer_t(wheel_wait_times[i / 2]));
+    }
+
+    // Cancel every other timer.
+    for (size_t i = 0; i < timers.size(); i += 2) {
+        timers[i].reset();
+    }
+
+    for (size_t i = 1; i < timers.size(); i += 2) {
+        timers[i]->wait();
+        const int64_t elapsed = static_cast<int64_t>(get_ticks()) - static_cast<int64_t>(start);
+        // Timers in the same millisecond may be fired together, a touch early.
+        ASSERT_GE(elapsed, (wheel_wait_times[i / 2] - 1) * MILLION);
+    }
+}
+
+TEST(TimerTest, TestCanceledTimers) {
+    unittest::run_in_thread_pool(run_TestCanceledTimers);
+}
+
+class self_canceling_timer_t : public timer_callback_t {
+public:
+    self_canceling_timer_t() : rings(0), token(add_timer(1, this)) { }
+
+    void on_timer() {
+        ++rings;
+        if (rings == 3) {
+            cancel_timer(token);
+            done.pulse();
+        }
+    }
+
+    int rings;
+    timer_token_t *token;
+    cond_t done;
+};
+
+void run_TestSelfCanceledTimer() {
+    self_canceling_timer_t timer;
+    timer.done.wait();
+    nap(5);
+    ASSERT_EQ(3, timer.rings);
+}
+
+TEST(TimerTest, TestSelfCanceledTimer) {
+    unittest::run_in_thread_pool(run_TestSelfCanceledTimer);
+}
+
 
 
 
@@ -0,0 +1,40 @@
+// Copyright 2010-2013 RethinkDB, all rights reserved.
+#include <vector>
+
+#include "concurrency/work_stealing.hpp"
+#include "unittest/gtest.hpp"
+#include "unittest/unittest_utils.hpp"
+
+namespace unittest {
+
+class count_call_t {
+public:
+    explicit count_call_t(std::vector<int> *_calls) : calls(_calls) { }
+    void operator()(int64_t i) const {
+        __sync_fetch_and_add(&(*calls)[i], 1);
+    }
+private:
+    std::vector<int> *calls;
+};
+
+/* `EveryIndexOnce` checks that every index is run exactly once, whatever the
+batch size and however the threads split the work. */
+
+void run_every_index_once_test() {
+    const int64_t counts[] = { 0, 1, 7, 64, 1000 };
+    const int64_t batch_sizes[] = { 1, 7, 64, 2000 };
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c) {
+        for (size_t b = 0; b < sizeof(batch_sizes) / sizeof(batch_sizes[0]); ++b) {
+            std::vector<int> calls(counts[c], 0);
+            parallel_for_each_batch(counts[c], batch_sizes[b], count_call_t(&calls));
+            for (int64_t i = 0; i < counts[c]; ++i) {
+                EXPECT_EQ(1, calls[i]);
+            }
+        }
+    }
+}
+TEST(WorkStealingTest, EveryIndexOnce) {
+    unittest::run_in_thread_pool(&run_every_index_once_test, 4);
+}
+
+}  // namespace unittest
@@ -0,0 +1,131 @@
+#!/usr/bin/python
+# Copyright 2010-2013 RethinkDB, all rights reserved.
+import sys, os, struct
+sys.path.append(os.path.abspath(os.path.join(os.path.dirname(__file__), os.path.pardir, 'common')))
+import memcached_workload_common
+
+# Speaks the binary memcached protocol directly over a socket, since the
+# memcache client libraries don't let us control quiet mode and pipelining.
+
+HEADER = struct.Struct(">BBHBBHIIQ")
+
+GET, SET, ADD, REPLACE, DELETE, INCR, DECR = 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06
+GETQ, NOOP, GETK, GETKQ, SETQ = 0x09, 0x0a, 0x0c, 0x0d, 0x11
+
+NO_ERROR, KEY_NOT_FOUND, KEY_EXISTS, NON_NUMERIC = 0x0000, 0x0001, 0x0002, 0x0006
+
+def request(opcode, key = "", extras = "", value = "", opaque = 0, cas = 0):
+    body = extras + key + value
+    return HEADER.pack(0x80, opcode, len(key), len(extras), 0, 0, len(body), opaque, cas) + body
+
+def storage_request(opcode, key, value, flags = 0, exptime = 0, opaque = 0, cas = 0):
+    return request(opcode, key, struct.pack(">II", flags, exptime), value, opaque, cas)
+
+def incr_decr_request(opcode, key, delta, initial = 0, exptime = 0, opaque = 0):
+    return request(opcode, key, struct.pack(">QQI", delta, initial, exptime), opaque = opaque)
+
+def recv_exactly(s, size):
+    data = ""
+    while len(data) < size:
+        chunk = s.recv(size - len(data))
+        if not chunk:
+            raise ValueError("Connection closed in the middle of a response")
+        data += chunk
+    return data
+
+def read_response(s):
+    magic, opcode, key_len, extras_len, _, status, body_len, opaque, cas = \
+        HEADER.unpack(recv_exactly(s, HEADER.size))
+    if magic != 0x81:
+        raise ValueError("Bad response magic: %#x" % magic)
+    body = recv_exactly(s, body_len)
+    return {"opcode": opcode, "status": status, "opaque": opaque, "cas": cas,
+            "extras": body[:extras_len],
+            "key": body[extras_len:extras_len + key_len],
+            "value": body[extras_len + key_len:]}
+
+def expect(response, status, opcode = None, value = None, key = None):
+    if response["status"] != status:
+        raise ValueError("Expected status %#x, got %#x (%r)" % (status, response["status"], response))
+    if opcode is not None and response["opcode"] != opcode:
+        raise ValueError("Expected a response to opcode %#x, got %r" % (opcode, response))
+    if value is not None and response["value"] != value:
+        raise ValueError("Expected value %r, got %r" % (value, response["value"]))
+    if key is not None and response["key"] != key:
+        raise ValueError("Expected key %r, got %r" % (key, response["key"]))
+    return response
+
+op = memcached_workload_common.option_parser_for_socket()
+opts = op.parse(sys.argv)
+
+with memcached_workload_common.make_socket_connection(opts) as s:
+
+    def roundtrip(req):
+        s.sendall(req)
+        return read_response(s)
+
+    print "Testing set, add and replace"
+    expect(roundtrip(storage_request(SET, "a", "apple")), NO_ERROR, SET)
+    expect(roundtrip(storage_request(ADD, "a", "avocado")), KEY_EXISTS, ADD)
+    expect(roundtrip(storage_request(REPLACE, "a", "apricot")), NO_ERROR, REPLACE)
+    expect(roundtrip(storage_request(REPLACE, "missing", "x")), KEY_NOT_FOUND, REPLACE)
+    expect(roundtrip(storage_request(ADD, "b", "banana", flags = 123)), NO_ERROR, ADD)
+
+    print "Testing get and getk"
+    expect(roundtrip(request(GET, "a")), NO_ERROR, GET, value = "apricot", key = "")
+    response = expect(roundtrip(request(GETK, "b")), NO_ERROR, GETK, value = "banana", key = "b")
+    if struct.unpack(">I", response["extras"])[0] != 123:
+        raise ValueError("Flags didn't survive: %r" % response)
+    expect(roundtrip(request(GET, "missing")), KEY_NOT_FOUND, GET)
+
+    print "Testing check-and-set"
+    set_cas = expect(roundtrip(storage_request(SET, "c", "cherry")), NO_ERROR, SET)["cas"]
+    get_cas = expect(roundtrip(request(GET, "c")), NO_ERROR, GET, value = "cherry")["cas"]
+    if set_cas == 0 or set_cas != get_cas:
+        raise ValueError("Set reported CAS %d but get reported %d" % (set_cas, get_cas))
+    new_cas = expect(roundtrip(storage_request(SET, "c", "cranberry", cas = get_cas)), NO_ERROR, SET)["cas"]
+    # The CAS we had is now stale.
+    expect(roundtrip(storage_request(SET, "c", "currant", cas = get_cas)), KEY_EXISTS, SET)
+    expect(roundtrip(storage_request(REPLACE, "c", "currant", cas = new_cas)), NO_ERROR, REPLACE)
+    expect(roundtrip(request(GET, "c")), NO_ERROR, GET, value = "currant")
+    expect(roundtrip(storage_request(SET, "missing", "x", cas = new_cas)), KEY_NOT_FOUND, SET)
+
+    print "Testing incr and decr"
+    expect(roundtrip(storage_request(SET, "n", "10")), NO_ERROR)
+    response = expect(roundtrip(incr_decr_request(INCR, "n", 5)), NO_ERROR, INCR)
+    if struct.unpack(">Q", response["value"])[0] != 15:
+        raise ValueError("Increment should have given 15: %r" % response)
+    # The increment's CAS is the one the value now has.
+    if response["cas"] == 0 or response["cas"] != roundtrip(request(GET, "n"))["cas"]:
+        raise ValueError("Increment reported a CAS that wasn't stored: %r" % response)
+    response = expect(roundtrip(incr_decr_request(DECR, "n", 20)), NO_ERROR, DECR)
+    if struct.unpack(">Q", response["value"])[0] != 0:
+        raise ValueError("Decrement should have stopped at 0: %r" % response)
+    expect(roundtrip(incr_decr_request(INCR, "a", 1)), NON_NUMERIC, INCR)
+    expect(roundtrip(incr_decr_request(INCR, "nokey", 1, exptime = 0xffffffff)), KEY_NOT_FOUND, INCR)
+    response = expect(roundtrip(incr_decr_request(INCR, "newkey", 1, initial = 42)), NO_ERROR, INCR)
+    if struct.unpack(">Q", response["value"])[0] != 42:
+        raise ValueError("Increment of a missing key should have created it as 42: %r" % response)
+    expect(roundtrip(request(GET, "newkey")), NO_ERROR, value = "42")
+
+    print "Testing pipelined quiet requests"
+    batch = ""
+    for i in xrange(100):
+        batch += storage_request(SETQ, "q%d" % i, str(i), opaque = i)
+    for i in xrange(100):
+        batch += request(GETKQ, "q%d" % i, opaque = 1000 + i)
+    # Quiet gets of missing keys send nothing at all.
+    batch += request(GETQ, "missing", opaque = 2000)
+    batch += request(NOOP, opaque = 3000)
+    s.sendall(batch)
+    # Successful quiet sets send nothing, so the gets' responses come first,
+    # in order, and the noop's response comes last.
+    for i in xrange(100):
+        response = expect(read_response(s), NO_ERROR, GETKQ, value = str(i), key = "q%d" % i)
+        if response["opaque"] != 1000 + i:
+            raise ValueError("Response out of order: %r" % response)
+    expect(read_response(s), NO_ERROR, NOOP)
+
+    print "Testing delete"
+    expect(roundtrip(request(DELETE, "a")), NO_ERROR, DELETE)
+    expect(roundtrip(request(DELETE, "a")), KEY_NOT_FOUND, DELETE)